@@ -28,7 +28,16 @@ CDBx - CDB reimplementation for Python.
 __author__ = u"Andr\xe9 Malo"
 __license__ = "Apache License, Version 2.0"
 __version__ = "0.2.5"
-__all__ = ["CDB", "CDBMaker"]
+__all__ = [
+    "CDB",
+    "CDBMaker",
+    "CDBOverlay",
+    "CDBStack",
+    "ReloadingCDB",
+    "CDBPool",
+    "ShardedCDB",
+    "ShardedCDBMaker",
+]
 
 try:
     from cdbx._cdb import __version__ as _c_version
@@ -42,4 +51,13 @@ if _c_version != __version__:
 del _c_version
 
 # pylint: disable = wrong-import-position
-from cdbx._cdb import CDB, CDBMaker
+from cdbx._cdb import (
+    CDB,
+    CDBMaker,
+    CDBOverlay,
+    CDBStack,
+    ReloadingCDB,
+    CDBPool,
+    ShardedCDB,
+    ShardedCDBMaker,
+)
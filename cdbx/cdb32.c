@@ -16,18 +16,28 @@
  */
 
 #include "cdbx.h"
+#include "pythread.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#define CDB32_HAVE_SENDFILE
+#if defined(__GLIBC__) \
+    && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+#define CDB32_HAVE_COPY_FILE_RANGE
+#endif
+#endif
 
 typedef uint32_t cdb32_off_t;
 typedef uint32_t cdb32_len_t;
 typedef uint32_t cdb32_hash_t;
 typedef unsigned char cdb32_key_t;
 
-/* Pointer */
-struct cdbx_cdb32_pointer_t {
-    cdb32_off_t offset;
-    cdb32_len_t length;
-};
-
 /* Slot entry */
 typedef struct {
     cdb32_hash_t hash;
@@ -89,25 +99,32 @@ struct cdbx_cdb32_iter_t {
     cdbx_cdb32_pointer_t value;
     cdbx_cdb32_t *cdb32;
     cdb32_off_t pos;
+    cdb32_off_t end;
 };
 
+/* Mapping (owned by a capsule) */
+typedef struct {
+    void *buf;
+    size_t size;
+} cdb32_map_t;
+
 /* Main struct */
 struct cdbx_cdb32_t {
     PyObject *map;
     Py_ssize_t map_size;
     const void *map_buf;
-    const unsigned char *map_pointer;
 
     cdb32_off_t sentinel;
 
     Py_ssize_t num_keys;
     Py_ssize_t num_records;
 
+    Py_ssize_t pins;  /* running calls without the GIL, see cdb32_pin */
+    int closed;  /* destroyed while pinned */
     int fd;
 };
 
 
-#define CDB32_READ_CURPOS ((cdb32_off_t)(0xFFFFFFFF))
 #define CDB32_MAX_LEN (0xFFFFFFFF)
 #define CDB32_MAX_OFF (0xFFFFFFFF)
 #define CDB32_MASK_TABLE (0x7FF)
@@ -154,34 +171,51 @@ struct cdbx_cdb32_t {
 /*
  * Transform bytes/unicode key to char/len
  *
- * RC(key_) is increased on success. However, *key_ might be replaced.
+ * Bytes keys and (in Python 3) latin-1 representable unicode keys are used in
+ * place. Other keys are converted and a new reference to the converted object
+ * is stored in *tmp_, which has to be released by the caller after the key
+ * data is no longer needed. *tmp_ is NULL otherwise.
  *
  * Return -1 on error
  * Return 0 on success
  */
 static int
-cdb32_cstring(PyObject **key_, cdb32_key_t **ckey_, cdb32_len_t *ckeysize_)
+cdb32_cstring(PyObject *key, PyObject **tmp_, cdb32_key_t **ckey_,
+              cdb32_len_t *ckeysize_)
 {
     Py_ssize_t length;
-    PyObject *key = *key_;
     char *cckey;
 
-    Py_INCREF(key);
+    *tmp_ = NULL;
     if (PyBytes_Check(key)) {
-        if (-1 == PyBytes_AsStringAndSize(key, &cckey, &length))
-            LCOV_EXCL_LINE_GOTO(error);
-        *ckey_ = (cdb32_key_t *)cckey;
+        *ckey_ = (cdb32_key_t *)PyBytes_AS_STRING(key);
+        length = PyBytes_GET_SIZE(key);
     }
     else if (PyUnicode_Check(key)) {
-        PyObject *tmp;
-        if (!(tmp = PyUnicode_AsLatin1String(key)))
-            goto error;
+#ifdef EXT3
+#if PY_VERSION_HEX < 0x030C0000
+        if (-1 == PyUnicode_READY(key))
+            LCOV_EXCL_LINE_RETURN(-1);
+#endif
+        /* 1-byte kind strings are stored as latin-1 already. Use them in
+         * place. Only wider kinds need to be encoded (and might fail).
+         */
+        if (PyUnicode_KIND(key) == PyUnicode_1BYTE_KIND) {
+            *ckey_ = (cdb32_key_t *)PyUnicode_DATA(key);
+            length = PyUnicode_GET_LENGTH(key);
+        }
+        else {
+#endif
+        if (!(key = PyUnicode_AsLatin1String(key)))
+            return -1;
 
-        Py_DECREF(key);
-        *key_ = key = tmp;
+        *tmp_ = key;
         if (-1 == PyBytes_AsStringAndSize(key, &cckey, &length))
             LCOV_EXCL_LINE_GOTO(error);
         *ckey_ = (cdb32_key_t *)cckey;
+#ifdef EXT3
+        }
+#endif
     }
     else {
         PyErr_SetString(PyExc_TypeError,
@@ -191,7 +225,7 @@ cdb32_cstring(PyObject **key_, cdb32_key_t **ckey_, cdb32_len_t *ckeysize_)
         "Key must be a str or bytes object"
 #endif
         );
-        goto error;
+        return -1;
     }
 
     /* should not happen. But what do I know? */
@@ -207,129 +241,210 @@ cdb32_cstring(PyObject **key_, cdb32_key_t **ckey_, cdb32_len_t *ckeysize_)
 
     return 0;
 
+/* LCOV_EXCL_START */
 error:
-    Py_DECREF(key);
+    Py_CLEAR(*tmp_);
     return -1;
+/* LCOV_EXCL_STOP */
 }
 
 
 /*
- * Read from map into buf
+ * Find a range in the map
  *
- * If buf is NULL, it works like a simple seek, but with validity check.
+ * The map is not copied, *ptr_ points into it.
  *
  * Return -1 on error
  * Return 0 on success
  */
 static int
 cdb32_read_map(cdbx_cdb32_t *self, cdb32_off_t offset, cdb32_len_t len,
-               unsigned char *buf)
+               const unsigned char **ptr_)
 {
-    Py_ssize_t curpos;
+    if (offset > self->map_size || self->map_size - offset < len) {
+        PyErr_SetString(PyExc_IOError, "Format Error");
+        return -1;
+    }
+
+    *ptr_ = (const unsigned char *)self->map_buf + offset;
+    return 0;
+}
 
-    if (offset == CDB32_READ_CURPOS) {
-        curpos = self->map_pointer - (unsigned const char *)self->map_buf;
 
-        if (self->map_size - curpos < len) {
-            PyErr_SetString(PyExc_IOError, "Format Error");
+/*
+ * Read from file into buf
+ *
+ * The file is read with pread(2), i.e. the file offset (which is shared
+ * with forked processes) is never used.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+static int
+cdb32_read(cdbx_cdb32_t *self, cdb32_off_t offset, cdb32_len_t len,
+           unsigned char *buf)
+{
+    const unsigned char *ptr;
+    ssize_t res;
+    off_t pos;
+
+    if (self->map) {
+        if (-1 == cdb32_read_map(self, offset, len, &ptr))
             return -1;
-        }
+        memcpy(buf, ptr, (size_t)len);
+        return 0;
     }
-    else {
-        if (offset > self->map_size
-            || self->map_size - offset < len) {
-            /* LCOV_EXCL_START */
 
+    pos = (off_t)offset;
+    while (len > 0) {
+        switch (res = pread(self->fd, buf, len > (cdb32_len_t)SSIZE_MAX
+                                           ? (size_t)SSIZE_MAX : (size_t)len,
+                            pos)) {
+        case -1:
+            if (errno == EINTR)
+                continue;  /* LCOV_EXCL_LINE */
+            PyErr_SetFromErrno(PyExc_IOError);
+            return -1;
+
+        case 0:
             PyErr_SetString(PyExc_IOError, "Format Error");
             return -1;
 
-            /* LCOV_EXCL_STOP */
+        default:
+            len -= (cdb32_len_t)res;
+            buf += res;
+            pos += res;
         }
-        self->map_pointer = (const unsigned char *)self->map_buf + offset;
     }
 
-    if (buf) {
-        memcpy(buf, self->map_pointer, len);
-        self->map_pointer = (const unsigned char *)self->map_pointer + len;
-    }
     return 0;
 }
 
 
 /*
- * Read from file into buf
+ * Read from file at a position into buf without touching the file offset
  *
- * Return -1 on error
+ * This function does not need the GIL.
+ *
+ * Return -1 on error (errno is set, errno == 0 means premature EOF)
  * Return 0 on success
  */
 static int
-cdb32_read(cdbx_cdb32_t *self, cdb32_off_t offset, cdb32_len_t len,
-           unsigned char *buf)
+cdb32_pread_nogil(int fd, off_t offset, size_t len, unsigned char *buf)
 {
     ssize_t res;
 
-    if (self->map)
-        return cdb32_read_map(self, offset, len, buf);
-
-#if CDB32_MAX_LEN > SSIZE_MAX
-    while (len > (cdb32_len_t)SSIZE_MAX) {
-        if (-1 == cdb32_read(self, offset, (cdb32_len_t)SSIZE_MAX, buf))
+    while (len > 0) {
+        switch (res = pread(fd, buf, len > (size_t)SSIZE_MAX
+                                         ? (size_t)SSIZE_MAX : len, offset)) {
+        case -1:
+            if (errno == EINTR)
+                continue;
             return -1;
-        len -= (cdb32_len_t)SSIZE_MAX;
-        buf += SSIZE_MAX;
-        offset = CDB32_READ_CURPOS;
+        case 0:
+            errno = 0;
+            return -1;
+
+        default:
+            len -= (size_t)res;
+            buf += res;
+            offset += res;
+        }
     }
-#endif
 
-    if (len > 0) {
-        if (offset != CDB32_READ_CURPOS
-            && -1 == lseek(self->fd, (off_t)offset, SEEK_SET)) {
-            PyErr_SetFromErrno(PyExc_IOError);
+    return 0;
+}
+
+
+/*
+ * Write buf to file
+ *
+ * This function does not need the GIL.
+ *
+ * Return -1 on error (errno is set)
+ * Return 0 on success
+ */
+static int
+cdb32_write_nogil(int fd, const unsigned char *buf, size_t len)
+{
+    ssize_t res;
+
+    while (len > 0) {
+        if (-1 == (res = write(fd, buf, len > (size_t)SSIZE_MAX
+                                        ? (size_t)SSIZE_MAX : len))) {
+            if (errno == EINTR)
+                continue;
             return -1;
         }
+        len -= (size_t)res;
+        buf += res;
+    }
 
-        while (len > 0) {
-            switch (res = read(self->fd, buf, len)) {
+    return 0;
+}
 
-            /* LCOV_EXCL_START */
-            case -1:
-                if (errno == EINTR)
-                    continue;
-                PyErr_SetFromErrno(PyExc_IOError);
-                return -1;
-            case 0:
-                PyErr_SetString(PyExc_IOError, "Format Error");
-                return -1;
 
-            /* LCOV_EXCL_STOP */
+/*
+ * Free cdbx_cdb32_t instance
+ */
+static void
+cdb32_free(cdbx_cdb32_t *self)
+{
+    Py_CLEAR(self->map);
+    PyMem_Free(self);
+}
 
-            default:
-                if ((cdb32_len_t)res > len) {
-                    /* LCOV_EXCL_START */
 
-                    PyErr_SetString(PyExc_IOError, "Read Error");
-                    return -1;
+/*
+ * Pin the instance for a call releasing the GIL
+ *
+ * cdbx_cdb32_destroy() only marks a pinned instance as closed and the last
+ * cdb32_unpin() frees it. Callers need to check self->closed after
+ * re-acquiring the GIL.
+ */
+#define cdb32_pin(self) (++(self)->pins)
 
-                    /* LCOV_EXCL_STOP */
-                }
-                len -= (cdb32_len_t)res;
-                buf += res;
-            }
-        }
-    }
+static void
+cdb32_unpin(cdbx_cdb32_t *self)
+{
+    if (!--self->pins && self->closed)
+        cdb32_free(self);
+}
 
-    return 0;
+
+/*
+ * Duplicate the file descriptor for use without the GIL
+ *
+ * The copy stays valid, even if the CDB (or the owner of the original
+ * descriptor) closes it while we're not looking.
+ *
+ * Return -1 on error
+ * Return the new descriptor on success
+ */
+static int
+cdb32_dup(cdbx_cdb32_t *self)
+{
+    int fd;
+
+#ifdef F_DUPFD_CLOEXEC
+    if (-1 == (fd = fcntl(self->fd, F_DUPFD_CLOEXEC, 0)))
+#else
+    if (-1 == (fd = dup(self->fd)))
+#endif
+        PyErr_SetFromErrno(PyExc_IOError);
+
+    return fd;
 }
 
 
 #define CDB32_READ_POINTER(self, offset_, pointer, res) do {                \
     if ((self)->map) {                                                      \
+        const unsigned char *ptr;                                           \
         if (!(res = cdb32_read_map((self), (offset_), CDB32_SIZEOF_TPTR,    \
-                                    NULL))) {                               \
-            if (((pointer)->length = CDB32_UNPACK_LEN((self)->map_pointer   \
+                                    &ptr))) {                               \
+            if (((pointer)->length = CDB32_UNPACK_LEN(ptr                   \
                                                       + CDB32_SIZEOF_OFF))) \
-                (pointer)->offset = CDB32_UNPACK_OFF((self)->map_pointer);  \
-            (self)->map_pointer += CDB32_SIZEOF_TPTR;                       \
+                (pointer)->offset = CDB32_UNPACK_OFF(ptr);                  \
         }                                                                   \
     }                                                                       \
     else {                                                                  \
@@ -346,12 +461,12 @@ cdb32_read(cdbx_cdb32_t *self, cdb32_off_t offset, cdb32_len_t len,
 
 #define CDB32_READ_SLOT(self, offset_, slot, res) do {                    \
     if ((self)->map) {                                                    \
+        const unsigned char *ptr;                                         \
         if (!(res = cdb32_read_map((self), (offset_), CDB32_SIZEOF_SLOT,  \
-                                    NULL))) {                             \
-            if (((slot)->offset = CDB32_UNPACK_OFF((self)->map_pointer    \
+                                    &ptr))) {                             \
+            if (((slot)->offset = CDB32_UNPACK_OFF(ptr                    \
                                                    + CDB32_SIZEOF_HASH))) \
-                (slot)->hash = CDB32_UNPACK_HASH((self)->map_pointer);    \
-            (self)->map_pointer += CDB32_SIZEOF_SLOT;                     \
+                (slot)->hash = CDB32_UNPACK_HASH(ptr);                    \
         }                                                                 \
     }                                                                     \
     else {                                                                \
@@ -368,10 +483,9 @@ cdb32_read(cdbx_cdb32_t *self, cdb32_off_t offset, cdb32_len_t len,
 
 #define CDB32_READ_SENTINEL(self, res) do {                               \
     if ((self)->map) {                                                    \
-        if (!(res = cdb32_read_map((self), 0, CDB32_SIZEOF_OFF, NULL))) { \
-            (self)->sentinel = CDB32_UNPACK_OFF((self)->map_pointer);     \
-            (self)->map_pointer += CDB32_SIZEOF_OFF;                      \
-        }                                                                 \
+        const unsigned char *ptr;                                         \
+        if (!(res = cdb32_read_map((self), 0, CDB32_SIZEOF_OFF, &ptr)))   \
+            (self)->sentinel = CDB32_UNPACK_OFF(ptr);                     \
     }                                                                     \
     else {                                                                \
         unsigned char buf[CDB32_SIZEOF_OFF];                              \
@@ -383,12 +497,11 @@ cdb32_read(cdbx_cdb32_t *self, cdb32_off_t offset, cdb32_len_t len,
 
 #define CDB32_READ_DLENGTH(self, offset, dlength, res) do {             \
     if ((self)->map) {                                                  \
+        const unsigned char *ptr;                                       \
         if (!(res = cdb32_read_map((self), (offset),                    \
-                                   CDB32_SIZEOF_DLENGTH, NULL))) {      \
-            (dlength)->klen = CDB32_UNPACK_LEN((self)->map_pointer);    \
-            (dlength)->dlen = CDB32_UNPACK_LEN((self)->map_pointer      \
-                                              + CDB32_SIZEOF_LEN);      \
-            self->map_pointer += CDB32_SIZEOF_DLENGTH;                  \
+                                   CDB32_SIZEOF_DLENGTH, &ptr))) {      \
+            (dlength)->klen = CDB32_UNPACK_LEN(ptr);                    \
+            (dlength)->dlen = CDB32_UNPACK_LEN(ptr + CDB32_SIZEOF_LEN); \
         }                                                               \
     }                                                                   \
     else {                                                              \
@@ -413,12 +526,14 @@ static int
 cdb32_cmp_key_map(cdbx_cdb32_t *self, cdb32_off_t offset,
                   const cdb32_key_t *key, cdb32_len_t len)
 {
+    const unsigned char *ptr;
+
     if (len > 0) {
-        if (-1 == cdb32_read_map(self, offset, len, NULL))
+        if (-1 == cdb32_read_map(self, offset, len, &ptr))
             LCOV_EXCL_LINE_RETURN(-1);
-        if (self->map_pointer == key)
+        if (ptr == key)
             return 1;
-        if (memcmp(self->map_pointer, key, (size_t)len))
+        if (memcmp(ptr, key, (size_t)len))
             LCOV_EXCL_LINE_RETURN(0);
     }
 
@@ -509,23 +624,13 @@ cdb32_hash_disk(cdbx_cdb32_t *self, cdb32_off_t offset, cdb32_len_t len,
     cdb32_len_t buflen;
     cdb32_hash_t result = CDB32_HASH_INIT;
 
-    if (len > 0 && offset != CDB32_READ_CURPOS) {
-        if (-1 == lseek(self->fd, (off_t)offset, SEEK_SET)) {
-            /* LCOV_EXCL_START */
-
-            PyErr_SetFromErrno(PyExc_IOError);
-            return -1;
-
-            /* LCOV_EXCL_STOP */
-        }
-    }
-
     while (len > 0) {
         if ((buflen = sizeof buf) > len)
             buflen = len;
 
-        if (-1 == cdb32_read(self, CDB32_READ_CURPOS, buflen, buf))
+        if (-1 == cdb32_read(self, offset, buflen, buf))
             LCOV_EXCL_LINE_RETURN(-1);
+        offset += buflen;
         len -= buflen;
         key = buf;
         while (buflen--)
@@ -555,37 +660,21 @@ cdb32_hash_mem(const cdb32_key_t *key, cdb32_len_t len)
 
 
 /*
- * Find a key/value pair
+ * Find a key/value pair with a precomputed hash
  *
  * Return -1 on error
  * Return 0 on success (includes not found [value.offset = 0])
  */
 static int
-cdb32_find(cdb32_find_t *self, cdbx_cdb32_pointer_t *value)
+cdb32_find_hashed(cdb32_find_t *self, cdbx_cdb32_pointer_t *value)
 {
     cdb32_slot_t slot = {0};
     cdb32_dlength_t dlength = {0};
+    const unsigned char *key;
     int res;
 
     /* If this is the first key, initialize the rest of the structure */
     if (!self->key_num) {
-        if (self->key_disk) {
-            if (self->cdb32->map) {
-                if (-1 == cdb32_read_map(self->cdb32, self->key_disk,
-                                         self->length, NULL))
-                    LCOV_EXCL_LINE_RETURN(-1);
-
-                self->hash = cdb32_hash_mem(
-                    (const cdb32_key_t *)self->cdb32->map_pointer, self->length
-                );
-            }
-            else if (-1 == cdb32_hash_disk(self->cdb32, self->key_disk,
-                                           self->length, &self->hash))
-                LCOV_EXCL_LINE_RETURN(-1);
-        }
-        else {
-            self->hash = cdb32_hash_mem(self->key, self->length);
-        }
         CDB32_READ_POINTER(self->cdb32, CDB32_PTR_TABLE(self->hash),
                            &self->table, res);
         if (-1 == res)
@@ -623,12 +712,11 @@ cdb32_find(cdb32_find_t *self, cdbx_cdb32_pointer_t *value)
                     if (self->cdb32->map) {
                         if (!(res = cdb32_read_map(self->cdb32,
                                                    self->key_disk,
-                                                   self->length, NULL)))
+                                                   self->length, &key)))
                             res = cdb32_cmp_key_map(self->cdb32,
                                                     slot.offset
                                                         + CDB32_SIZEOF_DLENGTH,
-                                                    self->cdb32->map_pointer,
-                                                    self->length);
+                                                    key, self->length);
                     }
                     else {
                         res = cdb32_cmp_key_disk(self->cdb32,
@@ -668,6 +756,40 @@ cdb32_find(cdb32_find_t *self, cdbx_cdb32_pointer_t *value)
 }
 
 
+/*
+ * Find a key/value pair
+ *
+ * Return -1 on error
+ * Return 0 on success (includes not found [value.offset = 0])
+ */
+static int
+cdb32_find(cdb32_find_t *self, cdbx_cdb32_pointer_t *value)
+{
+    const unsigned char *key;
+
+    /* If this is the first key, hash it */
+    if (!self->key_num) {
+        if (self->key_disk) {
+            if (self->cdb32->map) {
+                if (-1 == cdb32_read_map(self->cdb32, self->key_disk,
+                                         self->length, &key))
+                    LCOV_EXCL_LINE_RETURN(-1);
+
+                self->hash = cdb32_hash_mem(key, self->length);
+            }
+            else if (-1 == cdb32_hash_disk(self->cdb32, self->key_disk,
+                                           self->length, &self->hash))
+                LCOV_EXCL_LINE_RETURN(-1);
+        }
+        else {
+            self->hash = cdb32_hash_mem(self->key, self->length);
+        }
+    }
+
+    return cdb32_find_hashed(self, value);
+}
+
+
 /*
  * Count and cache keys and records
  *
@@ -740,184 +862,145 @@ cdb32_count_records(cdbx_cdb32_t *self)
 }
 
 
+#define CDB32_MAP_NAME "cdbx.map"
+
+/*
+ * Release a mapping (capsule destructor)
+ */
+static void
+cdb32_map_destroy(PyObject *capsule)
+{
+    cdb32_map_t *map;
+
+    if ((map = PyCapsule_GetPointer(capsule, CDB32_MAP_NAME))) {
+#ifdef HAVE_MMAP
+        (void)munmap(map->buf, map->size);
+#endif
+        PyMem_Free(map);
+    }
+}
+
+
+#ifdef HAVE_MMAP
+/*
+ * Find the end of the hash tables in a mapped header
+ *
+ * The cdb data ends there. Trailing bytes are not part of it.
+ *
+ * This does not need the GIL.
+ */
+static uint64_t
+cdb32_map_end(const unsigned char *buf)
+{
+    const unsigned char *cp;
+    uint64_t result = CDB32_SIZEOF_TABLE, end;
+    cdb32_len_t len;
+    size_t idx;
+
+    for (idx = 0; idx < CDB32_SIZEOF_TABLE; idx += CDB32_SIZEOF_TPTR) {
+        cp = buf + idx;
+        if (!(len = CDB32_UNPACK_LEN(cp + CDB32_SIZEOF_OFF)))
+            continue;
+        end = (uint64_t)CDB32_UNPACK_OFF(cp)
+              + (uint64_t)len * CDB32_SIZEOF_SLOT;
+        if (end > result)
+            result = end;
+    }
+
+    return result;
+}
+#endif
+
+
 /*
  * mmap the cdb file
  *
+ * The whole file is mapped with mmap(2) directly. Bounds checks however end
+ * at the hash tables (like before, when only that part was mapped), so
+ * trailing bytes are never read. The mapping is owned by a capsule, so code
+ * running without the GIL can keep it alive by holding a reference.
+ *
  * If it doesn't work, ignore. In this case we'll just seek & read later.
  *
  * Return -1 on error
  * Return 0 on success
  */
-
-#ifdef EXT3
-#define PyInt_FromSsize_t PyLong_FromSsize_t
-#define PyInt_FromLong PyLong_FromLong
-#endif
-
 static int
 cdb32_mmap(cdbx_cdb32_t *self)
 {
-    unsigned char *buf, *cp, *sp;
-    PyObject *module, *func, *args, *kwargs, *tmp;
-    cdb32_len_t len;
-    cdb32_off_t size = CDB32_SIZEOF_TABLE;
-    size_t size_;
+#ifdef HAVE_MMAP
+    struct stat st;
+    cdb32_map_t *map;
+    void *buf = MAP_FAILED;
+    uint64_t size = 0;
     int res;
 
-    if (!(module = PyImport_ImportModule("mmap")))
-        LCOV_EXCL_LINE_RETURN(-1);
-
-    if (!(buf = PyMem_Malloc(CDB32_SIZEOF_TABLE)))
-        LCOV_EXCL_LINE_GOTO(error_module);
-
-    if (-1 == cdb32_read(self, 0, CDB32_SIZEOF_TABLE, buf))
-        LCOV_EXCL_LINE_GOTO(error_buf);
+    Py_BEGIN_ALLOW_THREADS
+    if (-1 != (res = fstat(self->fd, &st))
+        && st.st_size >= CDB32_SIZEOF_TABLE
+        && (uint64_t)st.st_size <= (uint64_t)PY_SSIZE_T_MAX) {
+        buf = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, self->fd,
+                   0);
+        if (buf == MAP_FAILED)
+            res = -1;
+        else if ((size = cdb32_map_end(buf)) > (uint64_t)st.st_size)
+            size = (uint64_t)st.st_size;  /* truncated, fails on access */
+    }
+    Py_END_ALLOW_THREADS
 
-    /* Find the last non-empty table entry, use that to find the end of the
-     * file. Each table entry is a tuple of (offset, length), 4 bytes each.
-     */
-    cp = buf + CDB32_SIZEOF_TABLE - CDB32_SIZEOF_LEN;
-    sp = buf + CDB32_SIZEOF_OFF;
-    while (!(len = CDB32_UNPACK_LEN(cp))) {
-#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 6))
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wstrict-overflow"
-#endif
-        if (!(cp > sp))
-            break;
-#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 6))
-#pragma GCC diagnostic pop
-#endif
-        cp -= CDB32_SIZEOF_OFF + CDB32_SIZEOF_LEN;
+    if (-1 == res) {
+        PyErr_SetFromErrno(PyExc_IOError);
+        return -1;
+    }
+    if (buf == MAP_FAILED) {
+        if (st.st_size < CDB32_SIZEOF_TABLE)
+            PyErr_SetString(PyExc_IOError, "Format Error");
+        else
+            PyErr_SetNone(PyExc_OverflowError);  /* LCOV_EXCL_LINE */
+        return -1;
     }
 
-    /* Seek to the end */
-    if (len) {
-        cp -= CDB32_SIZEOF_OFF;
-        size = CDB32_UNPACK_OFF(cp);
-        len *= CDB32_SIZEOF_SLOT;
-        if ((CDB32_MAX_OFF == len) || (CDB32_MAX_OFF - len) < size - 1) {
-            /* LCOV_EXCL_START */
+    if (!(map = PyMem_Malloc(sizeof *map))) {
+        /* LCOV_EXCL_START */
+        (void)munmap(buf, (size_t)st.st_size);
+        PyErr_NoMemory();
+        return -1;
+        /* LCOV_EXCL_STOP */
+    }
+    map->buf = buf;
+    map->size = (size_t)st.st_size;
 
-            PyErr_SetNone(PyExc_OverflowError);
-            goto error_buf;
+    if (!(self->map = PyCapsule_New(map, CDB32_MAP_NAME,
+                                    cdb32_map_destroy))) {
+        /* LCOV_EXCL_START */
+        (void)munmap(buf, map->size);
+        PyMem_Free(map);
+        return -1;
+        /* LCOV_EXCL_STOP */
+    }
+    self->map_buf = buf;
+    self->map_size = (Py_ssize_t)size;
 
-            /* LCOV_EXCL_STOP */
-        }
-        size += len;
-
-        if (-1 == lseek(self->fd, size - 1, SEEK_SET)
-            || -1 == lseek(self->fd, 0, SEEK_SET)) {
-            PyErr_SetFromErrno(PyExc_IOError);
-            goto error_buf;
-        }
-
-        size_ = size;
-        if (size_ > PY_SSIZE_T_MAX) {
-            /* LCOV_EXCL_START */
-
-            PyErr_SetNone(PyExc_OverflowError);
-            goto error_buf;
-
-            /* LCOV_EXCL_STOP */
-        }
-    }
-
-    if (-1 == cdbx_attr(module, "mmap", &func) || !func)
-        goto error_buf;
-    if (!(kwargs = PyDict_New()))
-        LCOV_EXCL_LINE_GOTO(error_func);
-
-    if (-1 == cdbx_attr(module, "ACCESS_READ", &tmp) || !tmp)
-        LCOV_EXCL_LINE_GOTO(error_kwargs);
-    res = PyDict_SetItemString(kwargs, "access", tmp);
-    Py_DECREF(tmp);
-    if (-1 == res)
-        LCOV_EXCL_LINE_GOTO(error_kwargs);
-
-    if (!(tmp = PyInt_FromLong(self->fd)))
-        LCOV_EXCL_LINE_GOTO(error_kwargs);
-    res = PyDict_SetItemString(kwargs, "fileno", tmp);
-    Py_DECREF(tmp);
-    if (-1 == res)
-        LCOV_EXCL_LINE_GOTO(error_kwargs);
-
-    if (!(tmp = PyInt_FromSsize_t((Py_ssize_t)size)))
-        LCOV_EXCL_LINE_GOTO(error_kwargs);
-    res = PyDict_SetItemString(kwargs, "length", tmp);
-    Py_DECREF(tmp);
-    if (-1 == res)
-        LCOV_EXCL_LINE_GOTO(error_kwargs);
-
-    if (!(args = PyTuple_New(0)))
-        LCOV_EXCL_LINE_GOTO(error_kwargs);
-
-    tmp = PyObject_Call(func, args, kwargs);
-    Py_DECREF(args);
-    Py_DECREF(kwargs);
-    Py_DECREF(func);
-    PyMem_Free(buf);
-    Py_DECREF(module);
-    if (!tmp)
-        LCOV_EXCL_LINE_RETURN(-1);
-
-#ifdef EXT2
-    if (-1 == PyObject_AsReadBuffer(tmp, &self->map_buf, &self->map_size)) {
-        /* LCOV_EXCL_START */
-
-        Py_DECREF(tmp);
-        return -1;
-
-        /* LCOV_EXCL_STOP */
-    }
-    self->map = tmp;
-#else
-    {
-        Py_buffer view;
-
-        if (-1 == PyObject_GetBuffer(tmp, &view, PyBUF_SIMPLE)) {
-            /* LCOV_EXCL_START */
-
-            Py_DECREF(tmp);
-            return -1;
-
-            /* LCOV_EXCL_STOP */
-        }
-        self->map_buf = view.buf;
-        self->map_size = view.len;
-        self->map = tmp;
-    }
-#endif
-    self->map_pointer = self->map_buf;
-
-    return 0;
-
-/* LCOV_EXCL_START */
-error_kwargs:
-    Py_DECREF(kwargs);
-error_func:
-    Py_DECREF(func);
-/* LCOV_EXCL_STOP */
-
-error_buf:
-    PyMem_Free(buf);
-error_module:
-    Py_DECREF(module);
-
-    return -1;
-}
-
-#ifdef EXT3
-#undef PyInt_FromLong
-#undef PyInt_FromSsize_t
-#endif
+    return 0;
+#else
+    (void)self;
+    errno = ENOSYS;
+    PyErr_SetFromErrno(PyExc_IOError);
+    return -1;
+#endif
+}
 
 
 /*
  * Write a buffer on disk
+ *
+ * This does not need the GIL.
+ *
+ * Return -1 on error (errno is set)
+ * Return 0 on success
  */
 static int
-cdb32_maker_write(int fd, unsigned char *buf, size_t len)
+cdb32_maker_write(int fd, const unsigned char *buf, size_t len)
 {
     ssize_t res;
 
@@ -935,7 +1018,6 @@ cdb32_maker_write(int fd, unsigned char *buf, size_t len)
         case -1:
             if (errno == EINTR)
                 continue;
-            PyErr_SetFromErrno(PyExc_IOError);
             return -1;
         /* LCOV_EXCL_STOP */
 
@@ -943,7 +1025,7 @@ cdb32_maker_write(int fd, unsigned char *buf, size_t len)
             if ((size_t)res > len) {
                 /* LCOV_EXCL_START */
 
-                PyErr_SetString(PyExc_IOError, "Write Error");
+                errno = EIO;
                 return -1;
 
                 /* LCOV_EXCL_STOP */
@@ -959,7 +1041,7 @@ cdb32_maker_write(int fd, unsigned char *buf, size_t len)
 /*
  * Flush make writer buffer
  *
- * Return -1 on error
+ * Return -1 on error (errno is set)
  * Return 0 on success
  */
 static int
@@ -976,11 +1058,11 @@ cdb32_maker_buf_flush(cdbx_cdb32_maker_t *self)
 /*
  * Write string and optionally hash it on the go
  *
- * Return -1 on error
+ * Return -1 on error (errno is set)
  * Return 0 on success
  */
 static int
-cdb32_maker_buf_write(cdbx_cdb32_maker_t *self, cdb32_key_t *key,
+cdb32_maker_buf_write(cdbx_cdb32_maker_t *self, const cdb32_key_t *key,
                       cdb32_len_t len, cdb32_hash_t *hash)
 {
     cdb32_hash_t result = CDB32_HASH_INIT;
@@ -990,7 +1072,7 @@ cdb32_maker_buf_write(cdbx_cdb32_maker_t *self, cdb32_key_t *key,
         || (CDB32_MAX_OFF - len) < self->size - 1) {
         /* LCOV_EXCL_START */
 
-        PyErr_SetNone(PyExc_OverflowError);
+        errno = EOVERFLOW;
         return -1;
 
         /* LCOV_EXCL_STOP */
@@ -1020,6 +1102,127 @@ cdb32_maker_buf_write(cdbx_cdb32_maker_t *self, cdb32_key_t *key,
 }
 
 
+/*
+ * Add the slot entry of a record (already written at offset)
+ *
+ * This does not need the GIL.
+ *
+ * Return -1 on error (errno is set)
+ * Return 0 on success
+ */
+static int
+cdb32_maker_slot(cdbx_cdb32_maker_t *self, cdb32_hash_t hash,
+                 cdb32_off_t offset)
+{
+    cdb32_slot_list_t *slot_list;
+
+    /* Slots will be doubled -> times 2 */
+    if ((CDB32_MAX_OFF - (CDB32_SIZEOF_SLOT + CDB32_SIZEOF_SLOT)) <
+            self->size - 1) {
+        /* LCOV_EXCL_START */
+
+        errno = EOVERFLOW;
+        return -1;
+
+        /* LCOV_EXCL_STOP */
+    }
+    self->size += CDB32_SIZEOF_SLOT + CDB32_SIZEOF_SLOT;
+
+    if (!(slot_list = self->slot_lists)
+        || !(self->slot_list_index < CDB32_SLOT_LIST_SIZE)) {
+        if (!(slot_list = malloc(sizeof *slot_list))) {
+            /* LCOV_EXCL_START */
+
+            errno = ENOMEM;
+            return -1;
+
+            /* LCOV_EXCL_STOP */
+        }
+        self->slot_list_index = 0;
+        slot_list->prev = self->slot_lists;
+        self->slot_lists = slot_list;
+    }
+    slot_list->slots[self->slot_list_index].hash = hash;
+    slot_list->slots[self->slot_list_index++].offset = offset;
+    ++self->slot_counts[hash & 0xFF];
+
+    return 0;
+}
+
+
+/*
+ * Add a record
+ *
+ * If hash is NULL, the key is hashed while it's written. This does not need
+ * the GIL.
+ *
+ * Return -1 on error (errno is set)
+ * Return 0 on success
+ */
+static int
+cdb32_maker_add(cdbx_cdb32_maker_t *self, const cdb32_key_t *key,
+                cdb32_len_t lkey, const cdb32_key_t *value,
+                cdb32_len_t lvalue, const cdb32_hash_t *hash)
+{
+    cdb32_off_t offset;
+    cdb32_hash_t khash;
+    unsigned char *buf;
+
+    if ((CDB32_MAX_OFF - CDB32_SIZEOF_DLENGTH) < self->size - 1) {
+        /* LCOV_EXCL_START */
+
+        errno = EOVERFLOW;
+        return -1;
+
+        /* LCOV_EXCL_STOP */
+    }
+
+    if (((CDB32_WRITE_BUF_SIZE - self->buf_index) <
+            (CDB32_SIZEOF_DLENGTH)) && (-1 == cdb32_maker_buf_flush(self)))
+        LCOV_EXCL_LINE_RETURN(-1);
+
+    buf = self->buf + self->buf_index;
+    CDB32_PACK_LEN(lkey, buf);
+    buf += CDB32_SIZEOF_LEN;
+    CDB32_PACK_LEN(lvalue, buf);
+    self->buf_index += CDB32_SIZEOF_DLENGTH;
+    offset = self->offset;
+    self->size += CDB32_SIZEOF_DLENGTH;
+    self->offset += CDB32_SIZEOF_DLENGTH;
+
+    if (-1 == cdb32_maker_buf_write(self, key, lkey, hash ? NULL : &khash))
+        LCOV_EXCL_LINE_RETURN(-1);
+    if (-1 == cdb32_maker_buf_write(self, value, lvalue, NULL))
+        LCOV_EXCL_LINE_RETURN(-1);
+    if (hash)
+        khash = *hash;
+
+    return cdb32_maker_slot(self, khash, offset);
+}
+
+
+/*
+ * Raise the errno left by a failed maker operation
+ */
+static void
+cdb32_maker_raise(int err)
+{
+    switch (err) {
+    case ENOMEM:
+        PyErr_NoMemory();
+        break;
+
+    case EOVERFLOW:
+        PyErr_SetNone(PyExc_OverflowError);
+        break;
+
+    default:
+        errno = err;
+        PyErr_SetFromErrno(PyExc_IOError);
+    }
+}
+
+
 /*
  * Create cdbx_cdb32_t instance
  *
@@ -1045,6 +1248,8 @@ cdbx_cdb32_create(int fd, cdbx_cdb32_t **cdb32_, int mmap)
     self->num_keys = -1;
     self->num_records = -1;
     self->sentinel = 0;
+    self->pins = 0;
+    self->closed = 0;
     if (mmap) {
         if (-1 == cdb32_mmap(self)) {
             if (mmap == -1) {
@@ -1073,8 +1278,14 @@ cdbx_cdb32_destroy(cdbx_cdb32_t **cdb32_)
     if (cdb32_ && (self = *cdb32_)) {
         *cdb32_ = NULL;
 
-        Py_CLEAR(self->map);
-        PyMem_Free(self);
+        if (self->pins) {
+            /* The descriptor is about to be closed by our owner */
+            self->fd = -1;
+            self->closed = 1;
+        }
+        else {
+            cdb32_free(self);
+        }
     }
 }
 
@@ -1089,6 +1300,16 @@ cdbx_cdb32_fileno(cdbx_cdb32_t *self)
 }
 
 
+/*
+ * Return the number of mapped bytes (0 if the file is not mapped)
+ */
+EXT_LOCAL Py_ssize_t
+cdbx_cdb32_mapped_size(cdbx_cdb32_t *self)
+{
+    return self->map ? self->map_size : 0;
+}
+
+
 /*
  * Check if key is in the CDB
  *
@@ -1100,171 +1321,457 @@ cdbx_cdb32_fileno(cdbx_cdb32_t *self)
 EXT_LOCAL int
 cdbx_cdb32_contains(cdbx_cdb32_t *self, PyObject *key)
 {
-    cdb32_find_t find = {0};
     cdbx_cdb32_pointer_t value;
 
-    if (-1 == cdb32_cstring(&key, &find.key, &find.length))
-        return -1;
-
-    find.cdb32 = self;
-    if (-1 == cdb32_find(&find, &value))
-        LCOV_EXCL_LINE_GOTO(error);
-
-    Py_DECREF(key);
-    return !!value.offset;
-
-/* LCOV_EXCL_START */
-error:
-    Py_DECREF(key);
-    return -1;
-/* LCOV_EXCL_STOP */
+    return cdbx_cdb32_find(self, key, &value);
 }
 
 
 /*
- * Count the number of unique keys (cached)
+ * Find the first value of a key
  *
  * Return -1 on error
- * Return 0 on success
+ * Return 0 on success (not found)
+ * Return 1 on success (found)
  */
 EXT_LOCAL int
-cdbx_cdb32_count_keys(cdbx_cdb32_t *self, Py_ssize_t *result)
+cdbx_cdb32_find(cdbx_cdb32_t *self, PyObject *key,
+                cdbx_cdb32_pointer_t *value)
 {
-    if (self->num_keys == -1) {
-        if (-1 == cdb32_count_records(self))
-            LCOV_EXCL_LINE_RETURN(-1);
-    }
+    cdb32_find_t find;
+    PyObject *tmp;
+    int res;
 
-    *result = self->num_keys;
-    return 0;
+    if (-1 == cdb32_cstring(key, &tmp, &find.key, &find.length))
+        return -1;
+
+    find.cdb32 = self;
+    find.key_num = 0;
+    find.key_disk = 0;
+    res = cdb32_find(&find, value);
+    Py_XDECREF(tmp);
+    if (-1 == res)
+        LCOV_EXCL_LINE_RETURN(-1);
+
+    return !!value->offset;
 }
 
 
-#if 0
 /*
- * Count the number of records (cached)
+ * Turn a key (or value) into a bytes object and optionally hash it
+ *
+ * Unicode objects are transformed using the latin-1 encoding.
  *
  * Return -1 on error
  * Return 0 on success
  */
 EXT_LOCAL int
-cdbx_cdb32_count_records(cdbx_cdb32_t *self, Py_ssize_t *result)
+cdbx_cdb32_bytes(PyObject *obj, PyObject **result_, uint32_t *hash_)
 {
-    if (self->num_records == -1) {
-        if (-1 == cdb32_count_records(self))
-            return -1;
+    PyObject *tmp;
+    cdb32_key_t *ckey;
+    cdb32_len_t length;
+
+    if (-1 == cdb32_cstring(obj, &tmp, &ckey, &length))
+        return -1;
+
+    if (hash_)
+        *hash_ = cdb32_hash_mem(ckey, length);
+
+    if (!tmp) {
+        if (PyBytes_Check(obj)) {
+            Py_INCREF(obj);
+            tmp = obj;
+        }
+        else if (!(tmp = PyBytes_FromStringAndSize((char *)ckey,
+                                                   (Py_ssize_t)length))) {
+            LCOV_EXCL_LINE_RETURN(-1);
+        }
     }
 
-    *result = self->num_records;
+    *result_ = tmp;
     return 0;
 }
-#endif
 
 
 /*
- * Create cdbx_cdb32_iter_t
+ * Count the values of a key
+ *
+ * Walks the probe sequence and compares keys, but never reads the values.
  *
  * Return -1 on error
  * Return 0 on success
  */
 EXT_LOCAL int
-cdbx_cdb32_iter_create(cdbx_cdb32_t *cdb32, cdbx_cdb32_iter_t **result)
+cdbx_cdb32_count(cdbx_cdb32_t *self, PyObject *key, Py_ssize_t *result)
 {
-    cdbx_cdb32_iter_t *self;
+    cdb32_find_t find;
+    cdbx_cdb32_pointer_t value;
+    PyObject *tmp;
+    Py_ssize_t count = 0;
     int res;
 
-    if (!(self = PyMem_Malloc(sizeof *self))) {
-        /* LCOV_EXCL_START */
-
-        PyErr_SetNone(PyExc_MemoryError);
+    if (-1 == cdb32_cstring(key, &tmp, &find.key, &find.length))
         return -1;
 
-        /* LCOV_EXCL_STOP */
-    }
-
-    if (!cdb32->sentinel) {
-        CDB32_READ_SENTINEL(cdb32, res);
-        if (-1 == res)
-            LCOV_EXCL_LINE_GOTO(error);
-    }
-
-    self->cdb32 = cdb32;
-    self->pos = CDB32_SIZEOF_TABLE;
-    *result = self;
+    find.cdb32 = self;
+    find.key_num = 0;
+    find.key_disk = 0;
+    while ((res = cdb32_find(&find, &value)) == 1)
+        ++count;
+    Py_XDECREF(tmp);
+    if (-1 == res)
+        LCOV_EXCL_LINE_RETURN(-1);
 
+    *result = count;
     return 0;
-
-/* LCOV_EXCL_START */
-error:
-    PyMem_Free(self);
-    return -1;
-/* LCOV_EXCL_STOP */
 }
 
 
 /*
- * Destroy cdbx_cdb32_iter_t
+ * Visit the values of the key in one member
+ *
+ * Return -1 on error
+ * Return CDBX_VISIT_STOP or CDBX_VISIT_NEXT_MEMBER otherwise
  */
-EXT_LOCAL void
-cdbx_cdb32_iter_destroy(cdbx_cdb32_iter_t **self_)
+static int
+cdb32_find_visit(cdb32_find_t *find, Py_ssize_t idx,
+                 cdbx_cdb32_visit_t visit, void *ctx)
 {
-    cdbx_cdb32_iter_t *self;
+    cdbx_cdb32_pointer_t value;
+    int res = CDBX_VISIT_NEXT_MEMBER, found, first;
 
-    if (self_ && (self = *self_)) {
-        *self_ = NULL;
-        PyMem_Free(self);
+    find->key_num = 0;
+    for (first = 1; 1 == (found = cdb32_find_hashed(find, &value));
+         first = 0) {
+        if ((res = visit(ctx, idx, first, &value)) != CDBX_VISIT_NEXT_VALUE)
+            break;
     }
+    if (found == -1 || res == -1)
+        return -1;
+
+    return res == CDBX_VISIT_STOP ? res : CDBX_VISIT_NEXT_MEMBER;
 }
 
 
 /*
- * Find next key/value pair
- *
- * Opaque key and value pointers are returned (invalidated by next call).
- * key will be NULL if the end is reached.
- * value ref may be NULL
+ * Find a key in several CDBs, hashing it only once
  *
- * first == 1 if this is the first occurence of the key, 0 otherwise.
+ * visit(ctx, member, first, value) is called for every value found, member
+ * by member (first is 1 for the first value within the member). It returns
+ * CDBX_VISIT_STOP, CDBX_VISIT_NEXT_VALUE or CDBX_VISIT_NEXT_MEMBER or -1 on
+ * error.
  *
  * Return -1 on error
  * Return 0 on success
  */
 EXT_LOCAL int
-cdbx_cdb32_iter_next(cdbx_cdb32_iter_t *self,
-                     cdbx_cdb32_pointer_t **key_,
-                     cdbx_cdb32_pointer_t **value_,
-                     int *first_)
+cdbx_cdb32_find_stack(cdbx_cdb32_t **members, Py_ssize_t num, PyObject *key,
+                      cdbx_cdb32_visit_t visit, void *ctx)
 {
     cdb32_find_t find;
-    cdb32_dlength_t dlength = {0};
+    PyObject *tmp;
+    Py_ssize_t idx;
+    int res = 0;
+
+    if (-1 == cdb32_cstring(key, &tmp, &find.key, &find.length))
+        return -1;
+
+    find.hash = cdb32_hash_mem(find.key, find.length);
+    find.key_disk = 0;
+
+    for (idx = 0; idx < num; ++idx) {
+        find.cdb32 = members[idx];
+        res = cdb32_find_visit(&find, idx, visit, ctx);
+        if (res != CDBX_VISIT_NEXT_MEMBER)
+            break;
+    }
+    Py_XDECREF(tmp);
+
+    return res == -1 ? -1 : 0;
+}
+
+
+/*
+ * Map a key hash to one of num shards
+ *
+ * The hash is mixed first (murmur3 finalizer), because its low bits already
+ * pick the hash table within the shard.
+ */
+static Py_ssize_t
+cdb32_route(cdb32_hash_t hash, Py_ssize_t num)
+{
+    uint32_t mix = hash;
+
+    mix ^= mix >> 16;
+    mix *= UINT32_C(0x85ebca6b);
+    mix ^= mix >> 13;
+    mix *= UINT32_C(0xc2b2ae35);
+    mix ^= mix >> 16;
+
+    return (Py_ssize_t)(((uint64_t)mix * (uint64_t)num) >> 32);
+}
+
+
+/*
+ * Find the shard a key belongs to
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_route(PyObject *key, Py_ssize_t num, Py_ssize_t *idx)
+{
+    PyObject *tmp;
+    cdb32_key_t *ckey;
+    cdb32_len_t length;
+
+    if (-1 == cdb32_cstring(key, &tmp, &ckey, &length))
+        return -1;
+
+    *idx = cdb32_route(cdb32_hash_mem(ckey, length), num);
+    Py_XDECREF(tmp);
+
+    return 0;
+}
+
+
+/*
+ * Find a key in the shard it belongs to, hashing it only once
+ *
+ * member(ctx, idx) returns the shard's cdb32 (or NULL with an exception
+ * set). visit() works like with cdbx_cdb32_find_stack().
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_find_routed(Py_ssize_t num, cdbx_cdb32_member_t member,
+                       PyObject *key, cdbx_cdb32_visit_t visit, void *ctx)
+{
+    cdb32_find_t find;
+    PyObject *tmp;
+    Py_ssize_t idx;
+    int res = -1;
+
+    if (-1 == cdb32_cstring(key, &tmp, &find.key, &find.length))
+        return -1;
+
+    find.hash = cdb32_hash_mem(find.key, find.length);
+    find.key_disk = 0;
+
+    idx = cdb32_route(find.hash, num);
+    if ((find.cdb32 = member(ctx, idx)))
+        res = cdb32_find_visit(&find, idx, visit, ctx);
+    Py_XDECREF(tmp);
+
+    return res == -1 ? -1 : 0;
+}
+
+
+/*
+ * Count the number of unique keys (cached)
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_count_keys(cdbx_cdb32_t *self, Py_ssize_t *result)
+{
+    if (self->num_keys == -1) {
+        if (-1 == cdb32_count_records(self))
+            LCOV_EXCL_LINE_RETURN(-1);
+    }
+
+    *result = self->num_keys;
+    return 0;
+}
+
+
+#if 0
+/*
+ * Count the number of records (cached)
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_count_records(cdbx_cdb32_t *self, Py_ssize_t *result)
+{
+    if (self->num_records == -1) {
+        if (-1 == cdb32_count_records(self))
+            return -1;
+    }
+
+    *result = self->num_records;
+    return 0;
+}
+#endif
+
+
+/*
+ * Create cdbx_cdb32_iter_t
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_iter_create(cdbx_cdb32_t *cdb32, cdbx_cdb32_iter_t **result)
+{
+    cdbx_cdb32_iter_t *self;
+    int res;
+
+    if (!(self = PyMem_Malloc(sizeof *self))) {
+        /* LCOV_EXCL_START */
+
+        PyErr_SetNone(PyExc_MemoryError);
+        return -1;
+
+        /* LCOV_EXCL_STOP */
+    }
+
+    if (!cdb32->sentinel) {
+        CDB32_READ_SENTINEL(cdb32, res);
+        if (-1 == res)
+            LCOV_EXCL_LINE_GOTO(error);
+    }
+
+    self->cdb32 = cdb32;
+    self->pos = CDB32_SIZEOF_TABLE;
+    self->end = cdb32->sentinel;
+    *result = self;
+
+    return 0;
+
+/* LCOV_EXCL_START */
+error:
+    PyMem_Free(self);
+    return -1;
+/* LCOV_EXCL_STOP */
+}
+
+
+/*
+ * Destroy cdbx_cdb32_iter_t
+ */
+EXT_LOCAL void
+cdbx_cdb32_iter_destroy(cdbx_cdb32_iter_t **self_)
+{
+    cdbx_cdb32_iter_t *self;
+
+    if (self_ && (self = *self_)) {
+        *self_ = NULL;
+        PyMem_Free(self);
+    }
+}
+
+
+/*
+ * Restrict cdbx_cdb32_iter_t to the records between start and end
+ *
+ * start and end are data offsets as returned by cdbx_cdb32_split or
+ * cdbx_cdb32_iter_tell. -1 selects the beginning or the end of the data,
+ * respectively.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_iter_range(cdbx_cdb32_iter_t *self, Py_ssize_t start,
+                      Py_ssize_t end)
+{
+    cdb32_off_t sentinel = self->cdb32->sentinel;
+
+    if (start == -1)
+        start = CDB32_SIZEOF_TABLE;
+    if (end == -1)
+        end = (Py_ssize_t)sentinel;
+
+    if (start < CDB32_SIZEOF_TABLE || start > end
+        || (size_t)end > (size_t)sentinel) {
+        PyErr_SetString(PyExc_ValueError, "Range out of bounds");
+        return -1;
+    }
+
+    self->pos = (cdb32_off_t)start;
+    self->end = (cdb32_off_t)end;
+
+    return 0;
+}
+
+
+/*
+ * Return the data offset of the next record and the end of the range
+ */
+EXT_LOCAL void
+cdbx_cdb32_iter_tell(cdbx_cdb32_iter_t *self, Py_ssize_t *pos,
+                     Py_ssize_t *end)
+{
+    *pos = (Py_ssize_t)(self->pos < self->end ? self->pos : self->end);
+    *end = (Py_ssize_t)self->end;
+}
+
+
+/*
+ * Find next key/value pair
+ *
+ * Opaque key and value pointers are returned (invalidated by next call).
+ * key will be NULL if the end is reached.
+ * value ref may be NULL
+ *
+ * first == 1 if this is the first occurence of the key, 0 otherwise. first
+ * ref may be NULL, which skips the (hash table) probe for it.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_iter_next(cdbx_cdb32_iter_t *self,
+                     cdbx_cdb32_pointer_t **key_,
+                     cdbx_cdb32_pointer_t **value_,
+                     int *first_)
+{
+    cdb32_find_t find;
+    cdb32_dlength_t dlength = {0};
     int res;
 
-    if (self->pos < self->cdb32->sentinel) {
+    if (self->pos < self->end) {
         /* Find key + data length */
         CDB32_READ_DLENGTH(self->cdb32, self->pos, &dlength, res);
         if (-1 == res)
             LCOV_EXCL_LINE_RETURN(-1);
+
+        /* Records must not cross the data region (misaligned start) */
+        if ((uint64_t)self->pos + CDB32_SIZEOF_DLENGTH + dlength.klen
+            + dlength.dlen > (uint64_t)self->cdb32->sentinel) {
+            PyErr_SetString(PyExc_IOError, "Format Error");
+            return -1;
+        }
         self->pos += CDB32_SIZEOF_DLENGTH;
 
-        find.cdb32 = self->cdb32;
-        find.key_num = 0;
-        find.length = dlength.klen;
-        find.key_disk = self->pos;
         self->key.offset = self->pos;
         self->key.length = dlength.klen;
         self->pos += dlength.klen;
-        if (-1 == cdb32_find(&find, &self->value))
-            LCOV_EXCL_LINE_RETURN(-1);
 
-        if (!self->value.offset) {
-            /* LCOV_EXCL_START */
+        /* Probe if this is the first occurence of the key (if requested) */
+        if (first_) {
+            find.cdb32 = self->cdb32;
+            find.key_num = 0;
+            find.length = dlength.klen;
+            find.key_disk = self->key.offset;
+            if (-1 == cdb32_find(&find, &self->value))
+                LCOV_EXCL_LINE_RETURN(-1);
 
-            PyErr_SetString(PyExc_IOError, "Format Error");
-            return -1;
+            if (!self->value.offset) {
+                /* LCOV_EXCL_START */
 
-            /* LCOV_EXCL_STOP */
+                PyErr_SetString(PyExc_IOError, "Format Error");
+                return -1;
+
+                /* LCOV_EXCL_STOP */
+            }
+            *first_ = (self->value.offset == self->pos);
         }
-        *first_ = (self->value.offset == self->pos);
         *key_ = &self->key;
         if (value_) {
             self->value.offset = self->pos;
@@ -1276,7 +1783,8 @@ cdbx_cdb32_iter_next(cdbx_cdb32_iter_t *self,
         return 0;
     }
 
-    *first_ = 1;
+    if (first_)
+        *first_ = 1;
     *key_ = NULL;
     return 0;
 }
@@ -1325,346 +1833,2180 @@ error:
 
 
 /*
- * Create new maker instance
+ * Read a pointed value and decode it into a unicode object
+ *
+ * With a memory map, the value is decoded straight from the mapped buffer.
+ * Otherwise it's read into a temporary buffer first. If the encoding is NULL,
+ * a bytes object is returned instead.
  *
  * Return -1 on error
  * Return 0 on success
  */
 EXT_LOCAL int
-cdbx_cdb32_maker_create(int fd, cdbx_cdb32_maker_t **self_)
+cdbx_cdb32_read_decoded(cdbx_cdb32_t *self, cdbx_cdb32_pointer_t *value,
+                        const char *encoding, const char *errors,
+                        PyObject **result_)
 {
-    cdbx_cdb32_maker_t *self;
-    int j;
+    unsigned char sbuf[256], *buf;
+    const unsigned char *ptr;
+    Py_ssize_t length;
 
-    if (-1 == lseek(fd, 0, SEEK_SET)
-        || -1 == ftruncate(fd, 0)
-        || -1 == lseek(fd, CDB32_SIZEOF_TABLE, SEEK_SET)) {
+    if (!encoding)
+        return cdbx_cdb32_read(self, value, result_);
+
+    length = (Py_ssize_t)value->length;
+    if (length < 0 || (cdb32_off_t)length != value->length) {
         /* LCOV_EXCL_START */
 
-        PyErr_SetFromErrno(PyExc_IOError);
+        PyErr_SetString(PyExc_OverflowError, "Value too long");
         return -1;
 
         /* LCOV_EXCL_STOP */
     }
 
-    if (!(self = PyMem_Malloc(sizeof *self))) {
-        /* LCOV_EXCL_START */
+    if (self->map) {
+        if (-1 == cdb32_read_map(self, value->offset, value->length, &ptr))
+            LCOV_EXCL_LINE_RETURN(-1);
+        *result_ = PyUnicode_Decode((const char *)ptr, length, encoding,
+                                    errors);
+        return *result_ ? 0 : -1;
+    }
 
-        PyErr_SetNone(PyExc_MemoryError);
-        return -1;
+    if (value->length <= sizeof sbuf)
+        buf = sbuf;
+    else if (!(buf = PyMem_Malloc((size_t)value->length)))
+        LCOV_EXCL_LINE_GOTO(error_nomem);
 
-        /* LCOV_EXCL_STOP */
-    }
+    if (-1 == cdb32_read(self, value->offset, value->length, buf))
+        *result_ = NULL;  /* LCOV_EXCL_LINE */
+    else
+        *result_ = PyUnicode_Decode((const char *)buf, length, encoding,
+                                    errors);
 
-    for (j = 0; j < 256; ++j)
-        self->slot_counts[j] = 0;
-    self->slot_lists = NULL;
-    self->slot_list_index = 0;
-    self->buf_index = 0;
-    self->size = self->offset = CDB32_SIZEOF_TABLE;
-    self->fd = fd;
+    if (buf != sbuf)
+        PyMem_Free(buf);
 
-    *self_ = self;
-    return 0;
+    return *result_ ? 0 : -1;
+
+/* LCOV_EXCL_START */
+error_nomem:
+    PyErr_NoMemory();
+    return -1;
+/* LCOV_EXCL_STOP */
 }
 
 
 /*
- * Destroy maker instance
+ * Read a pointed value into a buffer
+ *
+ * The buffer must be large enough to hold the value.
  *
  * Return -1 on error
  * Return 0 on success
  */
-EXT_LOCAL void
-cdbx_cdb32_maker_destroy(cdbx_cdb32_maker_t **self_)
+EXT_LOCAL int
+cdbx_cdb32_read_into(cdbx_cdb32_t *self, cdbx_cdb32_pointer_t *value,
+                     void *buf)
 {
-    cdbx_cdb32_maker_t *self;
-    cdb32_slot_list_t *list;
+    return cdb32_read(self, value->offset, value->length, buf);
+}
 
-    if (self_ && (self = *self_)) {
-        *self_ = NULL;
 
-        while ((list = self->slot_lists)) {
+/*
+ * Read a part of a pointed value into a bytes object
+ *
+ * The range is clipped to the boundaries of the value. In mmap mode the
+ * range is sliced off the map, otherwise it's read with pread(2).
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_read_range(cdbx_cdb32_t *self, cdbx_cdb32_pointer_t *value,
+                      Py_ssize_t start, Py_ssize_t length, PyObject **result_)
+{
+    const unsigned char *ptr;
+    PyObject *result;
+    Py_ssize_t size;
+    cdb32_off_t offset;
+    cdb32_len_t len;
+
+    if (start < 0 || length < 0) {
+        PyErr_SetString(PyExc_ValueError, "Negative range");
+        return -1;
+    }
+
+    if ((size_t)start >= (size_t)value->length) {
+        offset = value->offset;
+        len = 0;
+    }
+    else {
+        offset = value->offset + (cdb32_off_t)start;
+        len = value->length - (cdb32_len_t)start;
+        if ((size_t)length < (size_t)len)
+            len = (cdb32_len_t)length;
+    }
+
+    size = (Py_ssize_t)len;
+    if (size < 0 || (cdb32_len_t)size != len) {
+        /* LCOV_EXCL_START */
+
+        PyErr_SetString(PyExc_OverflowError, "Value too long");
+        return -1;
+
+        /* LCOV_EXCL_STOP */
+    }
+
+    if (self->map) {
+        if (-1 == cdb32_read_map(self, offset, len, &ptr))
+            LCOV_EXCL_LINE_RETURN(-1);
+        *result_ = PyBytes_FromStringAndSize((const char *)ptr, size);
+        return *result_ ? 0 : -1;
+    }
+
+    if (!(result = PyBytes_FromStringAndSize(NULL, size)))
+        LCOV_EXCL_LINE_RETURN(-1);
+
+    if (-1 == cdb32_pread_nogil(self->fd, (off_t)offset, (size_t)len,
+                                (unsigned char *)PyBytes_AS_STRING(result))) {
+        if (errno)
+            PyErr_SetFromErrno(PyExc_IOError);
+        else
+            PyErr_SetString(PyExc_IOError, "Format Error");
+        Py_DECREF(result);
+        return -1;
+    }
+
+    *result_ = result;
+    return 0;
+}
+
+
+/*
+ * Send a pointed value to a file descriptor
+ *
+ * sendfile(2) is tried first. If it's not available or not applicable for
+ * the target, the value is written from the map (or read and written in
+ * chunks). The GIL is released during the transfer.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_send(cdbx_cdb32_t *self, cdbx_cdb32_pointer_t *value, int fd,
+                Py_ssize_t *sent_)
+{
+    unsigned char buf[CDB32_WRITE_BUF_SIZE];
+    const unsigned char *map_buf = NULL;
+    PyObject *map;
+    off_t offset;
+    size_t len, chunk;
+    int in_fd, err = 0;
+
+    if ((map = self->map)) {
+        if (-1 == cdb32_read_map(self, value->offset, value->length,
+                                 &map_buf))
+            LCOV_EXCL_LINE_RETURN(-1);
+
+        /* Keep the map alive, while we're not looking */
+        Py_INCREF(map);
+    }
+    if (-1 == (in_fd = cdb32_dup(self))) {
+        Py_XDECREF(map);
+        LCOV_EXCL_LINE_RETURN(-1);
+    }
+    offset = (off_t)value->offset;
+    len = (size_t)value->length;
+
+    Py_BEGIN_ALLOW_THREADS
+
+#ifdef CDB32_HAVE_SENDFILE
+    while (len > 0) {
+        ssize_t res;
+
+        if (-1 == (res = sendfile(fd, in_fd, &offset, len))) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EINVAL && errno != ENOSYS)
+                err = errno;
+            break;
+        }
+        if (!res) {
+            err = -1;
+            break;
+        }
+        len -= (size_t)res;
+    }
+#endif
+
+    if (len > 0 && !err) {
+        if (map_buf) {
+            if (-1 == cdb32_write_nogil(fd, map_buf + (size_t)(offset
+                                                   - (off_t)value->offset),
+                                        len))
+                err = errno;
+        }
+        else {
+            while (len > 0) {
+                if ((chunk = sizeof buf) > len)
+                    chunk = len;
+                if (-1 == cdb32_pread_nogil(in_fd, offset, chunk, buf)) {
+                    err = errno ? errno : -1;
+                    break;
+                }
+                if (-1 == cdb32_write_nogil(fd, buf, chunk)) {
+                    err = errno;
+                    break;
+                }
+                offset += (off_t)chunk;
+                len -= chunk;
+            }
+        }
+    }
+
+    close(in_fd);
+
+    Py_END_ALLOW_THREADS
+
+    Py_XDECREF(map);
+
+    if (err == -1) {
+        PyErr_SetString(PyExc_IOError, "Format Error");
+        return -1;
+    }
+    else if (err) {
+        errno = err;
+        PyErr_SetFromErrno(PyExc_IOError);
+        return -1;
+    }
+
+    *sent_ = (Py_ssize_t)value->length;
+    return 0;
+}
+
+
+/*
+ * Scan parameters
+ */
+#define CDB32_SCAN_MAX_THREADS (64)
+#define CDB32_SCAN_SAMPLES (16)  /* partition boundary samples per part */
+#define CDB32_SCAN_MAX_SAMPLES (1 << 20)
+#define CDB32_SCAN_MIN_PART (65536)
+#define CDB32_SCAN_BUF_SIZE (65536)
+
+#if defined(EXT3) && PY_VERSION_HEX >= 0x03070000
+#define CDB32_THREAD_FAILED(id) ((id) == PYTHREAD_INVALID_THREAD_ID)
+#else
+#define CDB32_THREAD_FAILED(id) ((id) == -1)
+#endif
+
+/* Scan predicates */
+typedef struct {
+    const cdb32_key_t *prefix;
+    const cdb32_key_t *suffix;
+    const cdb32_key_t *contains;
+    cdb32_len_t prefix_len;
+    cdb32_len_t suffix_len;
+    cdb32_len_t contains_len;
+} cdb32_scan_spec_t;
+
+/* Scan partition state */
+typedef struct {
+    const cdb32_scan_spec_t *spec;
+    const unsigned char *map_buf;
+    int fd;
+    cdb32_off_t start;
+    cdb32_off_t end;
+
+    unsigned char *buf;  /* read buffer (without map) */
+    cdb32_off_t buf_offset;
+    cdb32_len_t buf_length;
+    cdb32_len_t buf_size;
+
+    cdbx_cdb32_pointer_t *matches;  /* key/value pointer pairs */
+    size_t count;
+    size_t size;
+    int err;  /* errno, -1 on format error */
+
+    PyThread_type_lock done;  /* NULL if running in the calling thread */
+} cdb32_scan_part_t;
+
+
+/*
+ * Match a key against the scan predicates
+ *
+ * This function does not need the GIL.
+ *
+ * Return 0 on non-match
+ * Return 1 on match
+ */
+static int
+cdb32_scan_match(const cdb32_scan_spec_t *spec, const cdb32_key_t *key,
+                 cdb32_len_t len)
+{
+    const cdb32_key_t *pos, *end;
+
+    if (spec->prefix && (len < spec->prefix_len
+                         || memcmp(key, spec->prefix, spec->prefix_len)))
+        return 0;
+
+    if (spec->suffix && (len < spec->suffix_len
+                         || memcmp(key + (len - spec->suffix_len),
+                                   spec->suffix, spec->suffix_len)))
+        return 0;
+
+    if (spec->contains && spec->contains_len) {
+        if (len < spec->contains_len)
+            return 0;
+
+        end = key + (len - spec->contains_len) + 1;
+        for (pos = key; (pos = memchr(pos, *spec->contains,
+                                      (size_t)(end - pos))); ++pos) {
+            if (!memcmp(pos, spec->contains, spec->contains_len))
+                return 1;
+        }
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/*
+ * Access partition data
+ *
+ * Without a map, the data is read through a buffer in large chunks. The
+ * range must be within the partition.
+ *
+ * This function does not need the GIL.
+ *
+ * Return NULL on error (part->err is set)
+ */
+static const unsigned char *
+cdb32_scan_fetch(cdb32_scan_part_t *part, cdb32_off_t pos, cdb32_len_t len)
+{
+    unsigned char *tmp;
+    cdb32_len_t size;
+
+    if (part->map_buf)
+        return part->map_buf + pos;
+
+    if (pos >= part->buf_offset && len <= part->buf_length
+        && pos - part->buf_offset <= part->buf_length - len)
+        return part->buf + (pos - part->buf_offset);
+
+    if ((size = CDB32_SCAN_BUF_SIZE) < len)
+        size = len;
+    if (size > part->end - pos)
+        size = part->end - pos;
+
+    if (size > part->buf_size) {
+        if (!(tmp = realloc(part->buf, (size_t)size))) {
+            part->err = ENOMEM;
+            return NULL;
+        }
+        part->buf = tmp;
+        part->buf_size = size;
+    }
+
+    part->buf_length = 0;
+    if (-1 == cdb32_pread_nogil(part->fd, (off_t)pos, (size_t)size,
+                                part->buf)) {
+        part->err = errno ? errno : -1;
+        return NULL;
+    }
+    part->buf_offset = pos;
+    part->buf_length = size;
+
+    return part->buf;
+}
+
+
+/*
+ * Scan a partition of the records
+ *
+ * This function does not need the GIL. It's run in a worker thread (or the
+ * calling thread). Errors are reported in part->err.
+ */
+static void
+cdb32_scan_part(void *part_)
+{
+    cdb32_scan_part_t *part = part_;
+    const unsigned char *data;
+    cdbx_cdb32_pointer_t *matches;
+    cdb32_off_t pos = part->start;
+    cdb32_len_t klen, dlen;
+
+    while (pos < part->end) {
+        if (part->end - pos < CDB32_SIZEOF_DLENGTH) {
+            part->err = -1;
+            break;
+        }
+        if (!(data = cdb32_scan_fetch(part, pos, CDB32_SIZEOF_DLENGTH)))
+            break;
+        klen = CDB32_UNPACK_LEN(data);
+        dlen = CDB32_UNPACK_LEN(data + CDB32_SIZEOF_LEN);
+        pos += CDB32_SIZEOF_DLENGTH;
+
+        if (klen > part->end - pos || dlen > part->end - pos - klen) {
+            part->err = -1;
+            break;
+        }
+        if (!(data = cdb32_scan_fetch(part, pos, klen)))
+            break;
+
+        if (cdb32_scan_match(part->spec, data, klen)) {
+            if (part->count == part->size) {
+                part->size = part->size ? part->size << 1 : 64;
+                if (!(matches = realloc(part->matches,
+                                        part->size * 2 * sizeof *matches))) {
+                    part->err = ENOMEM;
+                    break;
+                }
+                part->matches = matches;
+            }
+            part->matches[part->count * 2].offset = pos;
+            part->matches[part->count * 2].length = klen;
+            part->matches[part->count * 2 + 1].offset = pos + klen;
+            part->matches[part->count * 2 + 1].length = dlen;
+            ++part->count;
+        }
+        pos += klen + dlen;
+    }
+
+    free(part->buf);
+    part->buf = NULL;
+    if (part->done)
+        PyThread_release_lock(part->done);
+}
+
+
+/*
+ * Compare two offsets (for qsort)
+ */
+static int
+cdb32_cmp_off(const void *a, const void *b)
+{
+    cdb32_off_t x = *(const cdb32_off_t *)a, y = *(const cdb32_off_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+/*
+ * Find record boundaries for partitioning
+ *
+ * The hash table slots point to record starts, which are spread over the
+ * whole data region. The samples are collected from the first tables.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+static int
+cdb32_scan_samples(cdbx_cdb32_t *self, cdb32_off_t *samples, size_t want,
+                   size_t *count_)
+{
+    cdbx_cdb32_pointer_t table = {0};
+    cdb32_slot_t slot = {0};
+    cdb32_off_t offset;
+    size_t count = 0;
+    cdb32_len_t j;
+    int res;
+
+    for (offset = 0; offset < CDB32_SIZEOF_TABLE && count < want;
+         offset += CDB32_SIZEOF_TPTR) {
+        CDB32_READ_POINTER(self, offset, &table, res);
+        if (-1 == res)
+            LCOV_EXCL_LINE_RETURN(-1);
+
+        for (j = 0; j < table.length && count < want; ++j) {
+            CDB32_READ_SLOT(self, table.offset + CDB32_OFFSET_SLOT(j), &slot,
+                            res);
+            if (-1 == res)
+                LCOV_EXCL_LINE_RETURN(-1);
+            if (slot.offset >= CDB32_SIZEOF_TABLE
+                && slot.offset < self->sentinel)
+                samples[count++] = slot.offset;
+        }
+    }
+
+    qsort(samples, count, sizeof *samples, cdb32_cmp_off);
+    *count_ = count;
+    return 0;
+}
+
+
+/*
+ * Split the data region into num partitions at record boundaries
+ *
+ * The boundaries are chosen near evenly spaced targets. bounds receives
+ * num + 1 offsets (partition idx is bounds[idx] .. bounds[idx + 1]).
+ * Partitions may be empty, if there are not enough records.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+static int
+cdb32_partition(cdbx_cdb32_t *self, size_t num, cdb32_off_t *bounds)
+{
+    cdb32_off_t *samples = NULL, start, end, target;
+    size_t want, nsamples = 0, sample = 0, idx;
+    int res;
+
+    if (!self->sentinel) {
+        CDB32_READ_SENTINEL(self, res);
+        if (-1 == res)
+            LCOV_EXCL_LINE_RETURN(-1);
+    }
+    start = CDB32_SIZEOF_TABLE;
+    end = self->sentinel > start ? self->sentinel : start;
+
+    if (num > 1) {
+        want = num > CDB32_SCAN_MAX_SAMPLES / CDB32_SCAN_SAMPLES
+               ? CDB32_SCAN_MAX_SAMPLES : num * CDB32_SCAN_SAMPLES;
+        if (!(samples = PyMem_Malloc(want * sizeof *samples))) {
+            /* LCOV_EXCL_START */
+
+            PyErr_NoMemory();
+            return -1;
+
+            /* LCOV_EXCL_STOP */
+        }
+        if (-1 == cdb32_scan_samples(self, samples, want, &nsamples)) {
+            /* LCOV_EXCL_START */
+
+            PyMem_Free(samples);
+            return -1;
+
+            /* LCOV_EXCL_STOP */
+        }
+    }
+
+    bounds[0] = start;
+    for (idx = 1; idx < num; ++idx) {
+        target = start + (cdb32_off_t)((uint64_t)(end - start)
+                                       * (uint64_t)idx / (uint64_t)num);
+        while (sample < nsamples && samples[sample] < target)
+            ++sample;
+        bounds[idx] = sample < nsamples ? samples[sample] : end;
+    }
+    bounds[num] = end;
+
+    if (samples)
+        PyMem_Free(samples);
+
+    return 0;
+}
+
+
+/*
+ * Split the data region into num (> 0) record aligned ranges
+ *
+ * bounds receives num + 1 offsets (range idx is bounds[idx] ..
+ * bounds[idx + 1]).
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_split(cdbx_cdb32_t *self, Py_ssize_t num, Py_ssize_t *bounds)
+{
+    cdb32_off_t *offsets;
+    Py_ssize_t idx;
+
+    if (!(offsets = PyMem_Malloc(((size_t)num + 1) * sizeof *offsets))) {
+        /* LCOV_EXCL_START */
+
+        PyErr_NoMemory();
+        return -1;
+
+        /* LCOV_EXCL_STOP */
+    }
+
+    if (-1 == cdb32_partition(self, (size_t)num, offsets)) {
+        /* LCOV_EXCL_START */
+
+        PyMem_Free(offsets);
+        return -1;
+
+        /* LCOV_EXCL_STOP */
+    }
+
+    for (idx = 0; idx <= num; ++idx)
+        bounds[idx] = (Py_ssize_t)offsets[idx];
+
+    PyMem_Free(offsets);
+    return 0;
+}
+
+
+/*
+ * Scan all records for keys matching the predicates
+ *
+ * The data region is split into partitions at record boundaries, which are
+ * scanned by native threads without the GIL. threads < 1 means: one per CPU.
+ * The matches are returned as key/value pointer pairs in file order,
+ * allocated with PyMem_Malloc.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_scan(cdbx_cdb32_t *self, PyObject *prefix, PyObject *suffix,
+                PyObject *contains, int all, int threads,
+                cdbx_cdb32_pointer_t **result_, Py_ssize_t *count_)
+{
+    cdb32_off_t bounds[CDB32_SCAN_MAX_THREADS + 1];
+    cdb32_scan_part_t parts[CDB32_SCAN_MAX_THREADS];
+    cdb32_scan_spec_t spec;
+    cdb32_find_t find;
+    cdbx_cdb32_pointer_t *result = NULL, value;
+    PyObject *tmp[3] = {NULL, NULL, NULL}, *map;
+    cdb32_key_t *ckey;
+    cdb32_off_t span;
+    size_t count, j, k;
+    int num = 0, err = 0, fd = -1, res, idx;
+
+    memset(&spec, 0, sizeof spec);
+    if (prefix && prefix != Py_None) {
+        if (-1 == cdb32_cstring(prefix, &tmp[0], &ckey, &spec.prefix_len))
+            goto error;
+        spec.prefix = ckey;
+    }
+    if (suffix && suffix != Py_None) {
+        if (-1 == cdb32_cstring(suffix, &tmp[1], &ckey, &spec.suffix_len))
+            goto error;
+        spec.suffix = ckey;
+    }
+    if (contains && contains != Py_None) {
+        if (-1 == cdb32_cstring(contains, &tmp[2], &ckey,
+                                &spec.contains_len))
+            goto error;
+        spec.contains = ckey;
+    }
+
+    if (!self->sentinel) {
+        CDB32_READ_SENTINEL(self, res);
+        if (-1 == res)
+            LCOV_EXCL_LINE_GOTO(error);
+    }
+    if (self->map && (size_t)self->sentinel > (size_t)self->map_size) {
+        /* LCOV_EXCL_START */
+
+        PyErr_SetString(PyExc_IOError, "Format Error");
+        goto error;
+
+        /* LCOV_EXCL_STOP */
+    }
+    span = self->sentinel > CDB32_SIZEOF_TABLE
+           ? self->sentinel - CDB32_SIZEOF_TABLE : 0;
+
+    if (threads < 1) {
+#ifdef _SC_NPROCESSORS_ONLN
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#else
+        threads = 1;
+#endif
+    }
+
+    if (threads > CDB32_SCAN_MAX_THREADS)
+        threads = CDB32_SCAN_MAX_THREADS;
+    if ((cdb32_off_t)threads > span / CDB32_SCAN_MIN_PART)
+        threads = (int)(span / CDB32_SCAN_MIN_PART);
+    if (threads < 1)
+        threads = 1;
+
+    if (-1 == cdb32_partition(self, (size_t)threads, bounds))
+        LCOV_EXCL_LINE_GOTO(error);
+
+    memset(parts, 0, sizeof parts);
+    for (idx = 0; idx < threads; ++idx) {
+        if (bounds[idx] < bounds[idx + 1]) {
+            parts[num].start = bounds[idx];
+            parts[num++].end = bounds[idx + 1];
+        }
+    }
+
+    if ((map = self->map))
+        Py_INCREF(map);  /* Keep the map alive, while we're not looking */
+    else if (-1 == (fd = cdb32_dup(self)))
+        LCOV_EXCL_LINE_GOTO(error);
+    cdb32_pin(self);
+
+    for (idx = 0; idx < num; ++idx) {
+        parts[idx].spec = &spec;
+        parts[idx].map_buf = map ? self->map_buf : NULL;
+        parts[idx].fd = fd;
+
+        /* The first one runs in the calling thread */
+        if (idx > 0 && (parts[idx].done = PyThread_allocate_lock())) {
+            (void)PyThread_acquire_lock(parts[idx].done, 1);
+            if (CDB32_THREAD_FAILED(PyThread_start_new_thread(
+                    cdb32_scan_part, &parts[idx]))) {
+                /* LCOV_EXCL_START */
+
+                PyThread_release_lock(parts[idx].done);
+                PyThread_free_lock(parts[idx].done);
+                parts[idx].done = NULL;
+
+                /* LCOV_EXCL_STOP */
+            }
+        }
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    for (idx = 0; idx < num; ++idx) {
+        if (!parts[idx].done)
+            cdb32_scan_part(&parts[idx]);
+    }
+    for (idx = 0; idx < num; ++idx) {
+        if (parts[idx].done)
+            (void)PyThread_acquire_lock(parts[idx].done, 1);
+    }
+    Py_END_ALLOW_THREADS
+
+    Py_XDECREF(map);
+    if (fd != -1)
+        close(fd);
+
+    count = 0;
+    for (idx = 0; idx < num; ++idx) {
+        if (parts[idx].done) {
+            PyThread_release_lock(parts[idx].done);
+            PyThread_free_lock(parts[idx].done);
+        }
+        if (parts[idx].err && !err)
+            err = parts[idx].err;
+        count += parts[idx].count;
+    }
+
+    /* Closed by another thread in the meantime? */
+    if (self->closed) {
+        cdbx_raise_closed();
+        goto error_parts;
+    }
+    if (err == -1) {
+        PyErr_SetString(PyExc_IOError, "Format Error");
+        goto error_parts;
+    }
+    else if (err) {
+        errno = err;
+        PyErr_SetFromErrno(PyExc_IOError);
+        goto error_parts;
+    }
+
+    if (count > (size_t)PY_SSIZE_T_MAX / (2 * sizeof *result)
+        || !(result = PyMem_Malloc((count ? count : 1) * 2 * sizeof *result)))
+    {
+        /* LCOV_EXCL_START */
+
+        PyErr_NoMemory();
+        goto error_parts;
+
+        /* LCOV_EXCL_STOP */
+    }
+
+    /* Merge in file order (dropping duplicate keys, if requested) */
+    for (count = 0, idx = 0; idx < num; ++idx) {
+        for (j = 0; j < parts[idx].count; ++j) {
+            k = j * 2;
+            if (!all) {
+                find.cdb32 = self;
+                find.key_num = 0;
+                find.length = parts[idx].matches[k].length;
+                find.key_disk = parts[idx].matches[k].offset;
+                if (-1 == cdb32_find(&find, &value))
+                    LCOV_EXCL_LINE_GOTO(error_parts);
+                if (value.offset != parts[idx].matches[k + 1].offset)
+                    continue;
+            }
+            result[count * 2] = parts[idx].matches[k];
+            result[count * 2 + 1] = parts[idx].matches[k + 1];
+            ++count;
+        }
+        free(parts[idx].matches);
+        parts[idx].matches = NULL;
+    }
+    cdb32_unpin(self);
+
+    for (idx = 0; idx < 3; ++idx)
+        Py_XDECREF(tmp[idx]);
+
+    *result_ = result;
+    *count_ = (Py_ssize_t)count;
+    return 0;
+
+error_parts:
+    for (idx = 0; idx < num; ++idx)
+        free(parts[idx].matches);
+    if (result)
+        PyMem_Free(result);
+    cdb32_unpin(self);
+error:
+    for (idx = 0; idx < 3; ++idx)
+        Py_XDECREF(tmp[idx]);
+    return -1;
+}
+
+
+/*
+ * Create new maker instance
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_maker_create(int fd, cdbx_cdb32_maker_t **self_)
+{
+    cdbx_cdb32_maker_t *self;
+    int j;
+
+    if (-1 == lseek(fd, 0, SEEK_SET)
+        || -1 == ftruncate(fd, 0)
+        || -1 == lseek(fd, CDB32_SIZEOF_TABLE, SEEK_SET)) {
+        /* LCOV_EXCL_START */
+
+        PyErr_SetFromErrno(PyExc_IOError);
+        return -1;
+
+        /* LCOV_EXCL_STOP */
+    }
+
+    if (!(self = PyMem_Malloc(sizeof *self))) {
+        /* LCOV_EXCL_START */
+
+        PyErr_SetNone(PyExc_MemoryError);
+        return -1;
+
+        /* LCOV_EXCL_STOP */
+    }
+
+    for (j = 0; j < 256; ++j)
+        self->slot_counts[j] = 0;
+    self->slot_lists = NULL;
+    self->slot_list_index = 0;
+    self->buf_index = 0;
+    self->size = self->offset = CDB32_SIZEOF_TABLE;
+    self->fd = fd;
+
+    *self_ = self;
+    return 0;
+}
+
+
+/*
+ * Destroy maker instance
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL void
+cdbx_cdb32_maker_destroy(cdbx_cdb32_maker_t **self_)
+{
+    cdbx_cdb32_maker_t *self;
+    cdb32_slot_list_t *list;
+
+    if (self_ && (self = *self_)) {
+        *self_ = NULL;
+
+        while ((list = self->slot_lists)) {
             self->slot_lists = list->prev;
-            PyMem_Free(list);
+            free(list);
+        }
+
+        PyMem_Free(self);
+    }
+}
+
+
+/*
+ * Return the FD
+ */
+EXT_LOCAL int
+cdbx_cdb32_maker_fileno(cdbx_cdb32_maker_t *self)
+{
+    return self->fd;
+}
+
+
+/*
+ * Add a key/value pair
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_maker_add(cdbx_cdb32_maker_t *self, PyObject *key, PyObject *value)
+{
+    PyObject *tmp_key, *tmp_value;
+    cdb32_key_t *ckey, *cvalue;
+    cdb32_len_t lkey, lvalue;
+    int res;
+
+    if (-1 == cdb32_cstring(key, &tmp_key, &ckey, &lkey))
+        return -1;
+    if (-1 == cdb32_cstring(value, &tmp_value, &cvalue, &lvalue)) {
+        Py_XDECREF(tmp_key);
+        return -1;
+    }
+
+    if (-1 == (res = cdb32_maker_add(self, ckey, lkey, cvalue, lvalue, NULL)))
+        cdb32_maker_raise(errno);  /* LCOV_EXCL_LINE */
+
+    Py_XDECREF(tmp_value);
+    Py_XDECREF(tmp_key);
+    return res;
+}
+
+
+/*
+ * Write the hash tables and the table pointers
+ *
+ * This does not need the GIL, so several makers can be committed in
+ * parallel.
+ *
+ * Return -1 on error (errno is set)
+ * Return 0 on success
+ */
+static int
+cdb32_maker_commit(cdbx_cdb32_maker_t *self)
+{
+    unsigned char *table = NULL, *tp, *buf;
+    cdb32_slot_t *sorted = NULL, *slots = NULL, *sp;
+    cdb32_off_t *starts;
+    cdb32_slot_list_t *slot_list;
+    cdb32_off_t offset, slot;
+    cdb32_len_t count, max_slots, num_slot;
+    size_t index;
+    int j, err;
+
+    /*
+     * Count the number of filled slots per bucket.
+     *
+     * `starts` contains the offset for each bucket in `sorted` later.
+     */
+    if (!(starts = malloc(256 * sizeof *starts))) {
+        /* LCOV_EXCL_START */
+
+        errno = ENOMEM;
+        return -1;
+
+        /* LCOV_EXCL_STOP */
+    }
+    for (count=0, max_slots=0, j=0; j < 256; ++j) {
+        count += self->slot_counts[j];
+        starts[j] = count;  /* We will fill them backwards below */
+        if (self->slot_counts[j] > max_slots)
+            max_slots = self->slot_counts[j];
+    }
+
+    /* + 1, because malloc(0) may return NULL */
+    if (!(sorted = malloc((count + 1) * sizeof *sorted))) {
+        /* LCOV_EXCL_START */
+
+        errno = ENOMEM;
+        goto error;
+
+        /* LCOV_EXCL_STOP */
+    }
+
+    /*
+     * This loop puts all hash slots into their buckets
+     * and they are ordered by insertion order (per bucket)
+     */
+    slot_list = self->slot_lists;
+    index = self->slot_list_index;
+    while (slot_list) {
+        while (index--) {
+            sorted[--starts[slot_list->slots[index].hash & 0xFF]] =
+                slot_list->slots[index];
+        }
+
+        index = CDB32_SLOT_LIST_SIZE;
+        slot_list = slot_list->prev;
+    }
+
+    /*
+     * The slots are the buffer for the actual later slot table,
+     * which is later serialized on disk. It contains twice the number of
+     * items as there are slots, so obviously there will be free slots,
+     * which act as end-of-search markers
+     */
+    if (!(slots = malloc((max_slots * 2 + 1) * sizeof *slots))) {
+        /* LCOV_EXCL_START */
+
+        errno = ENOMEM;
+        goto error;
+
+        /* LCOV_EXCL_STOP */
+    }
+
+    /*
+     * `table` contains the pointers to the slot tables. This will be the
+     * very beginning of the file.
+     */
+    if (!(tp = table = malloc(CDB32_SIZEOF_TABLE))) {
+        /* LCOV_EXCL_START */
+
+        errno = ENOMEM;
+        goto error;
+
+        /* LCOV_EXCL_STOP */
+    }
+
+    /*
+     * Now fill ALL the slot tables and write them to disk
+     */
+    sp = sorted;
+    offset = self->offset;
+    for (j = 0; j < 256; ++j) {
+        count = self->slot_counts[j];
+        max_slots = count + count;
+
+        /* Enter offset and slot table length into bucket table */
+        CDB32_PACK_OFF(offset, tp);
+        tp += CDB32_SIZEOF_OFF;
+        CDB32_PACK_LEN(max_slots, tp);
+        tp += CDB32_SIZEOF_LEN;
+
+        /* Reset all slots */
+        for (num_slot = 0; num_slot < max_slots; ++num_slot) {
+            slots[num_slot].offset = 0;
+            slots[num_slot].hash = 0;
+        }
+
+        /* Generate the real slot data */
+        for (num_slot = 0; num_slot < count; ++num_slot) {
+            /* Find search slot and skip already filled slots */
+            slot = (sp->hash >> 8) % max_slots;
+            while (slots[slot].offset)
+                slot = (slot + 1) % max_slots;
+            slots[slot] = *sp++;
+        }
+
+        /* Write it on disk */
+        buf = self->buf;
+        for (num_slot = 0; num_slot < max_slots; ++num_slot) {
+
+            /* LCOV_EXCL_START */
+            if (((CDB32_WRITE_BUF_SIZE - self->buf_index)
+                  < (CDB32_SIZEOF_SLOT))
+                && (-1 == cdb32_maker_buf_flush(self)))
+                goto error;
+            /* LCOV_EXCL_STOP */
+
+            buf = self->buf + self->buf_index;
+            CDB32_PACK_HASH(slots[num_slot].hash, buf);
+            buf += CDB32_SIZEOF_HASH;
+            CDB32_PACK_OFF(slots[num_slot].offset, buf);
+            self->buf_index += CDB32_SIZEOF_SLOT;
+            offset += CDB32_SIZEOF_SLOT;
         }
+    }
 
-        PyMem_Free(self);
+    if (-1 == cdb32_maker_buf_flush(self))
+        LCOV_EXCL_LINE_GOTO(error);
+
+    if (-1 == lseek(self->fd, 0, SEEK_SET))
+        LCOV_EXCL_LINE_GOTO(error);
+    if (-1 == cdb32_maker_write(self->fd, table, CDB32_SIZEOF_TABLE))
+        LCOV_EXCL_LINE_GOTO(error);
+
+    free(table);
+    free(slots);
+    free(sorted);
+    free(starts);
+    return 0;
+
+/* LCOV_EXCL_START */
+error:
+    err = errno;
+    free(table);
+    free(slots);
+    free(sorted);
+    free(starts);
+    errno = err;
+    return -1;
+/* LCOV_EXCL_STOP */
+}
+
+
+/*
+ * Commit the CDB
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_maker_commit(cdbx_cdb32_maker_t *self)
+{
+    if (-1 == cdb32_maker_commit(self)) {
+        /* LCOV_EXCL_START */
+
+        cdb32_maker_raise(errno);
+        return -1;
+
+        /* LCOV_EXCL_STOP */
+    }
+
+    return 0;
+}
+
+
+/*
+ * Commit part state
+ */
+typedef struct {
+    cdbx_cdb32_maker_t **makers;
+    Py_ssize_t start;  /* first maker */
+    Py_ssize_t num;    /* number of makers */
+    Py_ssize_t step;   /* distance between this part's makers */
+    PyThread_type_lock done;  /* held while the thread runs (or NULL) */
+    int err;
+} cdb32_commit_part_t;
+
+
+/*
+ * Commit (and sync) every step'th maker (runs without the GIL)
+ */
+static void
+cdb32_commit_part(void *part_)
+{
+    cdb32_commit_part_t *part = part_;
+    Py_ssize_t idx;
+
+    for (idx = part->start; idx < part->num; idx += part->step) {
+        if (-1 == cdb32_maker_commit(part->makers[idx])
+            || -1 == fsync(part->makers[idx]->fd)) {
+            /* LCOV_EXCL_START */
+
+            part->err = errno;
+            break;
+
+            /* LCOV_EXCL_STOP */
+        }
+    }
+
+    if (part->done)
+        PyThread_release_lock(part->done);
+}
+
+
+/*
+ * Commit several makers in parallel and sync their files to disk
+ *
+ * The makers are distributed over up to `threads` native threads (one per
+ * CPU if threads < 1), which run without the GIL. The calling thread takes
+ * part, too.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_maker_commit_many(cdbx_cdb32_maker_t **makers, Py_ssize_t num,
+                             int threads)
+{
+    cdb32_commit_part_t parts[CDB32_SCAN_MAX_THREADS];
+    int idx, err = 0;
+
+    if (threads < 1) {
+#ifdef _SC_NPROCESSORS_ONLN
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#else
+        threads = 1;
+#endif
+    }
+    if (threads > CDB32_SCAN_MAX_THREADS)
+        threads = CDB32_SCAN_MAX_THREADS;
+    if ((Py_ssize_t)threads > num)
+        threads = (int)num;
+    if (threads < 1)
+        threads = 1;
+
+    memset(parts, 0, sizeof parts);
+    for (idx = 0; idx < threads; ++idx) {
+        parts[idx].makers = makers;
+        parts[idx].start = idx;
+        parts[idx].num = num;
+        parts[idx].step = threads;
+
+        /* The first one runs in the calling thread */
+        if (idx > 0 && (parts[idx].done = PyThread_allocate_lock())) {
+            (void)PyThread_acquire_lock(parts[idx].done, 1);
+            if (CDB32_THREAD_FAILED(PyThread_start_new_thread(
+                    cdb32_commit_part, &parts[idx]))) {
+                /* LCOV_EXCL_START */
+
+                PyThread_release_lock(parts[idx].done);
+                PyThread_free_lock(parts[idx].done);
+                parts[idx].done = NULL;
+
+                /* LCOV_EXCL_STOP */
+            }
+        }
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    for (idx = 0; idx < threads; ++idx) {
+        if (!parts[idx].done)
+            cdb32_commit_part(&parts[idx]);
+    }
+    for (idx = 0; idx < threads; ++idx) {
+        if (parts[idx].done)
+            (void)PyThread_acquire_lock(parts[idx].done, 1);
+    }
+    Py_END_ALLOW_THREADS
+
+    for (idx = 0; idx < threads; ++idx) {
+        if (parts[idx].done) {
+            PyThread_release_lock(parts[idx].done);
+            PyThread_free_lock(parts[idx].done);
+        }
+        if (parts[idx].err && !err)
+            err = parts[idx].err;
+    }
+
+    if (err) {
+        /* LCOV_EXCL_START */
+
+        cdb32_maker_raise(err);
+        return -1;
+
+        /* LCOV_EXCL_STOP */
+    }
+
+    return 0;
+}
+
+
+/*
+ * Record copy state
+ */
+typedef struct {
+    cdbx_cdb32_maker_t *maker;
+    const unsigned char *map;  /* mapped source (or NULL) */
+    int fd;                    /* dup of the source fd (if not mapped) */
+    cdb32_off_t sentinel;
+
+    unsigned char *buf;  /* read window (if not mapped) */
+    cdb32_off_t buf_start;
+    cdb32_len_t buf_len;
+    size_t buf_size;
+
+    cdbx_cdb32_keep_t keep;
+    void *ctx;
+
+    PyObject *source_map;  /* kept alive during the copy */
+} cdb32_copy_t;
+
+#define CDB32_COPY_WINDOW (1 << 16)
+
+
+/*
+ * Make the source range [offset, offset + len) available
+ *
+ * This does not need the GIL.
+ *
+ * Return -1 on a format error
+ * Return errno on I/O errors
+ * Return 0 on success
+ */
+static int
+cdb32_copy_fetch(cdb32_copy_t *copy, cdb32_off_t offset, cdb32_len_t len,
+                 const unsigned char **result)
+{
+    unsigned char *tmp;
+    size_t size;
+
+    if (offset > copy->sentinel || len > copy->sentinel - offset)
+        return -1;
+
+    if (copy->map) {
+        *result = copy->map + offset;
+        return 0;
+    }
+
+    if (offset >= copy->buf_start
+        && (cdb32_off_t)(offset - copy->buf_start) <= copy->buf_len
+        && len <= copy->buf_len - (offset - copy->buf_start)) {
+        *result = copy->buf + (offset - copy->buf_start);
+        return 0;
+    }
+
+    /* Refill the window, starting at offset */
+    size = len > CDB32_COPY_WINDOW ? (size_t)len : CDB32_COPY_WINDOW;
+    if ((cdb32_off_t)size > copy->sentinel - offset)
+        size = (size_t)(copy->sentinel - offset);
+    if (size > copy->buf_size) {
+        if (!(tmp = realloc(copy->buf, size)))
+            LCOV_EXCL_LINE_RETURN(ENOMEM);
+        copy->buf = tmp;
+        copy->buf_size = size;
+    }
+
+    copy->buf_start = offset;
+    copy->buf_len = 0;
+    if (-1 == cdb32_pread_nogil(copy->fd, (off_t)offset, size, copy->buf))
+        LCOV_EXCL_LINE_RETURN(errno ? errno : -1);
+    copy->buf_len = (cdb32_len_t)size;
+
+    *result = copy->buf;
+    return 0;
+}
+
+
+/*
+ * Copy all records of the source into the maker
+ *
+ * If there's no maker, the records (without their values) are only passed
+ * to keep().
+ *
+ * This does not need the GIL (unless the keep callback does).
+ *
+ * Return -1 on a format error
+ * Return errno on other errors
+ * Return 0 on success
+ */
+static int
+cdb32_copy_records(cdb32_copy_t *copy)
+{
+    const unsigned char *record;
+    cdb32_off_t pos;
+    cdb32_len_t klen, vlen;
+    cdb32_hash_t hash;
+    int res;
+
+    for (pos = CDB32_SIZEOF_TABLE; pos < copy->sentinel;
+         pos += CDB32_SIZEOF_DLENGTH + klen + vlen) {
+        if ((res = cdb32_copy_fetch(copy, pos, CDB32_SIZEOF_DLENGTH,
+                                    &record)))
+            return res;
+        klen = CDB32_UNPACK_LEN(record);
+        vlen = CDB32_UNPACK_LEN(record + CDB32_SIZEOF_LEN);
+        if (klen > CDB32_MAX_LEN - CDB32_SIZEOF_DLENGTH
+            || vlen > CDB32_MAX_LEN - CDB32_SIZEOF_DLENGTH - klen)
+            return -1;
+
+        if ((res = cdb32_copy_fetch(copy, pos,
+                                    CDB32_SIZEOF_DLENGTH + klen
+                                    + (copy->maker ? vlen : 0),
+                                    &record)))
+            return res;
+        record += CDB32_SIZEOF_DLENGTH;
+
+        hash = cdb32_hash_mem(record, klen);
+        if (copy->keep) {
+            switch (copy->keep(copy->ctx, record, klen, hash)) {
+            case -1: return errno ? errno : EINVAL;
+            case 0: continue;
+            }
+        }
+
+        if (copy->maker
+            && -1 == cdb32_maker_add(copy->maker, record, klen,
+                                     record + klen, vlen, &hash))
+            LCOV_EXCL_LINE_RETURN(errno);
+    }
+
+    return 0;
+}
+
+
+/*
+ * Initialize the copy state for a source
+ *
+ * The source's map (if any) is kept alive until cdb32_copy_done().
+ * Otherwise the source is read through a duplicate of its file descriptor,
+ * so closing the source meanwhile does not pull it away under the copy.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+static int
+cdb32_copy_init(cdb32_copy_t *copy, cdbx_cdb32_maker_t *maker,
+                cdbx_cdb32_t *source, cdbx_cdb32_keep_t keep, void *ctx)
+{
+    int res;
+
+    memset(copy, 0, sizeof *copy);
+
+    if (!source->sentinel) {
+        CDB32_READ_SENTINEL(source, res);
+        if (-1 == res)
+            LCOV_EXCL_LINE_RETURN(-1);
+    }
+    if (source->map && (size_t)source->sentinel > (size_t)source->map_size) {
+        /* LCOV_EXCL_START */
+
+        PyErr_SetString(PyExc_IOError, "Format Error");
+        return -1;
+
+        /* LCOV_EXCL_STOP */
+    }
+
+    copy->maker = maker;
+    copy->map = source->map ? source->map_buf : NULL;
+    copy->fd = -1;
+    copy->sentinel = source->sentinel;
+    copy->keep = keep;
+    copy->ctx = ctx;
+
+    if ((copy->source_map = source->map))
+        Py_INCREF(copy->source_map);
+    else if (-1 == (copy->fd = cdb32_dup(source)))
+        LCOV_EXCL_LINE_RETURN(-1);
+
+    return 0;
+}
+
+
+/*
+ * Release the copy state
+ */
+static void
+cdb32_copy_done(cdb32_copy_t *copy)
+{
+    Py_CLEAR(copy->source_map);
+    if (copy->fd != -1) {
+        close(copy->fd);
+        copy->fd = -1;
+    }
+    free(copy->buf);
+    copy->buf = NULL;
+}
+
+
+/*
+ * Raise the exception for a cdb32_copy_records() result
+ */
+static void
+cdb32_copy_raise(int res)
+{
+    if (res == -1)
+        PyErr_SetString(PyExc_IOError, "Format Error");
+    else
+        cdb32_maker_raise(res);
+}
+
+
+/*
+ * Copy the records of a CDB into a maker (in file order)
+ *
+ * Every key is hashed only once; the hash is passed to keep() (if not NULL),
+ * which decides whether the record is copied (1) or skipped (0). It returns
+ * -1 (with errno set) on error. If `nogil` is true, the GIL is released
+ * during the copy, so keep() must not touch any Python object then.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_maker_copy(cdbx_cdb32_maker_t *self, cdbx_cdb32_t *source,
+                      cdbx_cdb32_keep_t keep, void *ctx, int nogil)
+{
+    cdb32_copy_t copy;
+    int res;
+
+    if (-1 == cdb32_copy_init(&copy, self, source, keep, ctx))
+        LCOV_EXCL_LINE_RETURN(-1);
+
+    if (nogil) {
+        Py_BEGIN_ALLOW_THREADS
+        res = cdb32_copy_records(&copy);
+        Py_END_ALLOW_THREADS
+    }
+    else {
+        res = cdb32_copy_records(&copy);
+    }
+
+    cdb32_copy_done(&copy);
+    if (res) {
+        cdb32_copy_raise(res);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Key set for merging (without the GIL)
+ *
+ * Maps key -> number of the winning record. The keys are stored in an
+ * arena, the table holds entry indexes + 1 (0 = free, linear probing).
+ */
+typedef struct {
+    uint32_t hash;
+    cdb32_len_t length;
+    size_t offset;  /* key position in the arena */
+    size_t record;  /* number of the winning record */
+} cdb32_keyset_entry_t;
+
+typedef struct {
+    cdb32_keyset_entry_t *entries;
+    size_t num_entries;
+    size_t max_entries;
+
+    size_t *table;
+    size_t mask;
+
+    unsigned char *arena;
+    size_t arena_len;
+    size_t arena_size;
+} cdb32_keyset_t;
+
+
+/*
+ * Find the table slot of a key
+ */
+static size_t *
+cdb32_keyset_slot(cdb32_keyset_t *set, const unsigned char *key,
+                  cdb32_len_t length, uint32_t hash)
+{
+    cdb32_keyset_entry_t *entry;
+    size_t *slot, idx;
+
+    for (idx = (hash ^ (hash >> 16)) & set->mask; ;
+         idx = (idx + 1) & set->mask) {
+        if (!*(slot = &set->table[idx]))
+            return slot;
+
+        entry = &set->entries[*slot - 1];
+        if (entry->hash == hash && entry->length == length
+            && !memcmp(set->arena + entry->offset, key, length))
+            return slot;
+    }
+}
+
+
+/*
+ * Find or add a key
+ *
+ * The entry pointer is stored in *entry_.
+ *
+ * Return -1 on error (ENOMEM)
+ * Return 0 if the key existed
+ * Return 1 if it was added (with record set to `record`)
+ */
+static int
+cdb32_keyset_put(cdb32_keyset_t *set, const unsigned char *key,
+                 cdb32_len_t length, uint32_t hash, size_t record,
+                 cdb32_keyset_entry_t **entry_)
+{
+    cdb32_keyset_entry_t *entry;
+    unsigned char *arena;
+    size_t *slot, *table, size, idx;
+
+    /* Keep the table at most half full */
+    size = set->table ? set->mask + 1 : 0;
+    if ((set->num_entries + 1) * 2 > size) {
+        size = size ? size * 2 : 1024;
+        if (!(table = calloc(size, sizeof *table)))
+            LCOV_EXCL_LINE_GOTO(error_nomem);
+
+        free(set->table);
+        set->table = table;
+        set->mask = size - 1;
+        for (idx = 0; idx < set->num_entries; ++idx) {
+            entry = &set->entries[idx];
+            *cdb32_keyset_slot(set, set->arena + entry->offset,
+                               entry->length, entry->hash) = idx + 1;
+        }
+    }
+
+    if (*(slot = cdb32_keyset_slot(set, key, length, hash))) {
+        *entry_ = &set->entries[*slot - 1];
+        return 0;
     }
+
+    if (set->num_entries == set->max_entries) {
+        size = set->max_entries ? set->max_entries * 2 : 1024;
+        if (!(entry = realloc(set->entries, size * sizeof *entry)))
+            LCOV_EXCL_LINE_GOTO(error_nomem);
+        set->entries = entry;
+        set->max_entries = size;
+    }
+    if (length > set->arena_size - set->arena_len) {
+        size = set->arena_size ? set->arena_size : CDB32_COPY_WINDOW;
+        while (length > size - set->arena_len)
+            size *= 2;
+        if (!(arena = realloc(set->arena, size)))
+            LCOV_EXCL_LINE_GOTO(error_nomem);
+        set->arena = arena;
+        set->arena_size = size;
+    }
+
+    entry = &set->entries[set->num_entries++];
+    entry->hash = hash;
+    entry->length = length;
+    entry->offset = set->arena_len;
+    entry->record = record;
+    if (length)
+        memcpy(set->arena + set->arena_len, key, length);
+    set->arena_len += length;
+    *slot = set->num_entries;
+
+    *entry_ = entry;
+    return 1;
+
+/* LCOV_EXCL_START */
+error_nomem:
+    errno = ENOMEM;
+    return -1;
+/* LCOV_EXCL_STOP */
 }
 
 
 /*
- * Return the FD
+ * Merge state (keep callback context)
  */
-EXT_LOCAL int
-cdbx_cdb32_maker_fileno(cdbx_cdb32_maker_t *self)
+typedef struct {
+    cdb32_keyset_t set;
+    size_t record;  /* number of the current record */
+    int dedup;
+    int collect;    /* collecting the last records? */
+} cdb32_merge_t;
+
+
+/*
+ * Decide whether to keep a record while merging
+ */
+static int
+cdb32_merge_keep(void *merge_, const unsigned char *key, uint32_t length,
+                 uint32_t hash)
 {
-    return self->fd;
+    cdb32_merge_t *merge = merge_;
+    cdb32_keyset_entry_t *entry;
+    size_t record = merge->record++;
+    int res;
+
+    if (-1 == (res = cdb32_keyset_put(&merge->set, key, length, hash, record,
+                                      &entry)))
+        LCOV_EXCL_LINE_RETURN(-1);
+
+    if (merge->dedup == CDBX_DEDUP_FIRST)
+        return res;
+
+    if (merge->collect) {
+        entry->record = record;
+        return 0;
+    }
+
+    return entry->record == record;
 }
 
 
 /*
- * Add a key/value pair
+ * Merge the records of several CDBs into a maker (without the GIL)
+ *
+ * dedup is one of the CDBX_DEDUP_* constants.
  *
  * Return -1 on error
  * Return 0 on success
  */
 EXT_LOCAL int
-cdbx_cdb32_maker_add(cdbx_cdb32_maker_t *self, PyObject *key, PyObject *value)
+cdbx_cdb32_maker_merge(cdbx_cdb32_maker_t *self, cdbx_cdb32_t **sources,
+                       Py_ssize_t num, int dedup)
 {
-    cdb32_key_t *ckey, *cvalue;
-    cdb32_slot_list_t *slot_list;
-    cdb32_len_t lkey, lvalue;
-    cdb32_off_t offset;
-    cdb32_hash_t hash;
-    unsigned char *buf;
-
-    if ((CDB32_MAX_OFF - CDB32_SIZEOF_DLENGTH) < self->size - 1) {
-        /* LCOV_EXCL_START */
+    cdb32_copy_t *copies;
+    cdb32_merge_t merge;
+    Py_ssize_t idx, init;
+    int res = 0;
+
+    if (!(copies = PyMem_Malloc((size_t)(num ? num : 1) * sizeof *copies))) {
+        PyErr_NoMemory();            /* LCOV_EXCL_LINE */
+        return -1;                   /* LCOV_EXCL_LINE */
+    }
 
-        PyErr_SetNone(PyExc_OverflowError);
-        return -1;
+    memset(&merge, 0, sizeof merge);
+    merge.dedup = dedup;
+    for (init = 0; init < num; ++init) {
+        if (-1 == cdb32_copy_init(&copies[init], self, sources[init],
+                                  dedup == CDBX_DEDUP_ALL
+                                      ? NULL : cdb32_merge_keep,
+                                  &merge))
+            LCOV_EXCL_LINE_GOTO(cleanup);
+    }
 
-        /* LCOV_EXCL_STOP */
+    Py_BEGIN_ALLOW_THREADS
+    if (dedup == CDBX_DEDUP_LAST) {
+        merge.collect = 1;
+        for (idx = 0; !res && idx < num; ++idx) {
+            copies[idx].maker = NULL;
+            res = cdb32_copy_records(&copies[idx]);
+            copies[idx].maker = self;
+        }
+        merge.collect = 0;
+        merge.record = 0;
     }
+    for (idx = 0; !res && idx < num; ++idx)
+        res = cdb32_copy_records(&copies[idx]);
+    Py_END_ALLOW_THREADS
+
+    if (res)
+        cdb32_copy_raise(res);
+
+cleanup:
+    for (idx = 0; idx < init; ++idx)
+        cdb32_copy_done(&copies[idx]);
+    PyMem_Free(copies);
+    free(merge.set.entries);
+    free(merge.set.table);
+    free(merge.set.arena);
+
+    return (res || init < num) ? -1 : 0;
+}
 
-    if (-1 == cdb32_cstring(&key, &ckey, &lkey))
-        return -1;
-    if (-1 == cdb32_cstring(&value, &cvalue, &lvalue))
-        LCOV_EXCL_LINE_GOTO(error_key);
 
-    if (((CDB32_WRITE_BUF_SIZE - self->buf_index) <
-            (CDB32_SIZEOF_DLENGTH)) && (-1 == cdb32_maker_buf_flush(self)))
-        LCOV_EXCL_LINE_GOTO(error_value);
+/*
+ * Dropped record (rebuild)
+ */
+typedef struct {
+    cdb32_off_t offset;
+    cdb32_len_t length;  /* of the whole record */
+} cdb32_range_t;
 
-    buf = self->buf + self->buf_index;
-    CDB32_PACK_LEN(lkey, buf);
-    buf += CDB32_SIZEOF_LEN;
-    CDB32_PACK_LEN(lvalue, buf);
-    self->buf_index += CDB32_SIZEOF_DLENGTH;
-    offset = self->offset;
-    self->size += CDB32_SIZEOF_DLENGTH;
-    self->offset += CDB32_SIZEOF_DLENGTH;
+/*
+ * Rebuild state
+ */
+typedef struct {
+    cdbx_cdb32_maker_t *maker;
+    const unsigned char *map;  /* mapped source (or NULL) */
+    size_t map_size;
+    int fd;                    /* dup of the source fd */
+    cdb32_off_t sentinel;
 
-    if (-1 == cdb32_maker_buf_write(self, ckey, lkey, &hash))
-        goto error_value;
-    if (-1 == cdb32_maker_buf_write(self, cvalue, lvalue, NULL))
-        goto error_value;
+    cdb32_range_t *drops;  /* sorted by offset */
+    cdb32_off_t *removed;  /* removed[i] = sum of drops[0..i-1] lengths */
+    size_t num_drops;
+    size_t max_drops;
 
-    /* Slots will be doubled -> times 2 */
-    if ((CDB32_MAX_OFF - (CDB32_SIZEOF_SLOT + CDB32_SIZEOF_SLOT)) <
-            self->size - 1) {
-        /* LCOV_EXCL_START */
+    cdb32_len_t klen;  /* key length while collecting the drops */
+    unsigned char *buf;
+} cdb32_rebuild_t;
 
-        PyErr_SetNone(PyExc_OverflowError);
-        goto error_value;
+#define CDB32_REBUILD_BUF (1 << 16)
 
-        /* LCOV_EXCL_STOP */
+
+/*
+ * Collect a record to drop (find visitor)
+ */
+static int
+cdb32_rebuild_visit(void *rebuild_, Py_ssize_t idx, int first,
+                    cdbx_cdb32_pointer_t *value)
+{
+    cdb32_rebuild_t *rebuild = rebuild_;
+    cdb32_range_t *drops;
+    size_t size;
+
+    (void)idx;
+    (void)first;
+
+    if (rebuild->num_drops == rebuild->max_drops) {
+        size = rebuild->max_drops ? rebuild->max_drops * 2 : 64;
+        if (!(drops = PyMem_Realloc(rebuild->drops, size * sizeof *drops))) {
+            PyErr_NoMemory();  /* LCOV_EXCL_LINE */
+            return -1;         /* LCOV_EXCL_LINE */
+        }
+        rebuild->drops = drops;
+        rebuild->max_drops = size;
     }
-    self->size += CDB32_SIZEOF_SLOT + CDB32_SIZEOF_SLOT;
 
-    if (!(slot_list = self->slot_lists)
-        || !(self->slot_list_index < CDB32_SLOT_LIST_SIZE)) {
-        if (!(slot_list = PyMem_Malloc(sizeof *slot_list))) {
-            /* LCOV_EXCL_START */
+    drops = &rebuild->drops[rebuild->num_drops++];
+    drops->offset = value->offset - rebuild->klen - CDB32_SIZEOF_DLENGTH;
+    drops->length = value->length + rebuild->klen + CDB32_SIZEOF_DLENGTH;
 
-            PyErr_SetNone(PyExc_MemoryError);
-            goto error_value;
+    return CDBX_VISIT_NEXT_VALUE;
+}
 
-            /* LCOV_EXCL_STOP */
-        }
-        self->slot_list_index = 0;
-        slot_list->prev = self->slot_lists;
-        self->slot_lists = slot_list;
-    }
-    slot_list->slots[self->slot_list_index].hash = hash;
-    slot_list->slots[self->slot_list_index++].offset = offset;
-    ++self->slot_counts[hash & 0xFF];
 
-    Py_DECREF(value);
-    Py_DECREF(key);
-    return 0;
+/*
+ * Order dropped records by offset
+ */
+static int
+cdb32_rebuild_cmp_range(const void *a_, const void *b_)
+{
+    const cdb32_range_t *a = a_, *b = b_;
 
-/* LCOV_EXCL_START */
-error_value:
-    Py_DECREF(value);
-error_key:
-    Py_DECREF(key);
-    return -1;
-/* LCOV_EXCL_STOP */
+    return a->offset < b->offset ? -1 : a->offset > b->offset;
 }
 
 
 /*
- * Commit the CDB
+ * Order slots by offset
+ */
+static int
+cdb32_rebuild_cmp_slot(const void *a_, const void *b_)
+{
+    const cdb32_slot_t *a = a_, *b = b_;
+
+    return a->offset < b->offset ? -1 : a->offset > b->offset;
+}
+
+
+/*
+ * Copy a byte range of the source to the maker as-is
  *
- * Return -1 on error
+ * This does not need the GIL.
+ *
+ * Return -1 on a format error
+ * Return errno on other errors
  * Return 0 on success
  */
-EXT_LOCAL int
-cdbx_cdb32_maker_commit(cdbx_cdb32_maker_t *self)
+static int
+cdb32_rebuild_copy(cdb32_rebuild_t *rebuild, cdb32_off_t offset,
+                   cdb32_len_t len)
 {
-    unsigned char *table, *tp, *buf;
-    cdb32_slot_t *sorted, *slots, *sp;
-    cdb32_off_t *starts;
-    cdb32_slot_list_t *slot_list;
-    cdb32_off_t offset, slot;
-    cdb32_len_t count, max_slots, num_slot;
-    size_t index;
-    int j;
+    cdbx_cdb32_maker_t *maker = rebuild->maker;
+    size_t chunk;
 
-    /*
-     * Count the number of filled slots per bucket.
-     *
-     * `starts` contains the offset for each bucket in `sorted` later.
-     */
-    if (!(starts = PyMem_Malloc(256 * sizeof *starts))) {
-        /* LCOV_EXCL_START */
+    if (!len)
+        return 0;
+    if (CDB32_MAX_OFF - len < maker->size - 1)
+        LCOV_EXCL_LINE_RETURN(EOVERFLOW);
+    if (-1 == cdb32_maker_buf_flush(maker))
+        LCOV_EXCL_LINE_RETURN(errno);
+    maker->size += len;
+    maker->offset += len;
+
+#ifdef CDB32_HAVE_COPY_FILE_RANGE
+    {
+        off64_t in_off = (off64_t)offset;
+        ssize_t res;
 
-        PyErr_SetNone(PyExc_MemoryError);
-        return -1;
+        while (len > 0) {
+            if (-1 == (res = copy_file_range(rebuild->fd, &in_off, maker->fd,
+                                             NULL, (size_t)len, 0))) {
+                if (errno == EINTR)
+                    continue;
+                if (errno != EXDEV && errno != EINVAL && errno != ENOSYS
+                    && errno != EOPNOTSUPP && errno != EBADF)
+                    LCOV_EXCL_LINE_RETURN(errno);
+                break;
+            }
+            if (!res)
+                LCOV_EXCL_LINE_RETURN(-1);
+            len -= (cdb32_len_t)res;
+        }
+        offset = (cdb32_off_t)in_off;
+    }
+#endif
 
-        /* LCOV_EXCL_STOP */
+    if (len > 0 && rebuild->map) {
+        if (-1 == cdb32_maker_write(maker->fd, rebuild->map + offset,
+                                    (size_t)len))
+            LCOV_EXCL_LINE_RETURN(errno);
+        return 0;
     }
-    for (count=0, max_slots=0, j=0; j < 256; ++j) {
-        count += self->slot_counts[j];
-        starts[j] = count;  /* We will fill them backwards below */
-        if (self->slot_counts[j] > max_slots)
-            max_slots = self->slot_counts[j];
+
+    while (len > 0) {
+        if ((chunk = CDB32_REBUILD_BUF) > len)
+            chunk = len;
+        if (-1 == cdb32_pread_nogil(rebuild->fd, (off_t)offset, chunk,
+                                    rebuild->buf))
+            LCOV_EXCL_LINE_RETURN(errno ? errno : -1);
+        if (-1 == cdb32_maker_write(maker->fd, rebuild->buf, chunk))
+            LCOV_EXCL_LINE_RETURN(errno);
+        offset += (cdb32_off_t)chunk;
+        len -= (cdb32_len_t)chunk;
     }
 
-    if (!(sorted = PyMem_Malloc(count * sizeof *sorted))) {
-        /* LCOV_EXCL_START */
+    return 0;
+}
 
-        PyErr_SetNone(PyExc_MemoryError);
-        goto error_starts;
 
-        /* LCOV_EXCL_STOP */
+/*
+ * Read a part of the source's hash tables
+ *
+ * This does not need the GIL.
+ *
+ * Return -1 on a format error
+ * Return errno on other errors
+ * Return 0 on success
+ */
+static int
+cdb32_rebuild_read(cdb32_rebuild_t *rebuild, cdb32_off_t offset, size_t len,
+                   unsigned char *buf)
+{
+    if (rebuild->map) {
+        memcpy(buf, rebuild->map + offset, len);
+        return 0;
     }
 
-    /*
-     * This loop puts all hash slots into their buckets
-     * and they are ordered by insertion order (per bucket)
-     */
-    slot_list = self->slot_lists;
-    index = self->slot_list_index;
-    while (slot_list) {
-        while (index--) {
-            sorted[--starts[slot_list->slots[index].hash & 0xFF]] =
-                slot_list->slots[index];
-        }
+    if (-1 == cdb32_pread_nogil(rebuild->fd, (off_t)offset, len, buf))
+        LCOV_EXCL_LINE_RETURN(errno ? errno : -1);
 
-        index = CDB32_SLOT_LIST_SIZE;
-        slot_list = slot_list->prev;
-    }
+    return 0;
+}
 
-    /*
-     * The slots are the buffer for the actual later slot table,
-     * which is later serialized on disk. It contains twice the number of
-     * items as there are slots, so obviously there will be free slots,
-     * which act as end-of-search markers
-     */
-    if (!(slots = PyMem_Malloc(max_slots * 2 * sizeof *slots))) {
-        /* LCOV_EXCL_START */
 
-        PyErr_SetNone(PyExc_MemoryError);
-        goto error_sorted;
+/*
+ * Copy the kept records and take over their slot entries
+ *
+ * Runs of kept records are copied as raw byte ranges. The slot entries come
+ * from the source's hash tables (so no key is read or hashed again), minus
+ * the dropped ones, with their offsets shifted. They're added per table in
+ * file order, which keeps the order of the values per key.
+ *
+ * This does not need the GIL.
+ *
+ * Return -1 on a format error
+ * Return errno on other errors
+ * Return 0 on success
+ */
+static int
+cdb32_rebuild_records(cdb32_rebuild_t *rebuild)
+{
+    unsigned char tables[CDB32_SIZEOF_TABLE], *tp, *sp, *packed = NULL, *ptmp;
+    cdb32_slot_t *slots = NULL, *tmp;
+    cdb32_off_t pos, base, offset, tlen;
+    size_t idx, num, lo, hi, max_slots = 0;
+    cdb32_hash_t hash;
+    int res;
 
-        /* LCOV_EXCL_STOP */
+    base = rebuild->maker->offset;
+    for (pos = CDB32_SIZEOF_TABLE, idx = 0; idx < rebuild->num_drops; ++idx) {
+        if ((res = cdb32_rebuild_copy(rebuild, pos,
+                                      rebuild->drops[idx].offset - pos)))
+            return res;
+        pos = rebuild->drops[idx].offset + rebuild->drops[idx].length;
     }
+    if ((res = cdb32_rebuild_copy(rebuild, pos, rebuild->sentinel - pos)))
+        return res;
+
+    if ((res = cdb32_rebuild_read(rebuild, 0, sizeof tables, tables)))
+        return res;
+
+    for (tp = tables; tp < tables + sizeof tables; tp += CDB32_SIZEOF_TPTR) {
+        offset = CDB32_UNPACK_OFF(tp);
+        tlen = CDB32_UNPACK_LEN(tp + CDB32_SIZEOF_OFF);
+        if (!tlen)
+            continue;
+        if (offset < rebuild->sentinel
+            || tlen > (CDB32_MAX_OFF - offset) / CDB32_SIZEOF_SLOT
+            || (rebuild->map && (size_t)offset + (size_t)tlen
+                                * CDB32_SIZEOF_SLOT > rebuild->map_size)) {
+            res = -1;
+            goto cleanup;
+        }
 
-    /*
-     * `table` contains the pointers to the slot tables. This will be the
-     * very beginning of the file.
-     */
-    if (!(tp = table = PyMem_Malloc(CDB32_SIZEOF_TABLE))) {
-        /* LCOV_EXCL_START */
-
-        PyErr_SetNone(PyExc_MemoryError);
-        goto error_slots;
+        if (tlen > max_slots) {
+            if (!(tmp = realloc(slots, (size_t)tlen * sizeof *slots)))
+                LCOV_EXCL_LINE_GOTO(error_nomem);
+            slots = tmp;
+            if (!(ptmp = realloc(packed, (size_t)tlen * CDB32_SIZEOF_SLOT)))
+                LCOV_EXCL_LINE_GOTO(error_nomem);
+            packed = ptmp;
+            max_slots = tlen;
+        }
 
-        /* LCOV_EXCL_STOP */
-    }
+        if ((res = cdb32_rebuild_read(
+                rebuild, offset, (size_t)tlen * CDB32_SIZEOF_SLOT, packed)))
+            goto cleanup;
 
-    /*
-     * Now fill ALL the slot tables and write them to disk
-     */
-    sp = sorted;
-    offset = self->offset;
-    for (j = 0; j < 256; ++j) {
-        count = self->slot_counts[j];
-        max_slots = count + count;
+        for (num = 0, idx = 0; idx < tlen; ++idx) {
+            sp = packed + idx * CDB32_SIZEOF_SLOT;
+            hash = CDB32_UNPACK_HASH(sp);
+            pos = CDB32_UNPACK_OFF(sp + CDB32_SIZEOF_HASH);
+            if (!pos)
+                continue;
+            if (pos < CDB32_SIZEOF_TABLE || pos >= rebuild->sentinel) {
+                res = -1;
+                goto cleanup;
+            }
 
-        /* Enter offset and slot table length into bucket table */
-        CDB32_PACK_OFF(offset, tp);
-        tp += CDB32_SIZEOF_OFF;
-        CDB32_PACK_LEN(max_slots, tp);
-        tp += CDB32_SIZEOF_LEN;
+            /* lo = number of drops before or at pos */
+            for (lo = 0, hi = rebuild->num_drops; lo < hi; ) {
+                if (rebuild->drops[(lo + hi) / 2].offset <= pos)
+                    lo = (lo + hi) / 2 + 1;
+                else
+                    hi = (lo + hi) / 2;
+            }
+            if (lo && rebuild->drops[lo - 1].offset == pos)
+                continue;
 
-        /* Reset all slots */
-        for (num_slot = 0; num_slot < max_slots; ++num_slot) {
-            slots[num_slot].offset = 0;
-            slots[num_slot].hash = 0;
+            slots[num].hash = hash;
+            slots[num++].offset = base + (pos - CDB32_SIZEOF_TABLE)
+                                  - rebuild->removed[lo];
         }
 
-        /* Generate the real slot data */
-        for (num_slot = 0; num_slot < count; ++num_slot) {
-            /* Find search slot and skip already filled slots */
-            slot = (sp->hash >> 8) % max_slots;
-            while (slots[slot].offset)
-                slot = (slot + 1) % max_slots;
-            slots[slot] = *sp++;
+        qsort(slots, num, sizeof *slots, cdb32_rebuild_cmp_slot);
+        for (idx = 0; idx < num; ++idx) {
+            if (-1 == cdb32_maker_slot(rebuild->maker, slots[idx].hash,
+                                       slots[idx].offset)) {
+                res = errno;   /* LCOV_EXCL_LINE */
+                goto cleanup;  /* LCOV_EXCL_LINE */
+            }
         }
+    }
+    res = 0;
 
-        /* Write it on disk */
-        buf = self->buf;
-        for (num_slot = 0; num_slot < max_slots; ++num_slot) {
+cleanup:
+    free(packed);
+    free(slots);
+    return res;
+
+/* LCOV_EXCL_START */
+error_nomem:
+    free(packed);
+    free(slots);
+    return ENOMEM;
+/* LCOV_EXCL_STOP */
+}
+
+
+/*
+ * Rebuild a CDB into a maker, dropping all records of some keys
+ *
+ * keys is a list of bytes. The remaining records are copied as raw byte
+ * ranges (using copy_file_range(2) where available) and their slot entries
+ * are taken over from the source. The GIL is released during the copy.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_maker_rebuild(cdbx_cdb32_maker_t *self, cdbx_cdb32_t *source,
+                         PyObject *keys)
+{
+    cdb32_rebuild_t rebuild;
+    PyObject *map, *key;
+    Py_ssize_t idx;
+    size_t num;
+    int res;
+
+    if (!source->sentinel) {
+        CDB32_READ_SENTINEL(source, res);
+        if (-1 == res)
+            LCOV_EXCL_LINE_RETURN(-1);
+    }
+    if (source->map && (size_t)source->sentinel > (size_t)source->map_size) {
+        /* LCOV_EXCL_START */
+
+        PyErr_SetString(PyExc_IOError, "Format Error");
+        return -1;
+
+        /* LCOV_EXCL_STOP */
+    }
 
-            /* LCOV_EXCL_START */
-            if (((CDB32_WRITE_BUF_SIZE - self->buf_index)
-                  < (CDB32_SIZEOF_SLOT))
-                && (-1 == cdb32_maker_buf_flush(self)))
-                goto error_table;
-            /* LCOV_EXCL_STOP */
+    memset(&rebuild, 0, sizeof rebuild);
+    rebuild.maker = self;
+    rebuild.map = source->map ? source->map_buf : NULL;
+    rebuild.map_size = (size_t)source->map_size;
+    rebuild.fd = -1;
+    rebuild.sentinel = source->sentinel;
+
+    /* Collect the records to drop */
+    for (idx = 0; idx < PyList_GET_SIZE(keys); ++idx) {
+        key = PyList_GET_ITEM(keys, idx);
+        rebuild.klen = (cdb32_len_t)PyBytes_GET_SIZE(key);
+        if (-1 == cdbx_cdb32_find_stack(&source, 1, key, cdb32_rebuild_visit,
+                                        &rebuild))
+            goto error;
+    }
 
-            buf = self->buf + self->buf_index;
-            CDB32_PACK_HASH(slots[num_slot].hash, buf);
-            buf += CDB32_SIZEOF_HASH;
-            CDB32_PACK_OFF(slots[num_slot].offset, buf);
-            self->buf_index += CDB32_SIZEOF_SLOT;
-            offset += CDB32_SIZEOF_SLOT;
-        }
+    qsort(rebuild.drops, rebuild.num_drops, sizeof *rebuild.drops,
+          cdb32_rebuild_cmp_range);
+    for (num = 0, idx = 0; (size_t)idx < rebuild.num_drops; ++idx) {
+        if (num && rebuild.drops[num - 1].offset
+                   == rebuild.drops[idx].offset)
+            continue;
+        rebuild.drops[num++] = rebuild.drops[idx];
     }
+    rebuild.num_drops = num;
+
+    if (!(rebuild.removed = PyMem_Malloc((num + 1)
+                                         * sizeof *rebuild.removed)))
+        LCOV_EXCL_LINE_GOTO(error_nomem);
+    rebuild.removed[0] = 0;
+    for (idx = 0; (size_t)idx < num; ++idx)
+        rebuild.removed[idx + 1] = rebuild.removed[idx]
+                                   + rebuild.drops[idx].length;
+
+    if (!rebuild.map && !(rebuild.buf = PyMem_Malloc(CDB32_REBUILD_BUF)))
+        LCOV_EXCL_LINE_GOTO(error_nomem);
+
+    /* Read through our own descriptor (copy_file_range(2) uses it even if
+     * the source is mapped), the source may be closed meanwhile */
+    if (-1 == (rebuild.fd = cdb32_dup(source)))
+        LCOV_EXCL_LINE_GOTO(error);
+    if ((map = source->map))
+        Py_INCREF(map);  /* Keep the map alive, while we're not looking */
 
-    if (-1 == cdb32_maker_buf_flush(self))
-        LCOV_EXCL_LINE_GOTO(error_table);
+    Py_BEGIN_ALLOW_THREADS
+    res = cdb32_rebuild_records(&rebuild);
+    close(rebuild.fd);
+    Py_END_ALLOW_THREADS
 
-    if (-1 == lseek(self->fd, 0, SEEK_SET)) {
-        PyErr_SetFromErrno(PyExc_IOError);
-        goto error_table;
+    Py_XDECREF(map);
+    if (res) {
+        cdb32_copy_raise(res);
+        goto error;
     }
-    if (-1 == cdb32_maker_write(self->fd, table, CDB32_SIZEOF_TABLE))
-        LCOV_EXCL_LINE_GOTO(error_table);
 
-    PyMem_Free(table);
-    PyMem_Free(slots);
-    PyMem_Free(sorted);
-    PyMem_Free(starts);
+    PyMem_Free(rebuild.buf);
+    PyMem_Free(rebuild.removed);
+    PyMem_Free(rebuild.drops);
     return 0;
 
-error_table:
-    PyMem_Free(table);
-error_slots:
-    PyMem_Free(slots);
-error_sorted:
-    PyMem_Free(sorted);
-error_starts:
-    PyMem_Free(starts);
+error_nomem:
+    PyErr_NoMemory();  /* LCOV_EXCL_LINE */
+error:
+    PyMem_Free(rebuild.buf);
+    PyMem_Free(rebuild.removed);
+    PyMem_Free(rebuild.drops);
     return -1;
 }
 
 
+/*
+ * Warm the page cache (and the mapping) for the whole file
+ *
+ * Mapped files are advised and touched page by page, so the first lookups
+ * don't fault. Otherwise the kernel is asked to read ahead. The GIL is
+ * released meanwhile.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_warm(cdbx_cdb32_t *self)
+{
+    const volatile unsigned char *buf;
+    PyObject *map;
+    size_t size, idx, page;
+    unsigned char sum = 0;
+
+    if (!(map = self->map)) {
+#ifdef POSIX_FADV_WILLNEED
+        int fd = self->fd;
+
+        Py_BEGIN_ALLOW_THREADS
+        (void)posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        Py_END_ALLOW_THREADS
+#endif
+        return 0;
+    }
+
+    Py_INCREF(map);  /* Keep the map alive, while we're not looking */
+    buf = self->map_buf;
+    size = (size_t)self->map_size;
+
+    Py_BEGIN_ALLOW_THREADS
+#ifdef POSIX_MADV_WILLNEED
+    (void)posix_madvise((void *)(uintptr_t)buf, size, POSIX_MADV_WILLNEED);
+#endif
+    page = (size_t)sysconf(_SC_PAGESIZE);
+    for (idx = 0; idx < size; idx += page)
+        sum ^= buf[idx];
+    Py_END_ALLOW_THREADS
+
+    (void)sum;
+    Py_DECREF(map);
+    return 0;
+}
+
+
 /*
  * Create new get-iterator
  *
@@ -1686,15 +4028,19 @@ cdbx_cdb32_get_iter_new(cdbx_cdb32_t *cdb32, PyObject *key,
         /* LCOV_EXCL_STOP */
     }
 
-    if (-1 == cdb32_cstring(&key, &result->find.key, &result->find.length)) {
+    if (-1 == cdb32_cstring(key, &result->key, &result->find.key,
+                            &result->find.length)) {
         PyMem_Free(result);
         return -1;
     }
+    if (!result->key) {
+        Py_INCREF(key);
+        result->key = key;
+    }
 
     result->find.cdb32 = cdb32;
     result->find.key_num = 0;
     result->find.key_disk = 0;
-    result->key = key;
     *result_ = result;
     return 0;
 }
@@ -1720,6 +4066,24 @@ cdbx_cdb32_get_iter_destroy(cdbx_cdb32_get_iter_t **self_)
 }
 
 
+/*
+ * Find next value pointer from get-iterator
+ *
+ * Return -1 on error
+ * Return 0 on success (exhausted)
+ * Return 1 on success (found)
+ */
+EXT_LOCAL int
+cdbx_cdb32_get_iter_next_pointer(cdbx_cdb32_get_iter_t *self,
+                                 cdbx_cdb32_pointer_t *value)
+{
+    if (-1 == cdb32_find(&self->find, value))
+        LCOV_EXCL_LINE_RETURN(-1);
+
+    return !!value->offset;
+}
+
+
 /*
  * Get next value from get-iterator
  *
@@ -1730,40 +4094,479 @@ EXT_LOCAL int
 cdbx_cdb32_get_iter_next(cdbx_cdb32_get_iter_t *self, PyObject **value_)
 {
     cdbx_cdb32_pointer_t value;
-    PyObject *result;
-    Py_ssize_t vsize;
 
-    if (-1 == cdb32_find(&self->find, &value))
-        LCOV_EXCL_LINE_RETURN(-1);
-    if (!value.offset) {
+    switch (cdbx_cdb32_get_iter_next_pointer(self, &value)) {
+    /* LCOV_EXCL_START */
+    case -1:
+        return -1;
+    /* LCOV_EXCL_STOP */
+
+    case 0:
         *value_ = NULL;
         return 0;
     }
 
-    vsize = (Py_ssize_t)value.length;
-    if (vsize < 0 || (cdb32_len_t)vsize != value.length) {
-        /* LCOV_EXCL_START */
+    return cdbx_cdb32_read(self->find.cdb32, &value, value_);
+}
 
-        PyErr_SetString(PyExc_OverflowError, "Value is too long");
-        return -1;
 
-        /* LCOV_EXCL_STOP */
+/*
+ * ************************************************************************
+ * Sampling
+ * ************************************************************************
+ */
+
+#define CDB32_SAMPLE_TRIALS(k) (16 * (size_t)(k) + 1024)
+
+/* Sample state */
+typedef struct {
+    cdbx_cdb32_t *cdb32;
+    cdbx_cdb32_pointer_t tables[256];
+    uint64_t cum[257];  /* cumulative slot counts */
+    uint64_t rng;
+    uint64_t *seen;  /* open addressing set of sampled slots (+ 1) */
+    size_t seen_mask;
+    int unique;
+} cdb32_sample_t;
+
+
+/*
+ * splitmix64
+ */
+static uint64_t
+cdb32_sample_rand(cdb32_sample_t *self)
+{
+    uint64_t z = (self->rng += UINT64_C(0x9E3779B97F4A7C15));
+
+    z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+    return z ^ (z >> 31);
+}
+
+
+/*
+ * Uniform random number in [0, bound) (bound > 0)
+ */
+static uint64_t
+cdb32_sample_below(cdb32_sample_t *self, uint64_t bound)
+{
+    uint64_t r, limit = UINT64_MAX - (UINT64_MAX % bound);
+
+    do {
+        r = cdb32_sample_rand(self);
+    } while (r >= limit);
+
+    return r % bound;
+}
+
+
+/*
+ * Check for a sampled slot and remember it (if insert is true)
+ *
+ * Return 0 if it was already sampled
+ * Return 1 otherwise
+ */
+static int
+cdb32_sample_mark(cdb32_sample_t *self, uint64_t slot, int insert)
+{
+    size_t idx = (size_t)((slot + 1) * UINT64_C(0x9E3779B97F4A7C15))
+                 & self->seen_mask;
+
+    while (self->seen[idx]) {
+        if (self->seen[idx] == slot + 1)
+            return 0;
+        idx = (idx + 1) & self->seen_mask;
+    }
+    if (insert)
+        self->seen[idx] = slot + 1;
+
+    return 1;
+}
+
+
+/*
+ * Resolve a slot number (over all tables) to a record
+ *
+ * Return -1 on error
+ * Return 0 if the slot is empty or (unique) not the first record of its key
+ * Return 1 if a record was found
+ */
+static int
+cdb32_sample_slot(cdb32_sample_t *self, uint64_t slot,
+                  cdbx_cdb32_pointer_t *result)
+{
+    cdbx_cdb32_t *cdb32 = self->cdb32;
+    cdb32_slot_t entry = {0};
+    cdb32_dlength_t dlength = {0};
+    cdb32_find_t find;
+    cdbx_cdb32_pointer_t value;
+    size_t low = 0, high = 256, mid;
+    int res;
+
+    /* Find the table: cum[low] <= slot < cum[low + 1] */
+    while (high - low > 1) {
+        mid = (low + high) / 2;
+        if (self->cum[mid] <= slot)
+            low = mid;
+        else
+            high = mid;
     }
 
-    if (!(result = PyBytes_FromStringAndSize(NULL, vsize)))
+    CDB32_READ_SLOT(cdb32, self->tables[low].offset
+                    + CDB32_OFFSET_SLOT((cdb32_off_t)(slot - self->cum[low])),
+                    &entry, res);
+    if (-1 == res)
         LCOV_EXCL_LINE_RETURN(-1);
+    if (!entry.offset)
+        return 0;
 
-    if (-1 == cdb32_read(self->find.cdb32, value.offset,
-                         (cdb32_len_t)PyBytes_GET_SIZE(result),
-                         (cdb32_key_t *)PyBytes_AS_STRING(result))) {
+    CDB32_READ_DLENGTH(cdb32, entry.offset, &dlength, res);
+    if (-1 == res)
+        LCOV_EXCL_LINE_RETURN(-1);
+    if (entry.offset < CDB32_SIZEOF_TABLE
+        || (uint64_t)entry.offset + CDB32_SIZEOF_DLENGTH + dlength.klen
+           + dlength.dlen > (uint64_t)cdb32->sentinel) {
         /* LCOV_EXCL_START */
 
-        Py_DECREF(result);
+        PyErr_SetString(PyExc_IOError, "Format Error");
         return -1;
 
         /* LCOV_EXCL_STOP */
     }
 
-    *value_ = result;
+    result[0].offset = entry.offset + CDB32_SIZEOF_DLENGTH;
+    result[0].length = dlength.klen;
+    result[1].offset = result[0].offset + dlength.klen;
+    result[1].length = dlength.dlen;
+
+    if (self->unique) {
+        find.cdb32 = cdb32;
+        find.key_num = 0;
+        find.length = dlength.klen;
+        find.key_disk = result[0].offset;
+        if (-1 == cdb32_find(&find, &value))
+            LCOV_EXCL_LINE_RETURN(-1);
+        if (value.offset != result[1].offset)
+            return 0;
+    }
+
+    return 1;
+}
+
+
+/*
+ * Draw a random sample of up to k records
+ *
+ * Every record is a non-empty slot in one of the hash tables. Random slots
+ * are picked across all tables (i.e. weighted by table length) until k
+ * distinct records are found. If that takes too many trials (k is close to
+ * the number of records or, with unique, many records are duplicate keys),
+ * the missing records are drawn by reservoir sampling over all slots
+ * instead. Fewer than k records are returned only if the CDB does not
+ * contain more.
+ *
+ * The result is an array of key/value pointer pairs (PyMem_Malloc'd) in
+ * random order.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_sample(cdbx_cdb32_t *self, Py_ssize_t k, uint64_t seed,
+                  int unique, cdbx_cdb32_pointer_t **result_,
+                  Py_ssize_t *count_)
+{
+    cdb32_sample_t sample;
+    cdbx_cdb32_pointer_t *result = NULL, pair[2];
+    uint64_t total, slot;
+    size_t count = 0, trials, size, idx, need, found;
+    cdb32_off_t offset;
+    int res;
+
+    memset(&sample, 0, sizeof sample);
+    sample.cdb32 = self;
+    sample.rng = seed;
+    sample.unique = unique;
+
+    if (!self->sentinel) {
+        CDB32_READ_SENTINEL(self, res);
+        if (-1 == res)
+            LCOV_EXCL_LINE_RETURN(-1);
+    }
+
+    for (idx = 0, offset = 0; idx < 256;
+         ++idx, offset += CDB32_SIZEOF_TPTR) {
+        CDB32_READ_POINTER(self, offset, &sample.tables[idx], res);
+        if (-1 == res)
+            LCOV_EXCL_LINE_RETURN(-1);
+        sample.cum[idx + 1] = sample.cum[idx] + sample.tables[idx].length;
+    }
+    total = sample.cum[256];
+
+    /* There are at least twice as many slots as records */
+    if ((uint64_t)k > total / 2)
+        k = (Py_ssize_t)(total / 2);
+    if (!(result = PyMem_Malloc(((size_t)k + 1) * 2 * sizeof *result)))
+        goto error_nomem;
+
+    if (k > 0) {
+        for (size = 4; size < (size_t)k * 2; size <<= 1)
+            ;
+        if (!(sample.seen = PyMem_Malloc(size * sizeof *sample.seen)))
+            goto error_nomem;
+        memset(sample.seen, 0, size * sizeof *sample.seen);
+        sample.seen_mask = size - 1;
+    }
+
+    /* Random trials */
+    for (trials = CDB32_SAMPLE_TRIALS(k); count < (size_t)k && trials;
+         --trials) {
+        slot = cdb32_sample_below(&sample, total);
+        if (!cdb32_sample_mark(&sample, slot, 0))
+            continue;
+        if (-1 == (res = cdb32_sample_slot(&sample, slot,
+                                           &result[count * 2])))
+            LCOV_EXCL_LINE_GOTO(error);
+        if (res) {
+            cdb32_sample_mark(&sample, slot, 1);
+            ++count;
+        }
+    }
+
+    /* Not enough: reservoir sampling over the remaining records, which
+     * needs no memory beyond the result */
+    if (count < (size_t)k) {
+        need = (size_t)k - count;
+        for (found = 0, slot = 0; slot < total; ++slot) {
+            if (!cdb32_sample_mark(&sample, slot, 0))
+                continue;
+            if (-1 == (res = cdb32_sample_slot(&sample, slot, pair)))
+                LCOV_EXCL_LINE_GOTO(error);
+            if (!res)
+                continue;
+
+            idx = found < need ? found
+                : (size_t)cdb32_sample_below(&sample, (uint64_t)found + 1);
+            ++found;
+            if (idx < need) {
+                result[(count + idx) * 2] = pair[0];
+                result[(count + idx) * 2 + 1] = pair[1];
+            }
+        }
+        if (found < need)
+            need = found;
+
+        /* The reservoir is still partly in file order: shuffle it */
+        for (idx = need; idx > 1; --idx) {
+            size = count + (size_t)cdb32_sample_below(&sample,
+                                                      (uint64_t)idx);
+            pair[0] = result[size * 2];
+            pair[1] = result[size * 2 + 1];
+            result[size * 2] = result[(count + idx - 1) * 2];
+            result[size * 2 + 1] = result[(count + idx - 1) * 2 + 1];
+            result[(count + idx - 1) * 2] = pair[0];
+            result[(count + idx - 1) * 2 + 1] = pair[1];
+        }
+        count += need;
+    }
+
+    PyMem_Free(sample.seen);
+    *result_ = result;
+    *count_ = (Py_ssize_t)count;
+    return 0;
+
+error_nomem:
+    PyErr_NoMemory();
+error:
+    PyMem_Free(sample.seen);
+    PyMem_Free(result);
+    return -1;
+}
+
+
+/*
+ * ************************************************************************
+ * Raw value locations
+ * ************************************************************************
+ */
+
+#define CDB32_COALESCE_GAP (4096)  /* max gap between merged ranges */
+#define CDB32_COALESCE_MAX (1 << 20)  /* max size of a merged read */
+
+/* Entry for read_many_at */
+typedef struct {
+    cdbx_cdb32_pointer_t pointer;
+    Py_ssize_t idx;
+} cdb32_location_t;
+
+
+/*
+ * Check an (offset, length) location against the data region
+ *
+ * Return -1 on error (ValueError)
+ * Return 0 on success
+ */
+static int
+cdb32_location(cdbx_cdb32_t *self, uint64_t offset, uint64_t length,
+               cdbx_cdb32_pointer_t *pointer)
+{
+    int res;
+
+    if (!self->sentinel) {
+        CDB32_READ_SENTINEL(self, res);
+        if (-1 == res)
+            LCOV_EXCL_LINE_RETURN(-1);
+    }
+
+    if (offset < CDB32_SIZEOF_TABLE || offset > self->sentinel
+        || length > (uint64_t)self->sentinel - offset) {
+        PyErr_SetString(PyExc_ValueError, "Location out of bounds");
+        return -1;
+    }
+
+    pointer->offset = (cdb32_off_t)offset;
+    pointer->length = (cdb32_len_t)length;
+    return 0;
+}
+
+
+/*
+ * Read raw bytes at a data location
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_read_at(cdbx_cdb32_t *self, uint64_t offset, uint64_t length,
+                   PyObject **result_)
+{
+    cdbx_cdb32_pointer_t pointer;
+
+    if (-1 == cdb32_location(self, offset, length, &pointer))
+        return -1;
+
+    return cdbx_cdb32_read(self, &pointer, result_);
+}
+
+
+/*
+ * Compare locations by offset
+ */
+static int
+cdb32_cmp_location(const void *a_, const void *b_)
+{
+    const cdb32_location_t *a = a_, *b = b_;
+
+    if (a->pointer.offset != b->pointer.offset)
+        return a->pointer.offset < b->pointer.offset ? -1 : 1;
+
+    return a->idx < b->idx ? -1 : (a->idx > b->idx);
+}
+
+
+/*
+ * Read raw bytes at many data locations
+ *
+ * locations contains count (offset, length) pairs. Offset 0 marks a missing
+ * entry, which results in None. result is a list of count items, which is
+ * filled in.
+ *
+ * Without a map, the locations are sorted and nearby ranges are merged into
+ * a single read each, so the file is read sequentially and with fewer calls.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_read_many_at(cdbx_cdb32_t *self, const uint64_t *locations,
+                        Py_ssize_t count, PyObject *result)
+{
+    cdb32_location_t *entries;
+    unsigned char *buf = NULL, *tmp;
+    PyObject *item;
+    cdb32_off_t start, end;
+    size_t size = 0;
+    Py_ssize_t idx, num = 0, first;
+
+    if ((size_t)count > PY_SSIZE_T_MAX / sizeof *entries
+        || !(entries = PyMem_Malloc(((size_t)count + 1) * sizeof *entries))) {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    for (idx = 0; idx < count; ++idx) {
+        if (!locations[idx * 2]) {
+            Py_INCREF(Py_None);
+            PyList_SET_ITEM(result, idx, Py_None);
+            continue;
+        }
+        if (-1 == cdb32_location(self, locations[idx * 2],
+                                 locations[idx * 2 + 1],
+                                 &entries[num].pointer))
+            goto error;
+        entries[num++].idx = idx;
+    }
+
+    if (!self->map)
+        qsort(entries, (size_t)num, sizeof *entries, cdb32_cmp_location);
+
+    for (idx = 0; idx < num; ) {
+        /* Collect a run of nearby ranges */
+        first = idx;
+        start = entries[idx].pointer.offset;
+        end = start + entries[idx].pointer.length;
+        while (!self->map && ++idx < num
+               && (uint64_t)entries[idx].pointer.offset
+                  <= (uint64_t)end + CDB32_COALESCE_GAP
+               && (uint64_t)entries[idx].pointer.offset
+                  + entries[idx].pointer.length
+                  - start <= CDB32_COALESCE_MAX) {
+            if (entries[idx].pointer.offset + entries[idx].pointer.length
+                > end)
+                end = entries[idx].pointer.offset
+                      + entries[idx].pointer.length;
+        }
+        if (self->map)
+            ++idx;
+
+        /* Single ranges are read directly */
+        if (idx - first == 1) {
+            if (-1 == cdbx_cdb32_read(self, &entries[first].pointer, &item))
+                LCOV_EXCL_LINE_GOTO(error);
+            PyList_SET_ITEM(result, entries[first].idx, item);
+            continue;
+        }
+
+        if ((size_t)(end - start) > size) {
+            if (!(tmp = PyMem_Realloc(buf, (size_t)(end - start)))) {
+                /* LCOV_EXCL_START */
+
+                PyErr_NoMemory();
+                goto error;
+
+                /* LCOV_EXCL_STOP */
+            }
+            buf = tmp;
+            size = (size_t)(end - start);
+        }
+        if (-1 == cdb32_read(self, start, end - start, buf))
+            LCOV_EXCL_LINE_GOTO(error);
+
+        for (; first < idx; ++first) {
+            if (!(item = PyBytes_FromStringAndSize(
+                    (char *)buf + (entries[first].pointer.offset - start),
+                    (Py_ssize_t)entries[first].pointer.length)))
+                LCOV_EXCL_LINE_GOTO(error);
+            PyList_SET_ITEM(result, entries[first].idx, item);
+        }
+    }
+
+    PyMem_Free(buf);
+    PyMem_Free(entries);
     return 0;
+
+error:
+    PyMem_Free(buf);
+    PyMem_Free(entries);
+    return -1;
 }
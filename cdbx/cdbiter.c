@@ -17,8 +17,9 @@
 
 #include "cdbx.h"
 
-#define FL_ALL   (1 << 0)
-#define FL_ITEMS (1 << 1)
+#define FL_ALL    (1 << 0)
+#define FL_ITEMS  (1 << 1)
+#define FL_VALUES (1 << 2)
 
 
 /*
@@ -30,6 +31,11 @@ typedef struct {
 
     cdbtype_t *main;  /* CDB instance we're attached to */
     cdbx_cdb32_iter_t *iter;  /* Iter state */
+    PyObject *encoding;  /* codec for keys and values */
+    PyObject *errors;  /* codec error handler */
+
+    Py_ssize_t batch;  /* batch size, 0 for single items */
+    PyObject *pending;  /* partial batch interrupted by an error */
 
     int flags;
 } cdbiter_t;
@@ -39,37 +45,41 @@ typedef struct {
 
 #define CDBIterType_iter PyObject_SelfIter
 
+/*
+ * Find the next key, value or item
+ *
+ * Return NULL on error or if exhausted (without exception set)
+ */
 static PyObject *
-CDBIterType_iternext(cdbiter_t *self)
+cdbiter_next(cdbiter_t *self, cdbx_cdb32_t *cdb32, const char *encoding,
+             const char *errors)
 {
-    cdbx_cdb32_t *cdb32;
     cdbx_cdb32_pointer_t *key_, *value_;
     PyObject *result, *key, *value;
-    int first;
-
-    if (!self->main || !(cdb32 = cdbx_type_get_cdb32(self->main)))
-        return cdbx_raise_closed();
+    int first = 1;
 
+    /* No need to probe for the first occurence if all keys are returned */
     do {
-        if (-1 == cdbx_cdb32_iter_next(self->iter, &key_, &value_, &first))
+        if (-1 == cdbx_cdb32_iter_next(self->iter, &key_, &value_,
+                                       (self->flags & FL_ALL) ? NULL : &first))
             LCOV_EXCL_LINE_RETURN(NULL);
-    } while ((!first && !(self->flags & FL_ALL)) && key_);
+    } while (!first && key_);
 
     if (!key_)
         return NULL;
 
-    if (-1 == cdbx_cdb32_read(cdb32, key_, &result))
-        LCOV_EXCL_LINE_RETURN(NULL);
+    /* Values only: the key is never read */
+    if (-1 == cdbx_cdb32_read_decoded(cdb32,
+                                      (self->flags & FL_VALUES) ? value_ : key_,
+                                      encoding, errors, &result))
+        return NULL;
 
     if (self->flags & FL_ITEMS) {
         key = result;
-        if (-1 == cdbx_cdb32_read(cdb32, value_, &value)) {
-            /* LCOV_EXCL_START */
-
+        if (-1 == cdbx_cdb32_read_decoded(cdb32, value_, encoding, errors,
+                                          &value)) {
             Py_DECREF(key);
             return NULL;
-
-            /* LCOV_EXCL_STOP */
         }
         if (!(result = PyTuple_New(2))) {
             /* LCOV_EXCL_START */
@@ -88,10 +98,96 @@ CDBIterType_iternext(cdbiter_t *self)
 }
 
 
+static PyObject *
+CDBIterType_iternext(cdbiter_t *self)
+{
+    cdbx_cdb32_t *cdb32;
+    PyObject *result, *item;
+    const char *encoding, *errors;
+    int res;
+
+    if (!self->main || !(cdb32 = cdbx_type_get_cdb32(self->main)))
+        return cdbx_raise_closed();
+
+    if (-1 == cdbx_codec_name(self->encoding, &encoding)
+        || -1 == cdbx_codec_name(self->errors, &errors))
+        LCOV_EXCL_LINE_RETURN(NULL);
+
+    if (!self->batch)
+        return cdbiter_next(self, cdb32, encoding, errors);
+
+    /* Collect the next batch in one go */
+    if ((result = self->pending))
+        self->pending = NULL;
+    else if (!(result = PyList_New(0)))
+        LCOV_EXCL_LINE_RETURN(NULL);
+
+    while (PyList_GET_SIZE(result) < self->batch) {
+        if (!(item = cdbiter_next(self, cdb32, encoding, errors))) {
+            if (PyErr_Occurred())
+                goto error;
+            break;
+        }
+        res = PyList_Append(result, item);
+        Py_DECREF(item);
+        if (-1 == res)
+            LCOV_EXCL_LINE_GOTO(error);
+    }
+
+    if (!PyList_GET_SIZE(result)) {
+        Py_DECREF(result);
+        return NULL;
+    }
+
+    return result;
+
+error:
+    /* The failed entry is skipped (as with single items), the others are
+     * not: they're returned as part of the next batch */
+    if (PyList_GET_SIZE(result))
+        self->pending = result;
+    else
+        Py_DECREF(result);
+    return NULL;
+}
+
+
+PyDoc_STRVAR(CDBIterType_cursor__doc__,
+"Resumption token\n\
+\n\
+A ``(start, end)`` tuple of the next record offset and the end of the\n\
+iterated range. Passing it as `start` and `end` to `CDB.items` (or the\n\
+other iterator factories) continues where this iterator stands, even in a\n\
+different process.\n\
+\n\
+:Type: tuple");
+
+static PyObject *
+CDBIterType_cursor(cdbiter_t *self, void *closure)
+{
+    Py_ssize_t pos, end;
+
+    cdbx_cdb32_iter_tell(self->iter, &pos, &end);
+
+    return Py_BuildValue("(nn)", pos, end);
+}
+
+static PyGetSetDef CDBIterType_getset[] = {
+    {"cursor",
+     (getter)CDBIterType_cursor,
+     NULL,
+     CDBIterType_cursor__doc__,
+     NULL},
+
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+
 static int
 CDBIterType_traverse(cdbiter_t *self, visitproc visit, void *arg)
 {
     Py_VISIT((PyObject *)self->main);
+    Py_VISIT(self->pending);
 
     return 0;
 }
@@ -103,6 +199,9 @@ CDBIterType_clear(cdbiter_t *self)
         PyObject_ClearWeakRefs((PyObject *)self);
 
     Py_CLEAR(self->main);
+    Py_CLEAR(self->encoding);
+    Py_CLEAR(self->errors);
+    Py_CLEAR(self->pending);
 
     cdbx_cdb32_iter_destroy(&self->iter);
 
@@ -141,14 +240,20 @@ EXT_LOCAL PyTypeObject CDBIterType = {
     0,                                                  /* tp_richcompare */
     offsetof(cdbiter_t, weakreflist),                   /* tp_weaklistoffset */
     (getiterfunc)CDBIterType_iter,                      /* tp_iter */
-    (iternextfunc)CDBIterType_iternext                  /* tp_iternext */
+    (iternextfunc)CDBIterType_iternext,                 /* tp_iternext */
+    0,                                                  /* tp_methods */
+    0,                                                  /* tp_members */
+    CDBIterType_getset                                  /* tp_getset */
 };
 
 /*
- * Create new key iterator object
+ * Create new key, items or values iterator object
+ *
+ * If batch is > 0, lists of up to batch entries are returned per step.
  */
 EXT_LOCAL PyObject *
-cdbx_iter_new(cdbtype_t *cdb, int items, int all)
+cdbx_iter_new(cdbtype_t *cdb, int what, int all, Py_ssize_t batch,
+              PyObject *encoding, PyObject *errors)
 {
     cdbiter_t *self;
     cdbx_cdb32_t *cdb32;
@@ -159,6 +264,13 @@ cdbx_iter_new(cdbtype_t *cdb, int items, int all)
     self->main = NULL;
     self->iter = NULL;
     self->flags = 0;
+    self->batch = batch;
+    self->pending = NULL;
+
+    Py_INCREF(encoding);
+    self->encoding = encoding;
+    Py_INCREF(errors);
+    self->errors = errors;
 
     if (!(cdb32 = cdbx_type_get_cdb32(cdb))) {
         /* LCOV_EXCL_START */
@@ -176,8 +288,10 @@ cdbx_iter_new(cdbtype_t *cdb, int items, int all)
     self->main = cdb;
     if (all)
         self->flags |= FL_ALL;
-    if (items)
+    if (what == CDBX_ITER_ITEMS)
         self->flags |= FL_ITEMS;
+    else if (what == CDBX_ITER_VALUES)
+        self->flags |= FL_VALUES;
 
     return (PyObject *)self;
 
@@ -189,4 +303,18 @@ error:
 /* LCOV_EXCL_STOP */
 }
 
+/*
+ * Restrict the iterator to the records between start and end
+ *
+ * -1 selects the beginning or the end of the data, respectively.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_iter_range(PyObject *self, Py_ssize_t start, Py_ssize_t end)
+{
+    return cdbx_cdb32_iter_range(((cdbiter_t *)self)->iter, start, end);
+}
+
 /* --------------------------- END CDBIterType --------------------------- */
@@ -17,6 +17,12 @@
 
 #include "cdbx.h"
 
+#include <fcntl.h>
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
 #define FL_FP_OPENED (1 << 0)
 #define FL_DESTROY   (1 << 1)
 #define FL_CLOSED    (1 << 2)
@@ -25,6 +31,9 @@
 #define FL_FP_CLOSE  (1 << 5)
 #define FL_MMAP_SET  (1 << 6)
 #define FL_MMAP_VAL  (1 << 7)
+#define FL_ATOMIC    (1 << 8)
+#define FL_SYNC_NONE (1 << 9)
+#define FL_SYNC_DATA (1 << 10)
 
 /*
  * Object structure for CDBMakerType
@@ -38,12 +47,186 @@ typedef struct {
     PyObject *cdb_cls;
     PyObject *fp;
     PyObject *filename;
+    PyObject *target;  /* final filename (atomic) */
     int flags;
 } cdbmaker_t;
 
 static PyObject *
 CDBMakerType_close(cdbmaker_t *);
 
+
+/*
+ * Return maker32 struct member (NULL if closed or committed)
+ */
+EXT_LOCAL cdbx_cdb32_maker_t *
+cdbx_maker_get_maker32(PyObject *self)
+{
+    if (((cdbmaker_t *)self)->flags & (FL_CLOSED | FL_COMMITTED | FL_ERROR))
+        return NULL;
+
+    return ((cdbmaker_t *)self)->maker32;
+}
+
+/*
+ * Sync the committed file according to the durability policy
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+static int
+cdbmaker_sync(cdbmaker_t *self)
+{
+    int fd = cdbx_cdb32_maker_fileno(self->maker32), res;
+
+    if (self->flags & FL_SYNC_NONE)
+        return 0;
+
+    Py_BEGIN_ALLOW_THREADS
+#ifdef HAVE_FDATASYNC
+    if (self->flags & FL_SYNC_DATA)
+        res = fdatasync(fd);
+    else
+#endif
+        res = fsync(fd);
+    Py_END_ALLOW_THREADS
+
+    if (-1 == res) {
+        PyErr_SetFromErrno(PyExc_IOError);  /* LCOV_EXCL_LINE */
+        return -1;                          /* LCOV_EXCL_LINE */
+    }
+
+    return 0;
+}
+
+
+/*
+ * Move the temporary file to its final name (and sync the directory)
+ *
+ * Once renamed, the file is never destroyed by the maker anymore.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+static int
+cdbmaker_publish(cdbmaker_t *self)
+{
+    const char *target = PyBytes_AS_STRING(self->target), *slash;
+    PyObject *dirname;
+    int fd, res;
+
+    if (-1 == rename(PyBytes_AS_STRING(self->filename), target)) {
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_IOError, self->target);
+        return -1;
+    }
+    self->flags &= ~FL_DESTROY;
+    Py_DECREF(self->filename);
+    Py_INCREF(self->target);
+    self->filename = self->target;
+
+    if (self->flags & (FL_SYNC_NONE | FL_SYNC_DATA))
+        return 0;
+
+    slash = strrchr(target, '/');
+    if (!(dirname = PyBytes_FromStringAndSize(
+            target, slash > target ? slash - target : 1)))
+        LCOV_EXCL_LINE_RETURN(-1);
+
+    Py_BEGIN_ALLOW_THREADS
+    if (-1 != (fd = open(PyBytes_AS_STRING(dirname),
+                         O_RDONLY | O_CLOEXEC))) {
+        res = fsync(fd);
+        close(fd);
+    }
+    else {
+        res = -1;  /* LCOV_EXCL_LINE */
+    }
+    Py_END_ALLOW_THREADS
+
+    if (-1 == res) {
+        /* LCOV_EXCL_START */
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_IOError, dirname);
+        Py_DECREF(dirname);
+        return -1;
+        /* LCOV_EXCL_STOP */
+    }
+    Py_DECREF(dirname);
+
+    return 0;
+}
+
+
+/*
+ * Create a temporary file next to the target and store it as fp/filename
+ *
+ * The file is created like a regular one (mode 0666 minus umask), so the
+ * published CDB gets the usual permissions.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+static int
+cdbmaker_open_atomic(cdbmaker_t *self, PyObject *file_, int *fd_)
+{
+    static unsigned long counter = 0;
+    const char *target, *slash;
+    PyObject *dirname, *filename, *tmp;
+    int fd, attempt;
+
+    if (!(self->target = cdbx_fs_path(file_))) {
+        if (PyErr_ExceptionMatches(PyExc_TypeError)) {
+            PyErr_Clear();
+            PyErr_SetString(PyExc_ValueError, "atomic requires a filename");
+        }
+        return -1;
+    }
+
+    target = PyBytes_AS_STRING(self->target);
+    slash = strrchr(target, '/');  /* cdbx_fs_path makes it absolute */
+    if (!(dirname = PyBytes_FromStringAndSize(target, slash - target)))
+        LCOV_EXCL_LINE_RETURN(-1);
+
+    for (attempt = 0; ; ++attempt) {
+        if (!(filename = PyBytes_FromFormat(
+                "%s/.%s.%ld-%lu.tmp", PyBytes_AS_STRING(dirname), slash + 1,
+                (long)getpid(), ++counter))) {
+            Py_DECREF(dirname);  /* LCOV_EXCL_LINE */
+            return -1;           /* LCOV_EXCL_LINE */
+        }
+
+        if (-1 != (fd = open(PyBytes_AS_STRING(filename),
+                             O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0666)))
+            break;
+        if (errno != EEXIST || attempt >= 100) {
+            PyErr_SetFromErrnoWithFilenameObject(PyExc_IOError, filename);
+            Py_DECREF(filename);
+            Py_DECREF(dirname);
+            return -1;
+        }
+        Py_DECREF(filename);  /* LCOV_EXCL_LINE */
+    }
+    Py_DECREF(dirname);
+
+    if (!(tmp = PyLong_FromLong(fd)))
+        LCOV_EXCL_LINE_GOTO(error_fd);
+    self->fp = cdbx_file_open(tmp, "w+b");
+    Py_DECREF(tmp);
+    if (!self->fp)
+        LCOV_EXCL_LINE_GOTO(error_fd);
+
+    self->filename = filename;
+    self->flags |= FL_FP_OPENED | FL_ATOMIC;
+    *fd_ = fd;
+    return 0;
+
+/* LCOV_EXCL_START */
+error_fd:
+    close(fd);
+    cdbx_unlink(filename);
+    Py_DECREF(filename);
+    return -1;
+/* LCOV_EXCL_STOP */
+}
+
 /* -------------------------- BEGIN CDBMakerType ------------------------- */
 
 PyDoc_STRVAR(CDBMakerType_commit__doc__,
@@ -76,14 +259,15 @@ CDBMakerType_commit(cdbmaker_t *self, PyObject *args, PyObject *kwds)
     }
     self->flags |= FL_COMMITTED;
 
-    if (-1 == fsync(cdbx_cdb32_maker_fileno(self->maker32))) {
-        /* LCOV_EXCL_START */
+    if (-1 == cdbmaker_sync(self))
+        LCOV_EXCL_LINE_RETURN(NULL);
 
-        PyErr_SetFromErrno(PyExc_IOError);
+    if ((self->flags & FL_ATOMIC) && -1 == cdbmaker_publish(self))
         return NULL;
 
-        /* LCOV_EXCL_STOP */
-    }
+    /* The file is complete and in place, a failing open below must not
+     * destroy it */
+    self->flags &= ~FL_DESTROY;
 
     tmp = (self->flags & FL_MMAP_SET) ?
         ((self->flags & FL_MMAP_VAL) ? Py_True : Py_False) : Py_None;
@@ -103,9 +287,8 @@ CDBMakerType_commit(cdbmaker_t *self, PyObject *args, PyObject *kwds)
                                        !!(self->flags & FL_FP_CLOSE), tmp);
     }
     if (!result)
-        LCOV_EXCL_LINE_RETURN(NULL);
+        return NULL;
 
-    self->flags &= ~FL_DESTROY;
     if (close)
         self->flags |= FL_FP_CLOSE;
     else
@@ -141,15 +324,8 @@ Parameters:\n\
     Value");
 
 static PyObject *
-CDBMakerType_add(cdbmaker_t *self, PyObject *args, PyObject *kwds)
+cdbmaker_add(cdbmaker_t *self, PyObject *key_, PyObject *value_)
 {
-    static char *kwlist[] = {"key", "value", NULL};
-    PyObject *key_, *value_;
-
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO", kwlist,
-                                     &key_, &value_))
-        return NULL;
-
     if (self->flags & (FL_CLOSED | FL_COMMITTED | FL_ERROR))
         return cdbx_raise_closed();
 
@@ -161,6 +337,35 @@ CDBMakerType_add(cdbmaker_t *self, PyObject *args, PyObject *kwds)
     Py_RETURN_NONE;
 }
 
+#ifdef CDBX_FASTCALL
+static PyObject *
+CDBMakerType_add(cdbmaker_t *self, PyObject *const *args, Py_ssize_t nargs,
+                 PyObject *kwnames)
+{
+    static const char * const kwlist[] = {"key", "value", NULL};
+    PyObject *argv[2] = {NULL, NULL};
+
+    if (-1 == cdbx_parse_fastcall("add", args, nargs, kwnames, kwlist, 2,
+                                  argv))
+        return NULL;
+
+    return cdbmaker_add(self, argv[0], argv[1]);
+}
+#else
+static PyObject *
+CDBMakerType_add(cdbmaker_t *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"key", "value", NULL};
+    PyObject *key_, *value_;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO", kwlist,
+                                     &key_, &value_))
+        return NULL;
+
+    return cdbmaker_add(self, key_, value_);
+}
+#endif
+
 
 PyDoc_STRVAR(CDBMakerType_close__doc__,
 "close(self)\n\
@@ -250,7 +455,7 @@ static PyMethodDef CDBMakerType_methods[] = {
      CDBMakerType_fileno__doc__},
 
     {"add",
-    EXT_CFUNC(CDBMakerType_add),              METH_KEYWORDS | METH_VARARGS,
+    EXT_CFUNC(CDBMakerType_add),              CDBX_METH_KEYWORDS,
      CDBMakerType_add__doc__},
 
     {"commit",
@@ -267,6 +472,7 @@ CDBMakerType_traverse(cdbmaker_t *self, visitproc visit, void *arg)
 {
     Py_VISIT(self->fp);
     Py_VISIT(self->filename);
+    Py_VISIT(self->target);
     Py_VISIT(self->cdb_cls);
 
     return 0;
@@ -289,6 +495,7 @@ CDBMakerType_clear(cdbmaker_t *self)
     }
 
     Py_CLEAR(self->filename);
+    Py_CLEAR(self->target);
     Py_CLEAR(self->cdb_cls);
 
     return 0;
@@ -337,27 +544,55 @@ EXT_LOCAL PyTypeObject CDBMakerType = {
 
 /*
  * Create new CDBMaker object
+ *
+ * atomic_ and durability may be NULL (not atomic, full durability).
  */
 EXT_LOCAL PyObject *
 cdbx_maker_new(PyTypeObject *cdb_cls, PyObject *file_, PyObject *close_,
-               PyObject *mmap_)
+               PyObject *mmap_, PyObject *atomic_, const char *durability)
 {
     cdbmaker_t *self;
-    int fd, res;
+    int fd, res, atomic = 0, flags = 0;
+
+    if (atomic_) {
+        switch (PyObject_IsTrue(atomic_)) {
+        case -1: return NULL;
+        case 1: atomic = 1;
+        }
+    }
+
+    if (durability && strcmp(durability, "full")) {
+        if (!strcmp(durability, "none"))
+            flags = FL_SYNC_NONE;
+        else if (!strcmp(durability, "data"))
+            flags = FL_SYNC_DATA;
+        else {
+            PyErr_SetString(PyExc_ValueError,
+                            "durability must be one of 'none', 'data', "
+                            "'full'");
+            return NULL;
+        }
+    }
 
     if (!(self = GENERIC_ALLOC(&CDBMakerType)))
         LCOV_EXCL_LINE_RETURN(NULL);
 
     self->maker32 = NULL;
-    self->flags = FL_CLOSED | FL_DESTROY;
+    self->flags = FL_CLOSED | FL_DESTROY | flags;
     self->cdb_cls = (PyObject *)cdb_cls;
     Py_INCREF(self->cdb_cls);
 
-    if (-1 == cdbx_obj_as_fd(file_, "w+b", &self->filename, &self->fp,
-                             &res, &fd))
-        goto error;
-    if (res)
-        self->flags |= FL_FP_OPENED;
+    if (atomic) {
+        if (-1 == cdbmaker_open_atomic(self, file_, &fd))
+            goto error;
+    }
+    else {
+        if (-1 == cdbx_obj_as_fd(file_, "w+b", &self->filename, &self->fp,
+                                 &res, &fd))
+            goto error;
+        if (res)
+            self->flags |= FL_FP_OPENED;
+    }
     self->flags &= ~FL_CLOSED;
 
     if (close_) {
@@ -0,0 +1,761 @@
+/*
+ * Copyright 2016 - 2025
+ * Andr\xe9 Malo or his licensors, as applicable
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cdbx.h"
+
+#define CDBOVERLAY_MIN_TABLE (16)
+
+/*
+ * Overlay entry
+ */
+typedef struct {
+    PyObject *key;    /* bytes */
+    PyObject *value;  /* bytes or NULL (deleted) */
+    uint32_t hash;    /* cdb32 hash of the key */
+} cdboverlay_entry_t;
+
+/*
+ * Object structure for CDBOverlayType
+ */
+typedef struct {
+    PyObject_HEAD
+    PyObject *weakreflist;
+
+    PyObject *cdb;  /* base CDB */
+
+    cdboverlay_entry_t *entries;  /* in insertion order */
+    Py_ssize_t num_entries;
+    Py_ssize_t max_entries;
+
+    Py_ssize_t *table;  /* entry index + 1 (0 = free), linear probing */
+    size_t mask;        /* table size - 1 */
+} cdboverlay_t;
+
+/*
+ * Base lookup state
+ */
+typedef struct {
+    cdbx_cdb32_t *cdb32;
+    PyObject *result;  /* the value or a list of values (all) */
+    int all;
+    int found;
+} cdboverlay_lookup_t;
+
+
+/* ------------------------ BEGIN Helper Functions ----------------------- */
+
+/*
+ * Find the table slot of a key
+ *
+ * The slot either points to the key's entry or is free.
+ */
+static Py_ssize_t *
+cdboverlay_slot(cdboverlay_t *self, const unsigned char *key, size_t length,
+                uint32_t hash)
+{
+    cdboverlay_entry_t *entry;
+    Py_ssize_t *slot;
+    size_t idx;
+
+    for (idx = (hash ^ (hash >> 16)) & self->mask; ;
+         idx = (idx + 1) & self->mask) {
+        if (!*(slot = &self->table[idx]))
+            return slot;
+
+        entry = &self->entries[*slot - 1];
+        if (entry->hash == hash
+            && (size_t)PyBytes_GET_SIZE(entry->key) == length
+            && !memcmp(PyBytes_AS_STRING(entry->key), key, length))
+            return slot;
+    }
+}
+
+
+/*
+ * Find the entry of a key (or NULL)
+ */
+static cdboverlay_entry_t *
+cdboverlay_find(cdboverlay_t *self, PyObject *key, uint32_t hash)
+{
+    Py_ssize_t *slot;
+
+    if (!self->table)
+        return NULL;
+
+    slot = cdboverlay_slot(self, (unsigned char *)PyBytes_AS_STRING(key),
+                           (size_t)PyBytes_GET_SIZE(key), hash);
+
+    return *slot ? &self->entries[*slot - 1] : NULL;
+}
+
+
+/*
+ * Add a new entry (stealing the references to key and value)
+ *
+ * The key must not exist in the overlay yet.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+static int
+cdboverlay_insert(cdboverlay_t *self, PyObject *key, PyObject *value,
+                  uint32_t hash)
+{
+    cdboverlay_entry_t *entries, *entry;
+    Py_ssize_t *table, idx;
+    size_t size;
+
+    if (self->num_entries == self->max_entries) {
+        idx = self->max_entries ? self->max_entries * 2 : 8;
+        if (!(entries = PyMem_Realloc(self->entries,
+                                      (size_t)idx * sizeof *entries)))
+            LCOV_EXCL_LINE_GOTO(error_nomem);
+        self->entries = entries;
+        self->max_entries = idx;
+    }
+
+    /* Keep the table at most half full */
+    size = self->table ? self->mask + 1 : 0;
+    if ((size_t)(self->num_entries + 1) * 2 > size) {
+        size = size ? size * 2 : CDBOVERLAY_MIN_TABLE;
+        if (!(table = PyMem_Malloc(size * sizeof *table)))
+            LCOV_EXCL_LINE_GOTO(error_nomem);
+        memset(table, 0, size * sizeof *table);
+
+        PyMem_Free(self->table);
+        self->table = table;
+        self->mask = size - 1;
+        for (idx = 0; idx < self->num_entries; ++idx) {
+            entry = &self->entries[idx];
+            *cdboverlay_slot(self, (unsigned char *)PyBytes_AS_STRING(
+                                 entry->key),
+                             (size_t)PyBytes_GET_SIZE(entry->key),
+                             entry->hash) = idx + 1;
+        }
+    }
+
+    entry = &self->entries[self->num_entries++];
+    entry->key = key;
+    entry->value = value;
+    entry->hash = hash;
+    *cdboverlay_slot(self, (unsigned char *)PyBytes_AS_STRING(key),
+                     (size_t)PyBytes_GET_SIZE(key), hash) = self->num_entries;
+
+    return 0;
+
+/* LCOV_EXCL_START */
+error_nomem:
+    Py_DECREF(key);
+    Py_XDECREF(value);
+    PyErr_NoMemory();
+    return -1;
+/* LCOV_EXCL_STOP */
+}
+
+
+/*
+ * Return the base's cdb32 or raise an exception
+ */
+static cdbx_cdb32_t *
+cdboverlay_base(cdboverlay_t *self)
+{
+    cdbx_cdb32_t *cdb32;
+
+    if (!(cdb32 = cdbx_type_get_cdb32((cdbtype_t *)self->cdb)))
+        cdbx_raise_closed();
+
+    return cdb32;
+}
+
+
+/*
+ * Visit a value found in the base
+ */
+static int
+cdboverlay_visit(void *lookup_, Py_ssize_t idx, int first,
+                 cdbx_cdb32_pointer_t *value)
+{
+    cdboverlay_lookup_t *lookup = lookup_;
+    PyObject *item;
+    int res;
+
+    (void)idx;
+    (void)first;
+
+    lookup->found = 1;
+    if (!lookup->result)
+        return CDBX_VISIT_STOP;
+
+    if (-1 == cdbx_cdb32_read(lookup->cdb32, value, &item))
+        LCOV_EXCL_LINE_RETURN(-1);
+
+    if (!lookup->all) {
+        Py_DECREF(lookup->result);
+        lookup->result = item;
+        return CDBX_VISIT_STOP;
+    }
+
+    res = PyList_Append(lookup->result, item);
+    Py_DECREF(item);
+    if (-1 == res)
+        LCOV_EXCL_LINE_RETURN(-1);
+
+    return CDBX_VISIT_NEXT_VALUE;
+}
+
+
+/*
+ * Look up a key, first in the overlay, then in the base
+ *
+ * If result_ is NULL, only the existence is checked.
+ *
+ * Return -1 on error
+ * Return 0 if not found
+ * Return 1 if found
+ */
+static int
+cdboverlay_lookup(cdboverlay_t *self, PyObject *key, int all,
+                  PyObject **result_)
+{
+    cdboverlay_lookup_t lookup;
+    cdboverlay_entry_t *entry;
+    PyObject *bkey;
+    uint32_t hash;
+    int res;
+
+    if (result_)
+        *result_ = NULL;
+
+    if (-1 == cdbx_cdb32_bytes(key, &bkey, &hash))
+        return -1;
+
+    if ((entry = cdboverlay_find(self, bkey, hash))) {
+        Py_DECREF(bkey);
+        if (!entry->value)
+            return 0;
+
+        if (result_) {
+            if (all) {
+                if (!(*result_ = PyList_New(1)))
+                    LCOV_EXCL_LINE_RETURN(-1);
+                Py_INCREF(entry->value);
+                PyList_SET_ITEM(*result_, 0, entry->value);
+            }
+            else {
+                Py_INCREF(entry->value);
+                *result_ = entry->value;
+            }
+        }
+        return 1;
+    }
+
+    if (!(lookup.cdb32 = cdboverlay_base(self)))
+        goto error_key;
+
+    lookup.all = all;
+    lookup.found = 0;
+    lookup.result = NULL;
+    if (result_) {
+        if (all)
+            lookup.result = PyList_New(0);
+        else {
+            Py_INCREF(Py_None);
+            lookup.result = Py_None;
+        }
+        if (!lookup.result)
+            LCOV_EXCL_LINE_GOTO(error_key);
+    }
+
+    res = cdbx_cdb32_find_stack(&lookup.cdb32, 1, bkey, cdboverlay_visit,
+                                &lookup);
+    Py_DECREF(bkey);
+    if (-1 == res) {
+        Py_XDECREF(lookup.result);  /* LCOV_EXCL_LINE */
+        return -1;                  /* LCOV_EXCL_LINE */
+    }
+
+    if (result_)
+        *result_ = lookup.result;
+    return lookup.found;
+
+error_key:
+    Py_DECREF(bkey);
+    return -1;
+}
+
+
+/*
+ * Skip base records with keys in the overlay (copy callback)
+ */
+static int
+cdboverlay_keep(void *self_, const unsigned char *key, uint32_t length,
+                uint32_t hash)
+{
+    cdboverlay_t *self = self_;
+
+    if (!self->table)
+        return 1;
+
+    return !*cdboverlay_slot(self, key, (size_t)length, hash);
+}
+
+/* ------------------------- END Helper Functions ------------------------ */
+
+/* ------------------------- BEGIN CDBOverlayType ------------------------ */
+
+PyDoc_STRVAR(CDBOverlayType_get__doc__,
+"get(self, key, default=None, all=False)\n\
+\n\
+Return value(s) for a key\n\
+\n\
+The overlay is checked first, the base CDB afterwards. If `key` is not\n\
+found (or deleted), `default` is returned.\n\
+\n\
+Note that in case of a unicode key, it will be transformed to a byte string\n\
+using the latin-1 encoding.\n\
+\n\
+Parameters:\n\
+  key (bytes):\n\
+    Key to lookup\n\
+\n\
+  default:\n\
+    Default value to pass back if the key was not found\n\
+\n\
+  all (bool):\n\
+    Return all values as a list instead of only the first? Default: False\n\
+\n\
+Returns:\n\
+  bytes or list: The value(s) or `default`");
+
+static PyObject *
+CDBOverlayType_get(cdboverlay_t *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"key", "default", "all", NULL};
+    PyObject *key_, *default_ = Py_None, *all_ = NULL, *result = NULL;
+    int all = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|OO", kwlist,
+                                     &key_, &default_, &all_))
+        return NULL;
+
+    if (all_) {
+        switch (PyObject_IsTrue(all_)) {
+        case -1: return NULL;
+        case 1: all = 1;
+        }
+    }
+
+    switch (cdboverlay_lookup(self, key_, all, &result)) {
+    case -1:
+        return NULL;
+
+    case 0:
+        Py_XDECREF(result);
+        Py_INCREF(default_);
+        return default_;
+    }
+
+    return result;
+}
+
+
+static PyObject *
+CDBOverlayType_getitem(cdboverlay_t *self, PyObject *key)
+{
+    PyObject *result = NULL;
+
+    switch (cdboverlay_lookup(self, key, 0, &result)) {
+    case -1:
+        return NULL;
+
+    case 0:
+        Py_XDECREF(result);
+        PyErr_SetObject(PyExc_KeyError, key);
+        return NULL;
+    }
+
+    return result;
+}
+
+
+static int
+CDBOverlayType_setitem(cdboverlay_t *self, PyObject *key, PyObject *value)
+{
+    cdboverlay_entry_t *entry;
+    cdbx_cdb32_t *cdb32;
+    PyObject *bkey, *bvalue = NULL;
+    uint32_t hash;
+    int res;
+
+    if (-1 == cdbx_cdb32_bytes(key, &bkey, &hash))
+        return -1;
+
+    if (value && -1 == cdbx_cdb32_bytes(value, &bvalue, NULL)) {
+        Py_DECREF(bkey);
+        return -1;
+    }
+
+    if ((entry = cdboverlay_find(self, bkey, hash))) {
+        Py_DECREF(bkey);
+        if (!value && !entry->value) {
+            PyErr_SetObject(PyExc_KeyError, key);
+            return -1;
+        }
+        Py_XDECREF(entry->value);
+        entry->value = bvalue;
+        return 0;
+    }
+
+    /* Deleting a key requires it to exist in the base */
+    if (!value) {
+        if (!(cdb32 = cdboverlay_base(self)))
+            goto error_key;
+        if (-1 == (res = cdbx_cdb32_contains(cdb32, bkey)))
+            LCOV_EXCL_LINE_GOTO(error_key);
+        if (!res) {
+            PyErr_SetObject(PyExc_KeyError, key);
+            goto error_key;
+        }
+    }
+
+    return cdboverlay_insert(self, bkey, bvalue, hash);
+
+error_key:
+    Py_DECREF(bkey);
+    return -1;
+}
+
+
+static int
+CDBOverlayType_contains(cdboverlay_t *self, PyObject *key)
+{
+    return cdboverlay_lookup(self, key, 0, NULL);
+}
+
+
+PyDoc_STRVAR(CDBOverlayType_has_key__doc__,
+"has_key(self, key)\n\
+\n\
+Check if the key appears in the overlay or the base CDB\n\
+\n\
+Parameters:\n\
+  key (bytes):\n\
+    Key to look up\n\
+\n\
+Returns:\n\
+  bool: Does the key exist (and is not deleted)?");
+
+static PyObject *
+CDBOverlayType_has_key(cdboverlay_t *self, PyObject *key)
+{
+    switch (CDBOverlayType_contains(self, key)) {
+    case -1: return NULL;
+    case 0: Py_RETURN_FALSE;
+    }
+
+    Py_RETURN_TRUE;
+}
+
+
+static Py_ssize_t
+CDBOverlayType_len(cdboverlay_t *self)
+{
+    cdboverlay_entry_t *entry;
+    cdbx_cdb32_t *cdb32;
+    Py_ssize_t idx, result;
+    int res;
+
+    if (!(cdb32 = cdboverlay_base(self)))
+        return -1;
+    if (-1 == cdbx_cdb32_count_keys(cdb32, &result))
+        LCOV_EXCL_LINE_RETURN(-1);
+
+    for (idx = 0; idx < self->num_entries; ++idx) {
+        entry = &self->entries[idx];
+        if (-1 == (res = cdbx_cdb32_contains(cdb32, entry->key)))
+            LCOV_EXCL_LINE_RETURN(-1);
+
+        if (entry->value && !res)
+            ++result;
+        else if (!entry->value && res)
+            --result;
+    }
+
+    return result;
+}
+
+
+PyDoc_STRVAR(CDBOverlayType_commit_to__doc__,
+"commit_to(self, file, close=False, mmap=None)\n\
+\n\
+Write the base CDB with the overlay applied into a new CDB\n\
+\n\
+The base records are streamed natively in file order. Records of keys,\n\
+which were updated or deleted in the overlay, are skipped. The updated\n\
+records are appended afterwards (in insertion order). The overlay itself\n\
+is left unchanged.\n\
+\n\
+Parameters:\n\
+  file (file or str or int):\n\
+    Either a (binary) python stream, a filename or a file descriptor,\n\
+    like with ``CDB.make``\n\
+\n\
+  close (bool):\n\
+    Close a passed stream or file descriptor, when the new CDB is closed?\n\
+\n\
+  mmap (bool):\n\
+    Passed to the new CDB\n\
+\n\
+Returns:\n\
+  CDB: The new CDB");
+
+static PyObject *
+CDBOverlayType_commit_to(cdboverlay_t *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"file", "close", "mmap", NULL};
+    PyObject *file_, *close_ = NULL, *mmap_ = NULL, *maker, *result;
+    PyObject *exc_type, *exc_value, *exc_tb;
+    cdboverlay_entry_t *entry;
+    cdbx_cdb32_maker_t *maker32;
+    cdbx_cdb32_t *cdb32;
+    Py_ssize_t idx;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|OO", kwlist,
+                                     &file_, &close_, &mmap_))
+        return NULL;
+
+    if (!(cdb32 = cdboverlay_base(self)))
+        return NULL;
+
+    if (!(maker = cdbx_maker_new(Py_TYPE(self->cdb), file_, close_, mmap_,
+                                 NULL, NULL)))
+        return NULL;
+    maker32 = cdbx_maker_get_maker32(maker);
+
+    if (-1 == cdbx_cdb32_maker_copy(maker32, cdb32, cdboverlay_keep, self, 0))
+        LCOV_EXCL_LINE_GOTO(error);
+
+    for (idx = 0; idx < self->num_entries; ++idx) {
+        entry = &self->entries[idx];
+        if (entry->value
+            && -1 == cdbx_cdb32_maker_add(maker32, entry->key, entry->value))
+            LCOV_EXCL_LINE_GOTO(error);
+    }
+
+    result = PyObject_CallMethod(maker, "commit", "()");
+    Py_DECREF(maker);
+    return result;
+
+/* LCOV_EXCL_START */
+error:
+    PyErr_Fetch(&exc_type, &exc_value, &exc_tb);
+    if (!(result = PyObject_CallMethod(maker, "close", "()")))
+        PyErr_Clear();
+    else
+        Py_DECREF(result);
+    PyErr_Restore(exc_type, exc_value, exc_tb);
+    Py_DECREF(maker);
+    return NULL;
+/* LCOV_EXCL_STOP */
+}
+
+
+PyDoc_STRVAR(CDBOverlayType_cdb__doc__,
+"The base CDB");
+
+static PyObject *
+CDBOverlayType_cdb(cdboverlay_t *self, void *closure)
+{
+    (void)closure;
+
+    Py_INCREF(self->cdb);
+    return self->cdb;
+}
+
+
+static PyObject *
+CDBOverlayType_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"cdb", NULL};
+    PyObject *cdb_;
+    cdboverlay_t *self;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O", kwlist, &cdb_))
+        return NULL;
+
+    if (!CDBType_Check(cdb_)) {
+        PyErr_SetString(PyExc_TypeError,
+                        "CDBOverlay base must be a CDB instance");
+        return NULL;
+    }
+
+    if (!(self = GENERIC_ALLOC(type)))
+        LCOV_EXCL_LINE_RETURN(NULL);
+
+    Py_INCREF(cdb_);
+    self->cdb = cdb_;
+
+    return (PyObject *)self;
+}
+
+
+static int
+CDBOverlayType_traverse(cdboverlay_t *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->cdb);
+
+    return 0;
+}
+
+static int
+CDBOverlayType_clear(cdboverlay_t *self)
+{
+    cdboverlay_entry_t *entries;
+    Py_ssize_t idx, num;
+
+    if (self->weakreflist)
+        PyObject_ClearWeakRefs((PyObject *)self);
+
+    entries = self->entries;
+    num = self->num_entries;
+    self->entries = NULL;
+    self->num_entries = self->max_entries = 0;
+    PyMem_Free(self->table);
+    self->table = NULL;
+
+    for (idx = 0; idx < num; ++idx) {
+        Py_DECREF(entries[idx].key);
+        Py_XDECREF(entries[idx].value);
+    }
+    PyMem_Free(entries);
+
+    Py_CLEAR(self->cdb);
+
+    return 0;
+}
+
+DEFINE_GENERIC_DEALLOC(CDBOverlayType)
+
+
+static PySequenceMethods CDBOverlayType_as_sequence = {
+    0,                                    /* sq_length */
+    0,                                    /* sq_concat */
+    0,                                    /* sq_repeat */
+    0,                                    /* sq_item */
+    0,                                    /* sq_slice */
+    0,                                    /* sq_ass_item */
+    0,                                    /* sq_ass_slice */
+    (objobjproc)CDBOverlayType_contains,  /* sq_contains */
+    0,                                    /* sq_inplace_concat */
+    0                                     /* sq_inplace_repeat */
+};
+
+static PyMappingMethods CDBOverlayType_as_mapping = {
+    (lenfunc)CDBOverlayType_len,          /* mp_length */
+    (binaryfunc)CDBOverlayType_getitem,   /* mp_subscript */
+    (objobjargproc)CDBOverlayType_setitem /* mp_ass_subscript */
+};
+
+static PyMethodDef CDBOverlayType_methods[] = {
+    {"get",
+     EXT_CFUNC(CDBOverlayType_get),           METH_KEYWORDS |
+                                              METH_VARARGS,
+     CDBOverlayType_get__doc__},
+
+    {"has_key",
+     EXT_CFUNC(CDBOverlayType_has_key),       METH_O,
+     CDBOverlayType_has_key__doc__},
+
+    {"commit_to",
+     EXT_CFUNC(CDBOverlayType_commit_to),     METH_KEYWORDS |
+                                              METH_VARARGS,
+     CDBOverlayType_commit_to__doc__},
+
+    {NULL, NULL}
+};
+
+static PyGetSetDef CDBOverlayType_getset[] = {
+    {"cdb",
+     (getter)CDBOverlayType_cdb,
+     NULL,
+     CDBOverlayType_cdb__doc__,
+     NULL},
+
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+PyDoc_STRVAR(CDBOverlayType__doc__,
+"CDBOverlay(cdb)\n\
+\n\
+Mutable in-memory overlay over an immutable CDB.\n\
+\n\
+Assigning a key replaces all of its values in the base CDB by the new one,\n\
+deleting it hides it. Lookups check the overlay's native hash table first\n\
+and the base CDB afterwards. Use `commit_to` to write the result into a\n\
+new CDB.\n\
+\n\
+Parameters:\n\
+  cdb (CDB):\n\
+    The base CDB. It's not owned by the overlay, closing it is still up\n\
+    to the caller.");
+
+EXT_LOCAL PyTypeObject CDBOverlayType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    EXT_MODULE_PATH ".CDBOverlay",                      /* tp_name */
+    sizeof(cdboverlay_t),                               /* tp_basicsize */
+    0,                                                  /* tp_itemsize */
+    (destructor)CDBOverlayType_dealloc,                 /* tp_dealloc */
+    0,                                                  /* tp_print */
+    0,                                                  /* tp_getattr */
+    0,                                                  /* tp_setattr */
+    0,                                                  /* tp_compare */
+    0,                                                  /* tp_repr */
+    0,                                                  /* tp_as_number */
+    &CDBOverlayType_as_sequence,                        /* tp_as_sequence */
+    &CDBOverlayType_as_mapping,                         /* tp_as_mapping */
+    (hashfunc)PyObject_HashNotImplemented,              /* tp_hash */
+    0,                                                  /* tp_call */
+    0,                                                  /* tp_str */
+    PyObject_GenericGetAttr,                            /* tp_getattro */
+    0,                                                  /* tp_setattro */
+    0,                                                  /* tp_as_buffer */
+    Py_TPFLAGS_HAVE_WEAKREFS                            /* tp_flags */
+    | Py_TPFLAGS_HAVE_CLASS
+    | Py_TPFLAGS_HAVE_SEQUENCE_IN
+    | Py_TPFLAGS_BASETYPE
+    | Py_TPFLAGS_HAVE_GC,
+    CDBOverlayType__doc__,                              /* tp_doc */
+    (traverseproc)CDBOverlayType_traverse,              /* tp_traverse */
+    (inquiry)CDBOverlayType_clear,                      /* tp_clear */
+    0,                                                  /* tp_richcompare */
+    offsetof(cdboverlay_t, weakreflist),                /* tp_weaklistoffset */
+    0,                                                  /* tp_iter */
+    0,                                                  /* tp_iternext */
+    CDBOverlayType_methods,                             /* tp_methods */
+    0,                                                  /* tp_members */
+    CDBOverlayType_getset,                              /* tp_getset */
+    0,                                                  /* tp_base */
+    0,                                                  /* tp_dict */
+    0,                                                  /* tp_descr_get */
+    0,                                                  /* tp_descr_set */
+    0,                                                  /* tp_dictoffset */
+    0,                                                  /* tp_init */
+    0,                                                  /* tp_alloc */
+    (newfunc)CDBOverlayType_new,                        /* tp_new */
+};
+
+/* -------------------------- END CDBOverlayType ------------------------- */
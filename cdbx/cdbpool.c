@@ -0,0 +1,769 @@
+/*
+ * Copyright 2016 - 2025
+ * Andr\xe9 Malo or his licensors, as applicable
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cdbx.h"
+
+#ifdef EXT3
+#define cdbpool_dict_get PyDict_GetItemWithError
+#else
+#define cdbpool_dict_get PyDict_GetItem
+#endif
+
+#define FL_CLOSED (1 << 0)
+
+#define CDBPOOL_NONE ((Py_ssize_t)-1)
+
+/*
+ * Pool entry
+ *
+ * Entries live in a fixed array of max_open slots. Used slots form a doubly
+ * linked list (most recently used first), free slots are chained via next.
+ */
+typedef struct {
+    PyObject *path;      /* as passed in (NULL if free) */
+    PyObject *cdb;       /* CDB */
+    Py_ssize_t mapped;   /* mapped bytes */
+    Py_ssize_t prev;
+    Py_ssize_t next;
+} cdbpool_entry_t;
+
+/*
+ * Object structure for CDBPoolType
+ */
+typedef struct {
+    PyObject_HEAD
+    PyObject *weakreflist;
+
+    PyObject *index;      /* dict: path -> int (entry slot) */
+    PyObject *mmap;       /* mmap argument for new CDBs */
+    cdbpool_entry_t *entries;
+
+    Py_ssize_t max_open;
+    Py_ssize_t max_mapped;  /* < 0 = unlimited */
+    Py_ssize_t mapped;
+    Py_ssize_t size;
+    Py_ssize_t head;        /* most recently used */
+    Py_ssize_t tail;        /* least recently used */
+    Py_ssize_t free;
+
+    Py_ssize_t hits;
+    Py_ssize_t misses;
+    Py_ssize_t evictions;
+    int flags;
+} cdbpool_t;
+
+
+/* ------------------------ BEGIN Helper Functions ----------------------- */
+
+/*
+ * Unlink an entry from the LRU list
+ */
+static void
+cdbpool_unlink(cdbpool_t *self, Py_ssize_t idx)
+{
+    cdbpool_entry_t *entry = &self->entries[idx];
+
+    if (entry->prev == CDBPOOL_NONE)
+        self->head = entry->next;
+    else
+        self->entries[entry->prev].next = entry->next;
+
+    if (entry->next == CDBPOOL_NONE)
+        self->tail = entry->prev;
+    else
+        self->entries[entry->next].prev = entry->prev;
+}
+
+
+/*
+ * Link an entry as most recently used
+ */
+static void
+cdbpool_link(cdbpool_t *self, Py_ssize_t idx)
+{
+    cdbpool_entry_t *entry = &self->entries[idx];
+
+    entry->prev = CDBPOOL_NONE;
+    entry->next = self->head;
+    if (self->head == CDBPOOL_NONE)
+        self->tail = idx;
+    else
+        self->entries[self->head].prev = idx;
+    self->head = idx;
+}
+
+
+/*
+ * Remove an entry from the pool
+ *
+ * The CDB is not closed explicitly. It's released, so other references
+ * (e.g. returned by open() or held by a running lookup in another thread)
+ * stay valid and the file is closed when the last of them is gone.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+static int
+cdbpool_drop(cdbpool_t *self, Py_ssize_t idx)
+{
+    cdbpool_entry_t *entry = &self->entries[idx];
+    PyObject *path, *cdb;
+    int res;
+
+    path = entry->path;
+    cdb = entry->cdb;
+    res = PyDict_DelItem(self->index, path);
+
+    cdbpool_unlink(self, idx);
+    entry->path = entry->cdb = NULL;
+    entry->next = self->free;
+    self->free = idx;
+    self->mapped -= entry->mapped;
+    --self->size;
+
+    /* The state is consistent now, releasing may run arbitrary code */
+    Py_DECREF(path);
+    Py_DECREF(cdb);
+
+    return res;
+}
+
+
+/*
+ * Evict least recently used entries until the limits are kept
+ *
+ * The most recently used entry is always kept.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+static int
+cdbpool_evict(cdbpool_t *self, Py_ssize_t need)
+{
+    while (self->size > 1 || (need && self->size)) {
+        if (self->size + need <= self->max_open
+            && (self->max_mapped < 0 || self->mapped <= self->max_mapped))
+            break;
+
+        ++self->evictions;
+        if (-1 == cdbpool_drop(self, self->tail))
+            LCOV_EXCL_LINE_RETURN(-1);
+    }
+
+    return 0;
+}
+
+
+/*
+ * Open the file as new CDB
+ *
+ * Return NULL on error
+ */
+static PyObject *
+cdbpool_open(cdbpool_t *self, PyObject *path)
+{
+    PyObject *result;
+    int fd;
+
+    if (-1 == cdbx_fs_open(path, &fd))
+        return NULL;
+
+    if (!(result = PyObject_CallFunction((PyObject *)&CDBType, "(iiO)", fd, 1,
+                                         self->mmap))) {
+        close(fd);
+        return NULL;
+    }
+
+    return result;
+}
+
+
+/*
+ * Find the slot of a path
+ *
+ * Return -1 on error
+ * Return 0 if not found
+ * Return 1 if found (*idx_ is set)
+ */
+static int
+cdbpool_find(cdbpool_t *self, PyObject *path, Py_ssize_t *idx_)
+{
+    PyObject *item;
+
+    if (!(item = cdbpool_dict_get(self->index, path))) {
+#ifdef EXT3
+        if (PyErr_Occurred())
+            return -1;
+#endif
+        return 0;
+    }
+
+    *idx_ = PyLong_AsSsize_t(item);
+    return 1;
+}
+
+
+/*
+ * Return a new reference to the (open) CDB of a path
+ *
+ * Return NULL on error
+ */
+static PyObject *
+cdbpool_acquire(cdbpool_t *self, PyObject *path)
+{
+    cdbpool_entry_t *entry;
+    PyObject *cdb, *item;
+    Py_ssize_t idx;
+    int res;
+
+    if (self->flags & FL_CLOSED)
+        return cdbx_raise_closed();
+
+    switch (cdbpool_find(self, path, &idx)) {
+    case -1:
+        return NULL;
+
+    case 1:
+        entry = &self->entries[idx];
+        if (cdbx_type_get_cdb32((cdbtype_t *)entry->cdb)) {
+            ++self->hits;
+            if (self->head != idx) {
+                cdbpool_unlink(self, idx);
+                cdbpool_link(self, idx);
+            }
+            Py_INCREF(entry->cdb);
+            return entry->cdb;
+        }
+
+        /* Closed by someone else. Reopen */
+        if (-1 == cdbpool_drop(self, idx))
+            LCOV_EXCL_LINE_RETURN(NULL);
+    }
+
+    ++self->misses;
+
+    /*
+     * Opening may release the GIL, so the pool may have been changed
+     * meanwhile (even closed). The pool itself is not touched before that's
+     * done.
+     */
+    if (!(cdb = cdbpool_open(self, path)))
+        return NULL;
+
+    if (self->flags & FL_CLOSED) {
+        Py_DECREF(cdb);
+        return cdbx_raise_closed();
+    }
+
+    switch (cdbpool_find(self, path, &idx)) {
+    case -1:
+        LCOV_EXCL_LINE_GOTO(error);
+
+    case 1:
+        /* Somebody else was faster */
+        entry = &self->entries[idx];
+        if (cdbx_type_get_cdb32((cdbtype_t *)entry->cdb)) {
+            Py_DECREF(cdb);
+            Py_INCREF(entry->cdb);
+            return entry->cdb;
+        }
+        if (-1 == cdbpool_drop(self, idx))
+            LCOV_EXCL_LINE_GOTO(error);
+    }
+
+    if (-1 == cdbpool_evict(self, 1))
+        LCOV_EXCL_LINE_GOTO(error);
+
+    idx = self->free;
+    if (!(item = PyLong_FromSsize_t(idx)))
+        LCOV_EXCL_LINE_GOTO(error);
+    res = PyDict_SetItem(self->index, path, item);
+    Py_DECREF(item);
+    if (-1 == res)
+        goto error;
+
+    entry = &self->entries[idx];
+    self->free = entry->next;
+    Py_INCREF(path);
+    entry->path = path;
+    entry->cdb = cdb;
+    entry->mapped = cdbx_cdb32_mapped_size(
+        cdbx_type_get_cdb32((cdbtype_t *)cdb)
+    );
+    self->mapped += entry->mapped;
+    ++self->size;
+    cdbpool_link(self, idx);
+
+    if (-1 == cdbpool_evict(self, 0))
+        LCOV_EXCL_LINE_RETURN(NULL);
+
+    Py_INCREF(cdb);
+    return cdb;
+
+error:
+    Py_DECREF(cdb);
+    return NULL;
+}
+
+
+/*
+ * Drop all entries
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+static int
+cdbpool_clear(cdbpool_t *self)
+{
+    int res = 0;
+
+    while (self->size) {
+        if (-1 == cdbpool_drop(self, self->tail))
+            res = -1;  /* LCOV_EXCL_LINE */
+    }
+
+    return res;
+}
+
+/* ------------------------- END Helper Functions ------------------------ */
+
+/* ------------------------- BEGIN CDBPoolType --------------------------- */
+
+PyDoc_STRVAR(CDBPoolType_open__doc__,
+"open(self, path)\n\
+\n\
+Return the CDB of a path, opening it if necessary\n\
+\n\
+The returned CDB must not be closed by the caller. It stays usable after\n\
+being evicted from the pool.\n\
+\n\
+Parameters:\n\
+  path (str or bytes):\n\
+    Filename\n\
+\n\
+Returns:\n\
+  CDB: The CDB instance");
+
+static PyObject *
+CDBPoolType_open(cdbpool_t *self, PyObject *path)
+{
+    return cdbpool_acquire(self, path);
+}
+
+
+PyDoc_STRVAR(CDBPoolType_get__doc__,
+"get(self, path, key, default=None)\n\
+\n\
+Return the first value for a key of the CDB of a path\n\
+\n\
+Parameters:\n\
+  path (str or bytes):\n\
+    Filename\n\
+\n\
+  key (bytes):\n\
+    Key to look up\n\
+\n\
+  default:\n\
+    Value returned if the key doesn't exist\n\
+\n\
+Returns:\n\
+  bytes: The value or the default");
+
+static PyObject *
+cdbpool_get(cdbpool_t *self, PyObject *path, PyObject *key,
+            PyObject *default_)
+{
+    PyObject *cdb, *result;
+    cdbx_cdb32_t *cdb32;
+    cdbx_cdb32_pointer_t value;
+
+    if (!(cdb = cdbpool_acquire(self, path)))
+        return NULL;
+
+    cdb32 = cdbx_type_get_cdb32((cdbtype_t *)cdb);
+    switch (cdbx_cdb32_find(cdb32, key, &value)) {
+    case -1:
+        result = NULL;
+        break;
+
+    case 0:
+        Py_INCREF(default_);
+        result = default_;
+        break;
+
+    default:
+        if (-1 == cdbx_cdb32_read_decoded(cdb32, &value, NULL, NULL,
+                                          &result))
+            result = NULL;  /* LCOV_EXCL_LINE */
+    }
+
+    Py_DECREF(cdb);
+    return result;
+}
+
+#ifdef CDBX_FASTCALL
+static PyObject *
+CDBPoolType_get(cdbpool_t *self, PyObject *const *args, Py_ssize_t nargs,
+                PyObject *kwnames)
+{
+    static const char * const kwlist[] = {"path", "key", "default", NULL};
+    PyObject *argv[3] = {NULL, NULL, Py_None};
+
+    if (-1 == cdbx_parse_fastcall("get", args, nargs, kwnames, kwlist, 2,
+                                  argv))
+        return NULL;
+
+    return cdbpool_get(self, argv[0], argv[1], argv[2]);
+}
+#else
+static PyObject *
+CDBPoolType_get(cdbpool_t *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"path", "key", "default", NULL};
+    PyObject *path_, *key_, *default_ = Py_None;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO|O", kwlist,
+                                     &path_, &key_, &default_))
+        return NULL;
+
+    return cdbpool_get(self, path_, key_, default_);
+}
+#endif
+
+
+PyDoc_STRVAR(CDBPoolType_discard__doc__,
+"discard(self, path)\n\
+\n\
+Remove the CDB of a path from the pool\n\
+\n\
+Parameters:\n\
+  path (str or bytes):\n\
+    Filename\n\
+\n\
+Returns:\n\
+  bool: Was it in the pool?");
+
+static PyObject *
+CDBPoolType_discard(cdbpool_t *self, PyObject *path)
+{
+    Py_ssize_t idx;
+
+    switch (cdbpool_find(self, path, &idx)) {
+    case -1: return NULL;
+    case 0: Py_RETURN_FALSE;
+    }
+
+    if (-1 == cdbpool_drop(self, idx))
+        LCOV_EXCL_LINE_RETURN(NULL);
+
+    Py_RETURN_TRUE;
+}
+
+
+PyDoc_STRVAR(CDBPoolType_clear__doc__,
+"clear(self)\n\
+\n\
+Remove all CDBs from the pool.");
+
+static PyObject *
+CDBPoolType_clear_(cdbpool_t *self)
+{
+    if (-1 == cdbpool_clear(self))
+        LCOV_EXCL_LINE_RETURN(NULL);
+
+    Py_RETURN_NONE;
+}
+
+
+PyDoc_STRVAR(CDBPoolType_close__doc__,
+"close(self)\n\
+\n\
+Remove all CDBs from the pool and refuse further lookups.");
+
+static PyObject *
+CDBPoolType_close(cdbpool_t *self)
+{
+    self->flags |= FL_CLOSED;
+
+    return CDBPoolType_clear_(self);
+}
+
+
+static int
+CDBPoolType_contains(cdbpool_t *self, PyObject *path)
+{
+    Py_ssize_t idx;
+
+    return cdbpool_find(self, path, &idx);
+}
+
+
+static Py_ssize_t
+CDBPoolType_len(cdbpool_t *self)
+{
+    return self->size;
+}
+
+
+PyDoc_STRVAR(CDBPoolType_mapped_bytes__doc__,
+"Number of bytes currently mapped by the pooled CDBs");
+
+static PyObject *
+CDBPoolType_get_mapped_bytes(cdbpool_t *self, void *closure)
+{
+    (void)closure;
+
+    return PyLong_FromSsize_t(self->mapped);
+}
+
+
+PyDoc_STRVAR(CDBPoolType_stats__doc__,
+"Counters as dict (``hits``, ``misses``, ``evictions``)");
+
+static PyObject *
+CDBPoolType_get_stats(cdbpool_t *self, void *closure)
+{
+    (void)closure;
+
+    return Py_BuildValue("{s:n,s:n,s:n}", "hits", self->hits,
+                         "misses", self->misses,
+                         "evictions", self->evictions);
+}
+
+
+static PyObject *
+CDBPoolType_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"max_open", "max_mapped_bytes", "mmap", NULL};
+    PyObject *max_mapped_ = Py_None, *mmap_ = Py_None;
+    Py_ssize_t max_open = 128, idx;
+    cdbpool_t *self;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|nOO", kwlist,
+                                     &max_open, &max_mapped_, &mmap_))
+        return NULL;
+
+    if (max_open < 1) {
+        PyErr_SetString(PyExc_ValueError, "max_open must be positive");
+        return NULL;
+    }
+
+    if (!(self = GENERIC_ALLOC(type)))
+        LCOV_EXCL_LINE_RETURN(NULL);
+
+    self->max_open = max_open;
+    self->head = self->tail = CDBPOOL_NONE;
+
+    if (max_mapped_ == Py_None) {
+        self->max_mapped = -1;
+    }
+    else {
+        if (-1 == (self->max_mapped = PyNumber_AsSsize_t(max_mapped_,
+                                                         PyExc_OverflowError))
+            && PyErr_Occurred())
+            goto error;
+        if (self->max_mapped < 0) {
+            PyErr_SetString(PyExc_ValueError,
+                            "max_mapped_bytes must not be negative");
+            goto error;
+        }
+    }
+
+    Py_INCREF(mmap_);
+    self->mmap = mmap_;
+
+    if (!(self->index = PyDict_New()))
+        LCOV_EXCL_LINE_GOTO(error);
+
+    if ((size_t)max_open > PY_SSIZE_T_MAX / sizeof *self->entries
+        || !(self->entries = PyMem_Malloc((size_t)max_open
+                                          * sizeof *self->entries))) {
+        PyErr_NoMemory();
+        goto error;
+    }
+    for (idx = 0; idx < max_open; ++idx) {
+        self->entries[idx].path = self->entries[idx].cdb = NULL;
+        self->entries[idx].next = idx + 1 < max_open ? idx + 1 : CDBPOOL_NONE;
+    }
+
+    return (PyObject *)self;
+
+error:
+    Py_DECREF(self);
+    return NULL;
+}
+
+
+static int
+CDBPoolType_traverse(cdbpool_t *self, visitproc visit, void *arg)
+{
+    Py_ssize_t idx;
+
+    Py_VISIT(self->index);
+    Py_VISIT(self->mmap);
+    for (idx = self->head; idx != CDBPOOL_NONE;
+         idx = self->entries[idx].next)
+        Py_VISIT(self->entries[idx].cdb);
+
+    return 0;
+}
+
+static int
+CDBPoolType_clear(cdbpool_t *self)
+{
+    if (self->weakreflist)
+        PyObject_ClearWeakRefs((PyObject *)self);
+
+    self->flags |= FL_CLOSED;
+    if (self->entries) {
+        if (-1 == cdbpool_clear(self))
+            PyErr_Clear();  /* LCOV_EXCL_LINE */
+        PyMem_Free(self->entries);
+        self->entries = NULL;
+    }
+    Py_CLEAR(self->index);
+    Py_CLEAR(self->mmap);
+
+    return 0;
+}
+
+DEFINE_GENERIC_DEALLOC(CDBPoolType)
+
+
+static PySequenceMethods CDBPoolType_as_sequence = {
+    (lenfunc)CDBPoolType_len,             /* sq_length */
+    0,                                    /* sq_concat */
+    0,                                    /* sq_repeat */
+    0,                                    /* sq_item */
+    0,                                    /* sq_slice */
+    0,                                    /* sq_ass_item */
+    0,                                    /* sq_ass_slice */
+    (objobjproc)CDBPoolType_contains,     /* sq_contains */
+    0,                                    /* sq_inplace_concat */
+    0                                     /* sq_inplace_repeat */
+};
+
+static PyMethodDef CDBPoolType_methods[] = {
+    {"open",
+     EXT_CFUNC(CDBPoolType_open),             METH_O,
+     CDBPoolType_open__doc__},
+
+    {"get",
+     EXT_CFUNC(CDBPoolType_get),              CDBX_METH_KEYWORDS,
+     CDBPoolType_get__doc__},
+
+    {"discard",
+     EXT_CFUNC(CDBPoolType_discard),          METH_O,
+     CDBPoolType_discard__doc__},
+
+    {"clear",
+     EXT_CFUNC(CDBPoolType_clear_),           METH_NOARGS,
+     CDBPoolType_clear__doc__},
+
+    {"close",
+     EXT_CFUNC(CDBPoolType_close),            METH_NOARGS,
+     CDBPoolType_close__doc__},
+
+    {NULL, NULL}
+};
+
+static PyGetSetDef CDBPoolType_getset[] = {
+    {"mapped_bytes",
+     (getter)CDBPoolType_get_mapped_bytes,
+     NULL,
+     CDBPoolType_mapped_bytes__doc__,
+     NULL},
+
+    {"stats",
+     (getter)CDBPoolType_get_stats,
+     NULL,
+     CDBPoolType_stats__doc__,
+     NULL},
+
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+PyDoc_STRVAR(CDBPoolType__doc__,
+"CDBPool(max_open=128, max_mapped_bytes=None, mmap=None)\n\
+\n\
+Bounded pool of open CDBs, keyed by path.\n\
+\n\
+Files are opened on first use and kept open (with their header decoded and\n\
+their mapping in place) until they are evicted as least recently used.\n\
+Paths are used as passed in, i.e. pass them consistently (``'a.cdb'`` and\n\
+``'./a.cdb'`` are different entries). Evicted CDBs are not closed\n\
+explicitly, but released; CDBs still in use elsewhere keep working.\n\
+\n\
+The pool is safe to use from several threads.\n\
+\n\
+Parameters:\n\
+  max_open (int):\n\
+    Maximum number of open files\n\
+\n\
+  max_mapped_bytes (int):\n\
+    Maximum total size of the mapped files. The most recently used file is\n\
+    always kept. If omitted or ``None``, there's no limit.\n\
+\n\
+  mmap (bool):\n\
+    Passed to every CDB opened");
+
+EXT_LOCAL PyTypeObject CDBPoolType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    EXT_MODULE_PATH ".CDBPool",                         /* tp_name */
+    sizeof(cdbpool_t),                                  /* tp_basicsize */
+    0,                                                  /* tp_itemsize */
+    (destructor)CDBPoolType_dealloc,                    /* tp_dealloc */
+    0,                                                  /* tp_print */
+    0,                                                  /* tp_getattr */
+    0,                                                  /* tp_setattr */
+    0,                                                  /* tp_compare */
+    0,                                                  /* tp_repr */
+    0,                                                  /* tp_as_number */
+    &CDBPoolType_as_sequence,                           /* tp_as_sequence */
+    0,                                                  /* tp_as_mapping */
+    0,                                                  /* tp_hash */
+    0,                                                  /* tp_call */
+    0,                                                  /* tp_str */
+    0,                                                  /* tp_getattro */
+    0,                                                  /* tp_setattro */
+    0,                                                  /* tp_as_buffer */
+    Py_TPFLAGS_HAVE_WEAKREFS                            /* tp_flags */
+    | Py_TPFLAGS_HAVE_CLASS
+    | Py_TPFLAGS_HAVE_SEQUENCE_IN
+    | Py_TPFLAGS_BASETYPE
+    | Py_TPFLAGS_HAVE_GC,
+    CDBPoolType__doc__,                                 /* tp_doc */
+    (traverseproc)CDBPoolType_traverse,                 /* tp_traverse */
+    (inquiry)CDBPoolType_clear,                         /* tp_clear */
+    0,                                                  /* tp_richcompare */
+    offsetof(cdbpool_t, weakreflist),                   /* tp_weaklistoffset */
+    0,                                                  /* tp_iter */
+    0,                                                  /* tp_iternext */
+    CDBPoolType_methods,                                /* tp_methods */
+    0,                                                  /* tp_members */
+    CDBPoolType_getset,                                 /* tp_getset */
+    0,                                                  /* tp_base */
+    0,                                                  /* tp_dict */
+    0,                                                  /* tp_descr_get */
+    0,                                                  /* tp_descr_set */
+    0,                                                  /* tp_dictoffset */
+    0,                                                  /* tp_init */
+    0,                                                  /* tp_alloc */
+    (newfunc)CDBPoolType_new,                           /* tp_new */
+};
+
+/* -------------------------- END CDBPoolType ---------------------------- */
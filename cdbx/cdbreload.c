@@ -0,0 +1,836 @@
+/*
+ * Copyright 2016 - 2025
+ * Andr\xe9 Malo or his licensors, as applicable
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cdbx.h"
+
+#include <sys/stat.h>
+#include <time.h>
+
+#define FL_CLOSED     (1 << 0)
+#define FL_BACKGROUND (1 << 1)
+#define FL_WARM       (1 << 2)
+#define FL_LOADING    (1 << 3)
+
+/*
+ * Object structure for ReloadingCDBType
+ *
+ * Readers take a reference to the current CDB for the duration of every
+ * operation (and iterators keep theirs), so swapping the pointer is safe
+ * under the GIL. A replaced CDB is freed once its last reader is done.
+ */
+typedef struct reloadcdb_t {
+    PyObject_HEAD
+    PyObject *weakreflist;
+    struct reloadcdb_t *prev;  /* all live instances (for fork handling) */
+    struct reloadcdb_t *next;
+
+    PyObject *path;     /* absolute bytes path */
+    PyObject *current;  /* CDB (NULL if closed) */
+    PyObject *mmap;     /* mmap argument for new CDBs */
+
+    double interval;    /* between checks (seconds, < 0 = never) */
+    double checked;     /* monotonic time of the last check */
+    dev_t dev;          /* identity of the file seen last */
+    ino_t ino;
+    Py_ssize_t generation;
+    int flags;
+} reloadcdb_t;
+
+static PyObject *
+reloadcdb_worker(reloadcdb_t *, PyObject *);
+
+static PyMethodDef reloadcdb_worker_def = {
+    "_reload", EXT_CFUNC(reloadcdb_worker), METH_NOARGS, NULL
+};
+
+static reloadcdb_t *reloadcdb_all = NULL;
+
+
+/* ------------------------ BEGIN Helper Functions ----------------------- */
+
+/*
+ * Return the monotonic time in seconds
+ */
+static double
+reloadcdb_now(void)
+{
+    struct timespec ts;
+
+    if (-1 == clock_gettime(CLOCK_MONOTONIC, &ts))
+        LCOV_EXCL_LINE_RETURN(0.0);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
+
+
+/*
+ * Open (and optionally warm) the file as new CDB
+ *
+ * Return NULL on error
+ */
+static PyObject *
+reloadcdb_open(reloadcdb_t *self, dev_t *dev_, ino_t *ino_)
+{
+    struct stat st;
+    PyObject *result;
+    int fd;
+
+    if (-1 == cdbx_fs_open(self->path, &fd))
+        return NULL;
+
+    if (-1 == fstat(fd, &st)) {
+        /* LCOV_EXCL_START */
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_IOError, self->path);
+        close(fd);
+        return NULL;
+        /* LCOV_EXCL_STOP */
+    }
+    *dev_ = st.st_dev;
+    *ino_ = st.st_ino;
+
+    if (!(result = PyObject_CallFunction((PyObject *)&CDBType, "(iiO)", fd, 1,
+                                         self->mmap))) {
+        close(fd);
+        return NULL;
+    }
+
+    if ((self->flags & FL_WARM)
+        && -1 == cdbx_cdb32_warm(cdbx_type_get_cdb32((cdbtype_t *)result))) {
+        Py_DECREF(result);  /* LCOV_EXCL_LINE */
+        return NULL;        /* LCOV_EXCL_LINE */
+    }
+
+    return result;
+}
+
+
+/*
+ * Open the file and swap it in
+ *
+ * Return -1 on error
+ * Return 0 if closed meanwhile
+ * Return 1 if swapped
+ */
+static int
+reloadcdb_load(reloadcdb_t *self)
+{
+    PyObject *cdb, *old;
+    dev_t dev;
+    ino_t ino;
+
+    if (!(cdb = reloadcdb_open(self, &dev, &ino)))
+        return -1;
+
+    if (self->flags & FL_CLOSED) {
+        if (!(old = PyObject_CallMethod(cdb, "close", "()"))) {
+            Py_DECREF(cdb);  /* LCOV_EXCL_LINE */
+            return -1;       /* LCOV_EXCL_LINE */
+        }
+        Py_DECREF(old);
+        Py_DECREF(cdb);
+        return 0;
+    }
+
+    old = self->current;
+    self->current = cdb;
+    self->dev = dev;
+    self->ino = ino;
+    ++self->generation;
+    Py_XDECREF(old);
+
+    return 1;
+}
+
+
+/*
+ * Load the new file in a daemon thread
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+static int
+reloadcdb_start(reloadcdb_t *self)
+{
+    PyObject *module, *func, *thread, *tmp;
+
+    if (!(func = PyCFunction_New(&reloadcdb_worker_def, (PyObject *)self)))
+        LCOV_EXCL_LINE_RETURN(-1);
+
+    if (!(module = PyImport_ImportModule("threading")))
+        LCOV_EXCL_LINE_GOTO(error_func);
+    thread = PyObject_CallMethod(module, "Thread", "(OO)", Py_None, func);
+    Py_DECREF(module);
+    if (!thread)
+        LCOV_EXCL_LINE_GOTO(error_func);
+
+    self->flags |= FL_LOADING;
+    if (-1 == PyObject_SetAttrString(thread, "daemon", Py_True)
+        || !(tmp = PyObject_CallMethod(thread, "start", "()"))) {
+        /* LCOV_EXCL_START */
+        self->flags &= ~FL_LOADING;
+        Py_DECREF(thread);
+        goto error_func;
+        /* LCOV_EXCL_STOP */
+    }
+    Py_DECREF(tmp);
+    Py_DECREF(thread);
+    Py_DECREF(func);
+
+    return 0;
+
+/* LCOV_EXCL_START */
+error_func:
+    Py_DECREF(func);
+    return -1;
+/* LCOV_EXCL_STOP */
+}
+
+
+/*
+ * Check if the file was replaced and reload it
+ *
+ * Unless forced, the check is done at most once per interval and the new
+ * file is loaded in the background (if configured).
+ *
+ * Return -1 on error
+ * Return 0 if nothing changed (yet)
+ * Return 1 if swapped
+ */
+static int
+reloadcdb_check(reloadcdb_t *self, int force)
+{
+    struct stat st;
+    double now;
+    int res;
+
+    if (self->flags & FL_CLOSED)
+        return 0;
+
+    if (!force) {
+        if (self->interval < 0 || (self->flags & FL_LOADING))
+            return 0;
+        now = reloadcdb_now();
+        if (now - self->checked < self->interval)
+            return 0;
+        self->checked = now;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    res = stat(PyBytes_AS_STRING(self->path), &st);
+    Py_END_ALLOW_THREADS
+
+    /* Keep serving the current file, if the path is gone */
+    if (-1 == res || (st.st_dev == self->dev && st.st_ino == self->ino))
+        return 0;
+
+    /* Don't retry a broken file until it's replaced again */
+    self->dev = st.st_dev;
+    self->ino = st.st_ino;
+
+    if (!force && (self->flags & FL_BACKGROUND))
+        return reloadcdb_start(self);
+
+    return reloadcdb_load(self);
+}
+
+
+/*
+ * Return a new reference to the current CDB (after checking for a new one)
+ */
+static PyObject *
+reloadcdb_current(reloadcdb_t *self)
+{
+    if (-1 == reloadcdb_check(self, 0))
+        return NULL;
+
+    if (!self->current)
+        return cdbx_raise_closed();
+
+    Py_INCREF(self->current);
+    return self->current;
+}
+
+
+/*
+ * Background loader
+ */
+static PyObject *
+reloadcdb_worker(reloadcdb_t *self, PyObject *unused)
+{
+    (void)unused;
+
+    if (-1 == reloadcdb_load(self))
+        PyErr_WriteUnraisable((PyObject *)self);
+    self->flags &= ~FL_LOADING;
+
+    Py_RETURN_NONE;
+}
+
+
+/*
+ * Reset per-process state in a forked child
+ *
+ * Loader threads don't survive a fork. Instances waiting for one would
+ * never check for new files again.
+ */
+static PyObject *
+reloadcdb_after_fork(PyObject *self, PyObject *unused)
+{
+    reloadcdb_t *inst;
+
+    (void)self;
+    (void)unused;
+
+    for (inst = reloadcdb_all; inst; inst = inst->next) {
+        inst->flags &= ~FL_LOADING;
+        inst->checked = 0.0;
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef reloadcdb_after_fork_def = {
+    "_after_fork", EXT_CFUNC(reloadcdb_after_fork), METH_NOARGS, NULL
+};
+
+
+/*
+ * Register the fork handler (os.register_at_fork)
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_reload_init_fork(void)
+{
+    PyObject *os, *func, *register_, *kwargs, *args, *result;
+
+    if (!(os = PyImport_ImportModule("os")))
+        LCOV_EXCL_LINE_RETURN(-1);
+
+    if (-1 == cdbx_attr(os, "register_at_fork", &register_))
+        LCOV_EXCL_LINE_GOTO(error_os);
+    Py_DECREF(os);
+    if (!register_)
+        return 0;  /* LCOV_EXCL_LINE */
+
+    if (!(func = PyCFunction_New(&reloadcdb_after_fork_def, NULL)))
+        LCOV_EXCL_LINE_GOTO(error_register);
+
+    kwargs = Py_BuildValue("{s:O}", "after_in_child", func);
+    Py_DECREF(func);
+    if (!kwargs)
+        LCOV_EXCL_LINE_GOTO(error_register);
+
+    if (!(args = PyTuple_New(0)))
+        LCOV_EXCL_LINE_GOTO(error_kwargs);
+
+    result = PyObject_Call(register_, args, kwargs);
+    Py_DECREF(args);
+    Py_DECREF(kwargs);
+    Py_DECREF(register_);
+    if (!result)
+        LCOV_EXCL_LINE_RETURN(-1);
+
+    Py_DECREF(result);
+    return 0;
+
+/* LCOV_EXCL_START */
+error_kwargs:
+    Py_DECREF(kwargs);
+error_register:
+    Py_DECREF(register_);
+    return -1;
+
+error_os:
+    Py_DECREF(os);
+    return -1;
+/* LCOV_EXCL_STOP */
+}
+
+/* ------------------------- END Helper Functions ------------------------ */
+
+/* ------------------------ BEGIN ReloadingCDBType ----------------------- */
+
+PyDoc_STRVAR(ReloadingCDBType_get__doc__,
+"get(self, key, default=None, all=False, encoding=None, errors=None)\n\
+\n\
+Return value(s) for a key from the current CDB (see ``CDB.get``)");
+
+#ifdef CDBX_VECTORCALL
+#define RELOADCDB_GET_FLAGS (METH_FASTCALL | METH_KEYWORDS)
+
+static PyObject *
+ReloadingCDBType_get(reloadcdb_t *self, PyObject *const *args,
+                     Py_ssize_t nargs, PyObject *kwnames)
+{
+    static PyObject *method;
+    PyObject *argv[8], *cdb, *result;
+    Py_ssize_t j, size;
+
+    /*
+     * Call the unbound CDB.get descriptor directly, which avoids creating a
+     * bound method per lookup
+     */
+    if (!method && !(method = PyObject_GetAttrString((PyObject *)&CDBType,
+                                                     "get")))
+        LCOV_EXCL_LINE_RETURN(NULL);
+
+    size = nargs + (kwnames ? PyTuple_GET_SIZE(kwnames) : 0);
+    if (size >= (Py_ssize_t)(sizeof argv / sizeof argv[0])) {
+        PyErr_SetString(PyExc_TypeError, "get() got too many arguments");
+        return NULL;
+    }
+
+    if (!(cdb = reloadcdb_current(self)))
+        return NULL;
+
+    argv[0] = cdb;
+    for (j = 0; j < size; ++j)
+        argv[j + 1] = args[j];
+
+    result = PyObject_Vectorcall(method, argv, (size_t)nargs + 1, kwnames);
+    Py_DECREF(cdb);
+
+    return result;
+}
+#else
+#define RELOADCDB_GET_FLAGS (METH_VARARGS | METH_KEYWORDS)
+
+static PyObject *
+ReloadingCDBType_get(reloadcdb_t *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *cdb, *method, *result;
+
+    if (!(cdb = reloadcdb_current(self)))
+        return NULL;
+
+    method = PyObject_GetAttrString(cdb, "get");
+    Py_DECREF(cdb);
+    if (!method)
+        LCOV_EXCL_LINE_RETURN(NULL);
+
+    result = PyObject_Call(method, args, kwds);
+    Py_DECREF(method);
+
+    return result;
+}
+#endif
+
+
+static PyObject *
+ReloadingCDBType_getitem(reloadcdb_t *self, PyObject *key)
+{
+    PyObject *cdb, *result;
+
+    if (!(cdb = reloadcdb_current(self)))
+        return NULL;
+
+    result = PyObject_GetItem(cdb, key);
+    Py_DECREF(cdb);
+
+    return result;
+}
+
+
+static int
+ReloadingCDBType_contains(reloadcdb_t *self, PyObject *key)
+{
+    PyObject *cdb;
+    int res;
+
+    if (!(cdb = reloadcdb_current(self)))
+        return -1;
+
+    res = PySequence_Contains(cdb, key);
+    Py_DECREF(cdb);
+
+    return res;
+}
+
+
+PyDoc_STRVAR(ReloadingCDBType_has_key__doc__,
+"has_key(self, key)\n\
+\n\
+Check if the key appears in the current CDB\n\
+\n\
+Parameters:\n\
+  key (bytes):\n\
+    Key to look up\n\
+\n\
+Returns:\n\
+  bool: Does the key exist?");
+
+static PyObject *
+ReloadingCDBType_has_key(reloadcdb_t *self, PyObject *key)
+{
+    switch (ReloadingCDBType_contains(self, key)) {
+    case -1: return NULL;
+    case 0: Py_RETURN_FALSE;
+    }
+
+    Py_RETURN_TRUE;
+}
+
+
+static Py_ssize_t
+ReloadingCDBType_len(reloadcdb_t *self)
+{
+    PyObject *cdb;
+    Py_ssize_t result;
+
+    if (!(cdb = reloadcdb_current(self)))
+        return -1;
+
+    result = PyObject_Size(cdb);
+    Py_DECREF(cdb);
+
+    return result;
+}
+
+
+static PyObject *
+ReloadingCDBType_iter(reloadcdb_t *self)
+{
+    PyObject *cdb, *result;
+
+    if (!(cdb = reloadcdb_current(self)))
+        return NULL;
+
+    /* The iterator keeps its CDB, even after a swap */
+    result = PyObject_GetIter(cdb);
+    Py_DECREF(cdb);
+
+    return result;
+}
+
+
+static PyObject *
+ReloadingCDBType_getattro(reloadcdb_t *self, PyObject *name)
+{
+    PyObject *cdb, *result;
+
+    if ((result = PyObject_GenericGetAttr((PyObject *)self, name))
+        || !PyErr_ExceptionMatches(PyExc_AttributeError))
+        return result;
+
+    /* Delegate everything else (keys, items, ...) to the current CDB */
+    PyErr_Clear();
+    if (!(cdb = reloadcdb_current(self)))
+        return NULL;
+
+    result = PyObject_GetAttr(cdb, name);
+    Py_DECREF(cdb);
+
+    return result;
+}
+
+
+PyDoc_STRVAR(ReloadingCDBType_reload__doc__,
+"reload(self)\n\
+\n\
+Check for a replaced file now and load it synchronously\n\
+\n\
+Returns:\n\
+  bool: Was a new file swapped in?");
+
+static PyObject *
+ReloadingCDBType_reload(reloadcdb_t *self)
+{
+    if (self->flags & FL_CLOSED)
+        return cdbx_raise_closed();
+
+    switch (reloadcdb_check(self, 1)) {
+    case -1: return NULL;
+    case 0: Py_RETURN_FALSE;
+    }
+
+    Py_RETURN_TRUE;
+}
+
+
+PyDoc_STRVAR(ReloadingCDBType_close__doc__,
+"close(self)\n\
+\n\
+Close the current CDB and stop reloading.");
+
+static PyObject *
+ReloadingCDBType_close(reloadcdb_t *self)
+{
+    PyObject *cdb, *result;
+
+    self->flags |= FL_CLOSED;
+    if (!(cdb = self->current))
+        Py_RETURN_NONE;
+
+    self->current = NULL;
+    result = PyObject_CallMethod(cdb, "close", "()");
+    Py_DECREF(cdb);
+
+    return result;
+}
+
+
+PyDoc_STRVAR(ReloadingCDBType_current__doc__,
+"The current CDB\n\
+\n\
+Keep it for a consistent view across several operations. It stays usable\n\
+after a swap (until it's garbage collected).");
+
+static PyObject *
+ReloadingCDBType_get_current(reloadcdb_t *self, void *closure)
+{
+    (void)closure;
+
+    return reloadcdb_current(self);
+}
+
+
+PyDoc_STRVAR(ReloadingCDBType_generation__doc__,
+"Number of swaps done so far");
+
+static PyObject *
+ReloadingCDBType_get_generation(reloadcdb_t *self, void *closure)
+{
+    (void)closure;
+
+    return PyLong_FromSsize_t(self->generation);
+}
+
+
+static PyObject *
+ReloadingCDBType_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"file", "mmap", "interval", "background",
+                             "warm", NULL};
+    PyObject *file_, *mmap_ = Py_None, *background_ = NULL, *warm_ = NULL;
+    reloadcdb_t *self;
+    double interval = 1.0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|OdOO", kwlist,
+                                     &file_, &mmap_, &interval,
+                                     &background_, &warm_))
+        return NULL;
+
+    if (!(self = GENERIC_ALLOC(type)))
+        LCOV_EXCL_LINE_RETURN(NULL);
+
+    if ((self->next = reloadcdb_all))
+        reloadcdb_all->prev = self;
+    reloadcdb_all = self;
+
+    self->interval = interval;
+    self->flags = FL_BACKGROUND | FL_WARM;
+    if (background_) {
+        switch (PyObject_IsTrue(background_)) {
+        case -1: goto error;
+        case 0: self->flags &= ~FL_BACKGROUND;
+        }
+    }
+    if (warm_) {
+        switch (PyObject_IsTrue(warm_)) {
+        case -1: goto error;
+        case 0: self->flags &= ~FL_WARM;
+        }
+    }
+
+    Py_INCREF(mmap_);
+    self->mmap = mmap_;
+
+    if (!(self->path = cdbx_fs_path(file_)))
+        goto error;
+
+    if (-1 == reloadcdb_load(self))
+        goto error;
+    self->checked = reloadcdb_now();
+
+    return (PyObject *)self;
+
+error:
+    Py_DECREF(self);
+    return NULL;
+}
+
+
+static int
+ReloadingCDBType_traverse(reloadcdb_t *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->current);
+    Py_VISIT(self->mmap);
+
+    return 0;
+}
+
+static int
+ReloadingCDBType_clear(reloadcdb_t *self)
+{
+    if (self->weakreflist)
+        PyObject_ClearWeakRefs((PyObject *)self);
+
+    if (self->prev)
+        self->prev->next = self->next;
+    else if (reloadcdb_all == self)
+        reloadcdb_all = self->next;
+    if (self->next)
+        self->next->prev = self->prev;
+    self->prev = self->next = NULL;
+
+    self->flags |= FL_CLOSED;
+    Py_CLEAR(self->current);
+    Py_CLEAR(self->mmap);
+    Py_CLEAR(self->path);
+
+    return 0;
+}
+
+DEFINE_GENERIC_DEALLOC(ReloadingCDBType)
+
+
+static PySequenceMethods ReloadingCDBType_as_sequence = {
+    0,                                       /* sq_length */
+    0,                                       /* sq_concat */
+    0,                                       /* sq_repeat */
+    0,                                       /* sq_item */
+    0,                                       /* sq_slice */
+    0,                                       /* sq_ass_item */
+    0,                                       /* sq_ass_slice */
+    (objobjproc)ReloadingCDBType_contains,   /* sq_contains */
+    0,                                       /* sq_inplace_concat */
+    0                                        /* sq_inplace_repeat */
+};
+
+static PyMappingMethods ReloadingCDBType_as_mapping = {
+    (lenfunc)ReloadingCDBType_len,           /* mp_length */
+    (binaryfunc)ReloadingCDBType_getitem,    /* mp_subscript */
+    0                                        /* mp_ass_subscript */
+};
+
+static PyMethodDef ReloadingCDBType_methods[] = {
+    {"get",
+     EXT_CFUNC(ReloadingCDBType_get),         RELOADCDB_GET_FLAGS,
+     ReloadingCDBType_get__doc__},
+
+    {"has_key",
+     EXT_CFUNC(ReloadingCDBType_has_key),     METH_O,
+     ReloadingCDBType_has_key__doc__},
+
+    {"reload",
+     EXT_CFUNC(ReloadingCDBType_reload),      METH_NOARGS,
+     ReloadingCDBType_reload__doc__},
+
+    {"close",
+     EXT_CFUNC(ReloadingCDBType_close),       METH_NOARGS,
+     ReloadingCDBType_close__doc__},
+
+    {NULL, NULL}
+};
+
+static PyGetSetDef ReloadingCDBType_getset[] = {
+    {"current",
+     (getter)ReloadingCDBType_get_current,
+     NULL,
+     ReloadingCDBType_current__doc__,
+     NULL},
+
+    {"generation",
+     (getter)ReloadingCDBType_get_generation,
+     NULL,
+     ReloadingCDBType_generation__doc__,
+     NULL},
+
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+PyDoc_STRVAR(ReloadingCDBType__doc__,
+"ReloadingCDB(file, mmap=None, interval=1.0, background=True, warm=True)\n\
+\n\
+CDB, which follows replacements of its file.\n\
+\n\
+At most once per `interval`, an operation checks whether the path points\n\
+to a different file (inode) now, e.g. after an atomic ``CDB.make``. The new\n\
+file is then opened and warmed in a background thread, while the old one\n\
+keeps serving, and swapped in afterwards. Operations never wait for a\n\
+reload. Iterators and other references to the previous CDB stay valid; it's\n\
+freed once the last of them is gone.\n\
+\n\
+All CDB methods are available (they act on the current CDB).\n\
+\n\
+Parameters:\n\
+  file (str or bytes):\n\
+    Filename\n\
+\n\
+  mmap (bool):\n\
+    Passed to every CDB opened\n\
+\n\
+  interval (float):\n\
+    Minimum seconds between two checks. Negative values disable automatic\n\
+    checks (use `reload`).\n\
+\n\
+  background (bool):\n\
+    Load new files in a background thread? If false, the operation\n\
+    noticing the change loads it.\n\
+\n\
+  warm (bool):\n\
+    Pre-fault the mapping (or read ahead the file) before swapping?");
+
+EXT_LOCAL PyTypeObject ReloadingCDBType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    EXT_MODULE_PATH ".ReloadingCDB",                    /* tp_name */
+    sizeof(reloadcdb_t),                                /* tp_basicsize */
+    0,                                                  /* tp_itemsize */
+    (destructor)ReloadingCDBType_dealloc,               /* tp_dealloc */
+    0,                                                  /* tp_print */
+    0,                                                  /* tp_getattr */
+    0,                                                  /* tp_setattr */
+    0,                                                  /* tp_compare */
+    0,                                                  /* tp_repr */
+    0,                                                  /* tp_as_number */
+    &ReloadingCDBType_as_sequence,                      /* tp_as_sequence */
+    &ReloadingCDBType_as_mapping,                       /* tp_as_mapping */
+    0,                                                  /* tp_hash */
+    0,                                                  /* tp_call */
+    0,                                                  /* tp_str */
+    (getattrofunc)ReloadingCDBType_getattro,            /* tp_getattro */
+    0,                                                  /* tp_setattro */
+    0,                                                  /* tp_as_buffer */
+    Py_TPFLAGS_HAVE_WEAKREFS                            /* tp_flags */
+    | Py_TPFLAGS_HAVE_CLASS
+    | Py_TPFLAGS_HAVE_SEQUENCE_IN
+    | Py_TPFLAGS_HAVE_ITER
+    | Py_TPFLAGS_BASETYPE
+    | Py_TPFLAGS_HAVE_GC,
+    ReloadingCDBType__doc__,                            /* tp_doc */
+    (traverseproc)ReloadingCDBType_traverse,            /* tp_traverse */
+    (inquiry)ReloadingCDBType_clear,                    /* tp_clear */
+    0,                                                  /* tp_richcompare */
+    offsetof(reloadcdb_t, weakreflist),                 /* tp_weaklistoffset */
+    (getiterfunc)ReloadingCDBType_iter,                 /* tp_iter */
+    0,                                                  /* tp_iternext */
+    ReloadingCDBType_methods,                           /* tp_methods */
+    0,                                                  /* tp_members */
+    ReloadingCDBType_getset,                            /* tp_getset */
+    0,                                                  /* tp_base */
+    0,                                                  /* tp_dict */
+    0,                                                  /* tp_descr_get */
+    0,                                                  /* tp_descr_set */
+    0,                                                  /* tp_dictoffset */
+    0,                                                  /* tp_init */
+    0,                                                  /* tp_alloc */
+    (newfunc)ReloadingCDBType_new,                      /* tp_new */
+};
+
+/* ------------------------- END ReloadingCDBType ------------------------ */
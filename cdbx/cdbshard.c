@@ -0,0 +1,779 @@
+/*
+ * Copyright 2016 - 2025
+ * Andr\xe9 Malo or his licensors, as applicable
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cdbx.h"
+
+/*
+ * Object structure for ShardedCDBType
+ */
+typedef struct {
+    PyObject_HEAD
+    PyObject *weakreflist;
+
+    PyObject *shards;  /* tuple of CDB instances, in manifest order */
+} cdbshard_t;
+
+/*
+ * Lookup state
+ */
+typedef struct {
+    cdbshard_t *self;
+    cdbx_cdb32_t *cdb32;
+    PyObject *result;  /* the value or a list of values (all) */
+    int all;
+    int found;
+} cdbshard_lookup_t;
+
+
+/* ------------------------ BEGIN Helper Functions ----------------------- */
+
+/*
+ * Find the path of a shard file (relative to the manifest)
+ *
+ * Return NULL on error
+ */
+EXT_LOCAL PyObject *
+cdbx_shard_path(PyObject *manifest, PyObject *name)
+{
+    PyObject *os_path, *dirname, *result;
+
+    if (!(os_path = PyImport_ImportModule("os.path")))
+        LCOV_EXCL_LINE_RETURN(NULL);
+
+    if (!(dirname = PyObject_CallMethod(os_path, "dirname", "(O)", manifest)))
+        LCOV_EXCL_LINE_GOTO(error);
+
+    result = PyObject_CallMethod(os_path, "join", "(OO)", dirname, name);
+    Py_DECREF(dirname);
+
+    Py_DECREF(os_path);
+    return result;
+
+/* LCOV_EXCL_START */
+error:
+    Py_DECREF(os_path);
+    return NULL;
+/* LCOV_EXCL_STOP */
+}
+
+
+/*
+ * Read the shard file names from the manifest
+ *
+ * Return NULL on error
+ */
+static PyObject *
+cdbshard_manifest_read(PyObject *manifest)
+{
+    PyObject *fp, *data, *lines, *tmp, *result;
+    Py_ssize_t idx, num;
+
+    if (!(fp = cdbx_file_open(manifest, "rb")))
+        return NULL;
+
+    data = PyObject_CallMethod(fp, "read", "()");
+    if (!(tmp = PyObject_CallMethod(fp, "close", "()"))) {
+        /* LCOV_EXCL_START */
+
+        Py_XDECREF(data);
+        data = NULL;
+
+        /* LCOV_EXCL_STOP */
+    }
+    else {
+        Py_DECREF(tmp);
+    }
+    Py_DECREF(fp);
+    if (!data)
+        LCOV_EXCL_LINE_RETURN(NULL);
+
+    lines = PyObject_CallMethod(data, "splitlines", "()");
+    Py_DECREF(data);
+    if (!lines)
+        LCOV_EXCL_LINE_RETURN(NULL);
+
+    if (!PyList_Check(lines) || (num = PyList_GET_SIZE(lines)) < 2)
+        goto error_format;
+
+    tmp = PyList_GET_ITEM(lines, 0);
+    if (!PyBytes_Check(tmp) || strcmp(PyBytes_AS_STRING(tmp),
+                                      CDBX_SHARD_MAGIC))
+        goto error_format;
+
+    for (idx = 1; idx < num; ++idx) {
+        if (!PyBytes_GET_SIZE(PyList_GET_ITEM(lines, idx)))
+            goto error_format;
+    }
+
+    result = PyList_GetSlice(lines, 1, num);
+    Py_DECREF(lines);
+    return result;
+
+error_format:
+    Py_DECREF(lines);
+    PyErr_SetString(PyExc_IOError, "Invalid shard manifest");
+    return NULL;
+}
+
+
+/*
+ * Return the cdb32 of a shard (lookup callback)
+ */
+static cdbx_cdb32_t *
+cdbshard_member(void *lookup_, Py_ssize_t idx)
+{
+    cdbshard_lookup_t *lookup = lookup_;
+
+    if (!(lookup->cdb32 = cdbx_type_get_cdb32(
+            (cdbtype_t *)PyTuple_GET_ITEM(lookup->self->shards, idx))))
+        cdbx_raise_closed();
+
+    return lookup->cdb32;
+}
+
+
+/*
+ * Visit a value found in the shard
+ */
+static int
+cdbshard_visit(void *lookup_, Py_ssize_t idx, int first,
+               cdbx_cdb32_pointer_t *value)
+{
+    cdbshard_lookup_t *lookup = lookup_;
+    PyObject *item;
+    int res;
+
+    (void)idx;
+    (void)first;
+
+    lookup->found = 1;
+    if (!lookup->result)
+        return CDBX_VISIT_STOP;
+
+    if (-1 == cdbx_cdb32_read(lookup->cdb32, value, &item))
+        LCOV_EXCL_LINE_RETURN(-1);
+
+    if (!lookup->all) {
+        Py_DECREF(lookup->result);
+        lookup->result = item;
+        return CDBX_VISIT_STOP;
+    }
+
+    res = PyList_Append(lookup->result, item);
+    Py_DECREF(item);
+    if (-1 == res)
+        LCOV_EXCL_LINE_RETURN(-1);
+
+    return CDBX_VISIT_NEXT_VALUE;
+}
+
+
+/*
+ * Look up a key
+ *
+ * If result_ is NULL, only the existence is checked.
+ *
+ * Return -1 on error
+ * Return 0 if not found
+ * Return 1 if found
+ */
+static int
+cdbshard_lookup(cdbshard_t *self, PyObject *key, int all,
+                PyObject **result_)
+{
+    cdbshard_lookup_t lookup;
+
+    lookup.self = self;
+    lookup.cdb32 = NULL;
+    lookup.all = all;
+    lookup.found = 0;
+    lookup.result = NULL;
+    if (result_) {
+        if (all)
+            lookup.result = PyList_New(0);
+        else {
+            Py_INCREF(Py_None);
+            lookup.result = Py_None;
+        }
+        if (!lookup.result)
+            LCOV_EXCL_LINE_RETURN(-1);
+    }
+
+    if (-1 == cdbx_cdb32_find_routed(PyTuple_GET_SIZE(self->shards),
+                                     cdbshard_member, key, cdbshard_visit,
+                                     &lookup)) {
+        Py_XDECREF(lookup.result);
+        return -1;
+    }
+
+    if (result_)
+        *result_ = lookup.result;
+    return lookup.found;
+}
+
+
+/*
+ * Chain the iterators of all shards
+ *
+ * If method is NULL, the shards are iterated directly. Otherwise the method
+ * is called with the `all` argument.
+ *
+ * Return NULL on error
+ */
+static PyObject *
+cdbshard_chain(cdbshard_t *self, char *method, PyObject *all_)
+{
+    PyObject *itertools, *chain, *iters, *iter, *result;
+    Py_ssize_t idx, num;
+
+    num = PyTuple_GET_SIZE(self->shards);
+    if (!(iters = PyTuple_New(num)))
+        LCOV_EXCL_LINE_RETURN(NULL);
+
+    for (idx = 0; idx < num; ++idx) {
+        if (method)
+            iter = PyObject_CallMethod(PyTuple_GET_ITEM(self->shards, idx),
+                                       method, "(O)", all_);
+        else
+            iter = PyObject_GetIter(PyTuple_GET_ITEM(self->shards, idx));
+        if (!iter)
+            goto error;
+        PyTuple_SET_ITEM(iters, idx, iter);
+    }
+
+    if (!(itertools = PyImport_ImportModule("itertools")))
+        LCOV_EXCL_LINE_GOTO(error);
+    chain = PyObject_GetAttrString(itertools, "chain");
+    Py_DECREF(itertools);
+    if (!chain)
+        LCOV_EXCL_LINE_GOTO(error);
+
+    result = PyObject_Call(chain, iters, NULL);
+    Py_DECREF(chain);
+
+    Py_DECREF(iters);
+    return result;
+
+error:
+    Py_DECREF(iters);
+    return NULL;
+}
+
+/* ------------------------- END Helper Functions ------------------------ */
+
+/* ------------------------- BEGIN ShardedCDBType ------------------------ */
+
+PyDoc_STRVAR(ShardedCDBType_make__doc__,
+"make(cls, manifest, shards=64, mmap=None)\n\
+\n\
+Create a ShardedCDBMaker instance, which writes the shard files next to\n\
+the manifest (named ``<manifest>.<index>``).\n\
+\n\
+Parameters:\n\
+  manifest (str or bytes):\n\
+    Filename of the manifest\n\
+\n\
+  shards (int):\n\
+    Number of shard files. Default: 64\n\
+\n\
+  mmap (bool):\n\
+    Passed to the ShardedCDB created by the maker's ``commit`` method\n\
+\n\
+Returns:\n\
+  ShardedCDBMaker: New maker instance");
+
+static PyObject *
+ShardedCDBType_make(PyTypeObject *cls, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"manifest", "shards", "mmap", NULL};
+    PyObject *manifest_, *mmap_ = NULL;
+    Py_ssize_t num = 64;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|nO", kwlist,
+                                     &manifest_, &num, &mmap_))
+        return NULL;
+
+    return cdbx_shard_maker_new(cls, manifest_, num, mmap_);
+}
+
+
+PyDoc_STRVAR(ShardedCDBType_get__doc__,
+"get(self, key, default=None, all=False)\n\
+\n\
+Return value(s) for a key from the shard it belongs to\n\
+\n\
+If `key` is not found, `default` is returned.\n\
+\n\
+Note that in case of a unicode key, it will be transformed to a byte string\n\
+using the latin-1 encoding.\n\
+\n\
+Parameters:\n\
+  key (bytes):\n\
+    Key to lookup\n\
+\n\
+  default:\n\
+    Default value to pass back if the key was not found\n\
+\n\
+  all (bool):\n\
+    Return all values as a list instead of only the first? Default: False\n\
+\n\
+Returns:\n\
+  bytes or list: The value(s) or `default`");
+
+static PyObject *
+cdbshard_get(cdbshard_t *self, PyObject *key_, PyObject *default_,
+             PyObject *all_)
+{
+    PyObject *result;
+    int all = 0;
+
+    if (all_) {
+        switch (PyObject_IsTrue(all_)) {
+        case -1: return NULL;
+        case 1: all = 1;
+        }
+    }
+
+    switch (cdbshard_lookup(self, key_, all, &result)) {
+    case -1:
+        return NULL;
+
+    case 0:
+        Py_DECREF(result);
+        Py_INCREF(default_);
+        return default_;
+    }
+
+    return result;
+}
+
+#ifdef CDBX_FASTCALL
+static PyObject *
+ShardedCDBType_get(cdbshard_t *self, PyObject *const *args, Py_ssize_t nargs,
+                   PyObject *kwnames)
+{
+    static const char * const kwlist[] = {"key", "default", "all", NULL};
+    PyObject *argv[3] = {NULL, Py_None, NULL};
+
+    if (-1 == cdbx_parse_fastcall("get", args, nargs, kwnames, kwlist, 1,
+                                  argv))
+        return NULL;
+
+    return cdbshard_get(self, argv[0], argv[1], argv[2]);
+}
+#else
+static PyObject *
+ShardedCDBType_get(cdbshard_t *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"key", "default", "all", NULL};
+    PyObject *key_, *default_ = Py_None, *all_ = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|OO", kwlist,
+                                     &key_, &default_, &all_))
+        return NULL;
+
+    return cdbshard_get(self, key_, default_, all_);
+}
+#endif
+
+
+static PyObject *
+ShardedCDBType_getitem(cdbshard_t *self, PyObject *key)
+{
+    PyObject *result;
+
+    switch (cdbshard_lookup(self, key, 0, &result)) {
+    case -1:
+        return NULL;
+
+    case 0:
+        Py_DECREF(result);
+        PyErr_SetObject(PyExc_KeyError, key);
+        return NULL;
+    }
+
+    return result;
+}
+
+
+static int
+ShardedCDBType_contains(cdbshard_t *self, PyObject *key)
+{
+    return cdbshard_lookup(self, key, 0, NULL);
+}
+
+
+PyDoc_STRVAR(ShardedCDBType_has_key__doc__,
+"has_key(self, key)\n\
+\n\
+Check if the key appears in the sharded CDB\n\
+\n\
+Parameters:\n\
+  key (bytes):\n\
+    Key to look up\n\
+\n\
+Returns:\n\
+  bool: Does the key exist?");
+
+static PyObject *
+ShardedCDBType_has_key(cdbshard_t *self, PyObject *key)
+{
+    switch (ShardedCDBType_contains(self, key)) {
+    case -1: return NULL;
+    case 0: Py_RETURN_FALSE;
+    }
+
+    Py_RETURN_TRUE;
+}
+
+
+static Py_ssize_t
+ShardedCDBType_len(cdbshard_t *self)
+{
+    Py_ssize_t idx, len, result = 0;
+
+    for (idx = 0; idx < PyTuple_GET_SIZE(self->shards); ++idx) {
+        if (-1 == (len = PyObject_Length(PyTuple_GET_ITEM(self->shards,
+                                                          idx))))
+            return -1;
+        result += len;
+    }
+
+    return result;
+}
+
+
+static PyObject *
+ShardedCDBType_iter(cdbshard_t *self)
+{
+    return cdbshard_chain(self, NULL, NULL);
+}
+
+
+PyDoc_STRVAR(ShardedCDBType_keys__doc__,
+"keys(self, all=False)\n\
+\n\
+Create key iterator over all shards (shard by shard)\n\
+\n\
+Parameters:\n\
+  all (bool):\n\
+    Iterate over all keys (including duplicates)? Default: False\n\
+\n\
+Returns:\n\
+  iterable: Key iterator");
+
+PyDoc_STRVAR(ShardedCDBType_values__doc__,
+"values(self, all=False)\n\
+\n\
+Create value iterator over all shards (shard by shard)\n\
+\n\
+Parameters:\n\
+  all (bool):\n\
+    Iterate over all values (including those of duplicate keys)?\n\
+    Default: False\n\
+\n\
+Returns:\n\
+  iterable: Value iterator");
+
+PyDoc_STRVAR(ShardedCDBType_items__doc__,
+"items(self, all=False)\n\
+\n\
+Create key/value pair iterator over all shards (shard by shard)\n\
+\n\
+Parameters:\n\
+  all (bool):\n\
+    Iterate over all items (including duplicate keys)? Default: False\n\
+\n\
+Returns:\n\
+  iterable: (key, value) iterator");
+
+#define SHARDED_CDB_ITER(name)                                              \
+static PyObject *                                                           \
+ShardedCDBType_##name(cdbshard_t *self, PyObject *args, PyObject *kwds)     \
+{                                                                           \
+    static char *kwlist[] = {"all", NULL};                                  \
+    PyObject *all_ = Py_False;                                              \
+                                                                            \
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist, &all_))      \
+        return NULL;                                                        \
+                                                                            \
+    return cdbshard_chain(self, #name, all_);                               \
+}
+
+SHARDED_CDB_ITER(keys)
+SHARDED_CDB_ITER(values)
+SHARDED_CDB_ITER(items)
+
+#undef SHARDED_CDB_ITER
+
+
+PyDoc_STRVAR(ShardedCDBType_close__doc__,
+"close(self)\n\
+\n\
+Close all shards.");
+
+static PyObject *
+ShardedCDBType_close(cdbshard_t *self)
+{
+    PyObject *tmp;
+    Py_ssize_t idx;
+    int res = 0;
+
+    for (idx = 0; idx < PyTuple_GET_SIZE(self->shards); ++idx) {
+        if (!(tmp = PyObject_CallMethod(PyTuple_GET_ITEM(self->shards, idx),
+                                        "close", "()"))) {
+            /* LCOV_EXCL_START */
+
+            if (res == -1)
+                PyErr_Clear();
+            res = -1;
+
+            /* LCOV_EXCL_STOP */
+        }
+        else {
+            Py_DECREF(tmp);
+        }
+    }
+
+    if (res == -1)
+        LCOV_EXCL_LINE_RETURN(NULL);
+    Py_RETURN_NONE;
+}
+
+
+PyDoc_STRVAR(ShardedCDBType_shards__doc__,
+"The shards (tuple of CDB instances, in manifest order)");
+
+static PyObject *
+ShardedCDBType_shards(cdbshard_t *self, void *closure)
+{
+    (void)closure;
+
+    Py_INCREF(self->shards);
+    return self->shards;
+}
+
+
+static PyObject *
+ShardedCDBType_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"manifest", "mmap", NULL};
+    PyObject *manifest_, *mmap_ = NULL, *manifest, *names, *path, *cdb;
+    cdbshard_t *self;
+    Py_ssize_t idx, num;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", kwlist,
+                                     &manifest_, &mmap_))
+        return NULL;
+
+    if (!mmap_)
+        mmap_ = Py_None;
+
+    if (!(manifest = cdbx_fs_path(manifest_)))
+        return NULL;
+
+    names = cdbshard_manifest_read(manifest);
+    if (!names)
+        goto error_manifest;
+
+    if (!(self = GENERIC_ALLOC(type)))
+        LCOV_EXCL_LINE_GOTO(error_names);
+
+    num = PyList_GET_SIZE(names);
+    if (!(self->shards = PyTuple_New(num)))
+        LCOV_EXCL_LINE_GOTO(error_self);
+
+    for (idx = 0; idx < num; ++idx) {
+        if (!(path = cdbx_shard_path(manifest,
+                                     PyList_GET_ITEM(names, idx))))
+            LCOV_EXCL_LINE_GOTO(error_self);
+
+        cdb = PyObject_CallFunction((PyObject *)&CDBType, "(OiO)", path, 1,
+                                    mmap_);
+        Py_DECREF(path);
+        if (!cdb)
+            goto error_self;
+        PyTuple_SET_ITEM(self->shards, idx, cdb);
+    }
+
+    Py_DECREF(names);
+    Py_DECREF(manifest);
+    return (PyObject *)self;
+
+error_self:
+    Py_DECREF(self);
+error_names:
+    Py_DECREF(names);
+error_manifest:
+    Py_DECREF(manifest);
+    return NULL;
+}
+
+
+static int
+ShardedCDBType_traverse(cdbshard_t *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->shards);
+
+    return 0;
+}
+
+static int
+ShardedCDBType_clear(cdbshard_t *self)
+{
+    if (self->weakreflist)
+        PyObject_ClearWeakRefs((PyObject *)self);
+
+    Py_CLEAR(self->shards);
+
+    return 0;
+}
+
+DEFINE_GENERIC_DEALLOC(ShardedCDBType)
+
+
+static PySequenceMethods ShardedCDBType_as_sequence = {
+    0,                                    /* sq_length */
+    0,                                    /* sq_concat */
+    0,                                    /* sq_repeat */
+    0,                                    /* sq_item */
+    0,                                    /* sq_slice */
+    0,                                    /* sq_ass_item */
+    0,                                    /* sq_ass_slice */
+    (objobjproc)ShardedCDBType_contains,  /* sq_contains */
+    0,                                    /* sq_inplace_concat */
+    0                                     /* sq_inplace_repeat */
+};
+
+static PyMappingMethods ShardedCDBType_as_mapping = {
+    (lenfunc)ShardedCDBType_len,          /* mp_length */
+    (binaryfunc)ShardedCDBType_getitem,   /* mp_subscript */
+    0                                     /* mp_ass_subscript */
+};
+
+static PyMethodDef ShardedCDBType_methods[] = {
+    {"make",
+     EXT_CFUNC(ShardedCDBType_make),          METH_CLASS    |
+                                              METH_KEYWORDS |
+                                              METH_VARARGS,
+     ShardedCDBType_make__doc__},
+
+    {"close",
+     EXT_CFUNC(ShardedCDBType_close),         METH_NOARGS,
+     ShardedCDBType_close__doc__},
+
+    {"get",
+     EXT_CFUNC(ShardedCDBType_get),           CDBX_METH_KEYWORDS,
+     ShardedCDBType_get__doc__},
+
+    {"has_key",
+     EXT_CFUNC(ShardedCDBType_has_key),       METH_O,
+     ShardedCDBType_has_key__doc__},
+
+    {"keys",
+     EXT_CFUNC(ShardedCDBType_keys),          METH_KEYWORDS |
+                                              METH_VARARGS,
+     ShardedCDBType_keys__doc__},
+
+    {"values",
+     EXT_CFUNC(ShardedCDBType_values),        METH_KEYWORDS |
+                                              METH_VARARGS,
+     ShardedCDBType_values__doc__},
+
+    {"items",
+     EXT_CFUNC(ShardedCDBType_items),         METH_KEYWORDS |
+                                              METH_VARARGS,
+     ShardedCDBType_items__doc__},
+
+    {NULL, NULL}
+};
+
+static PyGetSetDef ShardedCDBType_getset[] = {
+    {"shards",
+     (getter)ShardedCDBType_shards,
+     NULL,
+     ShardedCDBType_shards__doc__,
+     NULL},
+
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+PyDoc_STRVAR(ShardedCDBType__doc__,
+"ShardedCDB(manifest, mmap=None)\n\
+\n\
+Read-only mapping over a set of CDB files, which were created by\n\
+ShardedCDB.make.\n\
+\n\
+Every key lives in exactly one shard, which is picked by a stable hash of\n\
+the key. Lookups only touch that shard and hash the key only once.\n\
+Iteration runs shard by shard.\n\
+\n\
+Parameters:\n\
+  manifest (str or bytes):\n\
+    Filename of the manifest. It lists the shard files (relative to the\n\
+    manifest's directory).\n\
+\n\
+  mmap (bool):\n\
+    Passed to the CDBs of the shards.");
+
+EXT_LOCAL PyTypeObject ShardedCDBType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    EXT_MODULE_PATH ".ShardedCDB",                      /* tp_name */
+    sizeof(cdbshard_t),                                 /* tp_basicsize */
+    0,                                                  /* tp_itemsize */
+    (destructor)ShardedCDBType_dealloc,                 /* tp_dealloc */
+    0,                                                  /* tp_print */
+    0,                                                  /* tp_getattr */
+    0,                                                  /* tp_setattr */
+    0,                                                  /* tp_compare */
+    0,                                                  /* tp_repr */
+    0,                                                  /* tp_as_number */
+    &ShardedCDBType_as_sequence,                        /* tp_as_sequence */
+    &ShardedCDBType_as_mapping,                         /* tp_as_mapping */
+    (hashfunc)PyObject_HashNotImplemented,              /* tp_hash */
+    0,                                                  /* tp_call */
+    0,                                                  /* tp_str */
+    PyObject_GenericGetAttr,                            /* tp_getattro */
+    0,                                                  /* tp_setattro */
+    0,                                                  /* tp_as_buffer */
+    Py_TPFLAGS_HAVE_WEAKREFS                            /* tp_flags */
+    | Py_TPFLAGS_HAVE_CLASS
+    | Py_TPFLAGS_HAVE_SEQUENCE_IN
+    | Py_TPFLAGS_HAVE_ITER
+    | Py_TPFLAGS_BASETYPE
+    | Py_TPFLAGS_HAVE_GC,
+    ShardedCDBType__doc__,                              /* tp_doc */
+    (traverseproc)ShardedCDBType_traverse,              /* tp_traverse */
+    (inquiry)ShardedCDBType_clear,                      /* tp_clear */
+    0,                                                  /* tp_richcompare */
+    offsetof(cdbshard_t, weakreflist),                  /* tp_weaklistoffset */
+    (getiterfunc)ShardedCDBType_iter,                   /* tp_iter */
+    0,                                                  /* tp_iternext */
+    ShardedCDBType_methods,                             /* tp_methods */
+    0,                                                  /* tp_members */
+    ShardedCDBType_getset,                              /* tp_getset */
+    0,                                                  /* tp_base */
+    0,                                                  /* tp_dict */
+    0,                                                  /* tp_descr_get */
+    0,                                                  /* tp_descr_set */
+    0,                                                  /* tp_dictoffset */
+    0,                                                  /* tp_init */
+    0,                                                  /* tp_alloc */
+    (newfunc)ShardedCDBType_new,                        /* tp_new */
+};
+
+/* -------------------------- END ShardedCDBType ------------------------- */
@@ -0,0 +1,533 @@
+/*
+ * Copyright 2016 - 2025
+ * Andr\xe9 Malo or his licensors, as applicable
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cdbx.h"
+
+#define FL_DESTROY   (1 << 0)
+#define FL_CLOSED    (1 << 1)
+#define FL_COMMITTED (1 << 2)
+#define FL_ERROR     (1 << 3)
+#define FL_COMMITTING (1 << 4)
+
+/*
+ * Object structure for ShardedCDBMakerType
+ */
+typedef struct {
+    PyObject_HEAD
+    PyObject *weakreflist;
+
+    cdbx_cdb32_maker_t **makers;  /* one per shard */
+    Py_ssize_t num;
+
+    PyObject *cdb_cls;
+    PyObject *manifest;  /* absolute filename (bytes) */
+    PyObject *names;     /* list of shard filenames (relative) */
+    PyObject *fps;       /* list of shard file objects */
+    PyObject *mmap;
+    int flags;
+} cdbshardmaker_t;
+
+static PyObject *
+ShardedCDBMakerType_close(cdbshardmaker_t *);
+
+/* ------------------------ BEGIN Helper Functions ----------------------- */
+
+/*
+ * Refuse to touch the makers while they are committed without the GIL
+ *
+ * Return -1 on error (commit in progress)
+ * Return 0 on success
+ */
+static int
+cdbshardmaker_check_committing(cdbshardmaker_t *self)
+{
+    if (self->flags & FL_COMMITTING) {
+        PyErr_SetString(PyExc_IOError, "Commit in progress");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Write the manifest (and sync it to disk)
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+static int
+cdbshardmaker_manifest_write(cdbshardmaker_t *self)
+{
+    PyObject *lines, *sep, *data, *fp, *tmp;
+    int res = -1, fd;
+
+    lines = PyList_GetSlice(self->names, 0, PyList_GET_SIZE(self->names));
+    if (!lines)
+        LCOV_EXCL_LINE_RETURN(-1);
+    if (!(tmp = PyBytes_FromString(CDBX_SHARD_MAGIC)))
+        LCOV_EXCL_LINE_GOTO(error_lines);
+    res = PyList_Insert(lines, 0, tmp);
+    Py_DECREF(tmp);
+    if (-1 == res)
+        LCOV_EXCL_LINE_GOTO(error_lines);
+
+    /* trailing newline */
+    if (!(tmp = PyBytes_FromString("")))
+        LCOV_EXCL_LINE_GOTO(error_lines);
+    res = PyList_Append(lines, tmp);
+    Py_DECREF(tmp);
+    if (-1 == res)
+        LCOV_EXCL_LINE_GOTO(error_lines);
+
+    res = -1;
+    if (!(sep = PyBytes_FromString("\n")))
+        LCOV_EXCL_LINE_GOTO(error_lines);
+    data = PyObject_CallMethod(sep, "join", "(O)", lines);
+    Py_DECREF(sep);
+    if (!data)
+        LCOV_EXCL_LINE_GOTO(error_lines);
+
+    if (!(fp = cdbx_file_open(self->manifest, "wb")))
+        goto error_data;
+
+    if (!(tmp = PyObject_CallMethod(fp, "write", "(O)", data)))
+        LCOV_EXCL_LINE_GOTO(error_fp);
+    Py_DECREF(tmp);
+
+    if (!(tmp = PyObject_CallMethod(fp, "flush", "()")))
+        LCOV_EXCL_LINE_GOTO(error_fp);
+    Py_DECREF(tmp);
+
+    if (!(tmp = PyObject_CallMethod(fp, "fileno", "()")))
+        LCOV_EXCL_LINE_GOTO(error_fp);
+    res = cdbx_fd(tmp, &fd);
+    Py_DECREF(tmp);
+    if (-1 == res)
+        LCOV_EXCL_LINE_GOTO(error_fp);
+
+    if (-1 == (res = fsync(fd)))
+        PyErr_SetFromErrno(PyExc_IOError);  /* LCOV_EXCL_LINE */
+
+error_fp:
+    if (!(tmp = PyObject_CallMethod(fp, "close", "()"))) {
+        res = -1;  /* LCOV_EXCL_LINE */
+    }
+    else {
+        Py_DECREF(tmp);
+    }
+    Py_DECREF(fp);
+error_data:
+    Py_DECREF(data);
+error_lines:
+    Py_DECREF(lines);
+    return res;
+}
+
+/* ------------------------- END Helper Functions ------------------------ */
+
+/* ---------------------- BEGIN ShardedCDBMakerType ---------------------- */
+
+PyDoc_STRVAR(ShardedCDBMakerType_commit__doc__,
+"commit(self, threads=None)\n\
+\n\
+Commit all shards, write the manifest and finish the creation.\n\
+\n\
+The shards are committed and synced to disk in parallel native threads.\n\
+The manifest is written last. The `commit` method returns a new instance\n\
+of the class, which created the maker (usually ShardedCDB). Other threads\n\
+calling `add` or `close` meanwhile get an IOError.\n\
+\n\
+Parameters:\n\
+  threads (int):\n\
+    Maximum number of threads to use. If omitted or ``None``, one thread\n\
+    per CPU is used.\n\
+\n\
+Returns:\n\
+  ShardedCDB: New ShardedCDB instance");
+
+static PyObject *
+ShardedCDBMakerType_commit(cdbshardmaker_t *self, PyObject *args,
+                           PyObject *kwds)
+{
+    static char *kwlist[] = {"threads", NULL};
+    PyObject *threads_ = NULL, *tmp;
+    Py_ssize_t threads = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist, &threads_))
+        return NULL;
+
+    if (threads_ && threads_ != Py_None) {
+        threads = PyNumber_AsSsize_t(threads_, PyExc_OverflowError);
+        if (threads == -1 && PyErr_Occurred())
+            return NULL;
+        if (threads < 1) {
+            PyErr_SetString(PyExc_ValueError,
+                            "Number of threads must be positive");
+            return NULL;
+        }
+        if (threads > INT_MAX)
+            threads = INT_MAX;
+    }
+
+    if (-1 == cdbshardmaker_check_committing(self))
+        return NULL;
+    if (self->flags & (FL_CLOSED | FL_COMMITTED | FL_ERROR))
+        return cdbx_raise_closed();
+
+    /* close() and add() refuse to run until we are done (the GIL is
+     * released meanwhile) */
+    self->flags |= FL_COMMITTING;
+    if (-1 == cdbx_cdb32_maker_commit_many(self->makers, self->num,
+                                           (int)threads))
+        LCOV_EXCL_LINE_GOTO(error);
+
+    if (-1 == cdbshardmaker_manifest_write(self))
+        goto error;
+    self->flags |= FL_COMMITTED;
+    self->flags &= ~(FL_DESTROY | FL_COMMITTING);
+
+    if (!(tmp = ShardedCDBMakerType_close(self)))
+        LCOV_EXCL_LINE_RETURN(NULL);
+    Py_DECREF(tmp);
+
+    return PyObject_CallFunction(self->cdb_cls, "(OO)", self->manifest,
+                                 self->mmap);
+
+error:
+    self->flags &= ~FL_COMMITTING;
+    self->flags |= FL_ERROR;
+    return NULL;
+}
+
+
+PyDoc_STRVAR(ShardedCDBMakerType_add__doc__,
+"add(self, key, value)\n\
+\n\
+Add the key/value pair to the shard the key belongs to.\n\
+\n\
+Note that in case of a unicode key or value, it will be transformed to a\n\
+byte string using the latin-1 encoding.\n\
+\n\
+Parameters:\n\
+  key (str or bytes)\n\
+    Key\n\
+\n\
+  value (str or bytes):\n\
+    Value");
+
+static PyObject *
+cdbshardmaker_add(cdbshardmaker_t *self, PyObject *key_, PyObject *value_)
+{
+    Py_ssize_t idx;
+
+    if (-1 == cdbshardmaker_check_committing(self))
+        return NULL;
+    if (self->flags & (FL_CLOSED | FL_COMMITTED | FL_ERROR))
+        return cdbx_raise_closed();
+
+    if (-1 == cdbx_cdb32_route(key_, self->num, &idx))
+        return NULL;
+
+    if (-1 == cdbx_cdb32_maker_add(self->makers[idx], key_, value_)) {
+        self->flags |= FL_ERROR;
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+#ifdef CDBX_FASTCALL
+static PyObject *
+ShardedCDBMakerType_add(cdbshardmaker_t *self, PyObject *const *args,
+                        Py_ssize_t nargs, PyObject *kwnames)
+{
+    static const char * const kwlist[] = {"key", "value", NULL};
+    PyObject *argv[2] = {NULL, NULL};
+
+    if (-1 == cdbx_parse_fastcall("add", args, nargs, kwnames, kwlist, 2,
+                                  argv))
+        return NULL;
+
+    return cdbshardmaker_add(self, argv[0], argv[1]);
+}
+#else
+static PyObject *
+ShardedCDBMakerType_add(cdbshardmaker_t *self, PyObject *args,
+                        PyObject *kwds)
+{
+    static char *kwlist[] = {"key", "value", NULL};
+    PyObject *key_, *value_;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO", kwlist,
+                                     &key_, &value_))
+        return NULL;
+
+    return cdbshardmaker_add(self, key_, value_);
+}
+#endif
+
+
+PyDoc_STRVAR(ShardedCDBMakerType_close__doc__,
+"close(self)\n\
+\n\
+Close the ShardedCDBMaker and destroy the shard files (unless committed)");
+
+static PyObject *
+ShardedCDBMakerType_close(cdbshardmaker_t *self)
+{
+    PyObject *fps, *names, *path, *result;
+    Py_ssize_t idx;
+    int res = 0;
+
+    if (-1 == cdbshardmaker_check_committing(self))
+        return NULL;
+
+    self->flags |= FL_CLOSED;
+
+    if (self->makers) {
+        for (idx = 0; idx < self->num; ++idx)
+            cdbx_cdb32_maker_destroy(&self->makers[idx]);
+        PyMem_Free(self->makers);
+        self->makers = NULL;
+    }
+
+    fps = self->fps;
+    names = self->names;
+    self->fps = self->names = NULL;
+    if (!fps)
+        goto done;
+
+    for (idx = 0; idx < PyList_GET_SIZE(fps); ++idx) {
+        if (!(result = PyObject_CallMethod(PyList_GET_ITEM(fps, idx),
+                                           "close", "()"))) {
+            res = -1;  /* LCOV_EXCL_LINE */
+            continue;  /* LCOV_EXCL_LINE */
+        }
+        Py_DECREF(result);
+
+        if (self->flags & FL_DESTROY) {
+            if (!(path = cdbx_shard_path(self->manifest,
+                                         PyList_GET_ITEM(names, idx)))) {
+                res = -1;  /* LCOV_EXCL_LINE */
+                continue;  /* LCOV_EXCL_LINE */
+            }
+            if (-1 == cdbx_unlink(path))
+                res = -1;  /* LCOV_EXCL_LINE */
+            Py_DECREF(path);
+        }
+    }
+
+done:
+    Py_XDECREF(names);
+    Py_XDECREF(fps);
+
+    if (res == -1)
+        LCOV_EXCL_LINE_RETURN(NULL);
+    Py_RETURN_NONE;
+}
+
+
+static PyMethodDef ShardedCDBMakerType_methods[] = {
+    {"close",
+     EXT_CFUNC(ShardedCDBMakerType_close),    METH_NOARGS,
+     ShardedCDBMakerType_close__doc__},
+
+    {"add",
+     EXT_CFUNC(ShardedCDBMakerType_add),      CDBX_METH_KEYWORDS,
+     ShardedCDBMakerType_add__doc__},
+
+    {"commit",
+     EXT_CFUNC(ShardedCDBMakerType_commit),   METH_KEYWORDS | METH_VARARGS,
+     ShardedCDBMakerType_commit__doc__},
+
+    /* Sentinel */
+    {NULL, NULL}
+};
+
+
+static int
+ShardedCDBMakerType_traverse(cdbshardmaker_t *self, visitproc visit,
+                             void *arg)
+{
+    Py_VISIT(self->fps);
+    Py_VISIT(self->cdb_cls);
+    Py_VISIT(self->mmap);
+
+    return 0;
+}
+
+
+static int
+ShardedCDBMakerType_clear(cdbshardmaker_t *self)
+{
+    PyObject *result;
+
+    if (self->weakreflist)
+        PyObject_ClearWeakRefs((PyObject *)self);
+
+    if (!(result = ShardedCDBMakerType_close(self))) {
+        PyErr_Clear();  /* LCOV_EXCL_LINE */
+    }
+    else {
+        Py_DECREF(result);
+    }
+
+    Py_CLEAR(self->manifest);
+    Py_CLEAR(self->cdb_cls);
+    Py_CLEAR(self->mmap);
+
+    return 0;
+}
+
+
+DEFINE_GENERIC_DEALLOC(ShardedCDBMakerType)
+
+
+PyDoc_STRVAR(ShardedCDBMakerType__doc__,
+"ShardedCDBMaker - use ShardedCDB.make to create instance");
+
+EXT_LOCAL PyTypeObject ShardedCDBMakerType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    EXT_MODULE_PATH ".ShardedCDBMaker",                 /* tp_name */
+    sizeof(cdbshardmaker_t),                            /* tp_basicsize */
+    0,                                                  /* tp_itemsize */
+    (destructor)ShardedCDBMakerType_dealloc,            /* tp_dealloc */
+    0,                                                  /* tp_print */
+    0,                                                  /* tp_getattr */
+    0,                                                  /* tp_setattr */
+    0,                                                  /* tp_compare */
+    0,                                                  /* tp_repr */
+    0,                                                  /* tp_as_number */
+    0,                                                  /* tp_as_sequence */
+    0,                                                  /* tp_as_mapping */
+    0,                                                  /* tp_hash */
+    0,                                                  /* tp_call */
+    0,                                                  /* tp_str */
+    0,                                                  /* tp_getattro */
+    0,                                                  /* tp_setattro */
+    0,                                                  /* tp_as_buffer */
+    Py_TPFLAGS_HAVE_WEAKREFS                            /* tp_flags */
+    | Py_TPFLAGS_HAVE_CLASS
+    | Py_TPFLAGS_HAVE_GC,
+    ShardedCDBMakerType__doc__,                         /* tp_doc */
+    (traverseproc)ShardedCDBMakerType_traverse,         /* tp_traverse */
+    (inquiry)ShardedCDBMakerType_clear,                 /* tp_clear */
+    0,                                                  /* tp_richcompare */
+    offsetof(cdbshardmaker_t, weakreflist),             /* tp_weaklistoffset */
+    0,                                                  /* tp_iter */
+    0,                                                  /* tp_iternext */
+    ShardedCDBMakerType_methods,                        /* tp_methods */
+};
+
+
+/*
+ * Create new ShardedCDBMaker object
+ */
+EXT_LOCAL PyObject *
+cdbx_shard_maker_new(PyTypeObject *cdb_cls, PyObject *manifest_,
+                     Py_ssize_t num, PyObject *mmap_)
+{
+    cdbshardmaker_t *self;
+    PyObject *os_path, *base, *name, *path, *fp, *tmp;
+    Py_ssize_t idx;
+    int fd, res;
+
+    if (num < 1) {
+        PyErr_SetString(PyExc_ValueError,
+                        "Number of shards must be positive");
+        return NULL;
+    }
+
+    if (!(self = GENERIC_ALLOC(&ShardedCDBMakerType)))
+        LCOV_EXCL_LINE_RETURN(NULL);
+
+    self->flags = FL_CLOSED | FL_DESTROY;
+    self->cdb_cls = (PyObject *)cdb_cls;
+    Py_INCREF(self->cdb_cls);
+    self->mmap = mmap_ ? mmap_ : Py_None;
+    Py_INCREF(self->mmap);
+
+    if (!(self->manifest = cdbx_fs_path(manifest_)))
+        goto error;
+
+    if (!(self->makers = PyMem_Malloc((size_t)num * sizeof *self->makers))) {
+        /* LCOV_EXCL_START */
+
+        PyErr_NoMemory();
+        goto error;
+
+        /* LCOV_EXCL_STOP */
+    }
+    for (idx = 0; idx < num; ++idx)
+        self->makers[idx] = NULL;
+    self->num = num;
+
+    if (!(self->fps = PyList_New(0)) || !(self->names = PyList_New(0)))
+        LCOV_EXCL_LINE_GOTO(error);
+    self->flags &= ~FL_CLOSED;
+
+    if (!(os_path = PyImport_ImportModule("os.path")))
+        LCOV_EXCL_LINE_GOTO(error);
+    base = PyObject_CallMethod(os_path, "basename", "(O)", self->manifest);
+    Py_DECREF(os_path);
+    if (!base)
+        LCOV_EXCL_LINE_GOTO(error);
+
+    for (idx = 0; idx < num; ++idx) {
+        name = PyBytes_FromFormat("%s.%zd", PyBytes_AS_STRING(base), idx);
+        if (!name)
+            LCOV_EXCL_LINE_GOTO(error_base);
+        res = PyList_Append(self->names, name);
+        path = res == -1 ? NULL : cdbx_shard_path(self->manifest, name);
+        Py_DECREF(name);
+        if (!path)
+            LCOV_EXCL_LINE_GOTO(error_base);
+
+        fp = cdbx_file_open(path, "w+b");
+        Py_DECREF(path);
+        if (!fp) {
+            /* Nothing to close or destroy for this one */
+            if (-1 == PySequence_DelItem(self->names, idx))
+                PyErr_Clear();  /* LCOV_EXCL_LINE */
+            goto error_base;
+        }
+        res = PyList_Append(self->fps, fp);
+        Py_DECREF(fp);
+        if (-1 == res)
+            LCOV_EXCL_LINE_GOTO(error_base);
+
+        if (!(tmp = PyObject_CallMethod(fp, "fileno", "()")))
+            LCOV_EXCL_LINE_GOTO(error_base);
+        res = cdbx_fd(tmp, &fd);
+        Py_DECREF(tmp);
+        if (-1 == res || -1 == cdbx_cdb32_maker_create(fd,
+                                                       &self->makers[idx]))
+            LCOV_EXCL_LINE_GOTO(error_base);
+    }
+    Py_DECREF(base);
+
+    return (PyObject *)self;
+
+error_base:
+    Py_DECREF(base);
+error:
+    Py_DECREF(self);
+    return NULL;
+}
+
+/* ----------------------- END ShardedCDBMakerType ----------------------- */
@@ -0,0 +1,486 @@
+/*
+ * Copyright 2016 - 2025
+ * Andr\xe9 Malo or his licensors, as applicable
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cdbx.h"
+
+#define CDBSTACK_MEMBERS_INLINE (16)
+
+/*
+ * Object structure for CDBStackType
+ */
+typedef struct {
+    PyObject_HEAD
+    PyObject *weakreflist;
+
+    PyObject *members;  /* tuple of CDB instances, newest first */
+    PyObject *tombstone;  /* value marking deleted keys (or NULL) */
+} cdbstack_t;
+
+/*
+ * Lookup state
+ */
+typedef struct {
+    cdbstack_t *self;
+    cdbx_cdb32_t **members;
+    PyObject *result;  /* the value or a list of values (all) */
+    int all;
+    int found;
+} cdbstack_lookup_t;
+
+
+/* ------------------------ BEGIN Helper Functions ----------------------- */
+
+/*
+ * Collect the cdb32 structs of the members
+ *
+ * *members_ points to buf, if the members fit in there, or to a PyMem_Malloc'd
+ * array otherwise.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+static int
+cdbstack_members(cdbstack_t *self, cdbx_cdb32_t **buf,
+                 cdbx_cdb32_t ***members_)
+{
+    cdbx_cdb32_t **members = buf;
+    Py_ssize_t num, idx;
+
+    num = PyTuple_GET_SIZE(self->members);
+    if (num > CDBSTACK_MEMBERS_INLINE
+        && !(members = PyMem_Malloc((size_t)num * sizeof *members))) {
+        /* LCOV_EXCL_START */
+
+        PyErr_NoMemory();
+        return -1;
+
+        /* LCOV_EXCL_STOP */
+    }
+
+    for (idx = 0; idx < num; ++idx) {
+        if (!(members[idx] = cdbx_type_get_cdb32(
+                (cdbtype_t *)PyTuple_GET_ITEM(self->members, idx)))) {
+            if (members != buf)
+                PyMem_Free(members);
+            cdbx_raise_closed();
+            return -1;
+        }
+    }
+
+    *members_ = members;
+    return 0;
+}
+
+
+/*
+ * Check if a value is the tombstone
+ *
+ * Return -1 on error
+ * Return 0 if not
+ * Return 1 if it is
+ */
+static int
+cdbstack_is_tombstone(cdbstack_lookup_t *lookup, cdbx_cdb32_t *cdb32,
+                      cdbx_cdb32_pointer_t *value)
+{
+    PyObject *tombstone = lookup->self->tombstone, *data;
+    int res;
+
+    if (!tombstone
+        || (Py_ssize_t)value->length != PyBytes_GET_SIZE(tombstone))
+        return 0;
+
+    if (-1 == cdbx_cdb32_read(cdb32, value, &data))
+        LCOV_EXCL_LINE_RETURN(-1);
+
+    res = !memcmp(PyBytes_AS_STRING(data), PyBytes_AS_STRING(tombstone),
+                  (size_t)value->length);
+    Py_DECREF(data);
+
+    return res;
+}
+
+
+/*
+ * Visit a value found in a member
+ */
+static int
+cdbstack_visit(void *lookup_, Py_ssize_t idx, int first,
+               cdbx_cdb32_pointer_t *value)
+{
+    cdbstack_lookup_t *lookup = lookup_;
+    PyObject *item;
+    int res;
+
+    /* A tombstone hides the key in this and all older members */
+    if (first) {
+        switch (cdbstack_is_tombstone(lookup, lookup->members[idx], value)) {
+        case -1: return -1;
+        case 1: return CDBX_VISIT_STOP;
+        }
+    }
+
+    lookup->found = 1;
+    if (!lookup->result)
+        return CDBX_VISIT_STOP;
+
+    if (-1 == cdbx_cdb32_read(lookup->members[idx], value, &item))
+        LCOV_EXCL_LINE_RETURN(-1);
+
+    if (!lookup->all) {
+        Py_DECREF(lookup->result);
+        lookup->result = item;
+        return CDBX_VISIT_STOP;
+    }
+
+    res = PyList_Append(lookup->result, item);
+    Py_DECREF(item);
+    if (-1 == res)
+        LCOV_EXCL_LINE_RETURN(-1);
+
+    return CDBX_VISIT_NEXT_VALUE;
+}
+
+
+/*
+ * Look up a key
+ *
+ * If result_ is NULL, only the existence is checked.
+ *
+ * Return -1 on error
+ * Return 0 if not found
+ * Return 1 if found
+ */
+static int
+cdbstack_lookup(cdbstack_t *self, PyObject *key, int all,
+                PyObject **result_)
+{
+    cdbx_cdb32_t *buf[CDBSTACK_MEMBERS_INLINE];
+    cdbstack_lookup_t lookup;
+    int res;
+
+    lookup.self = self;
+    lookup.all = all;
+    lookup.found = 0;
+    lookup.result = NULL;
+    if (result_) {
+        if (all)
+            lookup.result = PyList_New(0);
+        else {
+            Py_INCREF(Py_None);
+            lookup.result = Py_None;
+        }
+        if (!lookup.result)
+            LCOV_EXCL_LINE_RETURN(-1);
+    }
+
+    if (-1 == cdbstack_members(self, buf, &lookup.members)) {
+        Py_XDECREF(lookup.result);
+        return -1;
+    }
+
+    res = cdbx_cdb32_find_stack(lookup.members,
+                                PyTuple_GET_SIZE(self->members), key,
+                                cdbstack_visit, &lookup);
+    if (lookup.members != buf)
+        PyMem_Free(lookup.members);
+
+    if (-1 == res) {
+        Py_XDECREF(lookup.result);
+        return -1;
+    }
+
+    if (result_)
+        *result_ = lookup.result;
+    return lookup.found;
+}
+
+/* ------------------------- END Helper Functions ------------------------ */
+
+/* -------------------------- BEGIN CDBStackType ------------------------- */
+
+PyDoc_STRVAR(CDBStackType_get__doc__,
+"get(self, key, default=None, all=False)\n\
+\n\
+Return value(s) for a key from the first member containing it\n\
+\n\
+If `key` is not found, `default` is returned. With `all`, the values of all\n\
+members are merged (newest first) into a list.\n\
+\n\
+Note that in case of a unicode key, it will be transformed to a byte string\n\
+using the latin-1 encoding.\n\
+\n\
+Parameters:\n\
+  key (bytes):\n\
+    Key to lookup\n\
+\n\
+  default:\n\
+    Default value to pass back if the key was not found\n\
+\n\
+  all (bool):\n\
+    Return all values instead of only the first? Default: False\n\
+\n\
+Returns:\n\
+  bytes or list: The value(s) or `default`");
+
+static PyObject *
+CDBStackType_get(cdbstack_t *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"key", "default", "all", NULL};
+    PyObject *key_, *default_ = NULL, *all_ = NULL, *result;
+    int all = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|OO", kwlist,
+                                     &key_, &default_, &all_))
+        return NULL;
+
+    if (all_) {
+        switch (PyObject_IsTrue(all_)) {
+        case -1: return NULL;
+        case 1: all = 1;
+        }
+    }
+
+    switch (cdbstack_lookup(self, key_, all, &result)) {
+    case -1:
+        return NULL;
+
+    case 0:
+        Py_DECREF(result);
+        if (!default_)
+            default_ = Py_None;
+        Py_INCREF(default_);
+        return default_;
+    }
+
+    return result;
+}
+
+
+static PyObject *
+CDBStackType_getitem(cdbstack_t *self, PyObject *key)
+{
+    PyObject *result;
+
+    switch (cdbstack_lookup(self, key, 0, &result)) {
+    case -1:
+        return NULL;
+
+    case 0:
+        Py_DECREF(result);
+        PyErr_SetObject(PyExc_KeyError, key);
+        return NULL;
+    }
+
+    return result;
+}
+
+
+static int
+CDBStackType_contains(cdbstack_t *self, PyObject *key)
+{
+    return cdbstack_lookup(self, key, 0, NULL);
+}
+
+
+PyDoc_STRVAR(CDBStackType_has_key__doc__,
+"has_key(self, key)\n\
+\n\
+Check if the key appears in the stack\n\
+\n\
+Parameters:\n\
+  key (bytes):\n\
+    Key to look up\n\
+\n\
+Returns:\n\
+  bool: Does the key exist (and is not deleted)?");
+
+static PyObject *
+CDBStackType_has_key(cdbstack_t *self, PyObject *key)
+{
+    switch (CDBStackType_contains(self, key)) {
+    case -1: return NULL;
+    case 0: Py_RETURN_FALSE;
+    }
+
+    Py_RETURN_TRUE;
+}
+
+
+static PyObject *
+CDBStackType_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"cdbs", "tombstone", NULL};
+    PyObject *cdbs_, *tombstone_ = NULL;
+    cdbstack_t *self;
+    Py_ssize_t idx;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", kwlist,
+                                     &cdbs_, &tombstone_))
+        return NULL;
+
+    if (!(self = GENERIC_ALLOC(type)))
+        LCOV_EXCL_LINE_RETURN(NULL);
+
+    if (!(self->members = PySequence_Tuple(cdbs_)))
+        goto error;
+
+    for (idx = 0; idx < PyTuple_GET_SIZE(self->members); ++idx) {
+        if (!CDBType_Check(PyTuple_GET_ITEM(self->members, idx))) {
+            PyErr_SetString(PyExc_TypeError,
+                            "CDBStack members must be CDB instances");
+            goto error;
+        }
+    }
+
+    if (tombstone_ && tombstone_ != Py_None) {
+        if (!PyBytes_Check(tombstone_)) {
+            PyErr_SetString(PyExc_TypeError, "tombstone must be bytes");
+            goto error;
+        }
+        Py_INCREF(tombstone_);
+        self->tombstone = tombstone_;
+    }
+
+    return (PyObject *)self;
+
+error:
+    Py_DECREF(self);
+    return NULL;
+}
+
+
+static int
+CDBStackType_traverse(cdbstack_t *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->members);
+    Py_VISIT(self->tombstone);
+
+    return 0;
+}
+
+static int
+CDBStackType_clear(cdbstack_t *self)
+{
+    if (self->weakreflist)
+        PyObject_ClearWeakRefs((PyObject *)self);
+
+    Py_CLEAR(self->members);
+    Py_CLEAR(self->tombstone);
+
+    return 0;
+}
+
+DEFINE_GENERIC_DEALLOC(CDBStackType)
+
+
+static PySequenceMethods CDBStackType_as_sequence = {
+    0,                                    /* sq_length */
+    0,                                    /* sq_concat */
+    0,                                    /* sq_repeat */
+    0,                                    /* sq_item */
+    0,                                    /* sq_slice */
+    0,                                    /* sq_ass_item */
+    0,                                    /* sq_ass_slice */
+    (objobjproc)CDBStackType_contains,    /* sq_contains */
+    0,                                    /* sq_inplace_concat */
+    0                                     /* sq_inplace_repeat */
+};
+
+static PyMappingMethods CDBStackType_as_mapping = {
+    0,                                    /* mp_length */
+    (binaryfunc)CDBStackType_getitem,     /* mp_subscript */
+    0                                     /* mp_ass_subscript */
+};
+
+static PyMethodDef CDBStackType_methods[] = {
+    {"get",
+     EXT_CFUNC(CDBStackType_get),             METH_KEYWORDS |
+                                              METH_VARARGS,
+     CDBStackType_get__doc__},
+
+    {"has_key",
+     EXT_CFUNC(CDBStackType_has_key),         METH_O,
+     CDBStackType_has_key__doc__},
+
+    {NULL, NULL}
+};
+
+PyDoc_STRVAR(CDBStackType__doc__,
+"CDBStack(cdbs, tombstone=None)\n\
+\n\
+Look up keys in a stack of CDBs, newest first.\n\
+\n\
+The first member containing a key wins. The key is hashed only once per\n\
+lookup. The stack does not own the members, closing them is still up to\n\
+the caller.\n\
+\n\
+Parameters:\n\
+  cdbs (iterable):\n\
+    CDB instances, newest first\n\
+\n\
+  tombstone (bytes):\n\
+    Value marking deleted keys. If the first value of a key in a member is\n\
+    the tombstone, the key is treated as missing in this and all older\n\
+    members. If omitted or ``None``, there are no tombstones.");
+
+EXT_LOCAL PyTypeObject CDBStackType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    EXT_MODULE_PATH ".CDBStack",                        /* tp_name */
+    sizeof(cdbstack_t),                                 /* tp_basicsize */
+    0,                                                  /* tp_itemsize */
+    (destructor)CDBStackType_dealloc,                   /* tp_dealloc */
+    0,                                                  /* tp_print */
+    0,                                                  /* tp_getattr */
+    0,                                                  /* tp_setattr */
+    0,                                                  /* tp_compare */
+    0,                                                  /* tp_repr */
+    0,                                                  /* tp_as_number */
+    &CDBStackType_as_sequence,                          /* tp_as_sequence */
+    &CDBStackType_as_mapping,                           /* tp_as_mapping */
+    (hashfunc)PyObject_HashNotImplemented,              /* tp_hash */
+    0,                                                  /* tp_call */
+    0,                                                  /* tp_str */
+    PyObject_GenericGetAttr,                            /* tp_getattro */
+    0,                                                  /* tp_setattro */
+    0,                                                  /* tp_as_buffer */
+    Py_TPFLAGS_HAVE_WEAKREFS                            /* tp_flags */
+    | Py_TPFLAGS_HAVE_CLASS
+    | Py_TPFLAGS_HAVE_SEQUENCE_IN
+    | Py_TPFLAGS_BASETYPE
+    | Py_TPFLAGS_HAVE_GC,
+    CDBStackType__doc__,                                /* tp_doc */
+    (traverseproc)CDBStackType_traverse,                /* tp_traverse */
+    (inquiry)CDBStackType_clear,                        /* tp_clear */
+    0,                                                  /* tp_richcompare */
+    offsetof(cdbstack_t, weakreflist),                  /* tp_weaklistoffset */
+    0,                                                  /* tp_iter */
+    0,                                                  /* tp_iternext */
+    CDBStackType_methods,                               /* tp_methods */
+    0,                                                  /* tp_members */
+    0,                                                  /* tp_getset */
+    0,                                                  /* tp_base */
+    0,                                                  /* tp_dict */
+    0,                                                  /* tp_descr_get */
+    0,                                                  /* tp_descr_set */
+    0,                                                  /* tp_dictoffset */
+    0,                                                  /* tp_init */
+    0,                                                  /* tp_alloc */
+    (newfunc)CDBStackType_new,                          /* tp_new */
+};
+
+/* --------------------------- END CDBStackType -------------------------- */
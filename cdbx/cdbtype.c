@@ -29,6 +29,8 @@ struct cdbtype_t {
     cdbx_cdb32_t *cdb32;  /* cdb struct, 32bit */
 
     PyObject *fp;  /* open file, might be NULL if fd was passed */
+    PyObject *encoding;  /* default codec for keys and values */
+    PyObject *errors;  /* default codec error handler */
     int flags;
 };
 
@@ -49,16 +51,40 @@ cdbx_type_get_cdb32(cdbtype_t *self)
 
 /*
  * Set KeyError(key)
+ *
+ * The key is known to be a bytes or unicode object (i.e. not a tuple), so it
+ * can be passed as exception value directly.
  */
 static void
 raise_key_error(PyObject *key)
 {
-    PyObject *tmp;
+    PyErr_SetObject(PyExc_KeyError, key);
+}
 
-    if ((tmp = PyTuple_Pack(1, key))) {
-        PyErr_SetObject(PyExc_KeyError, tmp);
-        Py_DECREF(tmp);
-    }
+
+/*
+ * Resolve the codec arguments of a call
+ *
+ * Omitted arguments (NULL) are replaced by the instance defaults. The names
+ * are borrowed from the (then borrowed) objects. A NULL encoding name means,
+ * values are not decoded.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+static int
+cdbtype_codec(cdbtype_t *self, PyObject **encoding_, PyObject **errors_,
+              const char **encoding, const char **errors)
+{
+    if (!*encoding_)
+        *encoding_ = self->encoding;
+    if (!*errors_)
+        *errors_ = self->errors;
+
+    if (-1 == cdbx_codec_name(*encoding_, encoding))
+        return -1;
+
+    return cdbx_codec_name(*errors_, errors);
 }
 
 /* ------------------------- END Helper Functions ------------------------ */
@@ -114,13 +140,14 @@ CDBType_len(cdbtype_t *self)
 
 
 PyDoc_STRVAR(CDBType_get__doc__,
-"get(self, key, default=None, all=False)\n\
+"get(self, key, default=None, all=False, encoding=<default>, errors=<default>)\n\
 \n\
 Return value(s) for a key\n\
 \n\
 If `key` is not found, `default` is returned. If `key` was found, then\n\
 depending on the `all` flag the value return is either a byte string\n\
-(`all` == False) or a list of byte strings (`all` == True).\n\
+(`all` == False) or a list of byte strings (`all` == True). If an encoding\n\
+applies, the values are decoded to unicode strings.\n\
 \n\
 Note that in case of a unicode key, it will be transformed to a byte string\n\
 using the latin-1 encoding.\n\
@@ -134,158 +161,1743 @@ Parameters:\n\
 \n\
   all (bool):\n\
     Return all values instead of only the first? Default: False\n\
+\n\
+  encoding (str):\n\
+    Decode the values using this encoding. If omitted, the encoding passed\n\
+    to the constructor applies. If ``None``, the values are not decoded.\n\
+\n\
+  errors (str):\n\
+    Decoding error handler. If omitted, the handler passed to the\n\
+    constructor applies. If ``None``, it defaults to ``'strict'``.\n\
 \n\
 Returns:\n\
   The value(s) or the default");
 
+/*
+ * Return all values of a key as list (or the default)
+ */
 static PyObject *
-CDBType_get(cdbtype_t *self, PyObject *args, PyObject *kwds)
+cdbtype_get_all(cdbtype_t *self, PyObject *key, PyObject *default_,
+                const char *encoding, const char *errors)
 {
-    static char *kwlist[] = {"key", "default", "all", NULL};
-    PyObject *key_, *default_ = NULL, *all_ = NULL;
-    PyObject *result, *result_list = NULL;
+    PyObject *result, *result_list;
     cdbx_cdb32_get_iter_t *get_iter;
-    int res, all = 0;
+    cdbx_cdb32_pointer_t value;
+    int res;
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|OO", kwlist,
-                                     &key_, &default_, &all_))
-        return NULL;
+    if (!(result_list = PyList_New(0)))
+        LCOV_EXCL_LINE_RETURN(NULL);
+
+    if (-1 == cdbx_cdb32_get_iter_new(self->cdb32, key, &get_iter))
+        LCOV_EXCL_LINE_GOTO(error_list);
+
+    while (1) {
+        if (-1 == (res = cdbx_cdb32_get_iter_next_pointer(get_iter, &value)))
+            LCOV_EXCL_LINE_GOTO(error_get_iter);
+        if (!res)
+            break;
+
+        if (-1 == cdbx_cdb32_read_decoded(self->cdb32, &value, encoding,
+                                          errors, &result))
+            goto error_get_iter;
+
+        res = PyList_Append(result_list, result);
+        Py_DECREF(result);
+        if (-1 == res)
+            LCOV_EXCL_LINE_GOTO(error_get_iter);
+    }
+    cdbx_cdb32_get_iter_destroy(&get_iter);
+
+    if (!PyList_GET_SIZE(result_list)) {
+        Py_DECREF(result_list);
+        Py_INCREF(default_);
+        return default_;
+    }
+    return result_list;
+
+error_get_iter:
+    cdbx_cdb32_get_iter_destroy(&get_iter);
+error_list:
+    Py_DECREF(result_list);
+    return NULL;
+}
+
+
+static PyObject *
+cdbtype_get(cdbtype_t *self, PyObject *key_, PyObject *default_,
+            PyObject *all_, PyObject *encoding_, PyObject *errors_)
+{
+    PyObject *result;
+    cdbx_cdb32_pointer_t value;
+    const char *encoding, *errors;
 
     if (!self->cdb32)
         return cdbx_raise_closed();
 
-    if (default_)
+    if (-1 == cdbtype_codec(self, &encoding_, &errors_, &encoding, &errors))
+        return NULL;
+
+    if (all_) {
+        switch (PyObject_IsTrue(all_)) {
+        case -1: return NULL;
+        case 1: return cdbtype_get_all(self, key_, default_, encoding,
+                                       errors);
+        }
+    }
+
+    switch (cdbx_cdb32_find(self->cdb32, key_, &value)) {
+    case -1:
+        return NULL;
+    case 0:
         Py_INCREF(default_);
-    else {
-        Py_INCREF(Py_None);
-        default_ = Py_None;
+        return default_;
+    }
+
+    if (-1 == cdbx_cdb32_read_decoded(self->cdb32, &value, encoding, errors,
+                                      &result))
+        return NULL;
+
+    return result;
+}
+
+#ifdef CDBX_FASTCALL
+static PyObject *
+CDBType_get(cdbtype_t *self, PyObject *const *args, Py_ssize_t nargs,
+            PyObject *kwnames)
+{
+    static const char * const kwlist[] = {"key", "default", "all",
+                                          "encoding", "errors", NULL};
+    PyObject *argv[5] = {NULL, Py_None, NULL, NULL, NULL};
+
+    if (-1 == cdbx_parse_fastcall("get", args, nargs, kwnames, kwlist, 1,
+                                  argv))
+        return NULL;
+
+    return cdbtype_get(self, argv[0], argv[1], argv[2], argv[3], argv[4]);
+}
+#else
+static PyObject *
+CDBType_get(cdbtype_t *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"key", "default", "all", "encoding", "errors",
+                             NULL};
+    PyObject *key_, *default_ = Py_None, *all_ = NULL, *encoding_ = NULL;
+    PyObject *errors_ = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|OOOO", kwlist,
+                                     &key_, &default_, &all_, &encoding_,
+                                     &errors_))
+        return NULL;
+
+    return cdbtype_get(self, key_, default_, all_, encoding_, errors_);
+}
+#endif
+
+
+PyDoc_STRVAR(CDBType_get_into__doc__,
+"get_into(self, key, buffer)\n\
+\n\
+Copy the first value of a key into a writable buffer\n\
+\n\
+No new value object is created. That makes it possible to run lookup loops\n\
+without any allocation per call.\n\
+\n\
+Note that in case of a unicode key, it will be transformed to a byte string\n\
+using the latin-1 encoding.\n\
+\n\
+Parameters:\n\
+  key (str or bytes):\n\
+    Key to look up\n\
+\n\
+  buffer (buffer):\n\
+    Writable, contiguous buffer (e.g. a bytearray, a numpy array or an\n\
+    mmap), which receives the value at its beginning\n\
+\n\
+Returns:\n\
+  int: The length of the value or -1 if the key was not found\n\
+\n\
+Raises:\n\
+  ValueError: The buffer is too small for the value");
+
+#ifdef EXT3
+#define PyInt_FromSsize_t PyLong_FromSsize_t
+#endif
+
+static PyObject *
+cdbtype_get_into(cdbtype_t *self, PyObject *key_, PyObject *buffer_)
+{
+    cdbx_cdb32_pointer_t value;
+    void *buf;
+    Py_ssize_t size;
+    int res;
+#ifdef EXT3
+    Py_buffer view;
+#endif
+
+    if (!self->cdb32)
+        return cdbx_raise_closed();
+
+#ifdef EXT2
+    if (-1 == PyObject_AsWriteBuffer(buffer_, &buf, &size))
+        return NULL;
+#else
+    if (-1 == PyObject_GetBuffer(buffer_, &view, PyBUF_WRITABLE))
+        return NULL;
+    buf = view.buf;
+    size = view.len;
+#endif
+
+    if (1 == (res = cdbx_cdb32_find(self->cdb32, key_, &value))) {
+        if ((size_t)value.length > (size_t)size) {
+            PyErr_SetString(PyExc_ValueError, "Buffer too small");
+            res = -1;
+        }
+        else if (-1 == cdbx_cdb32_read_into(self->cdb32, &value, buf)) {
+            res = -1;  /* LCOV_EXCL_LINE */
+        }
+    }
+
+#ifdef EXT3
+    PyBuffer_Release(&view);
+#endif
+
+    switch (res) {
+    case -1: return NULL;
+    case 0: return PyInt_FromSsize_t(-1);
+    }
+
+    return PyInt_FromSsize_t((Py_ssize_t)value.length);
+}
+
+#ifdef EXT3
+#undef PyInt_FromSsize_t
+#endif
+
+#ifdef CDBX_FASTCALL
+static PyObject *
+CDBType_get_into(cdbtype_t *self, PyObject *const *args, Py_ssize_t nargs,
+                 PyObject *kwnames)
+{
+    static const char * const kwlist[] = {"key", "buffer", NULL};
+    PyObject *argv[2] = {NULL, NULL};
+
+    if (-1 == cdbx_parse_fastcall("get_into", args, nargs, kwnames, kwlist, 2,
+                                  argv))
+        return NULL;
+
+    return cdbtype_get_into(self, argv[0], argv[1]);
+}
+#else
+static PyObject *
+CDBType_get_into(cdbtype_t *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"key", "buffer", NULL};
+    PyObject *key_, *buffer_;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO", kwlist,
+                                     &key_, &buffer_))
+        return NULL;
+
+    return cdbtype_get_into(self, key_, buffer_);
+}
+#endif
+
+
+PyDoc_STRVAR(CDBType_value_size__doc__,
+"value_size(self, key)\n\
+\n\
+Find the size of the first value of a key without reading it\n\
+\n\
+Note that in case of a unicode key, it will be transformed to a byte string\n\
+using the latin-1 encoding.\n\
+\n\
+Parameters:\n\
+  key (str or bytes):\n\
+    Key to look up\n\
+\n\
+Returns:\n\
+  int: The size of the value in bytes or -1 if the key was not found");
+
+#ifdef EXT3
+#define PyInt_FromSsize_t PyLong_FromSsize_t
+#endif
+
+static PyObject *
+CDBType_value_size(cdbtype_t *self, PyObject *key)
+{
+    cdbx_cdb32_pointer_t value;
+
+    if (!self->cdb32)
+        return cdbx_raise_closed();
+
+    switch (cdbx_cdb32_find(self->cdb32, key, &value)) {
+    case -1: return NULL;
+    case 0: return PyInt_FromSsize_t(-1);
     }
 
+    return PyInt_FromSsize_t((Py_ssize_t)value.length);
+}
+
+#ifdef EXT3
+#undef PyInt_FromSsize_t
+#endif
+
+
+PyDoc_STRVAR(CDBType_count__doc__,
+"count(self, key)\n\
+\n\
+Count the values of a key without reading them\n\
+\n\
+Note that in case of a unicode key, it will be transformed to a byte string\n\
+using the latin-1 encoding.\n\
+\n\
+Parameters:\n\
+  key (str or bytes):\n\
+    Key to look up\n\
+\n\
+Returns:\n\
+  int: The number of values stored under the key (0 if not found)");
+
+#ifdef EXT3
+#define PyInt_FromSsize_t PyLong_FromSsize_t
+#endif
+
+static PyObject *
+CDBType_count(cdbtype_t *self, PyObject *key)
+{
+    Py_ssize_t count;
+
+    if (!self->cdb32)
+        return cdbx_raise_closed();
+
+    if (-1 == cdbx_cdb32_count(self->cdb32, key, &count))
+        return NULL;
+
+    return PyInt_FromSsize_t(count);
+}
+
+#ifdef EXT3
+#undef PyInt_FromSsize_t
+#endif
+
+
+PyDoc_STRVAR(CDBType_locate__doc__,
+"locate(self, key, all=False)\n\
+\n\
+Find the location of a key's value(s) in the file without reading them\n\
+\n\
+The locations stay valid as long as the file is not replaced and can be\n\
+read later with `read_at` or `read_many_at` - also by another process.\n\
+\n\
+Note that in case of a unicode key, it will be transformed to a byte string\n\
+using the latin-1 encoding.\n\
+\n\
+Parameters:\n\
+  key (str or bytes):\n\
+    Key to look up\n\
+\n\
+  all (bool):\n\
+    Return the locations of all values? Default: False\n\
+\n\
+Returns:\n\
+  tuple or list: ``(offset, length)`` of the first value (or ``None`` if\n\
+  the key was not found). If `all` is true, a list of such tuples.");
+
+static PyObject *
+CDBType_locate(cdbtype_t *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"key", "all", NULL};
+    PyObject *key_, *all_ = NULL, *result, *item;
+    cdbx_cdb32_get_iter_t *get_iter;
+    cdbx_cdb32_pointer_t value;
+    int all = 0, res;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", kwlist,
+                                     &key_, &all_))
+        return NULL;
+
     if (all_) {
         switch (PyObject_IsTrue(all_)) {
-        case -1: goto error;
+        case -1: return NULL;
         case 1: all = 1;
         }
     }
-    if (all && !(result_list = PyList_New(0)))
-        LCOV_EXCL_LINE_GOTO(error);
+
+    if (!self->cdb32)
+        return cdbx_raise_closed();
+
+    if (!all) {
+        switch (cdbx_cdb32_find(self->cdb32, key_, &value)) {
+        case -1: return NULL;
+        case 0: Py_RETURN_NONE;
+        }
+        return Py_BuildValue("(nn)", (Py_ssize_t)value.offset,
+                             (Py_ssize_t)value.length);
+    }
 
     if (-1 == cdbx_cdb32_get_iter_new(self->cdb32, key_, &get_iter))
-        LCOV_EXCL_LINE_GOTO(error_list);
+        return NULL;
+    if (!(result = PyList_New(0)))
+        LCOV_EXCL_LINE_GOTO(error_iter);
+
+    while (1) {
+        if (-1 == (res = cdbx_cdb32_get_iter_next_pointer(get_iter, &value)))
+            LCOV_EXCL_LINE_GOTO(error);
+        if (!res)
+            break;
+        if (!(item = Py_BuildValue("(nn)", (Py_ssize_t)value.offset,
+                                   (Py_ssize_t)value.length)))
+            LCOV_EXCL_LINE_GOTO(error);
+        res = PyList_Append(result, item);
+        Py_DECREF(item);
+        if (-1 == res)
+            LCOV_EXCL_LINE_GOTO(error);
+    }
+    cdbx_cdb32_get_iter_destroy(&get_iter);
 
-    do {
-        if (-1 == cdbx_cdb32_get_iter_next(get_iter, &result))
-            LCOV_EXCL_LINE_GOTO(error_get_iter);
+    return result;
 
-        if (all && result) {
-            res = PyList_Append(result_list, result);
-            Py_DECREF(result);
-            if (-1 == res)
-                LCOV_EXCL_LINE_GOTO(error_get_iter);
+/* LCOV_EXCL_START */
+error:
+    Py_DECREF(result);
+error_iter:
+    cdbx_cdb32_get_iter_destroy(&get_iter);
+    return NULL;
+/* LCOV_EXCL_STOP */
+}
+
+
+PyDoc_STRVAR(CDBType_locate_many__doc__,
+"locate_many(self, keys)\n\
+\n\
+Find the locations of the first values of many keys\n\
+\n\
+The result is a bytes object containing an ``(offset, length)`` pair of\n\
+native unsigned 64 bit integers per key, e.g.\n\
+``numpy.frombuffer(result, dtype=numpy.uint64).reshape(-1, 2)`` provides\n\
+them as an array. Keys which are not found get the location ``(0, 0)``.\n\
+The result can be passed to `read_many_at` as-is.\n\
+\n\
+Parameters:\n\
+  keys (iterable):\n\
+    Keys to look up (str or bytes)\n\
+\n\
+Returns:\n\
+  bytes: The locations");
+
+static PyObject *
+CDBType_locate_many(cdbtype_t *self, PyObject *keys_)
+{
+    PyObject *keys, *result;
+    cdbx_cdb32_pointer_t value;
+    uint64_t location[2];
+    Py_ssize_t count, idx;
+
+    if (!(keys = PySequence_Fast(keys_, "keys must be iterable")))
+        return NULL;
+
+    /* Iterating the keys may have run python code closing us */
+    if (!self->cdb32) {
+        cdbx_raise_closed();
+        goto error_keys;
+    }
+
+    count = PySequence_Fast_GET_SIZE(keys);
+    if (count > PY_SSIZE_T_MAX / (Py_ssize_t)sizeof location) {
+        /* LCOV_EXCL_START */
+
+        PyErr_NoMemory();
+        goto error_keys;
+
+        /* LCOV_EXCL_STOP */
+    }
+    if (!(result = PyBytes_FromStringAndSize(NULL,
+                                             count
+                                             * (Py_ssize_t)sizeof location)))
+        LCOV_EXCL_LINE_GOTO(error_keys);
+
+    for (idx = 0; idx < count; ++idx) {
+        switch (cdbx_cdb32_find(self->cdb32,
+                                PySequence_Fast_GET_ITEM(keys, idx), &value)) {
+        case -1:
+            goto error;
+        case 0:
+            location[0] = location[1] = 0;
+            break;
+        default:
+            location[0] = value.offset;
+            location[1] = value.length;
+        }
+        (void)memcpy(PyBytes_AS_STRING(result) + idx * (Py_ssize_t)sizeof
+                     location, location, sizeof location);
+    }
+
+    Py_DECREF(keys);
+    return result;
+
+error:
+    Py_DECREF(result);
+error_keys:
+    Py_DECREF(keys);
+    return NULL;
+}
+
+
+PyDoc_STRVAR(CDBType_read_at__doc__,
+"read_at(self, offset, length)\n\
+\n\
+Read raw bytes at a location returned by `locate` or `locate_many`\n\
+\n\
+Parameters:\n\
+  offset (int):\n\
+    Offset in the file\n\
+\n\
+  length (int):\n\
+    Number of bytes to read\n\
+\n\
+Returns:\n\
+  bytes: The data\n\
+\n\
+Raises:\n\
+  ValueError: The location is outside of the data region");
+
+static PyObject *
+CDBType_read_at(cdbtype_t *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"offset", "length", NULL};
+    PyObject *result;
+    Py_ssize_t offset, length;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "nn", kwlist,
+                                     &offset, &length))
+        return NULL;
+
+    if (!self->cdb32)
+        return cdbx_raise_closed();
+
+    if (offset < 0 || length < 0) {
+        PyErr_SetString(PyExc_ValueError, "Location out of bounds");
+        return NULL;
+    }
+
+    if (-1 == cdbx_cdb32_read_at(self->cdb32, (uint64_t)offset,
+                                 (uint64_t)length, &result))
+        return NULL;
+
+    return result;
+}
+
+
+PyDoc_STRVAR(CDBType_read_many_at__doc__,
+"read_many_at(self, locations)\n\
+\n\
+Read raw bytes at many locations\n\
+\n\
+Without mmap, the locations are read in file order and nearby locations\n\
+are coalesced into single reads.\n\
+\n\
+Parameters:\n\
+  locations (iterable or bytes):\n\
+    ``(offset, length)`` pairs or the bytes returned by `locate_many`.\n\
+    Offset 0 denotes a missing entry.\n\
+\n\
+Returns:\n\
+  list: The data per location (bytes or ``None`` for missing entries)\n\
+\n\
+Raises:\n\
+  ValueError: A location is outside of the data region");
+
+static PyObject *
+CDBType_read_many_at(cdbtype_t *self, PyObject *locations_)
+{
+    PyObject *locations = NULL, *pair, *result;
+    uint64_t *buf;
+    const void *data;
+    Py_ssize_t count, idx, jdx, value;
+    int res;
+#ifdef EXT3
+    Py_buffer view;
+#endif
+
+#ifdef EXT2
+    if (PyObject_CheckReadBuffer(locations_)) {
+        if (-1 == PyObject_AsReadBuffer(locations_, &data, &count))
+            LCOV_EXCL_LINE_RETURN(NULL);
+#else
+    if (PyObject_CheckBuffer(locations_)) {
+        if (-1 == PyObject_GetBuffer(locations_, &view, PyBUF_SIMPLE))
+            return NULL;
+        data = view.buf;
+        count = view.len;
+#endif
+        res = 0;
+        if (count % (2 * (Py_ssize_t)sizeof *buf)) {
+            PyErr_SetString(PyExc_ValueError,
+                            "Location buffer size must be a multiple of 16");
+            res = -1;
+        }
+        else if (!(buf = PyMem_Malloc((size_t)count + 1))) {
+            PyErr_NoMemory();  /* LCOV_EXCL_LINE */
+            res = -1;  /* LCOV_EXCL_LINE */
+        }
+        else {
+            (void)memcpy(buf, data, (size_t)count);
+            count /= 2 * (Py_ssize_t)sizeof *buf;
+        }
+#ifdef EXT3
+        PyBuffer_Release(&view);
+#endif
+        if (-1 == res)
+            return NULL;
+    }
+    else {
+        if (!(locations = PySequence_Fast(locations_,
+                                          "locations must be iterable")))
+            return NULL;
+        count = PySequence_Fast_GET_SIZE(locations);
+        if ((size_t)count > PY_SSIZE_T_MAX / (2 * sizeof *buf)
+            || !(buf = PyMem_Malloc(((size_t)count * 2 + 1) * sizeof *buf))) {
+            /* LCOV_EXCL_START */
+
+            Py_DECREF(locations);
+            return PyErr_NoMemory();
+
+            /* LCOV_EXCL_STOP */
+        }
+        for (idx = 0; idx < count; ++idx) {
+            if (!(pair = PySequence_Fast(PySequence_Fast_GET_ITEM(locations,
+                                                                  idx),
+                                         "location must be a pair")))
+                goto error_buf;
+            if (PySequence_Fast_GET_SIZE(pair) != 2) {
+                Py_DECREF(pair);
+                PyErr_SetString(PyExc_TypeError, "location must be a pair");
+                goto error_buf;
+            }
+            for (jdx = 0; jdx < 2; ++jdx) {
+                if (-1 == (value = PyNumber_AsSsize_t(
+                               PySequence_Fast_GET_ITEM(pair, jdx),
+                               PyExc_OverflowError)) && PyErr_Occurred()) {
+                    Py_DECREF(pair);
+                    goto error_buf;
+                }
+                if (value < 0) {
+                    Py_DECREF(pair);
+                    PyErr_SetString(PyExc_ValueError,
+                                    "Location out of bounds");
+                    goto error_buf;
+                }
+                buf[idx * 2 + jdx] = (uint64_t)value;
+            }
+            Py_DECREF(pair);
+        }
+        Py_CLEAR(locations);
+    }
+
+    /* The conversion may have run python code closing us */
+    if (!self->cdb32) {
+        cdbx_raise_closed();
+        goto error_buf;
+    }
+
+    if (!(result = PyList_New(count)))
+        LCOV_EXCL_LINE_GOTO(error_buf);
+
+    if (-1 == cdbx_cdb32_read_many_at(self->cdb32, buf, count, result)) {
+        Py_DECREF(result);
+        goto error_buf;
+    }
+
+    PyMem_Free(buf);
+    return result;
+
+error_buf:
+    PyMem_Free(buf);
+    Py_XDECREF(locations);
+    return NULL;
+}
+
+
+PyDoc_STRVAR(CDBType_read_range__doc__,
+"read_range(self, key, start=0, length=None)\n\
+\n\
+Read a part of the first value of a key\n\
+\n\
+Only the requested range is read from the file. The range is clipped to the\n\
+boundaries of the value, like a slice would.\n\
+\n\
+Note that in case of a unicode key, it will be transformed to a byte string\n\
+using the latin-1 encoding.\n\
+\n\
+Parameters:\n\
+  key (str or bytes):\n\
+    Key to look up\n\
+\n\
+  start (int):\n\
+    Start offset within the value. Default: 0\n\
+\n\
+  length (int):\n\
+    Maximum number of bytes to read. If omitted or ``None``, the rest of the\n\
+    value is read.\n\
+\n\
+Returns:\n\
+  bytes: The requested part of the value or ``None`` if the key was not\n\
+         found");
+
+static PyObject *
+CDBType_read_range(cdbtype_t *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"key", "start", "length", NULL};
+    PyObject *key_, *length_ = NULL, *result;
+    cdbx_cdb32_pointer_t value;
+    Py_ssize_t start = 0, length = PY_SSIZE_T_MAX;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|nO", kwlist,
+                                     &key_, &start, &length_))
+        return NULL;
+
+    if (length_ && length_ != Py_None) {
+        if (-1 == (length = PyNumber_AsSsize_t(length_,
+                                               PyExc_OverflowError))
+            && PyErr_Occurred())
+            return NULL;
+    }
+
+    /* __index__ may have closed us */
+    if (!self->cdb32)
+        return cdbx_raise_closed();
+
+    switch (cdbx_cdb32_find(self->cdb32, key_, &value)) {
+    case -1: return NULL;
+    case 0: Py_RETURN_NONE;
+    }
+
+    if (-1 == cdbx_cdb32_read_range(self->cdb32, &value, start, length,
+                                    &result))
+        return NULL;
+
+    return result;
+}
+
+
+PyDoc_STRVAR(CDBType_send_value__doc__,
+"send_value(self, key, out_fd, all=False)\n\
+\n\
+Send value(s) for a key directly to a file descriptor\n\
+\n\
+The value is transferred with sendfile(2) from the CDB file if possible,\n\
+avoiding any copy through userspace. Otherwise it's written from the memory\n\
+map (or read and written in chunks). The GIL is released during the\n\
+transfer. `out_fd` is expected to be in blocking mode.\n\
+\n\
+Note that in case of a unicode key, it will be transformed to a byte string\n\
+using the latin-1 encoding.\n\
+\n\
+Parameters:\n\
+  key (str or bytes):\n\
+    Key to lookup\n\
+\n\
+  out_fd (file or int):\n\
+    Target file descriptor or an object providing fileno()\n\
+\n\
+  all (bool):\n\
+    Send all values (concatenated) instead of only the first? Default:\n\
+    False\n\
+\n\
+Returns:\n\
+  int: The number of bytes sent or -1 if the key was not found");
+
+#ifdef EXT3
+#define PyInt_FromSsize_t PyLong_FromSsize_t
+#endif
+
+static PyObject *
+CDBType_send_value(cdbtype_t *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"key", "out_fd", "all", NULL};
+    PyObject *key_, *out_fd_, *all_ = NULL;
+    cdbx_cdb32_get_iter_t *get_iter;
+    cdbx_cdb32_pointer_t value;
+    Py_ssize_t sent, total = -1;
+    int res, fd, all = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO|O", kwlist,
+                                     &key_, &out_fd_, &all_))
+        return NULL;
+
+    if (-1 == (fd = PyObject_AsFileDescriptor(out_fd_)))
+        return NULL;
+
+    if (all_) {
+        switch (PyObject_IsTrue(all_)) {
+        case -1: return NULL;
+        case 1: all = 1;
+        }
+    }
+
+    /* Check after the conversions above, they may run python code */
+    if (!self->cdb32)
+        return cdbx_raise_closed();
+
+    if (-1 == cdbx_cdb32_get_iter_new(self->cdb32, key_, &get_iter))
+        return NULL;
+
+    do {
+        /* The CDB might have been closed while sending */
+        if (!self->cdb32) {
+            cdbx_raise_closed();
+            goto error;
+        }
+        if (-1 == (res = cdbx_cdb32_get_iter_next_pointer(get_iter, &value)))
+            LCOV_EXCL_LINE_GOTO(error);
+
+        if (res) {
+            if (-1 == cdbx_cdb32_send(self->cdb32, &value, fd, &sent))
+                goto error;
+            total = (total == -1) ? sent : total + sent;
+        }
+    } while (all && res);
+    cdbx_cdb32_get_iter_destroy(&get_iter);
+
+    return PyInt_FromSsize_t(total);
+
+error:
+    cdbx_cdb32_get_iter_destroy(&get_iter);
+    return NULL;
+}
+
+#ifdef EXT3
+#undef PyInt_FromSsize_t
+#endif
+
+
+PyDoc_STRVAR(CDBType_items__doc__,
+"items(self, all=False, encoding=<default>, errors=<default>, start=None,\n\
+      end=None)\n\
+\n\
+Create key/value pair iterator\n\
+\n\
+Parameters:\n\
+  all (bool):\n\
+    Return all (i.e. non-unique-key) items? Default: False\n\
+\n\
+  encoding (str):\n\
+    Decode keys and values using this encoding. If omitted, the encoding\n\
+    passed to the constructor applies. If ``None``, nothing is decoded.\n\
+\n\
+  errors (str):\n\
+    Decoding error handler. If omitted, the handler passed to the\n\
+    constructor applies. If ``None``, it defaults to ``'strict'``.\n\
+\n\
+  start (int):\n\
+    Start iterating at this record offset (as returned by `split` or an\n\
+    iterator's `cursor`). If omitted or ``None``, start at the first record.\n\
+\n\
+  end (int):\n\
+    Stop iterating at this record offset. If omitted or ``None``, stop at\n\
+    the end of the data.\n\
+\n\
+Returns:\n\
+  iterable: Iterator over items");
+
+/*
+ * Create a key, items or values iterator
+ */
+static PyObject *
+cdbtype_iter_new(cdbtype_t *self, PyObject *all_, int what, Py_ssize_t batch,
+                 PyObject *encoding_, PyObject *errors_, PyObject *start_,
+                 PyObject *end_)
+{
+    PyObject *result;
+    const char *encoding, *errors;
+    Py_ssize_t start = -1, end = -1;
+    int all = 0;
+
+    if (-1 == cdbtype_codec(self, &encoding_, &errors_, &encoding, &errors))
+        return NULL;
+
+    if (all_) {
+        switch (PyObject_IsTrue(all_)) {
+        case -1: return NULL;
+        case 1: all = 1;
+        }
+    }
+
+    if (start_ && start_ != Py_None) {
+        if (-1 == (start = PyNumber_AsSsize_t(start_, PyExc_OverflowError))
+            && PyErr_Occurred())
+            return NULL;
+        if (start < 0)
+            goto out_of_bounds;
+    }
+    if (end_ && end_ != Py_None) {
+        if (-1 == (end = PyNumber_AsSsize_t(end_, PyExc_OverflowError))
+            && PyErr_Occurred())
+            return NULL;
+        if (end < 0)
+            goto out_of_bounds;
+    }
+
+    if (!self->cdb32)
+        return cdbx_raise_closed();
+
+    if (!(result = cdbx_iter_new(self, what, all, batch, encoding_, errors_)))
+        LCOV_EXCL_LINE_RETURN(NULL);
+
+    if ((start != -1 || end != -1)
+        && -1 == cdbx_iter_range(result, start, end)) {
+        Py_DECREF(result);
+        return NULL;
+    }
+
+    return result;
+
+out_of_bounds:
+    PyErr_SetString(PyExc_ValueError, "Range out of bounds");
+    return NULL;
+}
+
+#ifdef CDBX_FASTCALL
+static PyObject *
+CDBType_items(cdbtype_t *self, PyObject *const *args, Py_ssize_t nargs,
+              PyObject *kwnames)
+{
+    static const char * const kwlist[] = {"all", "encoding", "errors",
+                                          "start", "end", NULL};
+    PyObject *argv[5] = {NULL, NULL, NULL, NULL, NULL};
+
+    if (-1 == cdbx_parse_fastcall("items", args, nargs, kwnames, kwlist, 0,
+                                  argv))
+        return NULL;
+
+    return cdbtype_iter_new(self, argv[0], CDBX_ITER_ITEMS, 0, argv[1],
+                            argv[2], argv[3], argv[4]);
+}
+#else
+static PyObject *
+CDBType_items(cdbtype_t *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"all", "encoding", "errors", "start", "end",
+                             NULL};
+    PyObject *all_ = NULL, *encoding_ = NULL, *errors_ = NULL;
+    PyObject *start_ = NULL, *end_ = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OOOOO", kwlist,
+                                     &all_, &encoding_, &errors_, &start_,
+                                     &end_))
+        return NULL;
+
+    return cdbtype_iter_new(self, all_, CDBX_ITER_ITEMS, 0, encoding_,
+                            errors_, start_, end_);
+}
+#endif
+
+
+PyDoc_STRVAR(CDBType_keys__doc__,
+"keys(self, all=False, encoding=<default>, errors=<default>, start=None,\n\
+     end=None)\n\
+\n\
+Create key iterator\n\
+\n\
+Parameters:\n\
+  all (bool):\n\
+    Return all (i.e. non-unique) keys? Default: False\n\
+\n\
+  encoding (str):\n\
+    Decode the keys using this encoding. If omitted, the encoding passed to\n\
+    the constructor applies. If ``None``, the keys are not decoded.\n\
+\n\
+  errors (str):\n\
+    Decoding error handler. If omitted, the handler passed to the\n\
+    constructor applies. If ``None``, it defaults to ``'strict'``.\n\
+\n\
+  start (int):\n\
+    Start iterating at this record offset (as returned by `split` or an\n\
+    iterator's `cursor`). If omitted or ``None``, start at the first record.\n\
+\n\
+  end (int):\n\
+    Stop iterating at this record offset. If omitted or ``None``, stop at\n\
+    the end of the data.\n\
+\n\
+Returns:\n\
+  iterable: Iterator over keys");
+
+#ifdef CDBX_FASTCALL
+static PyObject *
+CDBType_keys(cdbtype_t *self, PyObject *const *args, Py_ssize_t nargs,
+             PyObject *kwnames)
+{
+    static const char * const kwlist[] = {"all", "encoding", "errors",
+                                          "start", "end", NULL};
+    PyObject *argv[5] = {NULL, NULL, NULL, NULL, NULL};
+
+    if (-1 == cdbx_parse_fastcall("keys", args, nargs, kwnames, kwlist, 0,
+                                  argv))
+        return NULL;
+
+    return cdbtype_iter_new(self, argv[0], CDBX_ITER_KEYS, 0, argv[1],
+                            argv[2], argv[3], argv[4]);
+}
+#else
+static PyObject *
+CDBType_keys(cdbtype_t *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"all", "encoding", "errors", "start", "end",
+                             NULL};
+    PyObject *all_ = NULL, *encoding_ = NULL, *errors_ = NULL;
+    PyObject *start_ = NULL, *end_ = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OOOOO", kwlist,
+                                     &all_, &encoding_, &errors_, &start_,
+                                     &end_))
+        return NULL;
+
+    return cdbtype_iter_new(self, all_, CDBX_ITER_KEYS, 0, encoding_,
+                            errors_, start_, end_);
+}
+#endif
+
+
+PyDoc_STRVAR(CDBType_values__doc__,
+"values(self, all=False, encoding=<default>, errors=<default>, start=None,\n\
+       end=None)\n\
+\n\
+Create value iterator\n\
+\n\
+The keys are not read. With `all` == True, the values are just returned in\n\
+file order without checking for duplicate keys.\n\
+\n\
+Parameters:\n\
+  all (bool):\n\
+    Return all values instead of only the first per key? Default: False\n\
+\n\
+  encoding (str):\n\
+    Decode the values using this encoding. If omitted, the encoding passed\n\
+    to the constructor applies. If ``None``, the values are not decoded.\n\
+\n\
+  errors (str):\n\
+    Decoding error handler. If omitted, the handler passed to the\n\
+    constructor applies. If ``None``, it defaults to ``'strict'``.\n\
+\n\
+  start (int):\n\
+    Start iterating at this record offset (as returned by `split` or an\n\
+    iterator's `cursor`). If omitted or ``None``, start at the first record.\n\
+\n\
+  end (int):\n\
+    Stop iterating at this record offset. If omitted or ``None``, stop at\n\
+    the end of the data.\n\
+\n\
+Returns:\n\
+  iterable: Iterator over values");
+
+#ifdef CDBX_FASTCALL
+static PyObject *
+CDBType_values(cdbtype_t *self, PyObject *const *args, Py_ssize_t nargs,
+               PyObject *kwnames)
+{
+    static const char * const kwlist[] = {"all", "encoding", "errors",
+                                          "start", "end", NULL};
+    PyObject *argv[5] = {NULL, NULL, NULL, NULL, NULL};
+
+    if (-1 == cdbx_parse_fastcall("values", args, nargs, kwnames, kwlist, 0,
+                                  argv))
+        return NULL;
+
+    return cdbtype_iter_new(self, argv[0], CDBX_ITER_VALUES, 0, argv[1],
+                            argv[2], argv[3], argv[4]);
+}
+#else
+static PyObject *
+CDBType_values(cdbtype_t *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"all", "encoding", "errors", "start", "end",
+                             NULL};
+    PyObject *all_ = NULL, *encoding_ = NULL, *errors_ = NULL;
+    PyObject *start_ = NULL, *end_ = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OOOOO", kwlist,
+                                     &all_, &encoding_, &errors_, &start_,
+                                     &end_))
+        return NULL;
+
+    return cdbtype_iter_new(self, all_, CDBX_ITER_VALUES, 0, encoding_,
+                            errors_, start_, end_);
+}
+#endif
+
+
+PyDoc_STRVAR(CDBType_iter_batches__doc__,
+"iter_batches(self, size=10000, what='items', all=False,\n\
+             encoding=<default>, errors=<default>, start=None, end=None)\n\
+\n\
+Create an iterator over batches of keys, values or items\n\
+\n\
+Each step returns a list of up to `size` entries, which is collected in one\n\
+go. That saves the per-item iteration overhead for full table scans.\n\
+If an entry cannot be decoded, the error is raised and the entries collected\n\
+so far are returned with the next batch.\n\
+\n\
+Parameters:\n\
+  size (int):\n\
+    Maximum number of entries per batch. Default: 10000\n\
+\n\
+  what (str):\n\
+    What to return: ``'keys'``, ``'values'`` or ``'items'`` (key/value\n\
+    tuples). Default: ``'items'``\n\
+\n\
+  all (bool):\n\
+    Return all (i.e. non-unique-key) entries? Default: False\n\
+\n\
+  encoding (str):\n\
+    Decode keys and values using this encoding. If omitted, the encoding\n\
+    passed to the constructor applies. If ``None``, nothing is decoded.\n\
+\n\
+  errors (str):\n\
+    Decoding error handler. If omitted, the handler passed to the\n\
+    constructor applies. If ``None``, it defaults to ``'strict'``.\n\
+\n\
+  start (int):\n\
+    Start iterating at this record offset (as returned by `split` or an\n\
+    iterator's `cursor`). If omitted or ``None``, start at the first record.\n\
+\n\
+  end (int):\n\
+    Stop iterating at this record offset. If omitted or ``None``, stop at\n\
+    the end of the data.\n\
+\n\
+Returns:\n\
+  iterable: Iterator over lists");
+
+static PyObject *
+CDBType_iter_batches(cdbtype_t *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"size", "what", "all", "encoding", "errors",
+                             "start", "end", NULL};
+    PyObject *all_ = NULL, *encoding_ = NULL, *errors_ = NULL;
+    PyObject *start_ = NULL, *end_ = NULL;
+    const char *what_ = "items";
+    Py_ssize_t size = 10000;
+    int what;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|nsOOOOO", kwlist,
+                                     &size, &what_, &all_, &encoding_,
+                                     &errors_, &start_, &end_))
+        return NULL;
+
+    if (size < 1) {
+        PyErr_SetString(PyExc_ValueError, "Batch size must be positive");
+        return NULL;
+    }
+
+    if (!strcmp(what_, "items"))
+        what = CDBX_ITER_ITEMS;
+    else if (!strcmp(what_, "keys"))
+        what = CDBX_ITER_KEYS;
+    else if (!strcmp(what_, "values"))
+        what = CDBX_ITER_VALUES;
+    else {
+        PyErr_SetString(PyExc_ValueError,
+                        "what must be one of 'items', 'keys', 'values'");
+        return NULL;
+    }
+
+    return cdbtype_iter_new(self, all_, what, size, encoding_, errors_,
+                            start_, end_);
+}
+
+
+PyDoc_STRVAR(CDBType_split__doc__,
+"split(self, n)\n\
+\n\
+Split the records into `n` ranges of roughly the same size\n\
+\n\
+The ranges are aligned to record boundaries and can be passed to\n\
+`items`, `keys`, `values` or `iter_batches` (as `start` and `end`), for\n\
+example by separate worker processes. Unique key iteration works across\n\
+the ranges, because a key is only returned from the range containing its\n\
+first record. Ranges may be empty, if there are only few records.\n\
+\n\
+Parameters:\n\
+  n (int):\n\
+    Number of ranges\n\
+\n\
+Returns:\n\
+  list: List of `n` ``(start, end)`` tuples");
+
+static PyObject *
+CDBType_split(cdbtype_t *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"n", NULL};
+    PyObject *result, *range;
+    Py_ssize_t num, idx, *bounds;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "n", kwlist,
+                                     &num))
+        return NULL;
+
+    if (!self->cdb32)
+        return cdbx_raise_closed();
+
+    if (num < 1) {
+        PyErr_SetString(PyExc_ValueError,
+                        "Number of ranges must be positive");
+        return NULL;
+    }
+    if ((size_t)num >= PY_SSIZE_T_MAX / sizeof *bounds
+        || !(bounds = PyMem_Malloc(((size_t)num + 1) * sizeof *bounds)))
+        return PyErr_NoMemory();
+
+    if (-1 == cdbx_cdb32_split(self->cdb32, num, bounds))
+        LCOV_EXCL_LINE_GOTO(error_bounds);
+
+    if (!(result = PyList_New(num)))
+        LCOV_EXCL_LINE_GOTO(error_bounds);
+
+    for (idx = 0; idx < num; ++idx) {
+        if (!(range = Py_BuildValue("(nn)", bounds[idx], bounds[idx + 1])))
+            LCOV_EXCL_LINE_GOTO(error);
+        PyList_SET_ITEM(result, idx, range);
+    }
+
+    PyMem_Free(bounds);
+    return result;
+
+/* LCOV_EXCL_START */
+error:
+    Py_DECREF(result);
+error_bounds:
+    PyMem_Free(bounds);
+    return NULL;
+/* LCOV_EXCL_STOP */
+}
+
+
+PyDoc_STRVAR(CDBType_to_columns__doc__,
+"to_columns(self, all=True)\n\
+\n\
+Export all keys and values into contiguous buffers\n\
+\n\
+The data is copied in two sequential passes over the records (sizing and\n\
+copying) without creating objects per record. The offset buffers contain\n\
+one entry per record plus a final one, as native unsigned 64 bit integers.\n\
+Key `i` is ``keys[key_offsets[i]:key_offsets[i + 1]]``, e.g.\n\
+``numpy.frombuffer(key_offsets, dtype=numpy.uint64)`` provides the offsets\n\
+(this is the layout of arrow's binary arrays).\n\
+\n\
+Parameters:\n\
+  all (bool):\n\
+    Export all records? If false, only the first record per key is\n\
+    exported. Default: True\n\
+\n\
+Returns:\n\
+  tuple: key bytes, key offsets, value bytes, value offsets (all bytes)");
+
+/*
+ * One pass over the records for to_columns()
+ *
+ * If the buffers are NULL, the records and sizes are just counted. Otherwise
+ * the records are copied into the buffers, which are sized by the counts
+ * passed in.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+static int
+cdbtype_columns_pass(cdbx_cdb32_t *cdb32, int all, char *keys,
+                     char *key_offsets, char *values, char *value_offsets,
+                     Py_ssize_t *count_, Py_ssize_t *ksize_,
+                     Py_ssize_t *vsize_)
+{
+    cdbx_cdb32_iter_t *iter;
+    cdbx_cdb32_pointer_t *key, *value;
+    Py_ssize_t count = 0, ksize = 0, vsize = 0;
+    uint64_t offset;
+    int first = 1;
+
+    if (-1 == cdbx_cdb32_iter_create(cdb32, &iter))
+        LCOV_EXCL_LINE_RETURN(-1);
+
+    while (1) {
+        if (-1 == cdbx_cdb32_iter_next(iter, &key, &value,
+                                       all ? NULL : &first))
+            LCOV_EXCL_LINE_GOTO(error);
+        if (!key)
+            break;
+        if (!first)
+            continue;
+
+        if (!keys) {
+            if ((size_t)key->length > (size_t)(PY_SSIZE_T_MAX - ksize)
+                || (size_t)value->length > (size_t)(PY_SSIZE_T_MAX - vsize)
+                || count >= PY_SSIZE_T_MAX / (Py_ssize_t)sizeof offset - 1) {
+                /* LCOV_EXCL_START */
+
+                PyErr_SetString(PyExc_OverflowError, "CDB too large");
+                goto error;
+
+                /* LCOV_EXCL_STOP */
+            }
+        }
+        else {
+            if (count >= *count_
+                || (size_t)key->length > (size_t)(*ksize_ - ksize)
+                || (size_t)value->length > (size_t)(*vsize_ - vsize)) {
+                /* LCOV_EXCL_START */
+
+                PyErr_SetString(PyExc_IOError, "Format Error");
+                goto error;
+
+                /* LCOV_EXCL_STOP */
+            }
+            offset = (uint64_t)ksize;
+            memcpy(key_offsets + count * (Py_ssize_t)sizeof offset, &offset,
+                   sizeof offset);
+            offset = (uint64_t)vsize;
+            memcpy(value_offsets + count * (Py_ssize_t)sizeof offset, &offset,
+                   sizeof offset);
+
+            if (-1 == cdbx_cdb32_read_into(cdb32, key, keys + ksize)
+                || -1 == cdbx_cdb32_read_into(cdb32, value, values + vsize))
+                LCOV_EXCL_LINE_GOTO(error);
+        }
+
+        ksize += (Py_ssize_t)key->length;
+        vsize += (Py_ssize_t)value->length;
+        ++count;
+    }
+    cdbx_cdb32_iter_destroy(&iter);
+
+    if (keys) {
+        offset = (uint64_t)ksize;
+        memcpy(key_offsets + count * (Py_ssize_t)sizeof offset, &offset,
+               sizeof offset);
+        offset = (uint64_t)vsize;
+        memcpy(value_offsets + count * (Py_ssize_t)sizeof offset, &offset,
+               sizeof offset);
+    }
+
+    *count_ = count;
+    *ksize_ = ksize;
+    *vsize_ = vsize;
+    return 0;
+
+/* LCOV_EXCL_START */
+error:
+    cdbx_cdb32_iter_destroy(&iter);
+    return -1;
+/* LCOV_EXCL_STOP */
+}
+
+static PyObject *
+CDBType_to_columns(cdbtype_t *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"all", NULL};
+    PyObject *all_ = NULL, *keys, *key_offsets, *values, *value_offsets;
+    Py_ssize_t count, ksize, vsize, osize;
+    int all = 1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist,
+                                     &all_))
+        return NULL;
+
+    if (all_) {
+        switch (PyObject_IsTrue(all_)) {
+        case -1: return NULL;
+        case 0: all = 0;
+        }
+    }
+
+    if (!self->cdb32)
+        return cdbx_raise_closed();
+
+    if (-1 == cdbtype_columns_pass(self->cdb32, all, NULL, NULL, NULL, NULL,
+                                   &count, &ksize, &vsize))
+        LCOV_EXCL_LINE_RETURN(NULL);
+
+    osize = (count + 1) * (Py_ssize_t)sizeof(uint64_t);
+    if (!(keys = PyBytes_FromStringAndSize(NULL, ksize)))
+        LCOV_EXCL_LINE_RETURN(NULL);
+    if (!(key_offsets = PyBytes_FromStringAndSize(NULL, osize)))
+        LCOV_EXCL_LINE_GOTO(error_keys);
+    if (!(values = PyBytes_FromStringAndSize(NULL, vsize)))
+        LCOV_EXCL_LINE_GOTO(error_key_offsets);
+    if (!(value_offsets = PyBytes_FromStringAndSize(NULL, osize)))
+        LCOV_EXCL_LINE_GOTO(error_values);
+
+    if (-1 == cdbtype_columns_pass(self->cdb32, all,
+                                   PyBytes_AS_STRING(keys),
+                                   PyBytes_AS_STRING(key_offsets),
+                                   PyBytes_AS_STRING(values),
+                                   PyBytes_AS_STRING(value_offsets),
+                                   &count, &ksize, &vsize))
+        LCOV_EXCL_LINE_GOTO(error_value_offsets);
+
+    return Py_BuildValue("(NNNN)", keys, key_offsets, values, value_offsets);
+
+/* LCOV_EXCL_START */
+error_value_offsets:
+    Py_DECREF(value_offsets);
+error_values:
+    Py_DECREF(values);
+error_key_offsets:
+    Py_DECREF(key_offsets);
+error_keys:
+    Py_DECREF(keys);
+    return NULL;
+/* LCOV_EXCL_STOP */
+}
+
+
+PyDoc_STRVAR(CDBType_scan__doc__,
+"scan(self, prefix=None, suffix=None, contains=None, regex=None,\n\
+     what='keys', all=False, threads=None, encoding=<default>,\n\
+     errors=<default>)\n\
+\n\
+Find all entries with keys matching the passed predicates\n\
+\n\
+The records are split into partitions, which are scanned by native threads\n\
+without holding the GIL. The `prefix`, `suffix` and `contains` predicates\n\
+are evaluated natively. `regex` is applied afterwards (with the GIL) on the\n\
+remaining candidates only. All passed predicates need to match.\n\
+\n\
+Note that unicode predicates are transformed to byte strings using the\n\
+latin-1 encoding.\n\
+\n\
+Parameters:\n\
+  prefix (str or bytes):\n\
+    The key starts with this string\n\
+\n\
+  suffix (str or bytes):\n\
+    The key ends with this string\n\
+\n\
+  contains (str or bytes):\n\
+    The key contains this string\n\
+\n\
+  regex (bytes or compiled regex):\n\
+    The pattern's search() method finds a match in the (undecoded) key\n\
+\n\
+  what (str):\n\
+    What to return: ``'keys'``, ``'values'`` or ``'items'`` (key/value\n\
+    tuples). Default: ``'keys'``\n\
+\n\
+  all (bool):\n\
+    Return all (i.e. non-unique-key) entries? Default: False\n\
+\n\
+  threads (int):\n\
+    Maximum number of threads to use. If omitted or ``None``, one per CPU\n\
+    is used. Small files are scanned with fewer threads.\n\
+\n\
+  encoding (str):\n\
+    Decode keys and values using this encoding. If omitted, the encoding\n\
+    passed to the constructor applies. If ``None``, nothing is decoded.\n\
+\n\
+  errors (str):\n\
+    Decoding error handler. If omitted, the handler passed to the\n\
+    constructor applies. If ``None``, it defaults to ``'strict'``.\n\
+\n\
+Returns:\n\
+  list: The matching entries in file order");
+
+/*
+ * Turn a scan match into the requested result object
+ *
+ * Return NULL on error
+ */
+static PyObject *
+cdbtype_scan_result(cdbtype_t *self, cdbx_cdb32_pointer_t *match, int what,
+                    const char *encoding, const char *errors)
+{
+    PyObject *key, *value, *result;
+
+    if (what == CDBX_ITER_VALUES)
+        match = &match[1];
+
+    if (-1 == cdbx_cdb32_read_decoded(self->cdb32, match, encoding, errors,
+                                      &result))
+        return NULL;
+
+    if (what == CDBX_ITER_ITEMS) {
+        key = result;
+        if (!self->cdb32) {
+            /* closed by the codec */
+            Py_DECREF(key);
+            return cdbx_raise_closed();
+        }
+        if (-1 == cdbx_cdb32_read_decoded(self->cdb32, &match[1], encoding,
+                                          errors, &value)) {
+            Py_DECREF(key);
+            return NULL;
+        }
+        if (!(result = PyTuple_New(2))) {
+            /* LCOV_EXCL_START */
+
+            Py_DECREF(value);
+            Py_DECREF(key);
+            return NULL;
+
+            /* LCOV_EXCL_STOP */
+        }
+        PyTuple_SET_ITEM(result, 0, key);
+        PyTuple_SET_ITEM(result, 1, value);
+    }
+
+    return result;
+}
+
+static PyObject *
+CDBType_scan(cdbtype_t *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"prefix", "suffix", "contains", "regex", "what",
+                             "all", "threads", "encoding", "errors", NULL};
+    PyObject *prefix_ = NULL, *suffix_ = NULL, *contains_ = NULL;
+    PyObject *regex_ = NULL, *all_ = NULL, *threads_ = NULL;
+    PyObject *encoding_ = NULL, *errors_ = NULL;
+    PyObject *search = NULL, *result, *item, *key, *tmp;
+    cdbx_cdb32_pointer_t *matches;
+    const char *encoding, *errors, *what_ = "keys";
+    Py_ssize_t count, idx, threads = 0;
+    int what, all = 0, res;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OOOOsOOOO", kwlist,
+                                     &prefix_, &suffix_, &contains_, &regex_,
+                                     &what_, &all_, &threads_, &encoding_,
+                                     &errors_))
+        return NULL;
+
+    if (!strcmp(what_, "keys"))
+        what = CDBX_ITER_KEYS;
+    else if (!strcmp(what_, "values"))
+        what = CDBX_ITER_VALUES;
+    else if (!strcmp(what_, "items"))
+        what = CDBX_ITER_ITEMS;
+    else {
+        PyErr_SetString(PyExc_ValueError,
+                        "what must be one of 'keys', 'values', 'items'");
+        return NULL;
+    }
+
+    if (all_) {
+        switch (PyObject_IsTrue(all_)) {
+        case -1: return NULL;
+        case 1: all = 1;
+        }
+    }
+
+    if (threads_ && threads_ != Py_None) {
+        if (-1 == (threads = PyNumber_AsSsize_t(threads_,
+                                                PyExc_OverflowError))
+            && PyErr_Occurred())
+            return NULL;
+        if (threads < 1) {
+            PyErr_SetString(PyExc_ValueError, "threads must be positive");
+            return NULL;
+        }
+        if (threads > INT_MAX)
+            threads = INT_MAX;
+    }
+
+    if (-1 == cdbtype_codec(self, &encoding_, &errors_, &encoding, &errors))
+        return NULL;
+
+    if (regex_ && regex_ != Py_None) {
+        if (-1 == cdbx_attr(regex_, "search", &search))
+            LCOV_EXCL_LINE_RETURN(NULL);
+        if (!search) {
+            if (!(tmp = PyImport_ImportModule("re")))
+                LCOV_EXCL_LINE_RETURN(NULL);
+            regex_ = PyObject_CallMethod(tmp, "compile", "(O)", regex_);
+            Py_DECREF(tmp);
+            if (!regex_)
+                return NULL;
+            res = cdbx_attr(regex_, "search", &search);
+            Py_DECREF(regex_);
+            if (-1 == res)
+                LCOV_EXCL_LINE_RETURN(NULL);
+        }
+    }
+
+    /* The conversions above may have run python code closing us */
+    if (!self->cdb32) {
+        cdbx_raise_closed();
+        goto error_search;
+    }
+
+    if (-1 == cdbx_cdb32_scan(self->cdb32, prefix_, suffix_, contains_, all,
+                              (int)threads, &matches, &count))
+        goto error_search;
+
+    if (!(result = PyList_New(0)))
+        LCOV_EXCL_LINE_GOTO(error_matches);
+
+    for (idx = 0; idx < count; ++idx) {
+        if (search) {
+            if (!self->cdb32) {
+                cdbx_raise_closed();
+                goto error_result;
+            }
+            if (-1 == cdbx_cdb32_read(self->cdb32, &matches[idx * 2], &key))
+                LCOV_EXCL_LINE_GOTO(error_result);
+            tmp = PyObject_CallFunction(search, "(O)", key);
+            Py_DECREF(key);
+            if (!tmp)
+                goto error_result;
+            res = PyObject_IsTrue(tmp);
+            Py_DECREF(tmp);
+            switch (res) {
+            case -1: goto error_result;
+            case 0: continue;
+            }
         }
-    } while (all && result);
-    cdbx_cdb32_get_iter_destroy(&get_iter);
 
-    if (all) {
-        if (!PyList_GET_SIZE(result_list)) {
-            Py_DECREF(result_list);
-            return default_;
+        /* search() or a codec may have closed us */
+        if (!self->cdb32) {
+            cdbx_raise_closed();
+            goto error_result;
         }
-        Py_DECREF(default_);
-        return result_list;
+        if (!(item = cdbtype_scan_result(self, &matches[idx * 2], what,
+                                         encoding, errors)))
+            goto error_result;
+        res = PyList_Append(result, item);
+        Py_DECREF(item);
+        if (-1 == res)
+            LCOV_EXCL_LINE_GOTO(error_result);
     }
 
-    if (!result)
-        return default_;
-
-    Py_DECREF(default_);
+    PyMem_Free(matches);
+    Py_XDECREF(search);
     return result;
 
-    /* LCOV_EXCL_START */
-error_get_iter:
-    cdbx_cdb32_get_iter_destroy(&get_iter);
-error_list:
-    if (all)
-        Py_DECREF(result_list);
-error:
-    /* LCOV_EXCL_STOP */
-
-    Py_DECREF(default_);
+error_result:
+    Py_DECREF(result);
+error_matches:
+    PyMem_Free(matches);
+error_search:
+    Py_XDECREF(search);
     return NULL;
 }
 
 
-PyDoc_STRVAR(CDBType_items__doc__,
-"items(self, all=False)\n\
+PyDoc_STRVAR(CDBType_sample__doc__,
+"sample(self, k, seed=None, unique_keys=False, encoding=<default>,\n\
+       errors=<default>)\n\
 \n\
-Create key/value pair iterator\n\
+Draw a uniform random sample of records\n\
+\n\
+The records are picked via random hash table slots, so only about two slot\n\
+reads per sampled record are needed instead of a full scan. The records\n\
+are distinct and returned in random order. Fewer than `k` records are\n\
+returned only if the CDB does not contain more.\n\
 \n\
 Parameters:\n\
-  all (bool):\n\
-    Return all (i.e. non-unique-key) items? Default: False\n\
+  k (int):\n\
+    Sample size\n\
+\n\
+  seed (int):\n\
+    Random seed for reproducible samples. If omitted or ``None``, a random\n\
+    seed is taken from the `random` module.\n\
+\n\
+  unique_keys (bool):\n\
+    Sample unique keys (i.e. only the first record per key) instead of\n\
+    records? Default: False\n\
+\n\
+  encoding (str):\n\
+    Decode keys and values using this encoding. If omitted, the encoding\n\
+    passed to the constructor applies. If ``None``, nothing is decoded.\n\
+\n\
+  errors (str):\n\
+    Decoding error handler. If omitted, the handler passed to the\n\
+    constructor applies. If ``None``, it defaults to ``'strict'``.\n\
 \n\
 Returns:\n\
-  iterable: Iterator over items");
+  list: List of key/value tuples");
 
 static PyObject *
-CDBType_items(cdbtype_t *self, PyObject *args, PyObject *kwds)
+CDBType_sample(cdbtype_t *self, PyObject *args, PyObject *kwds)
 {
-    static char *kwlist[] = {"all", NULL};
-    PyObject *all_ = NULL;
-    int all = 0;
-
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist,
-                                     &all_))
+    static char *kwlist[] = {"k", "seed", "unique_keys", "encoding", "errors",
+                             NULL};
+    PyObject *seed_ = NULL, *unique_ = NULL, *encoding_ = NULL;
+    PyObject *errors_ = NULL, *result, *item, *tmp;
+    cdbx_cdb32_pointer_t *records;
+    const char *encoding, *errors;
+    Py_ssize_t k, count, idx;
+    uint64_t seed;
+    int unique = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "n|OOOO", kwlist,
+                                     &k, &seed_, &unique_, &encoding_,
+                                     &errors_))
         return NULL;
 
-    if (!self->cdb32)
-        return cdbx_raise_closed();
+    if (k < 0) {
+        PyErr_SetString(PyExc_ValueError, "Sample size must not be negative");
+        return NULL;
+    }
 
-    if (all_) {
-        switch (PyObject_IsTrue(all_)) {
+    if (unique_) {
+        switch (PyObject_IsTrue(unique_)) {
         case -1: return NULL;
-        case 1: all = 1;
+        case 1: unique = 1;
         }
     }
 
-    return cdbx_iter_new(self, 1, all);
-}
-
-
-PyDoc_STRVAR(CDBType_keys__doc__,
-"keys(self, all=False)\n\
-\n\
-Create key iterator\n\
-\n\
-Parameters:\n\
-  all (bool):\n\
-    Return all (i.e. non-unique) keys? Default: False\n\
-\n\
-Returns:\n\
-  iterable: Iterator over keys");
-
-static PyObject *
-CDBType_keys(cdbtype_t *self, PyObject *args, PyObject *kwds)
-{
-    static char *kwlist[] = {"all", NULL};
-    PyObject *all_ = NULL;
-    int all = 0;
+    if (-1 == cdbtype_codec(self, &encoding_, &errors_, &encoding, &errors))
+        return NULL;
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist,
-                                     &all_))
+    if (!seed_ || seed_ == Py_None) {
+        if (!(tmp = PyImport_ImportModule("random")))
+            LCOV_EXCL_LINE_RETURN(NULL);
+        seed_ = PyObject_CallMethod(tmp, "getrandbits", "(i)", 64);
+        Py_DECREF(tmp);
+    }
+    else if (!PyIndex_Check(seed_)) {
+        PyErr_SetString(PyExc_TypeError, "seed must be an integer or None");
         return NULL;
+    }
+    else {
+        Py_INCREF(seed_);
+    }
+    if (!seed_)
+        LCOV_EXCL_LINE_RETURN(NULL);
+    tmp = PyNumber_Long(seed_);
+    Py_DECREF(seed_);
+    if (!tmp)
+        LCOV_EXCL_LINE_RETURN(NULL);
+    seed = (uint64_t)PyLong_AsUnsignedLongLongMask(tmp);
+    Py_DECREF(tmp);
+    if (PyErr_Occurred())
+        LCOV_EXCL_LINE_RETURN(NULL);
 
+    /* The conversions above may run python code, which may close us */
     if (!self->cdb32)
         return cdbx_raise_closed();
 
-    if (all_) {
-        switch (PyObject_IsTrue(all_)) {
-        case -1: return NULL;
-        case 1: all = 1;
+    if (-1 == cdbx_cdb32_sample(self->cdb32, k, seed, unique, &records,
+                                &count))
+        return NULL;
+
+    if (!(result = PyList_New(count)))
+        LCOV_EXCL_LINE_GOTO(error_records);
+
+    for (idx = 0; idx < count; ++idx) {
+        /* a codec may have closed us */
+        if (!self->cdb32) {
+            cdbx_raise_closed();
+            goto error_result;
         }
+        if (!(item = cdbtype_scan_result(self, &records[idx * 2],
+                                         CDBX_ITER_ITEMS, encoding, errors)))
+            goto error_result;
+        PyList_SET_ITEM(result, idx, item);
     }
 
-    return cdbx_iter_new(self, 0, all);
+    PyMem_Free(records);
+    return result;
+
+error_result:
+    Py_DECREF(result);
+error_records:
+    PyMem_Free(records);
+    return NULL;
 }
 
 
@@ -305,12 +1917,13 @@ CDBType_iter(cdbtype_t *self)
     if (!self->cdb32)
         return cdbx_raise_closed();
 
-    return cdbx_iter_new(self, 0, 0);
+    return cdbx_iter_new(self, CDBX_ITER_KEYS, 0, 0, self->encoding,
+                         self->errors);
 }
 
 
 PyDoc_STRVAR(CDBType_make__doc__,
-"make(cls, file, close=None, mmap=None)\n\
+"make(cls, file, close=None, mmap=None, atomic=False, durability='full')\n\
 \n\
 Create a CDB maker instance, which returns a CDB instance when done.\n\
 \n\
@@ -328,6 +1941,18 @@ Parameters:\n\
     Access the file by mapping it into memory? If True, mmap is required. If\n\
     false, mmap is not even tried. If omitted or ``None``, it's attempted but\n\
     no error on failure. This argument is applied on commit.\n\
+\n\
+  atomic (bool):\n\
+    Write into a temporary file next to `file` (which must be a filename)\n\
+    and rename it to `file` on commit? Readers never see a partially written\n\
+    CDB that way. If the maker is closed without commit, the temporary file\n\
+    is removed.\n\
+\n\
+  durability (str):\n\
+    How to sync the file on commit: ``'full'`` (default) uses fsync(2) and\n\
+    also syncs the directory after an atomic rename. ``'data'`` only uses\n\
+    fdatasync(2) (where available) on the file. ``'none'`` doesn't sync at\n\
+    all and leaves it to the OS, which is fine for scratch data.\n\
 \n\
 Returns:\n\
   CDBMaker: New maker instance");
@@ -335,14 +1960,308 @@ Returns:\n\
 static PyObject *
 CDBType_make(PyTypeObject *cls, PyObject *args, PyObject *kwds)
 {
-    static char *kwlist[] = {"file", "close", "mmap", NULL};
-    PyObject *file_, *close_ = NULL, *mmap_ = NULL;
+    static char *kwlist[] = {"file", "close", "mmap", "atomic", "durability",
+                             NULL};
+    PyObject *file_, *close_ = NULL, *mmap_ = NULL, *atomic_ = NULL;
+    const char *durability_ = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|OOOs", kwlist,
+                                     &file_, &close_, &mmap_, &atomic_,
+                                     &durability_))
+        return NULL;
+
+    return cdbx_maker_new(cls, file_, close_, mmap_, atomic_, durability_);
+}
+
+
+PyDoc_STRVAR(CDBType_merge__doc__,
+"merge(cls, sources, file, dedup='all', close=None, mmap=None)\n\
+\n\
+Merge several CDBs into a new one\n\
+\n\
+The records are copied natively (source by source, in file order) with the\n\
+GIL released. Every key is hashed only once.\n\
+\n\
+Parameters:\n\
+  sources (iterable):\n\
+    The CDBs to merge. Either CDB instances or anything accepted by the\n\
+    constructor (like filenames). The latter are opened and closed again by\n\
+    the merge.\n\
+\n\
+  file (file or str or int):\n\
+    The target, like with ``make``\n\
+\n\
+  dedup (str):\n\
+    Which records to keep per key: ``'all'`` (default), ``'first'`` or\n\
+    ``'last'`` (in the order of the sources). Deduplication keeps a native\n\
+    set of all keys in memory.\n\
+\n\
+  close (bool):\n\
+    Close a passed stream or file descriptor, when the new CDB is closed?\n\
+\n\
+  mmap (bool):\n\
+    Passed to the new CDB\n\
+\n\
+Returns:\n\
+  CDB: The merged CDB");
+
+static PyObject *
+CDBType_merge(PyTypeObject *cls, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"sources", "file", "dedup", "close", "mmap",
+                             NULL};
+    PyObject *sources_, *file_, *close_ = NULL, *mmap_ = NULL;
+    PyObject *iter, *item, *tmp, *cdbs, *opened, *maker = NULL;
+    PyObject *exc_type, *exc_value, *exc_tb, *result = NULL;
+    cdbx_cdb32_t **cdb32s = NULL;
+    const char *dedup_ = "all";
+    Py_ssize_t idx, num;
+    int dedup;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO|sOO", kwlist,
+                                     &sources_, &file_, &dedup_, &close_,
+                                     &mmap_))
+        return NULL;
+
+    if (!strcmp(dedup_, "all"))
+        dedup = CDBX_DEDUP_ALL;
+    else if (!strcmp(dedup_, "first"))
+        dedup = CDBX_DEDUP_FIRST;
+    else if (!strcmp(dedup_, "last"))
+        dedup = CDBX_DEDUP_LAST;
+    else {
+        PyErr_SetString(PyExc_ValueError,
+                        "dedup must be one of 'all', 'first', 'last'");
+        return NULL;
+    }
+
+    if (!(iter = PyObject_GetIter(sources_)))
+        return NULL;
+    if (!(cdbs = PyList_New(0)))
+        LCOV_EXCL_LINE_GOTO(error_iter);
+    if (!(opened = PyList_New(0)))
+        LCOV_EXCL_LINE_GOTO(error_cdbs);
+
+    /* Collect the sources, opening the non-CDBs */
+    while ((item = PyIter_Next(iter))) {
+        if (!CDBType_Check(item)) {
+            tmp = PyObject_CallFunctionObjArgs((PyObject *)cls, item, NULL);
+            Py_DECREF(item);
+            if (!(item = tmp))
+                goto cleanup;
+            if (-1 == PyList_Append(opened, item)) {
+                Py_DECREF(item);       /* LCOV_EXCL_LINE */
+                goto cleanup;          /* LCOV_EXCL_LINE */
+            }
+        }
+        idx = PyList_Append(cdbs, item);
+        Py_DECREF(item);
+        if (-1 == idx)
+            LCOV_EXCL_LINE_GOTO(cleanup);
+    }
+    if (PyErr_Occurred())
+        goto cleanup;
+
+    num = PyList_GET_SIZE(cdbs);
+    if (!(cdb32s = PyMem_Malloc((size_t)(num ? num : 1) * sizeof *cdb32s))) {
+        PyErr_NoMemory();              /* LCOV_EXCL_LINE */
+        goto cleanup;                  /* LCOV_EXCL_LINE */
+    }
+
+    if (!(maker = cdbx_maker_new(cls, file_, close_, mmap_, NULL, NULL)))
+        goto cleanup;
+
+    /* Fetch the sources last, the steps above may run python code */
+    for (idx = 0; idx < num; ++idx) {
+        if (!(cdb32s[idx] = cdbx_type_get_cdb32(
+                (cdbtype_t *)PyList_GET_ITEM(cdbs, idx)))) {
+            cdbx_raise_closed();
+            goto cleanup;
+        }
+    }
+
+    if (-1 != cdbx_cdb32_maker_merge(cdbx_maker_get_maker32(maker), cdb32s,
+                                     num, dedup)
+        && (result = PyObject_CallMethod(maker, "commit", "()")))
+        Py_CLEAR(maker);
+
+cleanup:
+    PyErr_Fetch(&exc_type, &exc_value, &exc_tb);
+    if (maker) {
+        /* LCOV_EXCL_START */
+        if (!(tmp = PyObject_CallMethod(maker, "close", "()")))
+            PyErr_Clear();
+        else
+            Py_DECREF(tmp);
+        Py_DECREF(maker);
+        /* LCOV_EXCL_STOP */
+    }
+    for (idx = 0; idx < PyList_GET_SIZE(opened); ++idx) {
+        if (!(tmp = PyObject_CallMethod(PyList_GET_ITEM(opened, idx),
+                                        "close", "()")))
+            PyErr_Clear();             /* LCOV_EXCL_LINE */
+        else
+            Py_DECREF(tmp);
+    }
+    PyErr_Restore(exc_type, exc_value, exc_tb);
+
+    PyMem_Free(cdb32s);
+    Py_DECREF(opened);
+error_cdbs:
+    Py_DECREF(cdbs);
+error_iter:
+    Py_DECREF(iter);
+    return result;
+}
+
+
+PyDoc_STRVAR(CDBType_rebuild__doc__,
+"rebuild(self, file, delete=None, replace=None, close=None, mmap=None)\n\
+\n\
+Write a copy of the CDB with some keys deleted or replaced\n\
+\n\
+Runs of unchanged records are copied as raw byte ranges (using\n\
+copy_file_range(2) where available) and their hash table entries are\n\
+taken over, so small edits of large files are mostly I/O. The replaced\n\
+records are appended at the end.\n\
+\n\
+Note that in case of unicode keys or values, they will be transformed to\n\
+byte strings using the latin-1 encoding.\n\
+\n\
+Parameters:\n\
+  file (file or str or int):\n\
+    The target, like with ``make``\n\
+\n\
+  delete (iterable):\n\
+    Keys to remove (all of their values). Keys not in the CDB are ignored.\n\
+\n\
+  replace (mapping):\n\
+    Keys to set to a new (single) value. Keys not in the CDB are added.\n\
+\n\
+  close (bool):\n\
+    Close a passed stream or file descriptor, when the new CDB is closed?\n\
+\n\
+  mmap (bool):\n\
+    Passed to the new CDB\n\
+\n\
+Returns:\n\
+  CDB: The new CDB");
+
+static PyObject *
+CDBType_rebuild(cdbtype_t *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"file", "delete", "replace", "close", "mmap",
+                             NULL};
+    PyObject *file_, *delete_ = NULL, *replace_ = NULL, *close_ = NULL;
+    PyObject *mmap_ = NULL, *keys, *items = NULL, *iter, *item, *key;
+    PyObject *value, *maker = NULL, *result = NULL, *tmp;
+    PyObject *exc_type, *exc_value, *exc_tb;
+    cdbx_cdb32_maker_t *maker32;
+    cdbx_cdb32_t *cdb32;
+    Py_ssize_t idx;
+    int res;
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|OO", kwlist,
-                                     &file_, &close_, &mmap_))
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|OOOO", kwlist,
+                                     &file_, &delete_, &replace_, &close_,
+                                     &mmap_))
         return NULL;
 
-    return cdbx_maker_new(cls, file_, close_, mmap_);
+    if (!self->cdb32)
+        return cdbx_raise_closed();
+
+    if (!(keys = PyList_New(0)))
+        LCOV_EXCL_LINE_RETURN(NULL);
+
+    if (delete_ && delete_ != Py_None) {
+        if (!(iter = PyObject_GetIter(delete_)))
+            goto cleanup;
+        while ((item = PyIter_Next(iter))) {
+            res = cdbx_cdb32_bytes(item, &key, NULL);
+            Py_DECREF(item);
+            if (-1 == res)
+                break;
+            res = PyList_Append(keys, key);
+            Py_DECREF(key);
+            if (-1 == res)
+                break;  /* LCOV_EXCL_LINE */
+        }
+        Py_DECREF(iter);
+        if (PyErr_Occurred())
+            goto cleanup;
+    }
+
+    /* items becomes a list of (bytes, bytes) */
+    if (replace_ && replace_ != Py_None) {
+        if (!(items = PyMapping_Items(replace_)))
+            goto cleanup;
+        for (idx = 0; idx < PyList_GET_SIZE(items); ++idx) {
+            item = PyList_GET_ITEM(items, idx);
+            if (!PyTuple_Check(item) || PyTuple_GET_SIZE(item) != 2) {
+                PyErr_SetString(PyExc_TypeError,
+                                "replace items must be pairs");
+                goto cleanup;
+            }
+            if (-1 == cdbx_cdb32_bytes(PyTuple_GET_ITEM(item, 0), &key,
+                                       NULL))
+                goto cleanup;
+            if (-1 == cdbx_cdb32_bytes(PyTuple_GET_ITEM(item, 1), &value,
+                                       NULL)) {
+                Py_DECREF(key);
+                goto cleanup;
+            }
+            if (!(tmp = PyTuple_Pack(2, key, value))
+                || -1 == PyList_Append(keys, key)) {
+                /* LCOV_EXCL_START */
+                Py_XDECREF(tmp);
+                Py_DECREF(value);
+                Py_DECREF(key);
+                goto cleanup;
+                /* LCOV_EXCL_STOP */
+            }
+            Py_DECREF(value);
+            Py_DECREF(key);
+            PyList_SetItem(items, idx, tmp);
+        }
+    }
+
+    if (!(maker = cdbx_maker_new(Py_TYPE(self), file_, close_, mmap_,
+                                 NULL, NULL)))
+        goto cleanup;
+    maker32 = cdbx_maker_get_maker32(maker);
+
+    /* Fetch the source last, the steps above may run python code */
+    if (!(cdb32 = cdbx_type_get_cdb32(self))) {
+        cdbx_raise_closed();
+        goto cleanup;
+    }
+    if (-1 == cdbx_cdb32_maker_rebuild(maker32, cdb32, keys))
+        LCOV_EXCL_LINE_GOTO(cleanup);
+
+    for (idx = 0; items && idx < PyList_GET_SIZE(items); ++idx) {
+        item = PyList_GET_ITEM(items, idx);
+        if (-1 == cdbx_cdb32_maker_add(maker32, PyTuple_GET_ITEM(item, 0),
+                                       PyTuple_GET_ITEM(item, 1)))
+            LCOV_EXCL_LINE_GOTO(cleanup);
+    }
+
+    if ((result = PyObject_CallMethod(maker, "commit", "()")))
+        Py_CLEAR(maker);
+
+cleanup:
+    if (maker) {
+        /* LCOV_EXCL_START */
+        PyErr_Fetch(&exc_type, &exc_value, &exc_tb);
+        if (!(tmp = PyObject_CallMethod(maker, "close", "()")))
+            PyErr_Clear();
+        else
+            Py_DECREF(tmp);
+        PyErr_Restore(exc_type, exc_value, exc_tb);
+        Py_DECREF(maker);
+        /* LCOV_EXCL_STOP */
+    }
+    Py_XDECREF(items);
+    Py_DECREF(keys);
+    return result;
 }
 
 
@@ -385,6 +2304,27 @@ CDBType_close(cdbtype_t *self)
 }
 
 
+PyDoc_STRVAR(CDBType_warm__doc__,
+"warm(self)\n\
+\n\
+Pull the whole file into the page cache (and the mapping)\n\
+\n\
+Mapped files are pre-faulted page by page, otherwise the kernel is asked to\n\
+read ahead. Warming before forking lets child processes share the pages.");
+
+static PyObject *
+CDBType_warm(cdbtype_t *self)
+{
+    if (!self->cdb32)
+        return cdbx_raise_closed();
+
+    if (-1 == cdbx_cdb32_warm(self->cdb32))
+        LCOV_EXCL_LINE_RETURN(NULL);
+
+    Py_RETURN_NONE;
+}
+
+
 PyDoc_STRVAR(CDBType_fileno__doc__,
 "fileno(self)\n\
 \n\
@@ -470,6 +2410,7 @@ PyDoc_STRVAR(CDBType_getitem__doc__,
 "__getitem__(self, key)\n\
 \n\
 Find the first value of the passed key and return the value as bytestring\n\
+(or as unicode string, if an encoding was passed to the constructor)\n\
 \n\
 Note that in case of a unicode key, it will be transformed to a byte string\n\
 using the latin-1 encoding.\n\
@@ -488,23 +2429,27 @@ Raises:\n\
 static PyObject *
 CDBType_getitem(cdbtype_t *self, PyObject *key)
 {
-    PyObject *result;
-    cdbx_cdb32_get_iter_t *get_iter;
-    int res;
+    PyObject *result, *encoding_ = NULL, *errors_ = NULL;
+    cdbx_cdb32_pointer_t value;
+    const char *encoding, *errors;
 
     if (!self->cdb32)
         return cdbx_raise_closed();
 
-    if (-1 == cdbx_cdb32_get_iter_new(self->cdb32, key, &get_iter))
+    switch (cdbx_cdb32_find(self->cdb32, key, &value)) {
+    case -1:
         return NULL;
+    case 0:
+        raise_key_error(key);
+        return NULL;
+    }
 
-    res = cdbx_cdb32_get_iter_next(get_iter, &result);
-    cdbx_cdb32_get_iter_destroy(&get_iter);
-    if (-1 == res)
+    if (-1 == cdbtype_codec(self, &encoding_, &errors_, &encoding, &errors))
         LCOV_EXCL_LINE_RETURN(NULL);
 
-    if (!result)
-        raise_key_error(key);
+    if (-1 == cdbx_cdb32_read_decoded(self->cdb32, &value, encoding, errors,
+                                      &result))
+        return NULL;
 
     return result;
 }
@@ -532,7 +2477,7 @@ static PyMappingMethods CDBType_as_mapping = {
 
 #ifdef METH_COEXIST
 PyDoc_STRVAR(CDBType_new__doc__,
-"__new__(cls, file, close=None, mmap=None)\n\
+"__new__(cls, file, close=None, mmap=None, encoding=None, errors=None)\n\
 \n\
 Create a CDB instance.\n\
 \n\
@@ -550,6 +2495,15 @@ Parameters:\n\
     Access the file by mapping it into memory? If True, mmap is required. If\n\
     false, mmap is not even tried. If omitted or ``None``, it's attempted but\n\
     no error on failure.\n\
+\n\
+  encoding (str):\n\
+    Default encoding for decoding returned keys and values. If omitted or\n\
+    ``None``, bytes are returned. Note that unicode keys passed in for\n\
+    lookups are still transformed using latin-1.\n\
+\n\
+  errors (str):\n\
+    Default decoding error handler. If omitted or ``None``, it defaults to\n\
+    ``'strict'``.\n\
 \n\
 Returns:\n\
   CDB: New CDB instance");
@@ -591,6 +2545,17 @@ static PyMethodDef CDBType_methods[] = {
                                               METH_VARARGS,
      CDBType_make__doc__},
 
+    {"merge",
+     EXT_CFUNC(CDBType_merge),                METH_CLASS    |
+                                              METH_KEYWORDS |
+                                              METH_VARARGS,
+     CDBType_merge__doc__},
+
+    {"rebuild",
+     EXT_CFUNC(CDBType_rebuild),              METH_KEYWORDS |
+                                              METH_VARARGS,
+     CDBType_rebuild__doc__},
+
     {"close",
      EXT_CFUNC(CDBType_close),                METH_NOARGS,
      CDBType_close__doc__},
@@ -599,25 +2564,95 @@ static PyMethodDef CDBType_methods[] = {
      EXT_CFUNC(CDBType_fileno),               METH_NOARGS,
      CDBType_fileno__doc__},
 
+    {"warm",
+     EXT_CFUNC(CDBType_warm),                 METH_NOARGS,
+     CDBType_warm__doc__},
+
     {"has_key",
      EXT_CFUNC(CDBType_contains),             METH_O,
      CDBType_has_key__doc__},
 
     {"keys",
-     EXT_CFUNC(CDBType_keys),                 METH_KEYWORDS |
-                                              METH_VARARGS,
+     EXT_CFUNC(CDBType_keys),                 CDBX_METH_KEYWORDS,
      CDBType_keys__doc__},
 
     {"items",
-     EXT_CFUNC(CDBType_items),                METH_KEYWORDS |
-                                              METH_VARARGS,
+     EXT_CFUNC(CDBType_items),                CDBX_METH_KEYWORDS,
      CDBType_items__doc__},
 
-    {"get",
-     EXT_CFUNC(CDBType_get),                  METH_KEYWORDS |
+    {"values",
+     EXT_CFUNC(CDBType_values),               CDBX_METH_KEYWORDS,
+     CDBType_values__doc__},
+
+    {"iter_batches",
+     EXT_CFUNC(CDBType_iter_batches),         METH_KEYWORDS |
+                                              METH_VARARGS,
+     CDBType_iter_batches__doc__},
+
+    {"split",
+     EXT_CFUNC(CDBType_split),                METH_KEYWORDS |
                                               METH_VARARGS,
+     CDBType_split__doc__},
+
+    {"to_columns",
+     EXT_CFUNC(CDBType_to_columns),           METH_KEYWORDS |
+                                              METH_VARARGS,
+     CDBType_to_columns__doc__},
+
+    {"scan",
+     EXT_CFUNC(CDBType_scan),                 METH_KEYWORDS |
+                                              METH_VARARGS,
+     CDBType_scan__doc__},
+
+    {"sample",
+     EXT_CFUNC(CDBType_sample),               METH_KEYWORDS |
+                                              METH_VARARGS,
+     CDBType_sample__doc__},
+
+    {"get",
+     EXT_CFUNC(CDBType_get),                  CDBX_METH_KEYWORDS,
      CDBType_get__doc__},
 
+    {"get_into",
+     EXT_CFUNC(CDBType_get_into),             CDBX_METH_KEYWORDS,
+     CDBType_get_into__doc__},
+
+    {"value_size",
+     EXT_CFUNC(CDBType_value_size),           METH_O,
+     CDBType_value_size__doc__},
+
+    {"count",
+     EXT_CFUNC(CDBType_count),                METH_O,
+     CDBType_count__doc__},
+
+    {"locate",
+     EXT_CFUNC(CDBType_locate),               METH_KEYWORDS |
+                                              METH_VARARGS,
+     CDBType_locate__doc__},
+
+    {"locate_many",
+     EXT_CFUNC(CDBType_locate_many),          METH_O,
+     CDBType_locate_many__doc__},
+
+    {"read_at",
+     EXT_CFUNC(CDBType_read_at),              METH_KEYWORDS |
+                                              METH_VARARGS,
+     CDBType_read_at__doc__},
+
+    {"read_many_at",
+     EXT_CFUNC(CDBType_read_many_at),         METH_O,
+     CDBType_read_many_at__doc__},
+
+    {"read_range",
+     EXT_CFUNC(CDBType_read_range),           METH_KEYWORDS |
+                                              METH_VARARGS,
+     CDBType_read_range__doc__},
+
+    {"send_value",
+     EXT_CFUNC(CDBType_send_value),           METH_KEYWORDS |
+                                              METH_VARARGS,
+     CDBType_send_value__doc__},
+
 #if 0
     {"getiter",
      EXT_CFUNC(CDBType_getiter),              METH_VARARGS,
@@ -641,16 +2676,12 @@ static PyMethodDef CDBType_methods[] = {
 };
 
 static PyObject *
-CDBType_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+cdbtype_new(PyTypeObject *type, PyObject *file_, PyObject *close_,
+            PyObject *mmap_, PyObject *encoding_, PyObject *errors_)
 {
-    static char *kwlist[] = {"file", "close", "mmap", NULL};
-    PyObject *file_, *close_ = NULL, *mmap_ = NULL;
     cdbtype_t *self;
-    int fd, res, mmap = -1;
-
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|OO", kwlist,
-                                     &file_, &close_, &mmap_))
-        return NULL;
+    const char *name;
+    int fd, res, mmap = -1, native = 0;
 
     if (!(self = GENERIC_ALLOC(type)))
         LCOV_EXCL_LINE_RETURN(NULL);
@@ -658,11 +2689,21 @@ CDBType_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
     self->cdb32 = NULL;
     self->flags = 0;
 
-    if (-1 == cdbx_obj_as_fd(file_, "rb", NULL, &self->fp, &res, &fd))
+    if (!encoding_)
+        encoding_ = Py_None;
+    else if (-1 == cdbx_codec_name(encoding_, &name))
         goto error;
-    if (res)
-        self->flags |= FL_FP_OPENED;
+    Py_INCREF(encoding_);
+    self->encoding = encoding_;
+
+    if (!errors_)
+        errors_ = Py_None;
+    else if (-1 == cdbx_codec_name(errors_, &name))
+        goto error;
+    Py_INCREF(errors_);
+    self->errors = errors_;
 
+    /* Convert these first, so there's nothing to clean up on errors */
     if (close_) {
         switch (PyObject_IsTrue(close_)) {
         case -1: goto error;
@@ -678,8 +2719,26 @@ CDBType_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
         }
     }
 
-    if (-1 == cdbx_cdb32_create(fd, &self->cdb32, mmap))
-        LCOV_EXCL_LINE_GOTO(error);
+    /* Plain filenames are opened natively, without a python file object */
+    if (PyUnicode_CheckExact(file_) || PyBytes_CheckExact(file_)) {
+        self->fp = NULL;
+        if (-1 == cdbx_fs_open(file_, &fd))
+            goto error;
+        self->flags |= FL_FP_OPENED;
+        native = 1;
+    }
+    else {
+        if (-1 == cdbx_obj_as_fd(file_, "rb", NULL, &self->fp, &res, &fd))
+            goto error;
+        if (res)
+            self->flags |= FL_FP_OPENED;
+    }
+
+    if (-1 == cdbx_cdb32_create(fd, &self->cdb32, mmap)) {
+        if (native)
+            close(fd);
+        goto error;
+    }
 
     return (PyObject *)self;
 
@@ -688,6 +2747,46 @@ error:
     return NULL;
 }
 
+static PyObject *
+CDBType_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"file", "close", "mmap", "encoding", "errors",
+                             NULL};
+    PyObject *file_, *close_ = NULL, *mmap_ = NULL, *encoding_ = NULL;
+    PyObject *errors_ = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|OOOO", kwlist,
+                                     &file_, &close_, &mmap_, &encoding_,
+                                     &errors_))
+        return NULL;
+
+    return cdbtype_new(type, file_, close_, mmap_, encoding_, errors_);
+}
+
+#ifdef CDBX_VECTORCALL
+/*
+ * Vectorcall entry point for CDB(...)
+ *
+ * This is only used for the exact type, subclasses are created via
+ * CDBType_new.
+ */
+EXT_LOCAL PyObject *
+cdbx_type_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf,
+                     PyObject *kwnames)
+{
+    static const char * const kwlist[] = {"file", "close", "mmap",
+                                          "encoding", "errors", NULL};
+    PyObject *argv[5] = {NULL, NULL, NULL, NULL, NULL};
+
+    if (-1 == cdbx_parse_fastcall("CDB", args, PyVectorcall_NARGS(nargsf),
+                                  kwnames, kwlist, 1, argv))
+        return NULL;
+
+    return cdbtype_new((PyTypeObject *)type, argv[0], argv[1], argv[2],
+                       argv[3], argv[4]);
+}
+#endif
+
 
 static int
 CDBType_traverse(cdbtype_t *self, visitproc visit, void *arg)
@@ -713,6 +2812,9 @@ CDBType_clear(cdbtype_t *self)
         Py_DECREF(result);
     }
 
+    Py_CLEAR(self->encoding);
+    Py_CLEAR(self->errors);
+
     return 0;
 }
 
@@ -721,7 +2823,7 @@ DEFINE_GENERIC_DEALLOC(CDBType)
 
 
 PyDoc_STRVAR(CDBType__doc__,
-"CDB(file, close=None, mmap=None)\n\
+"CDB(file, close=None, mmap=None, encoding=None, errors=None)\n\
 \n\
 Create a CDB instance from a file.\n\
 \n\
@@ -738,7 +2840,16 @@ Parameters:\n\
   mmap (bool):\n\
     Access the file by mapping it into memory? If True, mmap is required. If\n\
     false, mmap is not even tried. If omitted or ``None``, it's attempted but\n\
-    no error on failure.");
+    no error on failure.\n\
+\n\
+  encoding (str):\n\
+    Default encoding for decoding returned keys and values. If omitted or\n\
+    ``None``, bytes are returned. Note that unicode keys passed in for\n\
+    lookups are still transformed using latin-1.\n\
+\n\
+  errors (str):\n\
+    Default decoding error handler. If omitted or ``None``, it defaults to\n\
+    ``'strict'``.");
 
 EXT_LOCAL PyTypeObject CDBType = {
     PyVarObject_HEAD_INIT(NULL, 0)
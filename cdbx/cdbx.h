@@ -20,6 +20,20 @@
 
 #include "cext.h"
 
+/*
+ * METH_FASTCALL / vectorcall entry points (Python 3 only)
+ */
+#if defined(EXT3) && PY_VERSION_HEX >= 0x03070000
+#define CDBX_FASTCALL
+#define CDBX_METH_KEYWORDS (METH_FASTCALL | METH_KEYWORDS)
+#else
+#define CDBX_METH_KEYWORDS (METH_VARARGS | METH_KEYWORDS)
+#endif
+
+#if defined(CDBX_FASTCALL) && PY_VERSION_HEX >= 0x03090000
+#define CDBX_VECTORCALL
+#endif
+
 /* CDB32 public types (private impl) */
 typedef struct cdbx_cdb32_t cdbx_cdb32_t;
 typedef struct cdbx_cdb32_iter_t cdbx_cdb32_iter_t;
@@ -27,6 +41,12 @@ typedef struct cdbx_cdb32_pointer_t cdbx_cdb32_pointer_t;
 typedef struct cdbx_cdb32_maker_t cdbx_cdb32_maker_t;
 typedef struct cdbx_cdb32_get_iter_t cdbx_cdb32_get_iter_t;
 
+/* Pointer into the CDB file (offset + length) */
+struct cdbx_cdb32_pointer_t {
+    uint32_t offset;
+    uint32_t length;
+};
+
 
 /*
  * Main CDB type
@@ -42,13 +62,73 @@ extern EXT_LOCAL PyTypeObject CDBType;
 EXT_LOCAL cdbx_cdb32_t *
 cdbx_type_get_cdb32(cdbtype_t *);
 
+#ifdef CDBX_VECTORCALL
+EXT_LOCAL PyObject *
+cdbx_type_vectorcall(PyObject *, PyObject *const *, size_t, PyObject *);
+#endif
+
 
 /*
  * Key iterator
  */
+#define CDBX_ITER_KEYS   (0)
+#define CDBX_ITER_ITEMS  (1)
+#define CDBX_ITER_VALUES (2)
+
 extern EXT_LOCAL PyTypeObject CDBIterType;
 EXT_LOCAL PyObject *
-cdbx_iter_new(cdbtype_t *, int, int);
+cdbx_iter_new(cdbtype_t *, int, int, Py_ssize_t, PyObject *, PyObject *);
+
+EXT_LOCAL int
+cdbx_iter_range(PyObject *, Py_ssize_t, Py_ssize_t);
+
+
+/*
+ * Stack type
+ */
+extern EXT_LOCAL PyTypeObject CDBStackType;
+
+
+/*
+ * Sharded types
+ */
+#define CDBX_SHARD_MAGIC "cdbx-sharded 1"
+
+extern EXT_LOCAL PyTypeObject ShardedCDBType;
+extern EXT_LOCAL PyTypeObject ShardedCDBMakerType;
+
+EXT_LOCAL PyObject *
+cdbx_shard_path(PyObject *, PyObject *);
+
+EXT_LOCAL PyObject *
+cdbx_shard_maker_new(PyTypeObject *, PyObject *, Py_ssize_t, PyObject *);
+
+
+/*
+ * Overlay type
+ */
+extern EXT_LOCAL PyTypeObject CDBOverlayType;
+
+
+/*
+ * Reloading CDB type
+ */
+extern EXT_LOCAL PyTypeObject ReloadingCDBType;
+
+/*
+ * Register the fork handler resetting per-process state
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_reload_init_fork(void);
+
+
+/*
+ * Pool type
+ */
+extern EXT_LOCAL PyTypeObject CDBPoolType;
 
 
 /*
@@ -56,7 +136,11 @@ cdbx_iter_new(cdbtype_t *, int, int);
  */
 extern EXT_LOCAL PyTypeObject CDBMakerType;
 EXT_LOCAL PyObject *
-cdbx_maker_new(PyTypeObject *, PyObject *, PyObject *, PyObject *);
+cdbx_maker_new(PyTypeObject *, PyObject *, PyObject *, PyObject *,
+               PyObject *, const char *);
+
+EXT_LOCAL cdbx_cdb32_maker_t *
+cdbx_maker_get_maker32(PyObject *);
 
 
 /*
@@ -92,6 +176,99 @@ EXT_LOCAL int
 cdbx_cdb32_read(cdbx_cdb32_t *, cdbx_cdb32_pointer_t *, PyObject **);
 
 
+/*
+ * Read a pointed value and decode it into a unicode object
+ *
+ * If the encoding is NULL, a bytes object is returned instead.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_read_decoded(cdbx_cdb32_t *, cdbx_cdb32_pointer_t *, const char *,
+                        const char *, PyObject **);
+
+
+/*
+ * Read a pointed value into a buffer
+ *
+ * The buffer must be large enough to hold the value.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_read_into(cdbx_cdb32_t *, cdbx_cdb32_pointer_t *, void *);
+
+
+/*
+ * Read a part of a pointed value into a bytes object
+ *
+ * The range is clipped to the boundaries of the value.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_read_range(cdbx_cdb32_t *, cdbx_cdb32_pointer_t *, Py_ssize_t,
+                      Py_ssize_t, PyObject **);
+
+
+/*
+ * Send a pointed value to a file descriptor
+ *
+ * The GIL is released during the transfer.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_send(cdbx_cdb32_t *, cdbx_cdb32_pointer_t *, int, Py_ssize_t *);
+
+
+/*
+ * Scan all records for keys matching prefix, suffix and/or contains
+ *
+ * The partitions are scanned in parallel without the GIL. The result is an
+ * array of key/value pointer pairs (PyMem_Malloc'd), which needs to be
+ * released by the caller.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_scan(cdbx_cdb32_t *, PyObject *, PyObject *, PyObject *, int, int,
+                cdbx_cdb32_pointer_t **, Py_ssize_t *);
+
+
+/*
+ * Split the data region into num (> 0) record aligned ranges
+ *
+ * bounds receives num + 1 offsets (range idx is bounds[idx] ..
+ * bounds[idx + 1]).
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_split(cdbx_cdb32_t *, Py_ssize_t, Py_ssize_t *);
+
+
+/*
+ * Draw a random sample of up to k records
+ *
+ * The result is an array of key/value pointer pairs (PyMem_Malloc'd) in
+ * random order, which needs to be released by the caller. With unique, only
+ * the first record per key is considered.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_sample(cdbx_cdb32_t *, Py_ssize_t, uint64_t, int,
+                  cdbx_cdb32_pointer_t **, Py_ssize_t *);
+
+
 /*
  * Return the FD
  */
@@ -99,6 +276,13 @@ EXT_LOCAL int
 cdbx_cdb32_fileno(cdbx_cdb32_t *);
 
 
+/*
+ * Return the number of mapped bytes (0 if the file is not mapped)
+ */
+EXT_LOCAL Py_ssize_t
+cdbx_cdb32_mapped_size(cdbx_cdb32_t *);
+
+
 /*
  * Check if key is in the CDB
  *
@@ -111,6 +295,110 @@ EXT_LOCAL int
 cdbx_cdb32_contains(cdbx_cdb32_t *, PyObject *);
 
 
+/*
+ * Find the first value of a key
+ *
+ * Return -1 on error
+ * Return 0 on success (not found)
+ * Return 1 on success (found)
+ */
+EXT_LOCAL int
+cdbx_cdb32_find(cdbx_cdb32_t *, PyObject *, cdbx_cdb32_pointer_t *);
+
+
+/*
+ * Read raw bytes at a data location
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_read_at(cdbx_cdb32_t *, uint64_t, uint64_t, PyObject **);
+
+
+/*
+ * Read raw bytes at many data locations ((offset, length) pairs) into a
+ * list of the same size (offset 0 results in None)
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_read_many_at(cdbx_cdb32_t *, const uint64_t *, Py_ssize_t,
+                        PyObject *);
+
+
+/*
+ * Find a key in several CDBs, hashing it only once
+ *
+ * The visitor is called for every value found, member by member, with the
+ * member index and a flag, whether it's the first value within the member.
+ * It returns one of the CDBX_VISIT_* codes or -1 on error.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+#define CDBX_VISIT_STOP        (0)
+#define CDBX_VISIT_NEXT_VALUE  (1)
+#define CDBX_VISIT_NEXT_MEMBER (2)
+
+typedef int (*cdbx_cdb32_visit_t)(void *, Py_ssize_t, int,
+                                  cdbx_cdb32_pointer_t *);
+
+EXT_LOCAL int
+cdbx_cdb32_find_stack(cdbx_cdb32_t **, Py_ssize_t, PyObject *,
+                      cdbx_cdb32_visit_t, void *);
+
+
+/*
+ * Find the shard a key belongs to (out of num)
+ *
+ * The mapping is stable, it only depends on the key and the number of
+ * shards.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_route(PyObject *, Py_ssize_t, Py_ssize_t *);
+
+
+/*
+ * Find a key in the shard it belongs to, hashing it only once
+ *
+ * The member callback returns the cdb32 of the shard by index (or NULL with
+ * an exception set). The visitor works like with cdbx_cdb32_find_stack.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+typedef cdbx_cdb32_t *(*cdbx_cdb32_member_t)(void *, Py_ssize_t);
+
+EXT_LOCAL int
+cdbx_cdb32_find_routed(Py_ssize_t, cdbx_cdb32_member_t, PyObject *,
+                       cdbx_cdb32_visit_t, void *);
+
+
+/*
+ * Turn a key (or value) into a bytes object and optionally compute its hash
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_bytes(PyObject *, PyObject **, uint32_t *);
+
+
+/*
+ * Count the values of a key (without reading them)
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_count(cdbx_cdb32_t *, PyObject *, Py_ssize_t *);
+
+
 /*
  * Count the number of unique keys (cached)
  *
@@ -153,6 +441,18 @@ EXT_LOCAL int
 cdbx_cdb32_get_iter_next(cdbx_cdb32_get_iter_t *, PyObject **);
 
 
+/*
+ * Find next value pointer from get-iterator
+ *
+ * Return -1 on error
+ * Return 0 on success (exhausted)
+ * Return 1 on success (found)
+ */
+EXT_LOCAL int
+cdbx_cdb32_get_iter_next_pointer(cdbx_cdb32_get_iter_t *,
+                                 cdbx_cdb32_pointer_t *);
+
+
 /*
  * Destroy get-iterator
  *
@@ -180,6 +480,25 @@ EXT_LOCAL void
 cdbx_cdb32_iter_destroy(cdbx_cdb32_iter_t **);
 
 
+/*
+ * Restrict cdbx_cdb32_iter_t to the records between start and end
+ *
+ * -1 selects the beginning or the end of the data, respectively.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_iter_range(cdbx_cdb32_iter_t *, Py_ssize_t, Py_ssize_t);
+
+
+/*
+ * Return the data offset of the next record and the end of the range
+ */
+EXT_LOCAL void
+cdbx_cdb32_iter_tell(cdbx_cdb32_iter_t *, Py_ssize_t *, Py_ssize_t *);
+
+
 /*
  * Find next key/value pair
  *
@@ -187,7 +506,8 @@ cdbx_cdb32_iter_destroy(cdbx_cdb32_iter_t **);
  * key will be NULL if the end is reached.
  * value ref may be NULL
  *
- * first == 1 if this is the first occurence of the key, 0 otherwise.
+ * first == 1 if this is the first occurence of the key, 0 otherwise. first
+ * ref may be NULL, which skips the (hash table) probe for it.
  *
  * Return -1 on error
  * Return 0 on success
@@ -244,6 +564,72 @@ EXT_LOCAL int
 cdbx_cdb32_maker_commit(cdbx_cdb32_maker_t *);
 
 
+/*
+ * Commit several makers in parallel native threads and sync them to disk
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_maker_commit_many(cdbx_cdb32_maker_t **, Py_ssize_t, int);
+
+
+/*
+ * Copy the records of a CDB into a maker (optionally without the GIL)
+ *
+ * The keep callback gets the key, its length and its hash and returns 1 to
+ * copy the record, 0 to skip it or -1 (with errno set) on error.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+typedef int (*cdbx_cdb32_keep_t)(void *, const unsigned char *, uint32_t,
+                                 uint32_t);
+
+EXT_LOCAL int
+cdbx_cdb32_maker_copy(cdbx_cdb32_maker_t *, cdbx_cdb32_t *,
+                      cdbx_cdb32_keep_t, void *, int);
+
+
+/*
+ * Merge the records of several CDBs into a maker (without the GIL)
+ *
+ * CDBX_DEDUP_ALL copies all records, CDBX_DEDUP_FIRST only the first and
+ * CDBX_DEDUP_LAST only the last record of every key.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+#define CDBX_DEDUP_ALL   (0)
+#define CDBX_DEDUP_FIRST (1)
+#define CDBX_DEDUP_LAST  (2)
+
+EXT_LOCAL int
+cdbx_cdb32_maker_merge(cdbx_cdb32_maker_t *, cdbx_cdb32_t **, Py_ssize_t,
+                       int);
+
+
+/*
+ * Rebuild a CDB into a maker, dropping all records of the keys (list of
+ * bytes). The other records are copied as raw byte ranges.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_maker_rebuild(cdbx_cdb32_maker_t *, cdbx_cdb32_t *, PyObject *);
+
+
+/*
+ * Warm the page cache (and the mapping) for the whole file
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_cdb32_warm(cdbx_cdb32_t *);
+
+
 /*
  * ************************************************************************
  * Generic Utilities
@@ -270,6 +656,25 @@ EXT_LOCAL int
 cdbx_obj_as_fd(PyObject *, char *, PyObject **, PyObject **, int *, int *);
 
 
+/*
+ * Turn a filename into an absolute, normalized byte string path
+ *
+ * Return NULL on error
+ */
+EXT_LOCAL PyObject *
+cdbx_fs_path(PyObject *);
+
+
+/*
+ * Open a file (str or bytes name) for reading natively
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_fs_open(PyObject *, int *);
+
+
 /*
  * set IOError("I/O operation on a closed file") and return NULL
  */
@@ -287,6 +692,33 @@ EXT_LOCAL int
 cdbx_fd(PyObject *, int *);
 
 
+/*
+ * Find the name of a codec (encoding or error handler)
+ *
+ * Return -1 on error
+ * Return 0 if no error occured.
+ */
+EXT_LOCAL int
+cdbx_codec_name(PyObject *, const char **);
+
+
+#ifdef CDBX_FASTCALL
+/*
+ * Parse fastcall arguments
+ *
+ * The keyword list is NULL terminated, the first `required` arguments are
+ * mandatory. Passed arguments are stored as borrowed references into the
+ * result array, others are left untouched.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_parse_fastcall(const char *, PyObject *const *, Py_ssize_t, PyObject *,
+                    const char * const *, Py_ssize_t, PyObject **);
+#endif
+
+
 /*
  * Find a particular pyobject attribute
  *
@@ -70,11 +70,28 @@ EXT_INIT_FUNC {
     EXT_ADD_UNICODE(m, "__license__", "Apache License, Version 2.0", "ascii");
     EXT_ADD_STRING(m, "__version__", STRINGIFY(EXT_VERSION));
 
+#ifdef CDBX_VECTORCALL
+    CDBType.tp_vectorcall = cdbx_type_vectorcall;
+#endif
     EXT_INIT_TYPE(m, &CDBType);
     EXT_ADD_TYPE(m, "CDB", &CDBType);
     EXT_INIT_TYPE(m, &CDBIterType);
     EXT_INIT_TYPE(m, &CDBMakerType);
     EXT_ADD_TYPE(m, "CDBMaker", &CDBMakerType);
+    EXT_INIT_TYPE(m, &CDBStackType);
+    EXT_ADD_TYPE(m, "CDBStack", &CDBStackType);
+    EXT_INIT_TYPE(m, &CDBOverlayType);
+    EXT_ADD_TYPE(m, "CDBOverlay", &CDBOverlayType);
+    EXT_INIT_TYPE(m, &ReloadingCDBType);
+    EXT_ADD_TYPE(m, "ReloadingCDB", &ReloadingCDBType);
+    if (-1 == cdbx_reload_init_fork())
+        EXT_INIT_ERROR(LCOV_EXCL_LINE(m));
+    EXT_INIT_TYPE(m, &CDBPoolType);
+    EXT_ADD_TYPE(m, "CDBPool", &CDBPoolType);
+    EXT_INIT_TYPE(m, &ShardedCDBType);
+    EXT_ADD_TYPE(m, "ShardedCDB", &ShardedCDBType);
+    EXT_INIT_TYPE(m, &ShardedCDBMakerType);
+    EXT_ADD_TYPE(m, "ShardedCDBMaker", &ShardedCDBMakerType);
 
     EXT_INIT_RETURN(m);
 }
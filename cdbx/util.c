@@ -17,6 +17,13 @@
 
 #include "cdbx.h"
 
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
 /*
  * Unlink file
  *
@@ -165,6 +172,108 @@ error:
 }
 
 
+/*
+ * Turn a filename into a byte string
+ *
+ * Unicode filenames are encoded with the filesystem encoding.
+ *
+ * Return NULL on error
+ */
+static PyObject *
+fs_encode(PyObject *filename)
+{
+    if (PyUnicode_Check(filename)) {
+#ifdef EXT3
+        return PyUnicode_EncodeFSDefault(filename);
+#else
+        return PyUnicode_AsEncodedString(filename,
+                                         Py_FileSystemDefaultEncoding,
+                                         "strict");
+#endif
+    }
+    else if (PyBytes_Check(filename)) {
+        Py_INCREF(filename);
+        return filename;
+    }
+
+    PyErr_SetString(PyExc_TypeError, "Filename must be str or bytes");
+    return NULL;
+}
+
+
+/*
+ * Turn a filename into an absolute, normalized byte string path
+ *
+ * Unicode filenames are encoded with the filesystem encoding.
+ *
+ * Return NULL on error
+ */
+EXT_LOCAL PyObject *
+cdbx_fs_path(PyObject *filename)
+{
+    PyObject *tmp, *result;
+
+    if (!(tmp = fs_encode(filename)))
+        return NULL;
+
+    result = full_filename(tmp);
+    Py_DECREF(tmp);
+
+    return result;
+}
+
+
+/*
+ * Open a file for reading natively
+ *
+ * The file is opened with O_CLOEXEC and without creating a python file
+ * object. Directories are rejected (like python's open does).
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_fs_open(PyObject *filename, int *fd_)
+{
+    PyObject *name;
+    struct stat st;
+    int fd, res;
+
+    if (!(name = fs_encode(filename)))
+        return -1;
+
+    if (strlen(PyBytes_AS_STRING(name)) != (size_t)PyBytes_GET_SIZE(name)) {
+        PyErr_SetString(PyExc_ValueError, "embedded null byte");
+        Py_DECREF(name);
+        return -1;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    if (-1 != (res = fd = open(PyBytes_AS_STRING(name),
+                               O_RDONLY | O_CLOEXEC))) {
+        if (-1 == (res = fstat(fd, &st))) {
+            close(fd);  /* LCOV_EXCL_LINE */
+        }
+        else if (S_ISDIR(st.st_mode)) {
+            close(fd);
+            errno = EISDIR;
+            res = -1;
+        }
+    }
+    Py_END_ALLOW_THREADS
+
+    if (-1 == res) {
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_IOError, filename);
+        Py_DECREF(name);
+        return -1;
+    }
+
+    Py_DECREF(name);
+    *fd_ = fd;
+    return 0;
+}
+
+
 /*
  * set IOError("I/O operation on a closed file") and return NULL
  */
@@ -231,6 +340,104 @@ cdbx_fd(PyObject *obj, int *fd)
 }
 
 
+/*
+ * Find the name of a codec (encoding or error handler)
+ *
+ * None results in NULL. The returned name is borrowed from the passed object.
+ *
+ * Return -1 on error
+ * Return 0 if no error occured.
+ */
+EXT_LOCAL int
+cdbx_codec_name(PyObject *obj, const char **name)
+{
+    if (obj == Py_None) {
+        *name = NULL;
+        return 0;
+    }
+
+#ifdef EXT3
+    if (PyUnicode_Check(obj))
+        return (*name = PyUnicode_AsUTF8(obj)) ? 0 : -1;
+#endif
+    if (PyBytes_Check(obj)) {
+        *name = PyBytes_AS_STRING(obj);
+        return 0;
+    }
+
+    PyErr_SetString(PyExc_TypeError, "Codec name must be a string or None");
+    return -1;
+}
+
+
+#ifdef CDBX_FASTCALL
+/*
+ * Parse fastcall arguments
+ *
+ * The keyword list is NULL terminated, the first `required` arguments are
+ * mandatory. Passed arguments are stored as borrowed references into the
+ * result array, others are left untouched.
+ *
+ * Return -1 on error
+ * Return 0 on success
+ */
+EXT_LOCAL int
+cdbx_parse_fastcall(const char *fname, PyObject *const *args,
+                    Py_ssize_t nargs, PyObject *kwnames,
+                    const char * const *kwlist, Py_ssize_t required,
+                    PyObject **result)
+{
+    PyObject *name;
+    Py_ssize_t j, k, max, nkw;
+
+    for (max = 0; kwlist[max]; ++max)
+        ;
+
+    if (nargs > max) {
+        PyErr_Format(PyExc_TypeError,
+                     "%s() takes at most %zd argument%s (%zd given)",
+                     fname, max, (max == 1) ? "" : "s", nargs);
+        return -1;
+    }
+    for (j = 0; j < nargs; ++j)
+        result[j] = args[j];
+
+    nkw = kwnames ? PyTuple_GET_SIZE(kwnames) : 0;
+    for (j = 0; j < nkw; ++j) {
+        name = PyTuple_GET_ITEM(kwnames, j);
+        for (k = 0; k < max; ++k) {
+            if (!PyUnicode_CompareWithASCIIString(name, kwlist[k]))
+                break;
+        }
+        if (k == max) {
+            PyErr_Format(PyExc_TypeError,
+                         "'%U' is an invalid keyword argument for %s()",
+                         name, fname);
+            return -1;
+        }
+        if (k < nargs) {
+            PyErr_Format(PyExc_TypeError,
+                         "argument for %s() given by name ('%s') and "
+                         "position (%zd)", fname, kwlist[k], k + 1);
+            return -1;
+        }
+        result[k] = args[nargs + j];
+    }
+
+    for (j = nargs; j < required; ++j) {
+        if (!result[j]) {
+            PyErr_Format(PyExc_TypeError,
+                         "%s() missing required argument '%s' (pos %zd)",
+                         fname, kwlist[j], j + 1);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+#endif
+
+
 /*
  * Find a particular pyobject attribute
  *
@@ -0,0 +1,82 @@
+#!/usr/bin/env python
+# -*- coding: ascii -*-
+#
+# Copyright 2016 - 2025
+# Andr\xe9 Malo or his licensors, as applicable
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+"""
+Measure the per-call overhead of single key lookups
+~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+Usage: bench_lookup.py [number of keys]
+
+"""
+
+import sys as _sys
+import tempfile as _tempfile
+import timeit as _timeit
+
+import cdbx as _cdbx
+
+
+def bench(cdb, keys, missing):
+    """Run the lookup benchmarks and print ns per call"""
+    hit, miss = keys[len(keys) // 2], missing[0]
+    uhit = hit.decode("latin-1")
+    get, getitem = cdb.get, cdb.__getitem__
+
+    def getitem_miss():
+        """__getitem__ miss"""
+        try:
+            getitem(miss)
+        except KeyError:
+            pass
+
+    tests = [
+        ("get (hit)", lambda: get(hit)),
+        ("get (miss)", lambda: get(miss)),
+        ("get (str key)", lambda: get(uhit)),
+        ("getitem (hit)", lambda: getitem(hit)),
+        ("getitem (miss)", getitem_miss),
+        ("contains (hit)", lambda: hit in cdb),
+        ("contains (miss)", lambda: miss in cdb),
+    ]
+    for name, func in tests:
+        number = 200000
+        best = min(_timeit.repeat(func, number=number, repeat=5))
+        print("  %-18s %8.1f ns/call" % (name, best / number * 1e9))
+
+
+def main(num=10000):
+    """Main"""
+    keys = [("key-%d" % j).encode("ascii") for j in range(num)]
+    missing = [("nokey-%d" % j).encode("ascii") for j in range(10)]
+
+    with _tempfile.TemporaryFile() as fp:
+        make = _cdbx.CDB.make(fp)
+        for key in keys:
+            make.add(key, b"value-" + key)
+        make.commit().close()
+
+        for mmap in (True, False):
+            print("mmap=%r" % (mmap,))
+            cdb = _cdbx.CDB(fp, mmap=mmap)
+            try:
+                bench(cdb, keys, missing)
+            finally:
+                cdb.close()
+
+
+if __name__ == "__main__":
+    main(*[int(arg) for arg in _sys.argv[1:2]])
@@ -0,0 +1,84 @@
+#!/usr/bin/env python
+# -*- coding: ascii -*-
+#
+# Copyright 2016 - 2025
+# Andr\xe9 Malo or his licensors, as applicable
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+"""
+Measure the startup cost of opening many CDB files
+~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+Usage: bench_open.py [number of files]
+
+"""
+
+import os as _os
+import shutil as _shutil
+import sys as _sys
+import tempfile as _tempfile
+import time as _time
+
+import cdbx as _cdbx
+
+
+def bench(names, opener):
+    """Open all files (plus one lookup each), return seconds"""
+    start = _time.time()
+    cdbs = [opener(name) for name in names]
+    for cdb in cdbs:
+        cdb.get(b"key-1")
+    result = _time.time() - start
+
+    for cdb in cdbs:
+        cdb.close()
+    return result
+
+
+def main(num=5000):
+    """Main"""
+    tmpdir = _tempfile.mkdtemp()
+    try:
+        names = []
+        for j in range(num):
+            names.append(_os.path.join(tmpdir, "%d.cdb" % j))
+            make = _cdbx.CDB.make(names[-1])
+            for key in range(10):
+                make.add("key-%d" % key, "value-%d-%d" % (j, key))
+            make.commit().close()
+
+        tests = [
+            ("filename, mmap", lambda name: _cdbx.CDB(name, mmap=True)),
+            ("filename, no mmap", lambda name: _cdbx.CDB(name, mmap=False)),
+            (
+                "file object, mmap",
+                lambda name: _cdbx.CDB(
+                    open(name, "rb"),  # pylint: disable = consider-using-with
+                    close=True,
+                    mmap=True,
+                ),
+            ),
+        ]
+        print("%d files" % (num,))
+        for name, opener in tests:
+            best = min(bench(names, opener) for _ in range(3))
+            print(
+                "  %-18s %8.1f ms total %8.1f us/file"
+                % (name, best * 1e3, best / num * 1e6)
+            )
+    finally:
+        _shutil.rmtree(tmpdir)
+
+
+if __name__ == "__main__":
+    main(*[int(arg) for arg in _sys.argv[1:2]])
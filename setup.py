@@ -191,6 +191,12 @@ EXTENSIONS = lambda v: [
             "cdbx/cdb32.c",
             "cdbx/cdbiter.c",
             "cdbx/cdbmaker.c",
+            "cdbx/cdboverlay.c",
+            "cdbx/cdbreload.c",
+            "cdbx/cdbpool.c",
+            "cdbx/cdbshard.c",
+            "cdbx/cdbshardmaker.c",
+            "cdbx/cdbstack.c",
             "cdbx/cdbtype.c",
             "cdbx/util.c",
         ],
@@ -27,8 +27,15 @@ Tests for cdbx.CDB
 """
 __author__ = u"Andr\xe9 Malo"
 
+from contextlib import closing
 import os as _os
+import pickle as _pickle
+import re as _re
+import struct as _struct
+import sys as _sys
 import tempfile as _tempfile
+import time as _time
+import warnings as _warnings
 
 try:
     import mmap as _mmap
@@ -122,6 +129,1224 @@ def test_get(mmap):
         assert cdb.get("b", all=True) == [b"sakdhgjksghf"]
 
 
+@mark.parametrize("mmap", mmap_param)
+def test_unicode_keys(mmap):
+    """Latin-1 representable unicode keys match their bytes"""
+    kwargs = {} if mmap == -1 else {"mmap": mmap}
+
+    with _tempfile.TemporaryFile() as fp:
+        cdb = _cdbx.CDB.make(fp, **kwargs)
+        cdb.add(u"caf\xe9", u"cr\xe8me")
+        cdb.add(b"plain", b"ascii")
+        cdb.add(u"", u"empty")
+        cdb = cdb.commit()
+        assert cdb[b"caf\xe9"] == b"cr\xe8me"
+        assert cdb[u"caf\xe9"] == b"cr\xe8me"
+        assert cdb.get(u"plain") == b"ascii"
+        assert cdb[u""] == b"empty"
+        assert u"caf\xe9" in cdb
+        assert u"cafe" not in cdb
+        assert cdb.get(u"caf\xe9", all=True) == [b"cr\xe8me"]
+        assert list(cdb) == [b"caf\xe9", b"plain", b""]
+
+        with raises(ValueError):
+            cdb[u"caf\u20ac"]  # pylint: disable = pointless-statement
+
+
+@mark.parametrize("mmap", mmap_param)
+def test_values(mmap):
+    """Values iterator"""
+    kwargs = {} if mmap == -1 else {"mmap": mmap}
+
+    with _tempfile.TemporaryFile() as fp:
+        cdb = _cdbx.CDB.make(fp, **kwargs)
+        cdb.add("a", "bc")
+        cdb.add("def", "ghij")
+        cdb.add("def", "klmno")
+        cdb.add("a", "xxy")
+        cdb.add("b", "sakdhgjksghf")
+        cdb = cdb.commit()
+        assert list(cdb.values()) == [b"bc", b"ghij", b"sakdhgjksghf"]
+        assert list(cdb.values(all=True)) == [
+            b"bc", b"ghij", b"klmno", b"xxy", b"sakdhgjksghf"
+        ]
+        assert list(cdb.values(encoding="ascii")) == [
+            u"bc", u"ghij", u"sakdhgjksghf"
+        ]
+        assert list(cdb.keys(all=True)) == [b"a", b"def", b"def", b"a", b"b"]
+        assert list(cdb.items(all=True))[3] == (b"a", b"xxy")
+
+
+@mark.parametrize("mmap", mmap_param)
+def test_iter_batches(mmap):
+    """Batched iteration"""
+    kwargs = {} if mmap == -1 else {"mmap": mmap}
+
+    with _tempfile.TemporaryFile() as fp:
+        cdb = _cdbx.CDB.make(fp, **kwargs)
+        for num in range(25):
+            cdb.add("k%d" % (num % 10), "v%d" % num)
+        cdb = cdb.commit()
+
+        batches = list(cdb.iter_batches(4))
+        assert [len(batch) for batch in batches] == [4, 4, 2]
+        assert sum(batches, []) == list(cdb.items())
+
+        batches = list(cdb.iter_batches(size=10, all=True, what="keys"))
+        assert [len(batch) for batch in batches] == [10, 10, 5]
+        assert sum(batches, []) == list(cdb.keys(all=True))
+
+        batches = list(cdb.iter_batches(what="values", encoding="ascii"))
+        assert batches == [[u"v%d" % num for num in range(10)]]
+
+        it = cdb.iter_batches(10)
+        assert len(next(it)) == 10
+        with raises(StopIteration):
+            next(it)
+        with raises(StopIteration):
+            next(it)
+
+    with _tempfile.TemporaryFile() as fp:
+        cdb = _cdbx.CDB.make(fp, **kwargs)
+        for num in range(5):
+            cdb.add("k%d" % num, b"\xe9" if num == 2 else "v%d" % num)
+        cdb = cdb.commit()
+
+        # Entries collected before a decode error are not lost
+        it = cdb.iter_batches(4, what="values", encoding="ascii")
+        with raises(UnicodeError):
+            next(it)
+        assert next(it) == [u"v0", u"v1", u"v3", u"v4"]
+        with raises(StopIteration):
+            next(it)
+
+
+@mark.parametrize("mmap", mmap_param)
+def test_split(mmap):
+    """Split into ranges and resume from cursors"""
+    kwargs = {} if mmap == -1 else {"mmap": mmap}
+
+    with _tempfile.TemporaryFile() as fp:
+        cdb = _cdbx.CDB.make(fp, **kwargs)
+        for num in range(1000):
+            cdb.add("k%d" % (num % 300), "v%d" % num)
+        cdb = cdb.commit()
+
+        for num in (1, 2, 7, 2000):
+            ranges = cdb.split(num)
+            assert len(ranges) == num
+            assert ranges[0][0] == 2048
+            for (_, end), (start, _) in zip(ranges, ranges[1:]):
+                assert end == start
+            assert sum(
+                [list(cdb.items(start=start, end=end))
+                 for start, end in ranges], []
+            ) == list(cdb.items())
+            assert sum(
+                [list(cdb.keys(True, start=start, end=end))
+                 for start, end in ranges], []
+            ) == list(cdb.keys(all=True))
+        assert sum(1 for start, end in cdb.split(4) if start < end) == 4
+
+        start, end = cdb.split(3)[1]
+        it = cdb.values(True, start=start, end=end)
+        first = [next(it) for _ in range(10)]
+        cursor = _pickle.loads(_pickle.dumps(it.cursor))
+        rest = list(cdb.values(True, start=cursor[0], end=cursor[1]))
+        assert first + rest == list(cdb.values(True, start=start, end=end))
+        assert list(it) == rest
+        assert it.cursor == (end, end)
+
+        batches = cdb.iter_batches(size=100, start=start, end=end)
+        assert sum(batches, []) == list(cdb.items(start=start, end=end))
+
+        with raises(IOError):
+            list(cdb.items(start=2049))
+
+        class Closing(object):
+            """__index__ closes the CDB"""
+
+            def __index__(self):
+                cdb.close()
+                return 2048
+
+        with raises(IOError):
+            cdb.items(start=Closing())
+        cdb = _cdbx.CDB(fp, **kwargs)
+        with raises(IOError):
+            cdb.iter_batches(10, end=Closing())
+
+
+@mark.parametrize("mmap", mmap_param)
+def test_sample(mmap):
+    """Random sampling"""
+    kwargs = {} if mmap == -1 else {"mmap": mmap}
+
+    with _tempfile.TemporaryFile() as fp:
+        cdb = _cdbx.CDB.make(fp, **kwargs)
+        for num in range(1000):
+            cdb.add("k%d" % (num % 300), "v%d" % num)
+        cdb = cdb.commit()
+        records = list(cdb.items(all=True))
+
+        sample = cdb.sample(50, seed=42)
+        assert sample == cdb.sample(50, seed=42)
+        assert sample != cdb.sample(50, seed=43)
+        assert len(set(sample)) == 50
+        assert set(sample) <= set(records)
+        assert len(cdb.sample(50)) == 50
+
+        assert sorted(cdb.sample(1000, seed=1)) == sorted(records)
+        sample = cdb.sample(990, seed=5)
+        assert len(set(sample)) == 990
+        assert set(sample) <= set(records)
+        assert sample != [rec for rec in records if rec in set(sample)]
+        assert sorted(cdb.sample(5000)) == sorted(records)
+        assert sorted(cdb.sample(300, unique_keys=True)) == sorted(
+            cdb.items()
+        )
+        assert set(cdb.sample(100, unique_keys=True)) <= set(cdb.items())
+        assert cdb.sample(1, encoding="ascii", seed=7)[0] in [
+            (key.decode("ascii"), value.decode("ascii"))
+            for key, value in records
+        ]
+
+    with _tempfile.TemporaryFile() as fp:
+        cdb = _cdbx.CDB.make(fp, **kwargs)
+        for num in range(3000):
+            cdb.add("a", str(num))
+        cdb.add("b", "x")
+        cdb = cdb.commit()
+        assert sorted(cdb.sample(5, unique_keys=True)) == [
+            (b"a", b"0"), (b"b", b"x")
+        ]
+
+        class Closing(object):
+            """__index__ and __bool__ close the CDB"""
+
+            def __index__(self):
+                cdb.close()
+                return 3
+
+            def __bool__(self):
+                cdb.close()
+                return True
+
+            __nonzero__ = __bool__
+
+        with raises(IOError):
+            cdb.sample(2, seed=Closing())
+        cdb = _cdbx.CDB(fp, **kwargs)
+        with raises(IOError):
+            cdb.sample(2, unique_keys=Closing())
+
+    def closing_errors(exc):
+        """Decoding error handler closing the CDB"""
+        cdb.close()
+        return u"?", exc.end
+
+    import codecs as _codecs
+
+    _codecs.register_error("cdbx-test-closing", closing_errors)
+    with _tempfile.TemporaryFile() as fp:
+        cdb = _cdbx.CDB.make(fp, **kwargs)
+        for num in range(10):
+            cdb.add("k%d" % num, b"\xe9")
+        cdb = cdb.commit()
+        with raises(IOError):
+            cdb.sample(5, encoding="ascii", errors="cdbx-test-closing")
+
+
+@mark.parametrize("mmap", mmap_param)
+def test_locate(mmap):
+    """Value locations and raw reads"""
+    kwargs = {} if mmap == -1 else {"mmap": mmap}
+
+    with _tempfile.TemporaryFile() as fp:
+        cdb = _cdbx.CDB.make(fp, **kwargs)
+        for num in range(1000):
+            cdb.add("k%d" % (num % 300), "v%d" % num)
+        cdb.add("big", "x" * (3 << 20))
+        cdb.add("empty", "")
+        cdb = cdb.commit()
+
+        loc = cdb.locate("k7")
+        assert cdb.read_at(*loc) == b"v7"
+        assert cdb.locate(b"nope") is None
+        assert cdb.locate("nope", all=True) == []
+        assert [cdb.read_at(*loc) for loc in cdb.locate("k7", all=True)] == [
+            b"v7", b"v307", b"v607", b"v907"
+        ]
+        assert cdb.read_at(*cdb.locate("empty")) == b""
+
+        keys = ["k%d" % num for num in range(0, 300, 7)]
+        keys[3:3] = ["big", "nope", "empty", "k5", "k5"]
+        expected = [cdb.get(key) for key in keys]
+        locations = cdb.locate_many(keys)
+        assert len(locations) == len(keys) * 16
+        pairs = _struct.unpack("=%dQ" % (len(keys) * 2), locations)
+        assert pairs[8:10] == (0, 0)
+        assert cdb.read_many_at(locations) == expected
+        assert cdb.read_many_at(
+            list(zip(pairs[::2], pairs[1::2]))
+        ) == expected
+        assert cdb.read_many_at(bytearray(locations)) == expected
+        assert cdb.read_many_at(
+            [cdb.locate("k1"), cdb.locate("big"), cdb.locate("k2")]
+        ) == [b"v1", b"x" * (3 << 20), b"v2"]
+
+        class Closing(object):
+            """__index__ closes the CDB"""
+
+            def __index__(self):
+                cdb.close()
+                return 2048
+
+        def closing_keys():
+            """Generator closing the CDB"""
+            yield "k1"
+            cdb.close()
+            yield "k2"
+
+        with raises(IOError):
+            cdb.read_many_at([(Closing(), 2)])
+        cdb = _cdbx.CDB(fp, **kwargs)
+        with raises(IOError):
+            cdb.locate_many(closing_keys())
+
+        class ClosingBool(object):
+            """__bool__ closes the CDB"""
+
+            def __bool__(self):
+                cdb.close()
+                return True
+
+            __nonzero__ = __bool__
+
+        cdb = _cdbx.CDB(fp, **kwargs)
+        with raises(IOError):
+            cdb.locate("k7", all=ClosingBool())
+
+
+@mark.parametrize("mmap", mmap_param)
+def test_stack(mmap):
+    """Lookups in a stack of CDBs"""
+    kwargs = {} if mmap == -1 else {"mmap": mmap}
+
+    def make(*items):
+        """Create CDB"""
+        cdb = _cdbx.CDB.make(_tempfile.TemporaryFile(), close=True, **kwargs)
+        for key, value in items:
+            cdb.add(key, value)
+        return cdb.commit()
+
+    base = make(("a", "1"), ("b", "2"), ("b", "3"), ("c", "4"), ("d", "5"))
+    delta1 = make(("b", "20"), ("c", "\0DEL"), ("e", "6"), ("e", "7"))
+    delta2 = make(("a", "10"), ("d", "\0DEL"), ("d", "50"))
+    cdbs = [delta2, delta1, base]
+    try:
+        stack = _cdbx.CDBStack(cdbs, tombstone=b"\0DEL")
+        assert stack.get("a") == b"10"
+        assert stack[b"b"] == b"20"
+        assert stack.get("c") is None
+        assert stack.get("d", b"x") == b"x"
+        assert stack.get("e") == b"6"
+        assert stack.get("f") is None
+        with raises(KeyError):
+            stack["c"]
+
+        assert stack.get("a", all=True) == [b"10", b"1"]
+        assert stack.get("b", all=True) == [b"20", b"2", b"3"]
+        assert stack.get("c", default=1, all=True) == 1
+        assert stack.get("e", all=True) == [b"6", b"7"]
+
+        assert [key in stack for key in "abcdef"] == [
+            True, True, False, False, True, False
+        ]
+
+        stack = _cdbx.CDBStack(cdbs)
+        assert stack.get("c") == b"\0DEL"
+        assert stack.get("d", all=True) == [b"\0DEL", b"50", b"5"]
+        assert "d" in stack
+
+        stack = _cdbx.CDBStack(cdbs * 10, tombstone=b"\0DEL")
+        assert stack.get("a", all=True) == [b"10", b"1"] * 10
+        assert stack.get("c", all=True) is None
+    finally:
+        for cdb in cdbs:
+            cdb.close()
+
+
+@mark.parametrize("mmap", mmap_param)
+def test_make_atomic(mmap, tmpdir):
+    """Atomic publishing of a new CDB"""
+    kwargs = {} if mmap == -1 else {"mmap": mmap}
+    fname = _os.path.join(str(tmpdir), "published.cdb")
+
+    make = _cdbx.CDB.make(fname, atomic=True, **kwargs)
+    make.add("key", "old")
+    with closing(make.commit()) as old:
+        assert _os.listdir(str(tmpdir)) == ["published.cdb"]
+        assert old["key"] == b"old"
+
+        for durability in ("none", "data", "full"):
+            make = _cdbx.CDB.make(fname.encode(_sys.getfilesystemencoding()),
+                                  atomic=True, durability=durability,
+                                  **kwargs)
+            names = _os.listdir(str(tmpdir))
+            assert len(names) == 2
+            assert [name for name in names if name.endswith(".tmp")]
+
+            make.add("key", durability)
+            with closing(_cdbx.CDB(fname, **kwargs)) as current:
+                assert current["key"] != durability.encode("ascii")
+
+            with closing(make.commit()) as new:
+                assert new["key"] == durability.encode("ascii")
+            assert _os.listdir(str(tmpdir)) == ["published.cdb"]
+
+        # The old reader still sees the old file
+        assert old["key"] == b"old"
+
+    # Closing without commit removes the temporary file only
+    make = _cdbx.CDB.make(fname, atomic=True, **kwargs)
+    make.add("key", "never")
+    make.close()
+    assert _os.listdir(str(tmpdir)) == ["published.cdb"]
+    with closing(_cdbx.CDB(fname, **kwargs)) as cdb:
+        assert cdb["key"] == b"full"
+
+    # durability without atomic
+    with closing(_cdbx.CDB.make(_tempfile.TemporaryFile(), close=True,
+                                durability="none", **kwargs).commit()) as cdb:
+        assert len(cdb) == 0
+
+
+@mark.parametrize("mmap", mmap_param)
+def test_reloading(mmap, tmpdir):
+    """Follow replacements of a published CDB"""
+    kwargs = {} if mmap == -1 else {"mmap": mmap}
+    fname = _os.path.join(str(tmpdir), "published.cdb")
+
+    def publish(value):
+        """Atomically replace the CDB"""
+        make = _cdbx.CDB.make(fname, atomic=True, durability="none")
+        for num in range(1000):
+            make.add("key%d" % num, value)
+        make.commit().close()
+
+    publish("one")
+    cdb = _cdbx.ReloadingCDB(fname, interval=0, **kwargs)
+    try:
+        assert cdb.generation == 1
+        assert cdb["key1"] == b"one"
+        items = cdb.items()
+        assert next(items) == (b"key0", b"one")
+        current = cdb.current
+        if hasattr(_os, "get_inheritable"):
+            assert not _os.get_inheritable(current.fileno())
+
+        # The new file is loaded in the background, the old one keeps serving
+        publish("two")
+        deadline = _time.time() + 10
+        while cdb.get("key1") != b"two":
+            assert cdb.get("key1") in (b"one", b"two")
+            assert _time.time() < deadline
+            _time.sleep(0.01)
+        assert cdb.generation == 2
+
+        # Old readers still work on the old file
+        assert len(list(items)) == 999
+        assert current["key1"] == b"one"
+        del items, current
+
+        assert "key999" in cdb
+        assert cdb.has_key("key999")
+        assert len(cdb) == 1000
+        assert sorted(cdb)[:2] == [b"key0", b"key1"]
+        assert cdb.get("key2", all=True) == [b"two"]
+        assert dict(cdb.items())[b"key3"] == b"two"
+
+        # Synchronous reload
+        publish("three")
+        assert cdb.reload()
+        assert not cdb.reload()
+        assert cdb["key1"] == b"three"
+        assert cdb.generation == 3
+    finally:
+        cdb.close()
+
+    # No automatic checks
+    cdb = _cdbx.ReloadingCDB(fname, interval=-1, warm=False, **kwargs)
+    try:
+        publish("four")
+        assert cdb["key1"] == b"three"
+        assert cdb.reload()
+        assert cdb["key1"] == b"four"
+    finally:
+        cdb.close()
+
+
+@mark.skipif(
+    not _os.path.isdir("/proc/self/fd"), reason="Needs /proc/self/fd"
+)
+@mark.parametrize("mmap", mmap_param)
+def test_close_releases_fds(mmap, tmpdir):
+    """Closing releases the file and the mapping"""
+    kwargs = {} if mmap == -1 else {"mmap": mmap}
+    fname = _os.path.join(str(tmpdir), "cdb")
+    make = _cdbx.CDB.make(fname)
+    make.add("key", "value")
+    make.commit().close()
+
+    before = len(_os.listdir("/proc/self/fd"))
+    for _ in range(10):
+        with closing(_cdbx.CDB(fname, **kwargs)) as cdb:
+            assert cdb["key"] == b"value"
+    assert len(_os.listdir("/proc/self/fd")) == before
+
+
+@mark.parametrize("mmap", mmap_param)
+def test_pool(mmap, tmpdir):
+    """Bounded pool of open CDBs"""
+    kwargs = {} if mmap == -1 else {"mmap": mmap}
+    names = []
+    for num in range(5):
+        names.append(_os.path.join(str(tmpdir), "%d.cdb" % num))
+        make = _cdbx.CDB.make(names[-1])
+        for key in range(100):
+            make.add("key%d" % key, "value%d-%d" % (num, key))
+        make.commit().close()
+
+    pool = _cdbx.CDBPool(max_open=2, **kwargs)
+    assert pool.get(names[0], "key1") == b"value0-1"
+    assert pool.get(names[1], "key2") == b"value1-2"
+    assert pool.get(names[0], "nope") is None
+    assert pool.get(names[0], "nope", b"x") == b"x"
+    assert len(pool) == 2
+
+    # names[1] is least recently used now
+    kept = pool.open(names[1])
+    assert pool.get(names[0], key="key3") == b"value0-3"
+    assert pool.get(names[2], "key4") == b"value2-4"
+    assert len(pool) == 2
+    assert names[0] in pool
+    assert names[1] not in pool
+    assert names[2] in pool
+    assert pool.stats == {"hits": 4, "misses": 3, "evictions": 1}
+
+    # Evicted CDBs are still usable
+    assert kept["key5"] == b"value1-5"
+    assert pool.open(names[1]) is not kept
+    del kept
+
+    assert pool.discard(names[1])
+    assert not pool.discard(names[1])
+    assert len(pool) == 1
+
+    pool.clear()
+    assert len(pool) == 0
+    assert pool.mapped_bytes == 0
+
+    # Mapped bytes are bounded as well
+    size = _os.path.getsize(names[0])
+    pool = _cdbx.CDBPool(max_open=5, max_mapped_bytes=size * 2, **kwargs)
+    for name in names:
+        assert pool.get(name, "key9") is not None
+    if mmap is False:
+        assert len(pool) == 5
+        assert pool.mapped_bytes == 0
+    elif mmap is True:
+        assert len(pool) == 2
+        assert pool.mapped_bytes == size * 2
+        assert names[3] in pool and names[4] in pool
+
+    # The most recently used file is kept, even if it's too large
+    pool = _cdbx.CDBPool(max_mapped_bytes=0, **kwargs)
+    assert pool.get(names[0], "key1") == b"value0-1"
+    assert pool.get(names[1], "key1") == b"value1-1"
+    assert len(pool) == (1 if pool.mapped_bytes else 2)
+    pool.close()
+
+
+def test_pool_threads(tmpdir):
+    """Pool lookups from several threads"""
+    import threading as _threading
+
+    names = []
+    for num in range(8):
+        names.append(_os.path.join(str(tmpdir), "%d.cdb" % num))
+        make = _cdbx.CDB.make(names[-1])
+        make.add("key", str(num))
+        make.commit().close()
+
+    pool = _cdbx.CDBPool(max_open=3)
+    errors = []
+
+    def work(offset):
+        """Look up all files a few times"""
+        try:
+            for run in range(200):
+                num = (offset + run) % len(names)
+                assert pool.get(names[num], "key") == str(num).encode("ascii")
+        except Exception as e:  # pylint: disable = broad-except
+            errors.append(e)
+
+    threads = [_threading.Thread(target=work, args=(num,)) for num in range(4)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+
+    assert not errors
+    assert len(pool) == 3
+    stats = pool.stats
+    assert stats["hits"] + stats["misses"] == 800
+
+
+def _fork(func):
+    """Run func in a forked child, return its pid"""
+    with _warnings.catch_warnings():
+        # "This process is multi-threaded, use of fork() may lead to ..."
+        _warnings.simplefilter("ignore", DeprecationWarning)
+        pid = _os.fork()
+    if not pid:
+        status = 1
+        try:
+            status = 0 if func() else 1
+        finally:
+            _os._exit(status)  # pylint: disable = protected-access
+    return pid
+
+
+@mark.skipif(not hasattr(_os, "fork"), reason="Needs fork()")
+@mark.parametrize("mmap", mmap_param)
+def test_fork(mmap, tmpdir):
+    """CDBs opened before fork are shared by parent and children"""
+    kwargs = {} if mmap == -1 else {"mmap": mmap}
+    fname = _os.path.join(str(tmpdir), "shared.cdb")
+    make = _cdbx.CDB.make(fname)
+    for num in range(2000):
+        make.add("key%d" % num, "value%d" % num * (num % 7 + 1))
+    make.commit().close()
+
+    cdb = _cdbx.CDB(fname, **kwargs)
+    cdb.warm()
+    assert cdb["key1"] == b"value1" * 2
+
+    def work():
+        """Look up and iterate everything a few times"""
+        for _ in range(5):
+            for num in range(2000):
+                if cdb["key%d" % num] != b"value%d" % num * (num % 7 + 1):
+                    return False
+            if len(list(cdb.items())) != 2000:
+                return False
+        return True
+
+    pids = [_fork(work) for _ in range(4)]
+    try:
+        assert work()
+    finally:
+        statuses = [_os.waitpid(pid, 0)[1] for pid in pids]
+    assert statuses == [0] * len(pids)
+    cdb.close()
+
+
+@mark.skipif(not hasattr(_os, "fork"), reason="Needs fork()")
+def test_fork_reloading(tmpdir):
+    """ReloadingCDB keeps reloading in forked children"""
+    fname = _os.path.join(str(tmpdir), "published.cdb")
+
+    def publish(value):
+        """Atomically replace the CDB"""
+        make = _cdbx.CDB.make(fname, atomic=True, durability="none")
+        make.add("key", value)
+        make.commit().close()
+
+    publish("one")
+    cdb = _cdbx.ReloadingCDB(fname, interval=0)
+
+    def work():
+        """Wait for the next replacement"""
+        publish("three")
+        deadline = _time.time() + 10
+        while cdb["key"] != b"three":
+            if _time.time() > deadline:
+                return False
+            _time.sleep(0.01)
+        return True
+
+    # Fork while a loader thread may be running
+    publish("two")
+    cdb.get("key")
+    pid = _fork(work)
+    assert _os.waitpid(pid, 0)[1] == 0
+    cdb.close()
+
+
+@mark.parametrize("mmap", mmap_param)
+def test_overlay(mmap):
+    """Updates in an overlay and committing them"""
+    kwargs = {} if mmap == -1 else {"mmap": mmap}
+
+    cdb = _cdbx.CDB.make(_tempfile.TemporaryFile(), close=True, **kwargs)
+    for num in range(1000):
+        cdb.add("key%d" % num, "value%d" % num)
+    cdb.add("key7", "again")
+    cdb.add("key8", "again")
+    with closing(cdb.commit()) as base:
+        overlay = _cdbx.CDBOverlay(base)
+        assert overlay.cdb is base
+        assert len(overlay) == 1000
+
+        overlay["key7"] = "new"
+        overlay[u"\xe9"] = u"\xe8"
+        overlay["key1000"] = "x"
+        del overlay["key1000"]
+        del overlay["key8"]
+        del overlay["key9"]
+        overlay["key9"] = "back"
+        for num in range(10, 100):
+            overlay["extra%d" % num] = "x"
+        for num in range(100, 200):
+            del overlay["key%d" % num]
+
+        assert overlay["key7"] == b"new"
+        assert overlay.get("key7", all=True) == [b"new"]
+        assert overlay.get("key8") is None
+        assert overlay.get("key8", all=True) is None
+        assert overlay.get("key9", b"x") == b"back"
+        assert overlay.get("key6", all=True) == [b"value6"]
+        assert overlay.get(b"\xe9") == b"\xe8"
+        assert overlay.get("key1000", 1) == 1
+        assert overlay.get("key1001", 1, all=True) == 1
+        with raises(KeyError):
+            overlay["key8"]
+        with raises(KeyError):
+            del overlay["key8"]
+        with raises(KeyError):
+            del overlay["key1001"]
+
+        assert [key in overlay for key in ("key7", "key8", "key150")] == [
+            True, False, False
+        ]
+        assert overlay.has_key("key6")
+        assert len(overlay) == 1000 - 1 - 100 + 90 + 1
+        assert base.get("key7", all=True) == [b"value7", b"again"]
+
+        for close in (False, True):
+            fp = _tempfile.TemporaryFile()
+            with closing(overlay.commit_to(fp, close=close, **kwargs)) as cdb:
+                assert len(cdb) == len(overlay)
+                assert sorted(cdb.items(all=True)) == sorted(
+                    (key, overlay[key]) for key in cdb
+                )
+                assert cdb.get("key7", all=True) == [b"new"]
+                assert "key8" not in cdb
+                assert cdb["key9"] == b"back"
+                assert cdb[b"\xe9"] == b"\xe8"
+                # The base records come first, in file order
+                assert list(cdb)[:3] == [b"key0", b"key1", b"key2"]
+            if not close:
+                fp.close()
+
+    with raises(IOError):
+        overlay.get("key6")
+    assert overlay["key7"] == b"new"
+
+
+@mark.parametrize("mmap", mmap_param)
+def test_merge(mmap, tmpdir):
+    """Merge several CDBs into one"""
+    kwargs = {} if mmap == -1 else {"mmap": mmap}
+    sources = []
+    for hour in range(3):
+        fname = _os.path.join(str(tmpdir), "hour%d" % hour)
+        make = _cdbx.CDB.make(fname)
+        for num in range(hour * 500, hour * 500 + 1000):
+            make.add("key%d" % num, "%d-%d" % (hour, num))
+        make.add("key0", "%d-again" % hour)
+        make.commit().close()
+        sources.append(fname)
+
+    def merge(dedup):
+        """Merge the sources"""
+        with closing(_cdbx.CDB(sources[1], **kwargs)) as cdb:
+            return _cdbx.CDB.merge(
+                [sources[0], cdb, sources[2]], _tempfile.TemporaryFile(),
+                dedup=dedup, close=True, **kwargs
+            )
+
+    with closing(merge("all")) as cdb:
+        assert len(cdb) == 2000
+        assert len(list(cdb.items(all=True))) == 3003
+        assert cdb.get("key0", all=True) == [
+            b"0-0", b"0-again", b"1-again", b"2-again"
+        ]
+        assert cdb.get("key600", all=True) == [b"0-600", b"1-600"]
+
+    with closing(merge("first")) as cdb:
+        assert len(list(cdb.items(all=True))) == 2000
+        assert cdb.get("key0", all=True) == [b"0-0"]
+        assert cdb["key600"] == b"0-600"
+        assert cdb["key1999"] == b"2-1999"
+        assert list(cdb)[:2] == [b"key0", b"key1"]
+
+    with closing(merge("last")) as cdb:
+        assert len(list(cdb.items(all=True))) == 2000
+        assert cdb.get("key0", all=True) == [b"2-again"]
+        assert cdb["key600"] == b"1-600"
+        assert cdb["key1200"] == b"2-1200"
+        assert cdb["key499"] == b"0-499"
+
+    with closing(_cdbx.CDB.merge([], _tempfile.TemporaryFile(),
+                                 close=True)) as cdb:
+        assert len(cdb) == 0
+
+
+@mark.parametrize("mmap", mmap_param)
+def test_rebuild(mmap):
+    """Rebuild with deleted and replaced keys"""
+    kwargs = {} if mmap == -1 else {"mmap": mmap}
+    records = [
+        (("key%d" % (num % 700)).encode("ascii"), ("%d" % num).encode("ascii"))
+        for num in range(3000)
+    ]
+    delete = [("key%d" % num).encode("ascii") for num in range(0, 700, 9)]
+    replace = dict(
+        (("key%d" % num).encode("ascii"), b"new")
+        for num in range(1, 700, 10)
+    )
+    replace[b"added"] = b"new"
+
+    make = _cdbx.CDB.make(_tempfile.TemporaryFile(), close=True, **kwargs)
+    for key, value in records:
+        make.add(key, value)
+    with closing(make.commit()) as cdb:
+        with closing(cdb.rebuild(_tempfile.TemporaryFile(), close=True,
+                                 delete=delete + [b"nope"], replace=replace,
+                                 **kwargs)) as new:
+            expected = [
+                (key, value) for key, value in records
+                if key not in delete and key not in replace
+            ] + list(replace.items())
+            assert list(new.items(all=True)) == expected
+            assert len(new) == 700 - len(set(delete) - set(replace)) + 1
+
+            for key in set(key for key, _ in records):
+                assert new.get(key, all=True) == ([
+                    value for key_, value in expected if key_ == key
+                ] or None)
+
+        # No changes at all
+        with closing(cdb.rebuild(_tempfile.TemporaryFile(), close=True,
+                                 **kwargs)) as new:
+            assert list(new.items(all=True)) == records
+            assert new.get(b"key5", all=True) == cdb.get(b"key5", all=True)
+
+        # Everything deleted
+        with closing(cdb.rebuild(_tempfile.TemporaryFile(), close=True,
+                                 delete=iter(cdb), **kwargs)) as new:
+            assert len(new) == 0
+            assert new.get(b"key5") is None
+
+
+@mark.parametrize("mmap", mmap_param)
+def test_sharded(mmap, tmpdir):
+    """Build and query a sharded CDB"""
+    kwargs = {} if mmap == -1 else {"mmap": mmap}
+    fname = _os.path.join(str(tmpdir), "set")
+    keys = [("key%d" % num).encode("ascii") for num in range(2000)]
+
+    for shards, threads in ((7, None), (7, 2), (1, 1)):
+        make = _cdbx.ShardedCDB.make(fname, shards, **kwargs)
+        for key in keys:
+            make.add(key, key.upper())
+        make.add(keys[7], b"again")
+        make.add(u"\xe9", u"\xe8")
+        with closing(make.commit(threads=threads)) as cdb:
+            assert len(cdb.shards) == shards
+            assert len(cdb) == len(keys) + 1
+            assert all(len(shard) for shard in cdb.shards)
+
+            assert cdb[keys[7]] == b"KEY7"
+            assert cdb.get(keys[7], all=True) == [b"KEY7", b"again"]
+            assert cdb.get(b"key2000", b"x") == b"x"
+            assert cdb.get(b"key2000", all=True) is None
+            assert cdb.get(b"\xe9") == b"\xe8"
+            assert u"\xe9" in cdb
+            with raises(KeyError):
+                cdb[b"key2000"]
+
+            assert sorted(cdb) == sorted(keys + [b"\xe9"])
+            assert sorted(cdb.keys(True)) == sorted(keys + [keys[7], b"\xe9"])
+            assert len(list(cdb.values())) == len(keys) + 1
+            assert dict(cdb.items()) == dict(
+                [(key, key.upper()) for key in keys] + [(b"\xe9", b"\xe8")]
+            )
+            assert len(list(cdb.items(all=True))) == len(keys) + 2
+
+            # Every key is found in exactly one shard
+            for key in keys[::97]:
+                assert [key in shard for shard in cdb.shards].count(True) == 1
+
+        # Routing is stable
+        with closing(_cdbx.ShardedCDB(fname, **kwargs)) as cdb:
+            for key in keys[::13]:
+                assert cdb[key] == key.upper()
+
+    assert sorted(_os.listdir(str(tmpdir))) == ["set", "set.0"] + [
+        "set.%d" % num for num in range(1, 7)
+    ]
+
+
+def test_sharded_close_commit(tmpdir):
+    """Close while committing in another thread"""
+    import threading as _threading
+
+    fname = _os.path.join(str(tmpdir), "set")
+    errors = []
+
+    def close(make):
+        """Close the maker, collect errors"""
+        try:
+            make.close()
+        except IOError as e:
+            errors.append(str(e))
+
+    for delay in (0, 0.0001, 0.001, 0.01):
+        make = _cdbx.ShardedCDB.make(fname, 4)
+        for num in range(100000):
+            make.add("key%d" % num, "value%d" % num)
+        closer = _threading.Timer(delay, close, args=(make,))
+        closer.start()
+        try:
+            make.commit(threads=4).close()
+        except IOError:
+            pass
+        finally:
+            closer.join()
+
+    assert set(errors) <= set(["Commit in progress"])
+
+
+@mark.parametrize("mmap", mmap_param)
+def test_to_columns(mmap):
+    """Columnar export"""
+    kwargs = {} if mmap == -1 else {"mmap": mmap}
+
+    def columns(keys, key_offsets, values, value_offsets):
+        """Split the buffers into items"""
+        key_offsets = _struct.unpack(
+            "=%dQ" % (len(key_offsets) // 8), key_offsets
+        )
+        value_offsets = _struct.unpack(
+            "=%dQ" % (len(value_offsets) // 8), value_offsets
+        )
+        assert len(key_offsets) == len(value_offsets)
+        assert key_offsets[-1] == len(keys)
+        assert value_offsets[-1] == len(values)
+        return [
+            (
+                keys[key_offsets[idx] : key_offsets[idx + 1]],
+                values[value_offsets[idx] : value_offsets[idx + 1]],
+            )
+            for idx in range(len(key_offsets) - 1)
+        ]
+
+    with _tempfile.TemporaryFile() as fp:
+        cdb = _cdbx.CDB.make(fp, **kwargs)
+        for num in range(25):
+            cdb.add("k%d" % (num % 10), "v" * num)
+        cdb.add("", "")
+        cdb = cdb.commit()
+
+        assert columns(*cdb.to_columns()) == list(cdb.items(all=True))
+        assert columns(*cdb.to_columns(all=False)) == list(cdb.items())
+
+        class Closing(object):
+            """__bool__ closes the CDB"""
+
+            def __bool__(self):
+                cdb.close()
+                return True
+
+            __nonzero__ = __bool__
+
+        with raises(IOError):
+            cdb.to_columns(all=Closing())
+
+
+@mark.parametrize("mmap", mmap_param)
+def test_scan(mmap):
+    """Scan for matching keys"""
+    kwargs = {} if mmap == -1 else {"mmap": mmap}
+
+    with _tempfile.TemporaryFile() as fp:
+        cdb = _cdbx.CDB.make(fp, **kwargs)
+        for num in range(20000):
+            cdb.add("key-%d" % num, "value-%d" % num)
+        cdb.add("key-5", "dup")
+        cdb.add("big-" + "x" * 70000, "y" * 70000)
+        cdb = cdb.commit()
+        items = list(cdb.items(all=True))
+
+        def expected(func, all=False):
+            # pylint: disable = redefined-builtin
+            seen, result = set(), []
+            for key, value in items:
+                if func(key) and (all or key not in seen):
+                    result.append((key, value))
+                seen.add(key)
+            return result
+
+        for threads in (1, 2, 3, 8, None):
+            assert cdb.scan(prefix="key-199", threads=threads) == [
+                key for key, _ in expected(lambda k: k.startswith(b"key-199"))
+            ]
+            assert cdb.scan(suffix=b"99", what="values", threads=threads) == [
+                value for _, value in expected(lambda k: k.endswith(b"99"))
+            ]
+            assert cdb.scan(
+                contains="-5", suffix="5", what="items", all=True,
+                threads=threads
+            ) == expected(
+                lambda k: b"-5" in k[1:] and k.endswith(b"5"), all=True
+            )
+
+        assert cdb.scan(prefix="key-5", suffix="5", contains="key-5") == [
+            key
+            for key, _ in expected(
+                lambda k: k.startswith(b"key-5") and k.endswith(b"5")
+            )
+        ]
+        assert cdb.scan(prefix="key-5", suffix="-5", what="values",
+                        all=True) == [b"value-5", b"dup"]
+        assert cdb.scan(regex=b"^key-1234[0-9]$", contains="") == [
+            ("key-1234%d" % num).encode("ascii") for num in range(10)
+        ]
+        assert cdb.scan(
+            regex=_re.compile(b"7$"), prefix="key-1", encoding="ascii"
+        ) == [
+            key.decode("ascii")
+            for key, _ in expected(
+                lambda k: k.startswith(b"key-1") and k.endswith(b"7")
+            )
+        ]
+        assert cdb.scan(prefix="nope") == []
+        assert cdb.scan(contains="z" * 100) == []
+        assert cdb.scan(prefix="big-", suffix="x", what="values") == [
+            b"y" * 70000
+        ]
+        assert len(cdb.scan(threads=4)) == 20001
+        assert len(cdb.scan(all=True)) == 20002
+
+        class Closing(object):
+            """search() and __index__ close the CDB"""
+
+            def search(self, key):
+                cdb.close()
+                return key
+
+            def __index__(self):
+                cdb.close()
+                return 4
+
+        with raises(IOError):
+            cdb.scan(threads=Closing())
+        cdb = _cdbx.CDB(fp, **kwargs)
+        with raises(IOError):
+            cdb.scan(prefix="key-1", regex=Closing(), what="items")
+
+
+@mark.parametrize("mmap", mmap_param)
+def test_scan_close(mmap):
+    """Close while scanning in another thread"""
+    import threading as _threading
+
+    kwargs = {} if mmap == -1 else {"mmap": mmap}
+
+    with _tempfile.TemporaryFile() as fp:
+        cdb = _cdbx.CDB.make(fp, **kwargs)
+        for num in range(100000):
+            cdb.add("key-%d" % num, "value-%d" % num)
+        cdb.commit().close()
+
+        for delay in (0, 0.0001, 0.001, 0.01):
+            cdb = _cdbx.CDB(fp, **kwargs)
+            closer = _threading.Timer(delay, cdb.close)
+            closer.start()
+            try:
+                assert len(cdb.scan(what="items", threads=4)) == 100000
+            except IOError:
+                pass
+            finally:
+                closer.join()
+            with raises(IOError):
+                cdb.scan()
+
+
+@mark.parametrize("mmap", mmap_param)
+def test_decode(mmap):
+    """Decode keys and values"""
+    kwargs = {} if mmap == -1 else {"mmap": mmap}
+    big = u"\u20ac" * 1000
+
+    with _tempfile.TemporaryFile() as fp:
+        cdb = _cdbx.CDB.make(fp, **kwargs)
+        cdb.add(b"a", u"b\xe4r".encode("utf-8"))
+        cdb.add(b"a", big.encode("utf-8"))
+        cdb.add(u"b\xe4".encode("utf-8"), b"\xff")
+        cdb.commit().close()
+
+        with closing(_cdbx.CDB(fp, encoding="utf-8", **kwargs)) as cdb:
+            assert cdb["a"] == u"b\xe4r"
+            assert cdb.get("a") == u"b\xe4r"
+            assert cdb.get("a", all=True) == [u"b\xe4r", big]
+            assert cdb.get("a", encoding=None) == u"b\xe4r".encode("utf-8")
+            assert cdb.get("a", encoding="latin-1") == u"b\xc3\xa4r"
+            assert cdb.get("x", default=1) == 1
+            assert list(cdb) == [u"a", u"b\xe4"]
+            assert list(cdb.keys(all=True)) == [u"a", u"a", u"b\xe4"]
+            assert list(cdb.keys(encoding=None)) == [
+                b"a", u"b\xe4".encode("utf-8")
+            ]
+
+            key = u"b\xe4".encode("utf-8")
+            with raises(UnicodeDecodeError):
+                cdb[key]  # pylint: disable = pointless-statement
+            with raises(UnicodeDecodeError):
+                list(cdb.items())
+            assert cdb.get(key, errors="replace") == u"\ufffd"
+            assert list(cdb.items(errors="replace")) == [
+                (u"a", u"b\xe4r"), (u"b\xe4", u"\ufffd")
+            ]
+
+        cdb = _cdbx.CDB(fp, encoding="utf-8", errors="ignore", **kwargs)
+        with closing(cdb):
+            assert cdb[u"b\xe4".encode("utf-8")] == u""
+            assert cdb.get(key, errors=None, encoding="latin-1") == u"\xff"
+
+
+@mark.parametrize("mmap", mmap_param)
+def test_get_into(mmap):
+    """get_into method"""
+    kwargs = {} if mmap == -1 else {"mmap": mmap}
+
+    with _tempfile.TemporaryFile() as fp:
+        cdb = _cdbx.CDB.make(fp, **kwargs)
+        cdb.add("a", "bc")
+        cdb.add("a", "xxy")
+        cdb.add("def", "ghij")
+        cdb.add("e", "")
+        cdb = cdb.commit()
+
+        buf = bytearray(b"-" * 6)
+        assert cdb.get_into("a", buf) == 2
+        assert buf == bytearray(b"bc----")
+        assert cdb.get_into(b"def", buf) == 4
+        assert buf == bytearray(b"ghij--")
+        assert cdb.get_into("e", buf) == 0
+        assert buf == bytearray(b"ghij--")
+        assert cdb.get_into("c", buf) == -1
+        assert buf == bytearray(b"ghij--")
+
+        view = memoryview(buf)[4:]
+        assert cdb.get_into("a", view) == 2
+        assert buf == bytearray(b"ghijbc")
+
+
+@mark.parametrize("mmap", mmap_param)
+def test_value_range(mmap):
+    """value_size, count and read_range methods"""
+    kwargs = {} if mmap == -1 else {"mmap": mmap}
+
+    with _tempfile.TemporaryFile() as fp:
+        cdb = _cdbx.CDB.make(fp, **kwargs)
+        cdb.add("a", "0123456789")
+        cdb.add("a", "xxy")
+        cdb.add("e", "")
+        cdb = cdb.commit()
+
+        assert cdb.value_size("a") == 10
+        assert cdb.value_size(b"e") == 0
+        assert cdb.value_size("c") == -1
+
+        assert cdb.count("a") == 2
+        assert cdb.count(b"e") == 1
+        assert cdb.count("c") == 0
+
+        assert cdb.read_range("a") == b"0123456789"
+        assert cdb.read_range("a", 3) == b"3456789"
+        assert cdb.read_range("a", 3, 2) == b"34"
+        assert cdb.read_range("a", start=8, length=5) == b"89"
+        assert cdb.read_range("a", 10) == b""
+        assert cdb.read_range("a", 20, 5) == b""
+        assert cdb.read_range("a", 0, 0) == b""
+        assert cdb.read_range("a", 0, None) == b"0123456789"
+        assert cdb.read_range("e", 0, 3) == b""
+        assert cdb.read_range("c", 0, 3) is None
+
+        class Closing(object):
+            """__index__ closes the CDB"""
+
+            def __index__(self):
+                cdb.close()
+                return 3
+
+        with raises(IOError):
+            cdb.read_range("a", 0, Closing())
+
+
+@mark.parametrize("mmap", mmap_param)
+def test_send_value(mmap):
+    """send_value method"""
+    kwargs = {} if mmap == -1 else {"mmap": mmap}
+
+    with _tempfile.TemporaryFile() as fp:
+        cdb = _cdbx.CDB.make(fp, **kwargs)
+        cdb.add("a", "bc")
+        cdb.add("def", "ghij")
+        cdb.add("a", "xxy")
+        cdb.add("e", "")
+        cdb.add("big", b"x" * 100000)
+        cdb = cdb.commit()
+
+        with _tempfile.TemporaryFile() as out:
+            assert cdb.send_value("a", out) == 2
+            assert cdb.send_value("a", out.fileno(), all=True) == 5
+            assert cdb.send_value("def", out, all=False) == 4
+            assert cdb.send_value("e", out) == 0
+            assert cdb.send_value("c", out) == -1
+            assert cdb.send_value("c", out, all=True) == -1
+            assert cdb.send_value("big", out) == 100000
+            out.seek(0)
+            assert out.read() == b"bcbcxxyghij" + b"x" * 100000
+
+        rfd, wfd = _os.pipe()
+        try:
+            assert cdb.send_value(b"def", wfd) == 4
+            assert _os.read(rfd, 10) == b"ghij"
+        finally:
+            _os.close(rfd)
+            _os.close(wfd)
+
+        class Closing(object):
+            """fileno() closes the CDB"""
+
+            def __init__(self, fp):
+                self.fp = fp
+
+            def fileno(self):
+                cdb.close()
+                return self.fp.fileno()
+
+        with _tempfile.TemporaryFile() as out:
+            with raises(IOError):
+                cdb.send_value("a", Closing(out))
+
+
 @mark.parametrize("mmap", mmap_param)
 def test_random(mmap):
     """Test random mapping"""
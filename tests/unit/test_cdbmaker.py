@@ -92,6 +92,17 @@ def test_add_args():
         with raises(TypeError):
             make.add(lah="luh")
 
+        with raises(TypeError):
+            make.add("foo")
+
+        with raises(TypeError):
+            make.add("foo", "bar", "baz")
+
+        with raises(TypeError):
+            make.add("foo", key="bar")
+
+        make.add(value="bar", key="foo")
+
         with raises(TypeError):
             make.add(object(), object())
 
@@ -0,0 +1,156 @@
+# -*- coding: ascii -*-
+u"""
+:Copyright:
+
+ Copyright 2016 - 2025
+ Andr\xe9 Malo or his licensors, as applicable
+
+:License:
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+============================
+ Tests for CDB overlay type
+============================
+
+Tests for CDB overlay type.
+"""
+__author__ = u"Andr\xe9 Malo"
+
+import tempfile as _tempfile
+import weakref as _weakref
+
+from pytest import raises
+
+from .. import _util as _test
+
+import cdbx as _cdbx
+
+# pylint: disable = consider-using-with, pointless-statement
+
+
+def _cdb(*items):
+    """Create CDB"""
+    make = _cdbx.CDB.make(_tempfile.TemporaryFile(), close=True)
+    for key, value in items:
+        make.add(key, value)
+    return make.commit()
+
+
+def test_new_args():
+    """CDBOverlay() args error handling"""
+    with raises(TypeError):
+        _cdbx.CDBOverlay()
+
+    with raises(TypeError) as e:
+        _cdbx.CDBOverlay(object())
+    assert e.value.args == ("CDBOverlay base must be a CDB instance",)
+
+    with raises(TypeError):
+        _cdbx.CDBOverlay(cdb=None)
+
+
+def test_item_args():
+    """get/set/del args error handling"""
+    cdb = _cdb(("foo", "bar"))
+    overlay = _cdbx.CDBOverlay(cdb)
+
+    with raises(TypeError):
+        overlay.get()
+
+    with raises(TypeError):
+        overlay.get(object())
+
+    with raises(TypeError):
+        overlay[object()]
+
+    with raises(TypeError):
+        object() in overlay
+
+    with raises(TypeError):
+        overlay[object()] = "x"
+
+    with raises(TypeError):
+        overlay["foo"] = object()
+
+    with raises(TypeError):
+        del overlay[object()]
+
+    with raises(RuntimeError) as e:
+        overlay.get("foo", all=_test.badbool)
+    assert e.value.args == ("yoyo",)
+
+    with raises(TypeError):
+        hash(overlay)
+
+    assert overlay.get("foo") == b"bar"
+    cdb.close()
+
+
+def test_commit_to_args():
+    """commit_to() args error handling"""
+    cdb = _cdb(("foo", "bar"))
+    overlay = _cdbx.CDBOverlay(cdb)
+
+    with raises(TypeError):
+        overlay.commit_to()
+
+    with raises(TypeError):
+        overlay.commit_to(object())
+
+    with _tempfile.TemporaryFile() as fp:
+        with raises(RuntimeError) as e:
+            overlay.commit_to(fp, close=_test.badbool)
+        assert e.value.args == ("yoyo",)
+
+        cdb.close()
+        with raises(IOError):
+            overlay.commit_to(fp)
+
+
+def test_closed():
+    """bail if the base is closed"""
+    cdb = _cdb(("foo", "bar"), ("baz", "x"))
+    overlay = _cdbx.CDBOverlay(cdb)
+    overlay["foo"] = "new"
+    overlay["bar"] = "x"
+    cdb.close()
+
+    assert overlay["foo"] == b"new"
+    with raises(IOError):
+        overlay.get("baz")
+
+    with raises(IOError):
+        "baz" in overlay
+
+    with raises(IOError):
+        len(overlay)
+
+    with raises(IOError):
+        del overlay["baz"]
+
+    del overlay["bar"]
+    assert "bar" not in overlay
+
+
+def test_weakref():
+    """weakref handling"""
+    cdb = _cdb(("foo", "bar"))
+    overlay = _cdbx.CDBOverlay(cdb)
+    proxy = _weakref.proxy(overlay)
+    assert proxy["foo"] == b"bar"
+    del overlay
+
+    with raises(ReferenceError):
+        proxy["foo"]
+    cdb.close()
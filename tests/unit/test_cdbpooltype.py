@@ -0,0 +1,140 @@
+# -*- coding: ascii -*-
+u"""
+:Copyright:
+
+ Copyright 2016 - 2025
+ Andr\xe9 Malo or his licensors, as applicable
+
+:License:
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+=========================
+ Tests for CDB pool type
+=========================
+
+Tests for CDB pool type.
+"""
+__author__ = u"Andr\xe9 Malo"
+
+import os as _os
+import weakref as _weakref
+
+from pytest import raises
+
+from .. import _util as _test
+
+import cdbx as _cdbx
+
+# pylint: disable = pointless-statement
+
+
+def _make(fname, value):
+    """Create CDB"""
+    make = _cdbx.CDB.make(fname)
+    make.add("key", value)
+    make.commit().close()
+
+
+def test_new_args():
+    """CDBPool() args error handling"""
+    with raises(TypeError):
+        _cdbx.CDBPool("1")
+
+    with raises(ValueError):
+        _cdbx.CDBPool(0)
+
+    with raises(TypeError):
+        _cdbx.CDBPool(max_mapped_bytes="1")
+
+    with raises(ValueError):
+        _cdbx.CDBPool(max_mapped_bytes=-1)
+
+    with raises(TypeError):
+        _cdbx.CDBPool(nope=1)
+
+
+def test_lookup_errors(tmpdir):
+    """lookup error handling"""
+    fname = _os.path.join(str(tmpdir), "cdb")
+    pool = _cdbx.CDBPool()
+
+    with raises(TypeError):
+        pool.open(1)
+
+    with raises(TypeError):
+        pool.open([])
+
+    with raises(IOError):
+        pool.open(fname)
+    assert len(pool) == 0
+
+    with raises(TypeError):
+        pool.get(fname)
+
+    _make(fname, "value")
+    with raises(TypeError):
+        pool.get(fname, 1)
+    assert len(pool) == 1
+
+    with raises(RuntimeError) as e:
+        _cdbx.CDBPool(mmap=_test.badbool).open(fname)
+    assert e.value.args == ("yoyo",)
+
+
+def test_closed_cdb(tmpdir):
+    """A CDB closed behind the pool's back is reopened"""
+    fname = _os.path.join(str(tmpdir), "cdb")
+    _make(fname, "value")
+    pool = _cdbx.CDBPool()
+
+    pool.open(fname).close()
+    cdb = pool.open(fname)
+    assert cdb["key"] == b"value"
+
+    cdb.close()
+    assert pool.get(fname, "key") == b"value"
+    assert len(pool) == 1
+
+
+def test_closed(tmpdir):
+    """bail after close"""
+    fname = _os.path.join(str(tmpdir), "cdb")
+    _make(fname, "value")
+    pool = _cdbx.CDBPool()
+    cdb = pool.open(fname)
+    pool.close()
+    pool.close()  # noop
+
+    assert len(pool) == 0
+    assert fname not in pool
+    assert cdb["key"] == b"value"
+
+    with raises(IOError):
+        pool.open(fname)
+
+    with raises(IOError):
+        pool.get(fname, "key")
+
+
+def test_weakref(tmpdir):
+    """weakref handling"""
+    fname = _os.path.join(str(tmpdir), "cdb")
+    _make(fname, "value")
+    pool = _cdbx.CDBPool()
+    proxy = _weakref.proxy(pool)
+    assert proxy.get(fname, "key") == b"value"
+    del pool
+
+    with raises(ReferenceError):
+        proxy.get(fname, "key")
@@ -0,0 +1,120 @@
+# -*- coding: ascii -*-
+u"""
+:Copyright:
+
+ Copyright 2016 - 2025
+ Andr\xe9 Malo or his licensors, as applicable
+
+:License:
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+==========================
+ Tests for CDB stack type
+==========================
+
+Tests for CDB stack type.
+"""
+__author__ = u"Andr\xe9 Malo"
+
+import tempfile as _tempfile
+import weakref as _weakref
+
+from pytest import raises
+
+from .. import _util as _test
+
+import cdbx as _cdbx
+
+# pylint: disable = consider-using-with, pointless-statement
+
+
+def _cdb(*items):
+    """Create CDB"""
+    make = _cdbx.CDB.make(_tempfile.TemporaryFile(), close=True)
+    for key, value in items:
+        make.add(key, value)
+    return make.commit()
+
+
+def test_new_args():
+    """CDBStack() args error handling"""
+    with raises(TypeError):
+        _cdbx.CDBStack()
+
+    with raises(TypeError):
+        _cdbx.CDBStack(1)
+
+    with raises(TypeError):
+        _cdbx.CDBStack([object()])
+
+    with raises(TypeError):
+        _cdbx.CDBStack([], tombstone=u"x")
+
+    assert _cdbx.CDBStack([]).get("foo") is None
+    assert "foo" not in _cdbx.CDBStack(iter([]), tombstone=None)
+
+
+def test_get_args():
+    """get() args error handling"""
+    cdb = _cdb(("foo", "bar"))
+    stack = _cdbx.CDBStack([cdb])
+
+    with raises(TypeError):
+        stack.get()
+
+    with raises(TypeError):
+        stack.get(object())
+
+    with raises(TypeError):
+        stack[object()]
+
+    with raises(TypeError):
+        object() in stack
+
+    with raises(RuntimeError) as e:
+        stack.get("foo", all=_test.badbool)
+    assert e.value.args == ("yoyo",)
+
+    cdb.close()
+
+
+def test_closed():
+    """bail if a member is closed"""
+    cdbs = [_cdb(("foo", "bar")) for _ in range(20)]
+    stack = _cdbx.CDBStack(cdbs)
+    assert stack.has_key("foo")
+
+    cdbs[-1].close()
+    with raises(IOError):
+        stack.get("foo")
+
+    cdbs[0].close()
+    with raises(IOError):
+        "foo" in stack
+
+    for cdb in cdbs:
+        cdb.close()
+
+
+def test_weakref():
+    """weakref handling"""
+    cdb = _cdb(("foo", "bar"))
+    stack = _cdbx.CDBStack([cdb])
+    proxy = _weakref.proxy(stack)
+    assert proxy["foo"] == b"bar"
+    del stack
+
+    with raises(ReferenceError):
+        proxy["foo"]
+    cdb.close()
@@ -64,12 +64,27 @@ def test_closed():
     with raises(IOError):
         cdb.get("bar")
 
+    with raises(IOError):
+        cdb.warm()
+
     with raises(IOError):
         cdb.items("baz")
 
     with raises(IOError):
         cdb.keys()
 
+    with raises(IOError):
+        cdb.values()
+
+    with raises(IOError):
+        cdb.iter_batches()
+
+    with raises(IOError):
+        cdb.to_columns()
+
+    with raises(IOError):
+        cdb.scan(prefix="foo")
+
     with raises(IOError):
         list(cdb)
 
@@ -79,6 +94,33 @@ def test_closed():
     with raises(IOError):
         cdb.fileno()
 
+    with raises(IOError):
+        cdb.send_value("foo", 1)
+
+    with raises(IOError):
+        cdb.value_size("foo")
+
+    with raises(IOError):
+        cdb.count("foo")
+
+    with raises(IOError):
+        cdb.locate("foo")
+
+    with raises(IOError):
+        cdb.locate_many(["foo"])
+
+    with raises(IOError):
+        cdb.read_at(2048, 0)
+
+    with raises(IOError):
+        cdb.read_many_at([])
+
+    with raises(IOError):
+        cdb.get_into("foo", bytearray(10))
+
+    with raises(IOError):
+        cdb.read_range("foo", 0, 1)
+
     with raises(IOError):
         "foo" in cdb
 
@@ -96,11 +138,94 @@ def test_get_args():
         with raises(TypeError):
             cdb.get(nope="wrong")
 
+        with raises(TypeError):
+            cdb.get()
+
+        with raises(TypeError):
+            cdb.get("foo", None, False, None, None, 1)
+
+        with raises(TypeError):
+            cdb.get("foo", encoding=1)
+
+        with raises(TypeError):
+            cdb.get("foo", errors=1)
+
+        with raises(TypeError):
+            cdb.get("foo", key="bar")
+
+        assert cdb.get(all=True, default=1, key="foo") == 1
+
         with raises(RuntimeError) as e:
             cdb.get("foo", all=_test.badbool)
         assert e.value.args == ("yoyo",)
 
 
+def test_send_value_args():
+    """send_value() args error handling"""
+    with closing(
+        _cdbx.CDB.make(_tempfile.TemporaryFile(), close=True).commit()
+    ) as cdb:
+        with raises(TypeError):
+            cdb.send_value("foo")
+
+        with raises(TypeError):
+            cdb.send_value("foo", object())
+
+        with raises(RuntimeError) as e:
+            cdb.send_value("foo", 1, all=_test.badbool)
+        assert e.value.args == ("yoyo",)
+
+        with raises(TypeError):
+            cdb.send_value(object(), 1)
+
+
+def test_get_into_args():
+    """get_into() args error handling"""
+    make = _cdbx.CDB.make(_tempfile.TemporaryFile(), close=True)
+    make.add("foo", "bar")
+    with closing(make.commit()) as cdb:
+        with raises(TypeError):
+            cdb.get_into("foo")
+
+        with raises((TypeError, BufferError)):
+            cdb.get_into("foo", b"readonly")
+
+        with raises(TypeError):
+            cdb.get_into(object(), bytearray(10))
+
+        buf = bytearray(2)
+        with raises(ValueError):
+            cdb.get_into("foo", buf)
+        assert buf == bytearray(2)
+
+
+def test_read_range_args():
+    """read_range() args error handling"""
+    with closing(
+        _cdbx.CDB.make(_tempfile.TemporaryFile(), close=True).commit()
+    ) as cdb:
+        with raises(TypeError):
+            cdb.read_range()
+
+        with raises(TypeError):
+            cdb.read_range("foo", length="bar")
+
+        with raises(TypeError):
+            cdb.value_size(object())
+
+        with raises(TypeError):
+            cdb.count(object())
+
+    make = _cdbx.CDB.make(_tempfile.TemporaryFile(), close=True)
+    make.add("foo", "bar")
+    with closing(make.commit()) as cdb:
+        with raises(ValueError):
+            cdb.read_range("foo", -1)
+
+        with raises(ValueError):
+            cdb.read_range("foo", 0, -1)
+
+
 def test_items_args():
     """items() args error handling"""
     with closing(
@@ -109,6 +234,30 @@ def test_items_args():
         with raises(TypeError):
             cdb.items(nope="wrong")
 
+        with raises(TypeError):
+            cdb.items(True, None, None, None, None, True)
+
+        with raises(TypeError):
+            cdb.items(start="0")
+
+        with raises(ValueError):
+            cdb.items(start=-1)
+
+        with raises(ValueError):
+            cdb.items(start=1)
+
+        with raises(ValueError):
+            cdb.items(end=-5)
+
+        with raises(ValueError):
+            cdb.items(start=2048, end=2049)
+
+        assert cdb.items(start=2048, end=2048).cursor == (2048, 2048)
+        assert cdb.items().cursor == (2048, 2048)
+
+        with raises(TypeError):
+            cdb.items(encoding=1)
+
         with raises(RuntimeError) as e:
             cdb.items(all=_test.badbool)
         assert e.value.args == ("yoyo",)
@@ -122,11 +271,203 @@ def test_keys_args():
         with raises(TypeError):
             cdb.keys(nope="wrong")
 
+        with raises(TypeError):
+            cdb.keys(errors=1)
+
         with raises(RuntimeError) as e:
             cdb.keys(all=_test.badbool)
         assert e.value.args == ("yoyo",)
 
 
+def test_values_args():
+    """values() args error handling"""
+    with closing(
+        _cdbx.CDB.make(_tempfile.TemporaryFile(), close=True).commit()
+    ) as cdb:
+        with raises(TypeError):
+            cdb.values(nope="wrong")
+
+        with raises(TypeError):
+            cdb.values(encoding=1)
+
+        with raises(RuntimeError) as e:
+            cdb.values(all=_test.badbool)
+        assert e.value.args == ("yoyo",)
+
+
+def test_iter_batches_args():
+    """iter_batches() args error handling"""
+    with closing(
+        _cdbx.CDB.make(_tempfile.TemporaryFile(), close=True).commit()
+    ) as cdb:
+        with raises(TypeError):
+            cdb.iter_batches(nope="wrong")
+
+        with raises(ValueError):
+            cdb.iter_batches(0)
+
+        with raises(ValueError):
+            cdb.iter_batches(what="nope")
+
+        with raises(RuntimeError) as e:
+            cdb.iter_batches(all=_test.badbool)
+        assert e.value.args == ("yoyo",)
+
+        assert list(cdb.iter_batches()) == []
+
+
+def test_split_args():
+    """split() args error handling"""
+    with closing(
+        _cdbx.CDB.make(_tempfile.TemporaryFile(), close=True).commit()
+    ) as cdb:
+        with raises(TypeError):
+            cdb.split()
+
+        with raises(TypeError):
+            cdb.split("2")
+
+        with raises(ValueError):
+            cdb.split(0)
+
+        assert cdb.split(3) == [(2048, 2048)] * 3
+
+
+def test_sample_args():
+    """sample() args error handling"""
+    with closing(
+        _cdbx.CDB.make(_tempfile.TemporaryFile(), close=True).commit()
+    ) as cdb:
+        with raises(TypeError):
+            cdb.sample()
+
+        with raises(ValueError):
+            cdb.sample(-1)
+
+        with raises(TypeError):
+            cdb.sample(1, seed="x")
+
+        with raises(RuntimeError) as e:
+            cdb.sample(1, unique_keys=_test.badbool)
+        assert e.value.args == ("yoyo",)
+
+        assert cdb.sample(10) == []
+        assert cdb.sample(0, seed=-1) == []
+
+
+def test_locate_args():
+    """locate() / read_at() args error handling"""
+    make = _cdbx.CDB.make(_tempfile.TemporaryFile(), close=True)
+    make.add("foo", "bar")
+    with closing(make.commit()) as cdb:
+        with raises(TypeError):
+            cdb.locate()
+
+        with raises(TypeError):
+            cdb.locate(object())
+
+        with raises(RuntimeError) as e:
+            cdb.locate("foo", all=_test.badbool)
+        assert e.value.args == ("yoyo",)
+
+        with raises(TypeError):
+            cdb.locate_many(1)
+
+        with raises(TypeError):
+            cdb.locate_many([object()])
+
+        with raises(TypeError):
+            cdb.read_at(2048)
+
+        for offset, length in ((-1, 0), (2048, -1), (0, 0), (2048, 15),
+                               (2063, 0)):
+            with raises(ValueError):
+                cdb.read_at(offset, length)
+
+        assert cdb.read_at(2048, 14) == b"\3\0\0\0\3\0\0\0foobar"
+        assert cdb.read_at(2062, 0) == b""
+
+        with raises(TypeError):
+            cdb.read_many_at(1)
+
+        with raises(TypeError):
+            cdb.read_many_at([1])
+
+        with raises(TypeError):
+            cdb.read_many_at([(1,)])
+
+        with raises(TypeError):
+            cdb.read_many_at([(2048, "1")])
+
+        with raises(ValueError):
+            cdb.read_many_at([(2048, -1)])
+
+        with raises(ValueError):
+            cdb.read_many_at([(2048, 100)])
+
+        with raises(ValueError):
+            cdb.read_many_at(b"x" * 8)
+
+        assert cdb.read_many_at([]) == []
+        assert cdb.read_many_at(b"") == []
+        assert cdb.read_many_at([(0, 0)]) == [None]
+
+
+def test_to_columns_args():
+    """to_columns() args error handling"""
+    with closing(
+        _cdbx.CDB.make(_tempfile.TemporaryFile(), close=True).commit()
+    ) as cdb:
+        with raises(TypeError):
+            cdb.to_columns(nope="wrong")
+
+        with raises(RuntimeError) as e:
+            cdb.to_columns(all=_test.badbool)
+        assert e.value.args == ("yoyo",)
+
+        assert cdb.to_columns() == (b"", b"\0" * 8, b"", b"\0" * 8)
+
+
+def test_scan_args():
+    """scan() args error handling"""
+    with closing(
+        _cdbx.CDB.make(_tempfile.TemporaryFile(), close=True).commit()
+    ) as cdb:
+        with raises(TypeError):
+            cdb.scan(nope="wrong")
+
+        with raises(TypeError):
+            cdb.scan(prefix=object())
+
+        with raises(TypeError):
+            cdb.scan(suffix=object())
+
+        with raises(TypeError):
+            cdb.scan(contains=object())
+
+        with raises(ValueError):
+            cdb.scan(what="nope")
+
+        with raises(ValueError):
+            cdb.scan(threads=0)
+
+        with raises(TypeError):
+            cdb.scan(threads="1")
+
+        with raises(TypeError):
+            cdb.scan(encoding=1)
+
+        with raises(TypeError):
+            cdb.scan(regex=1)
+
+        with raises(RuntimeError) as e:
+            cdb.scan(all=_test.badbool)
+        assert e.value.args == ("yoyo",)
+
+        assert cdb.scan() == []
+        assert cdb.scan(threads=_sys.maxsize) == []
+
+
 def test_make_args():
     """make() args error handling"""
     with raises(TypeError):
@@ -140,12 +481,172 @@ def test_make_args():
         _cdbx.CDB.make(12, mmap=_test.badbool)
     assert e.value.args == ("yoyo",)
 
+    with raises(RuntimeError) as e:
+        _cdbx.CDB.make(12, atomic=_test.badbool)
+    assert e.value.args == ("yoyo",)
+
+    with raises(ValueError):
+        _cdbx.CDB.make(12, atomic=True)
+
+    with raises(ValueError):
+        _cdbx.CDB.make(12, durability="some")
+
+    with raises(TypeError):
+        _cdbx.CDB.make(12, durability=1)
+
+
+def test_make_atomic_errors(tmpdir):
+    """atomic make() error handling"""
+    fname = _os.path.join(str(tmpdir), "nope", "cdb")
+    with raises(IOError):
+        _cdbx.CDB.make(fname, atomic=True)
+
+    fname = _os.path.join(str(tmpdir), "cdb")
+    make = _cdbx.CDB.make(fname, atomic=True)
+    _os.mkdir(fname)
+    with raises(IOError):
+        make.commit()
+    make.close()
+    assert _os.listdir(str(tmpdir)) == ["cdb"]
+
+    class Failing(_cdbx.CDB):
+        """Fails to open the committed file"""
+
+        def __new__(cls, *args, **kwargs):
+            raise RuntimeError("yoyo")
+
+    # The committed file survives
+    for atomic in (True, False):
+        fname = _os.path.join(str(tmpdir), "failing-%s" % atomic)
+        make = Failing.make(fname, atomic=atomic)
+        make.add("a", "b")
+        with raises(RuntimeError):
+            make.commit()
+        make.close()
+        with closing(_cdbx.CDB(fname)) as cdb:
+            assert cdb["a"] == b"b"
+
+
+def test_merge_args(tmpdir):
+    """merge() args error handling"""
+    fname = _os.path.join(str(tmpdir), "source")
+    _cdbx.CDB.make(fname).commit().close()
+
+    with raises(TypeError):
+        _cdbx.CDB.merge([fname])
+
+    with raises(TypeError):
+        _cdbx.CDB.merge(1, 12)
+
+    with raises(ValueError):
+        _cdbx.CDB.merge([fname], 12, dedup="none")
+
+    def sources():
+        """Yield a source and fail"""
+        yield fname
+        raise RuntimeError("yoyo")
+
+    with raises(RuntimeError) as e:
+        _cdbx.CDB.merge(sources(), 12)
+    assert e.value.args == ("yoyo",)
+
+    with raises(IOError):
+        _cdbx.CDB.merge([fname, _os.path.join(str(tmpdir), "nope")], 12)
+
+    with closing(_cdbx.CDB(fname)) as cdb:
+        pass
+    with raises(IOError):
+        _cdbx.CDB.merge([fname, cdb], 12)
+
+    with raises(RuntimeError) as e:
+        _cdbx.CDB.merge([fname], 12, close=_test.badbool)
+    assert e.value.args == ("yoyo",)
+
+    class Closing(object):
+        """fileno() closes the source"""
+
+        def __init__(self, fp):
+            self.fp = fp
+
+        def fileno(self):
+            cdb.close()
+            return self.fp.fileno()
+
+    cdb = _cdbx.CDB(fname)
+    with _tempfile.TemporaryFile() as fp:
+        with raises(IOError):
+            _cdbx.CDB.merge([cdb], Closing(fp))
+    assert _os.listdir(str(tmpdir)) == ["source"]
+
+
+def test_rebuild_args():
+    """rebuild() args error handling"""
+    make = _cdbx.CDB.make(_tempfile.TemporaryFile(), close=True)
+    make.add("foo", "bar")
+    cdb = make.commit()
+
+    with _tempfile.TemporaryFile() as fp:
+        with raises(TypeError):
+            cdb.rebuild()
+
+        with raises(TypeError):
+            cdb.rebuild(fp, delete=1)
+
+        with raises(TypeError):
+            cdb.rebuild(fp, delete=[object()])
+
+        def keys():
+            """Yield a key and fail"""
+            yield "foo"
+            raise RuntimeError("yoyo")
+
+        with raises(RuntimeError) as e:
+            cdb.rebuild(fp, delete=keys())
+        assert e.value.args == ("yoyo",)
+
+        with raises((TypeError, AttributeError)):
+            cdb.rebuild(fp, replace=["foo"])
+
+        with raises(TypeError):
+            cdb.rebuild(fp, replace={object(): "bar"})
+
+        with raises(TypeError):
+            cdb.rebuild(fp, replace={"foo": object()})
+
+        with raises(RuntimeError) as e:
+            cdb.rebuild(fp, close=_test.badbool)
+        assert e.value.args == ("yoyo",)
+
+        def closing_keys():
+            """Yield a key and close the CDB"""
+            yield "foo"
+            cdb.close()
+
+        with raises(IOError):
+            cdb.rebuild(fp, delete=closing_keys())
+
+        # closed now
+        with raises(IOError):
+            cdb.rebuild(fp)
+
 
 def test_new_args():
     """__new__() args error handling"""
     with raises(TypeError):
         _cdbx.CDB(duh="dah")
 
+    with raises(TypeError):
+        _cdbx.CDB()
+
+    with raises(TypeError):
+        _cdbx.CDB(12, None, None, None, None, None)
+
+    with raises(TypeError):
+        _cdbx.CDB(12, encoding=1)
+
+    with raises(TypeError):
+        _cdbx.CDB(12, errors=1)
+
     with raises(RuntimeError) as e:
         _cdbx.CDB(12, close=_test.badbool)
     assert e.value.args == ("yoyo",)
@@ -227,7 +728,7 @@ def test_fd():
 
 
 def test_bad_mmap():
-    """Fake bad mmap module"""
+    """The mmap module is not used"""
 
     class Fake(object):
         """Hell raiser"""
@@ -241,16 +742,90 @@ def test_bad_mmap():
         fp = _tempfile.TemporaryFile()
         try:
             _cdbx.CDB.make(fp).commit()
-
-            with raises(RuntimeError) as e:
-                _cdbx.CDB(fp, mmap=True)
-            assert e.value.args == ("Huh",)
-
+            _cdbx.CDB(fp, mmap=True).close()
             _cdbx.CDB(fp, mmap=None).close()
         finally:
             fp.close()
 
 
+def test_mmap_short_file():
+    """mmap=True on files too short for a header"""
+    with _tempfile.TemporaryFile() as fp:
+        with raises(IOError):
+            _cdbx.CDB(fp, mmap=True)
+
+        fp.write(b"x" * 100)
+        fp.flush()
+        with raises(IOError):
+            _cdbx.CDB(fp, mmap=True)
+
+        _cdbx.CDB(fp).close()
+
+
+def test_mmap_trailing_data(tmpdir):
+    """mmap=True ignores bytes behind the hash tables"""
+    fname = _os.path.join(str(tmpdir), "cdbtype_trailing.cdb")
+    make = _cdbx.CDB.make(fname)
+    for num in range(10):
+        make.add("k%d" % num, "v%d" % num)
+    make.commit().close()
+    size = _os.path.getsize(fname)
+
+    with open(fname, "ab") as fp:
+        fp.write(b"\xff" * 5000)
+    pool = _cdbx.CDBPool(mmap=True)
+    cdb = pool.open(fname)
+    assert pool.mapped_bytes == size
+    assert cdb.get("k7") == b"v7"
+    assert len(list(cdb.items())) == 10
+    pool.close()
+
+    # Truncated tables fail on access
+    with open(fname, "r+b") as fp:
+        fp.truncate(size - 8)
+    with closing(_cdbx.CDB(fname, mmap=True)) as cdb:
+        with raises(IOError):
+            [cdb.get("k%d" % num) for num in range(10)]
+
+
+def test_new_filename_native(tmpdir):
+    """__new__() opens plain filenames natively"""
+    fname = _os.path.join(str(tmpdir), "cdbtype_new_native.cdb")
+
+    with raises(IOError) as e:
+        _cdbx.CDB(fname)
+    assert e.value.filename == fname
+
+    with raises(IOError):
+        _cdbx.CDB(str(tmpdir))
+
+    with open(fname, "wb") as fp:
+        fp.write(b"x" * 100)
+    with raises(ValueError):
+        _cdbx.CDB(fname.encode("ascii") + b"\0")
+    with raises(IOError):
+        _cdbx.CDB(fname, mmap=True)
+
+    _cdbx.CDB.make(fname).commit().close()
+
+    # Bad arguments don't leak a descriptor
+    for kwargs in ({"close": _test.badbool}, {"mmap": _test.badbool}):
+        fd = _os.open(fname, _os.O_RDONLY)
+        _os.close(fd)
+        with raises(RuntimeError):
+            _cdbx.CDB(fname, **kwargs)
+        fd2 = _os.open(fname, _os.O_RDONLY)
+        _os.close(fd2)
+        assert fd2 == fd
+
+    cdb = _cdbx.CDB(fname.encode("ascii"), mmap=False)
+    fd = cdb.fileno()
+    assert cdb.get("nope") is None
+    cdb.close()
+    with raises(OSError):
+        _os.fstat(fd)
+
+
 def test_new_filename(tmpdir):
     """__new__() filename handling"""
     fname = _os.path.join(str(tmpdir), "cdbtype_new_filename.cdb")
@@ -0,0 +1,145 @@
+# -*- coding: ascii -*-
+u"""
+:Copyright:
+
+ Copyright 2016 - 2025
+ Andr\xe9 Malo or his licensors, as applicable
+
+:License:
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+===============================
+ Tests for reloading CDB type
+===============================
+
+Tests for reloading CDB type.
+"""
+__author__ = u"Andr\xe9 Malo"
+
+import os as _os
+import weakref as _weakref
+
+from pytest import raises
+
+from .. import _util as _test
+
+import cdbx as _cdbx
+
+# pylint: disable = consider-using-with, pointless-statement
+
+
+def _make(fname, value):
+    """Publish CDB"""
+    make = _cdbx.CDB.make(fname, atomic=True, durability="none")
+    make.add("key", value)
+    make.commit().close()
+
+
+def test_new_args(tmpdir):
+    """ReloadingCDB() args error handling"""
+    fname = _os.path.join(str(tmpdir), "cdb")
+
+    with raises(TypeError):
+        _cdbx.ReloadingCDB()
+
+    with raises(TypeError):
+        _cdbx.ReloadingCDB(1)
+
+    with raises(IOError):
+        _cdbx.ReloadingCDB(fname)
+
+    _make(fname, "value")
+    with raises(TypeError):
+        _cdbx.ReloadingCDB(fname, interval="1")
+
+    with raises(RuntimeError) as e:
+        _cdbx.ReloadingCDB(fname, background=_test.badbool)
+    assert e.value.args == ("yoyo",)
+
+    with raises(RuntimeError) as e:
+        _cdbx.ReloadingCDB(fname, warm=_test.badbool)
+    assert e.value.args == ("yoyo",)
+
+    with raises(RuntimeError) as e:
+        _cdbx.ReloadingCDB(fname, mmap=_test.badbool)
+    assert e.value.args == ("yoyo",)
+
+
+def test_bad_replacement(tmpdir):
+    """A broken replacement keeps the current CDB"""
+    fname = _os.path.join(str(tmpdir), "cdb")
+    _make(fname, "value")
+    cdb = _cdbx.ReloadingCDB(fname, mmap=True, interval=-1, background=False)
+
+    _os.unlink(fname)
+    assert not cdb.reload()
+    assert cdb["key"] == b"value"
+
+    _os.mkdir(fname)
+    with raises(IOError):
+        cdb.reload()
+    assert not cdb.reload()  # not retried until replaced again
+    assert cdb["key"] == b"value"
+    assert cdb.generation == 1
+
+    cdb.close()
+    cdb.close()  # noop
+
+
+def test_closed(tmpdir):
+    """bail after close"""
+    fname = _os.path.join(str(tmpdir), "cdb")
+    _make(fname, "value")
+    cdb = _cdbx.ReloadingCDB(fname)
+    cdb.close()
+
+    with raises(IOError):
+        cdb.get("key")
+
+    with raises(IOError):
+        cdb["key"]
+
+    with raises(IOError):
+        "key" in cdb
+
+    with raises(IOError):
+        len(cdb)
+
+    with raises(IOError):
+        iter(cdb)
+
+    with raises(IOError):
+        cdb.keys
+
+    with raises(IOError):
+        cdb.current
+
+    with raises(IOError):
+        cdb.reload()
+
+    with raises(AttributeError):
+        _cdbx.ReloadingCDB(fname).nope
+
+
+def test_weakref(tmpdir):
+    """weakref handling"""
+    fname = _os.path.join(str(tmpdir), "cdb")
+    _make(fname, "value")
+    cdb = _cdbx.ReloadingCDB(fname)
+    proxy = _weakref.proxy(cdb)
+    assert proxy["key"] == b"value"
+    del cdb
+
+    with raises(ReferenceError):
+        proxy["key"]
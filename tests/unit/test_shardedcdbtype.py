@@ -0,0 +1,189 @@
+# -*- coding: ascii -*-
+u"""
+:Copyright:
+
+ Copyright 2016 - 2025
+ Andr\xe9 Malo or his licensors, as applicable
+
+:License:
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+
+============================
+ Tests for sharded CDB types
+============================
+
+Tests for sharded CDB types.
+"""
+__author__ = u"Andr\xe9 Malo"
+
+from contextlib import closing
+import os as _os
+import weakref as _weakref
+
+from pytest import raises
+
+from .. import _util as _test
+
+import cdbx as _cdbx
+
+# pylint: disable = pointless-statement
+
+
+def test_make_args(tmpdir):
+    """make() args error handling"""
+    fname = _os.path.join(str(tmpdir), "set")
+
+    with raises(TypeError):
+        _cdbx.ShardedCDB.make()
+
+    with raises(TypeError):
+        _cdbx.ShardedCDB.make(fname, "4")
+
+    with raises(ValueError):
+        _cdbx.ShardedCDB.make(fname, 0)
+
+    with raises(TypeError):
+        _cdbx.ShardedCDB.make(object())
+
+    with raises(IOError):
+        _cdbx.ShardedCDB.make(_os.path.join(fname, "nope", "set"))
+    assert _os.listdir(str(tmpdir)) == []
+
+    with raises(TypeError):
+        _cdbx.ShardedCDBMaker()
+
+
+def test_maker(tmpdir):
+    """maker error handling and cleanup"""
+    fname = _os.path.join(str(tmpdir), u"set")
+
+    make = _cdbx.ShardedCDB.make(fname.encode("ascii"), 3)
+    assert sorted(_os.listdir(str(tmpdir))) == ["set.0", "set.1", "set.2"]
+
+    with raises(TypeError):
+        make.add("foo")
+
+    with raises(TypeError):
+        make.add(object(), "bar")
+
+    make.add(value="bar", key="foo")
+
+    with raises(TypeError):
+        make.commit(lah="luh")
+
+    with raises(TypeError):
+        make.commit(threads="1")
+
+    with raises(ValueError):
+        make.commit(threads=0)
+
+    with raises(TypeError):
+        make.add("foo", object())
+
+    with raises(IOError):
+        make.add("foo", "bar")
+
+    with raises(IOError):
+        make.commit()
+
+    make.close()
+    make.close()  # noop
+    assert _os.listdir(str(tmpdir)) == []
+
+    with closing(_cdbx.ShardedCDB.make(fname, 2)) as make:
+        make.add("foo", "bar")
+    assert _os.listdir(str(tmpdir)) == []
+
+    make = _cdbx.ShardedCDB.make(fname, 2)
+    del make
+    assert _os.listdir(str(tmpdir)) == []
+
+    make = _cdbx.ShardedCDB.make(fname, 2)
+    proxy = _weakref.proxy(make)
+    del make
+    with raises(ReferenceError):
+        proxy.add("foo", "bar")
+
+
+def test_new_args(tmpdir):
+    """ShardedCDB() args error handling"""
+    fname = _os.path.join(str(tmpdir), "set")
+
+    with raises(TypeError):
+        _cdbx.ShardedCDB()
+
+    with raises(TypeError):
+        _cdbx.ShardedCDB(1)
+
+    with raises(IOError):
+        _cdbx.ShardedCDB(fname)
+
+    for content in (b"", b"cdbx-sharded 1\n", b"cdbx-sharded 2\nset.0\n",
+                    b"cdbx-sharded 1\nset.0\n\nset.1\n"):
+        with open(fname, "wb") as fp:
+            fp.write(content)
+        with raises(IOError):
+            _cdbx.ShardedCDB(fname)
+
+    with open(fname, "wb") as fp:
+        fp.write(b"cdbx-sharded 1\nset.0\n")
+    with raises(IOError):
+        _cdbx.ShardedCDB(fname)
+
+
+def test_get_args(tmpdir):
+    """get() args error handling"""
+    fname = _os.path.join(str(tmpdir), "set")
+    make = _cdbx.ShardedCDB.make(fname, 2)
+    make.add("foo", "bar")
+
+    with closing(make.commit()) as cdb:
+        with raises(TypeError):
+            cdb.get()
+
+        with raises(TypeError):
+            cdb.get(object())
+
+        with raises(TypeError):
+            cdb[object()]
+
+        with raises(TypeError):
+            object() in cdb
+
+        with raises(TypeError):
+            cdb.keys(all=True, nope=1)
+
+        with raises(RuntimeError) as e:
+            cdb.get("foo", all=_test.badbool)
+        assert e.value.args == ("yoyo",)
+
+        with raises(RuntimeError) as e:
+            cdb.items(_test.badbool)
+        assert e.value.args == ("yoyo",)
+
+        assert cdb.has_key("foo")
+
+    with raises(IOError):
+        cdb.get("foo")
+
+    with raises(IOError):
+        "foo" in cdb
+
+    with raises(IOError):
+        len(cdb)
+
+    with raises(IOError):
+        list(cdb)
+
+    cdb.close()  # noop